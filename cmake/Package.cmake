@@ -5,6 +5,12 @@ install(
     DESTINATION bin
 )
 
+# Creates the reduced precision model variants
+install(
+    FILES misc/quantize_model.py
+    DESTINATION bin
+)
+
 # License file
 install(
     FILES LICENSE.md
@@ -21,6 +21,8 @@
 #include <FAST/Algorithms/NeuralNetwork/TensorToSegmentation.hpp>
 #include <FAST/Algorithms/NeuralNetwork/BoundingBoxNetwork.hpp>
 #include <FAST/Data/BoundingBox.hpp>
+#include "source/logic/ExecutionPolicy.h"
+#include <thread>
 
 using namespace fast;
 
@@ -37,6 +39,8 @@ int main(int argc, char** argv) {
     parser.addOption("disable-case-1-batch");
     parser.addOption("disable-case-1_inceptionv3");
     //parser.addOption("disable-case-3-batch");
+    parser.addOption("disable-case-affinity");
+    parser.addVariable("concurrent-slides", "2", "Number of slides processed at the same time in the affinity case");
     parser.addOption("disable-warmup");
     parser.parse(argc, argv);
     const int iterations = 10;  //10;
@@ -50,6 +54,7 @@ int main(int argc, char** argv) {
     const bool case1_batch = !parser.getOption("disable-case-1-batch");
     const bool case1_inceptionv3 = !parser.getOption("disable-case-1_inceptionv3");
     //const bool case3_batch = !parser.getOption("disable-case-3-batch");
+    const bool caseAffinity = !parser.getOption("disable-case-affinity");
     const std::string machine = "windows2";  // {windows, windows2, ubuntu}, just for storing results on both machines used in the experiments
 
 
@@ -1375,4 +1380,108 @@ int main(int argc, char** argv) {
         }
     }
 
+    if(caseAffinity) {
+        std::cout << "\nConcurrent patch-wise classification with and without core pinning and NUMA binding...\n" << std::endl;
+        // CASE AFFINITY - Case 1 with OpenVINO CPU on several slides at the same time, one slot of the execution policy each
+        const std::string resultFilename = "../results_" + machine + "/neural-network-runtimes-case-affinity.csv";
+        std::ofstream file(resultFilename.c_str());
+
+        std::vector<int> img_size {512, 512};
+        int patch_level = 0;
+        const int concurrentSlides = std::stoi(parser.get("concurrent-slides"));
+
+        // Write header
+        file << "Policy;Iteration;Slot;NN inference AVG;NN inference STD;Slot total;Total\n";
+
+        std::map<std::string, ExecutionPolicy> policies;
+        policies["unpinned"].numa = "off";
+        policies["pinned"].numa = "off";
+        policies["pinned"].cores = ExecutionPolicy::parseCpuList("0-" + std::to_string(std::thread::hardware_concurrency() - 1));
+        policies["numa"].numa = "auto";
+        for(auto&& policy : policies) {
+            policy.second.concurrentSlides = concurrentSlides;
+            std::cout << "Policy " << policy.first << ": " << policy.second.toString() << std::endl;
+            std::cout << "====================================" << std::endl;
+
+            for(int iteration = 0; iteration <= iterations; ++iteration) {
+                std::vector<std::thread> threads;
+                std::vector<float> inferenceAverage(concurrentSlides), inferenceStd(concurrentSlides), slotTime(concurrentSlides);
+                auto start = std::chrono::high_resolution_clock::now();
+                for(int slot = 0; slot < concurrentSlides; ++slot) {
+                    threads.emplace_back([&, slot]() {
+                        // Pipeline threads created from here on inherit the placement of the slot
+                        policy.second.apply(slot);
+                        auto slotStart = std::chrono::high_resolution_clock::now();
+                        auto importer = WholeSlideImageImporter::create();
+                        if (machine == "windows") {
+                            importer->setFilename("C:/Users/andrep/workspace/FAST-Pathology_old/A05.svs");
+                        } else if (machine == "windows2") {
+                            importer->setFilename("C:/Users/andrp/workspace/FAST-Pathology/A05.svs");
+                        } else {
+                            importer->setFilename(Config::getTestDataPath() + "/WSI/A05.svs");
+                        }
+
+                        auto tissueSegmentation = TissueSegmentation::create();
+                        tissueSegmentation->setInputConnection(importer->getOutputPort());
+
+                        auto generator = PatchGenerator::create();
+                        generator->setPatchSize(img_size[0], img_size[1]);
+                        generator->setPatchLevel(patch_level);
+                        generator->setInputConnection(importer->getOutputPort());
+                        generator->setInputConnection(1, tissueSegmentation->getOutputPort());
+
+                        auto network = NeuralNetwork::create();
+                        network->setInferenceEngine("OpenVINO");
+                        network->getInferenceEngine()->setDeviceType(InferenceDeviceType::CPU);
+                        if (machine == "ubuntu") {
+                            network->load("/home/andrep/FastPathology/data/Models/mobilenet_v2_bach_model." +
+                                          network->getInferenceEngine()->getDefaultFileExtension());
+                        } else if (machine == "windows") {
+                            network->load("C:/Users/andrep/FastPathology/data/Models/mobilenet_v2_bach_model." +
+                                          network->getInferenceEngine()->getDefaultFileExtension());
+                        } else {
+                            network->load("C:/Users/andrp/FastPathology/data/Models/mobilenet_v2_bach_model." +
+                                          network->getInferenceEngine()->getDefaultFileExtension());
+                        }
+                        network->setInputConnection(generator->getOutputPort());
+                        network->setScaleFactor(1.0f / 255.0f);
+                        network->enableRuntimeMeasurements();
+
+                        auto stitcher = PatchStitcher::create();
+                        stitcher->setInputConnection(network->getOutputPort());
+
+                        DataObject::pointer data;
+                        do {
+                            data = stitcher->updateAndGetOutputData<DataObject>();
+                        } while (!data->isLastFrame());
+
+                        std::chrono::duration<float, std::milli> timeUsed = std::chrono::high_resolution_clock::now() - slotStart;
+                        inferenceAverage[slot] = network->getRuntime("inference")->getAverage();
+                        inferenceStd[slot] = network->getRuntime("inference")->getStdDeviation();
+                        slotTime[slot] = timeUsed.count();
+                    });
+                }
+                for(auto& thread : threads)
+                    thread.join();
+                std::chrono::duration<float, std::milli> timeUsed = std::chrono::high_resolution_clock::now() - start;
+                std::cout << "Total runtime: " << timeUsed.count() << std::endl;
+
+                if (iteration == 0 && warmupIteration)
+                    continue;
+
+                for(int slot = 0; slot < concurrentSlides; ++slot) {
+                    file <<
+                         policy.first + ";" +
+                         std::to_string(iteration) + ";" +
+                         std::to_string(slot) + ";" +
+                         std::to_string(inferenceAverage[slot]) + ";" +
+                         std::to_string(inferenceStd[slot]) + ";" +
+                         std::to_string(slotTime[slot]) + ";" +
+                         std::to_string(timeUsed.count())
+                         << std::endl;
+                }
+            }
+        }
+    }
+
 }
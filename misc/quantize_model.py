@@ -0,0 +1,81 @@
+"""
+Creates a reduced precision variant of an ONNX model for FastPathology, see ModelQuantizer.
+
+fp16 converts the weights and computations to half precision, keeping float32 inputs and outputs.
+int8 quantizes the weights and activations statically, with the activation ranges calibrated on patches
+from the slides of a project, given as a NumPy array of uint8 patches (patches x height x width x channels).
+
+Requires onnx and onnxruntime, and onnxconverter-common for fp16.
+"""
+import argparse
+import numpy as np
+import onnx
+
+
+def get_input(model):
+    # Initializers may be listed as graph inputs in older models
+    initializers = {initializer.name for initializer in model.graph.initializer}
+    inputs = [node for node in model.graph.input if node.name not in initializers]
+    if len(inputs) != 1:
+        raise ValueError("Only models with a single input can be calibrated")
+    shape = [dimension.dim_value if dimension.HasField("dim_value") else -1
+             for dimension in inputs[0].type.tensor_type.shape.dim]
+    return inputs[0].name, shape
+
+
+def convert_fp16(model_path, output_path):
+    from onnxconverter_common import float16
+    model = onnx.load(model_path)
+    model = float16.convert_float_to_float16(model, keep_io_types=True)
+    onnx.save(model, output_path)
+
+
+def convert_int8(model_path, output_path, calibration_path, scale_factor):
+    from onnxruntime.quantization import CalibrationDataReader, QuantFormat, QuantType, quantize_static
+
+    name, shape = get_input(onnx.load(model_path))
+    patches = np.load(calibration_path)
+    channels = patches.shape[3]
+    # FAST gives the network channels last images, unless the model expects channels first
+    channels_first = len(shape) == 4 and shape[1] == channels and shape[3] != channels
+
+    class PatchReader(CalibrationDataReader):
+        def __init__(self):
+            self.index = 0
+
+        def get_next(self):
+            if self.index >= len(patches):
+                return None
+            patch = patches[self.index:self.index + 1].astype(np.float32) * scale_factor
+            if channels_first:
+                patch = patch.transpose(0, 3, 1, 2)
+            self.index += 1
+            return {name: patch}
+
+    quantize_static(model_path, output_path, PatchReader(),
+                    quant_format=QuantFormat.QDQ,
+                    activation_type=QuantType.QUInt8,
+                    weight_type=QuantType.QInt8,
+                    per_channel=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Create a reduced precision variant of an ONNX model")
+    parser.add_argument("model", help="ONNX model")
+    parser.add_argument("output", help="Variant to create")
+    parser.add_argument("--precision", choices=["fp16", "int8"], required=True)
+    parser.add_argument("--calibration", help="Calibration patches as a .npy file, required for int8")
+    parser.add_argument("--scale-factor", type=float, default=1.0, help="Intensity scale factor of the pipelines using the model")
+    args = parser.parse_args()
+
+    if args.precision == "fp16":
+        convert_fp16(args.model, args.output)
+    else:
+        if args.calibration is None:
+            parser.error("int8 requires --calibration")
+        convert_int8(args.model, args.output, args.calibration, args.scale_factor)
+    print("Created " + args.output)
+
+
+if __name__ == "__main__":
+    main()
@@ -153,7 +153,12 @@ namespace fast{
         QObject::connect(_project_widget, &ProjectWidget::resetDisplay, this, &MainSidePanelWidget::resetDisplay);
         QObject::connect(this, &MainSidePanelWidget::loadProject, _project_widget, &ProjectWidget::loadProject);
         QObject::connect(this, &MainSidePanelWidget::filesDropped, _project_widget, &ProjectWidget::selectFileDrag);
+        // New results have been saved, so prefetched results must be read again before the display is updated
+        QObject::connect(_process_widget, &ProcessWidget::pipelineFinished, [this]() {
+            m_mainWindow->getSlidePrefetcher()->invalidate();
+        });
         QObject::connect(_process_widget, &ProcessWidget::pipelineFinished, m_mainWindow, &MainWindow::changeWSIDisplayReceived);
+        QObject::connect(_process_widget, &ProcessWidget::pipelineFinished, _project_widget, &ProjectWidget::updateProcessingStatus);
         connect(m_mainWindow, &MainWindow::updateProjectTitle, _project_widget, &ProjectWidget::updateTitle);
     }
 
@@ -1,4 +1,5 @@
 #include "MainWindow.hpp"
+#include "source/logic/Logger.h"
 #include <FAST/Visualization/ImagePyramidRenderer/ImagePyramidRenderer.hpp>
 #include <QPushButton>
 #include <QFileDialog>
@@ -55,11 +56,11 @@ MainWindow::MainWindow() {
         // For dev on windows
 		dataPath = QCoreApplication::applicationDirPath().toStdString() + "/../../data/";
     }
-    std::cout << "Data path was: " << dataPath << std::endl;
+    Logger::debug("MainWindow") << "Data path was: " << dataPath;
     for(std::string folder : {"pipelines"}) {
         for(auto filename : getDirectoryList(join(dataPath, folder))) {
             if(!isFile(join(cwd, folder, filename))) {
-                std::cout << "File not found, copying to fastpathology folder: " << join(cwd, folder, filename) << std::endl;
+                Logger::info("MainWindow") << "File not found, copying to fastpathology folder: " << join(cwd, folder, filename);
                 QFile::copy(QString::fromStdString(join(dataPath, folder, filename)), QString::fromStdString(join(cwd, folder, filename)));
             } else {
                 //std::cout << "File already exists: " << join(cwd, folder, filename) << std::endl;
@@ -72,10 +73,12 @@ MainWindow::MainWindow() {
              "You have no AI models in your model folder: " + QString::fromStdString(join(cwd, "models")) +
              "Do you wish to download some models now? (~151 MB)");
         if(reply == QMessageBox::Yes) {
-            downloadZipFile("http://fast.eriksmistad.no/download/fastpathology-models-v1.0.0.zip", join(cwd, "models"), "AI models");
+            downloadZipFile(Downloader::getDownloadUrl("fastpathology-models-v1.0.0.zip"), join(cwd, "models"), "AI models");
         }
     }
 
+    m_slidePrefetcher = std::make_shared<SlidePrefetcher>();
+
     setupInterface();
     setupConnections();
 
@@ -89,16 +92,16 @@ void MainWindow::showSplashMenu(bool allowClose) {
     connect(splash, &ProjectSplashWidget::newProjectSignal, [=](QString name) {
         if(m_project)
             reset();
-        std::cout << "Creating project with name " << name.toStdString() << std::endl;;
+        Logger::info("MainWindow") << "Creating project with name " << name.toStdString();
         m_project = std::make_shared<Project>(name.toStdString());
         emit updateProjectTitle();
     });
     connect(splash, &ProjectSplashWidget::openProjectSignal, [=](QString name) {
         if(m_project)
             reset();
-        std::cout << "Opening project with name " << name.toStdString() << std::endl;;
-        // TODO have some sort of progress bar here.
-        m_project = std::make_shared<Project>(name.toStdString(), true); // <-- This takes time
+        Logger::info("MainWindow") << "Opening project with name " << name.toStdString();
+        // Only reads the slide list, slides are opened and thumbnails loaded in the background by the project widget
+        m_project = std::make_shared<Project>(name.toStdString(), true);
         emit _side_panel_widget->loadProject();
         emit updateProjectTitle();
     });
@@ -108,7 +111,7 @@ void MainWindow::showSplashMenu(bool allowClose) {
             for(auto filename : getDirectoryList(folder)) {
                 if(filename == "LICENSE.md")
                     continue;
-                std::cout << "Loading " << filename << std::endl;
+                Logger::debug("MainWindow") << "Loading " << filename;
                 m_project->includeImage(join(folder, filename));
             }
         }
@@ -206,6 +209,7 @@ void MainWindow::createOpenGLWindow() {
 
 void MainWindow::reset()
 {
+    m_slidePrefetcher->clear();
     _side_panel_widget->resetInterface();
 }
 
@@ -220,7 +224,8 @@ void MainWindow::changeWSIDisplayReceived(std::string uid_name)
         ->connect(img->get_image_pyramid());
     view->addRenderer(renderer);
 
-    auto results = getCurrentProject()->loadResults(uid_name);
+    // Results of neighbouring slides have usually been indexed and imported already by the prefetcher
+    auto results = Project::loadResults(m_slidePrefetcher->getResultIndex(getCurrentProject(), uid_name));
     if(!results.empty()) {
         for(auto result : results) {
             view->addRenderer(result.renderer);
@@ -255,6 +260,10 @@ std::shared_ptr<WholeSlideImage> MainWindow::getCurrentWSI() const {
     return getCurrentProject()->getImage(getCurrentWSIUID());
 }
 
+std::shared_ptr<SlidePrefetcher> MainWindow::getSlidePrefetcher() const {
+    return m_slidePrefetcher;
+}
+
 std::string MainWindow::getCurrentWSIUID() const {
     return m_currentVisibleWSI;
 }
@@ -11,6 +11,7 @@
 #include <QProgressDialog>
 #include "source/utils/utilities.h"
 #include "source/gui/MainSidePanelWidget.h"
+#include "source/logic/SlidePrefetcher.h"
 
 QT_BEGIN_NAMESPACE
 class QAction;
@@ -64,6 +65,10 @@ class MainWindow : public Window {
         std::shared_ptr<Project> getCurrentProject() const;
         std::string getCurrentWSIUID() const;
         std::shared_ptr<WholeSlideImage> getCurrentWSI() const;
+        /**
+         * Background loader for the slides next to the one being viewed.
+         */
+        std::shared_ptr<SlidePrefetcher> getSlidePrefetcher() const;
 
         std::string getRootFolder() const;
     protected:
@@ -81,6 +86,7 @@ class MainWindow : public Window {
 
         View* view;
         std::shared_ptr<Project> m_project;
+        std::shared_ptr<SlidePrefetcher> m_slidePrefetcher;
         std::string m_currentVisibleWSI; /* Unique id_name of the currently rendered (hence visible) WSI. */
 
         std::string _application_name; /* */
@@ -3,6 +3,7 @@
 //
 
 #include "PipelineScriptEditorWidget.h"
+#include "source/logic/Logger.h"
 
 #include <FAST/PipelineEditor.hpp>
 
@@ -179,12 +180,12 @@ namespace fast {
 
     bool PipelineScriptEditorWidget::saveScript()
     {
-        std::cout << "Saving...: " << this->_current_script_filename.toStdString() << std::endl;
+        Logger::info("PipelineScriptEditorWidget") << "Saving...: " << this->_current_script_filename.toStdString();
         if (this->_current_script_filename.isEmpty())
             return saveAsScript();
         else
         {
-            std::cout << "We are saving, not save as..." << std::endl;
+            Logger::debug("PipelineScriptEditorWidget") << "We are saving, not save as...";
             return saveFileScript(this->_current_script_filename);
         }
     }
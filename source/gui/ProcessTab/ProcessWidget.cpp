@@ -1,4 +1,5 @@
 #include "ProcessWidget.h"
+#include "source/logic/Logger.h"
 #include <FAST/Importers/WholeSlideImageImporter.hpp>
 #include <FAST/Visualization/ImagePyramidRenderer/ImagePyramidRenderer.hpp>
 #include <FAST/Data/ImagePyramid.hpp>
@@ -10,9 +11,51 @@
 #include <FAST/Visualization/ComputationThread.hpp>
 #include <FAST/Algorithms/ImagePatch/PatchGenerator.hpp>
 #include "source/logic/WholeSlideImage.h"
+#include "source/logic/PipelineRewriter.h"
+#include "source/logic/BatchSizeTuner.h"
+#include "source/logic/InferenceBenchmark.h"
+#include "source/logic/ExecutionPolicy.h"
+#include "source/logic/PatchPrefetcher.h"
+#include "source/logic/PatchScheduler.h"
+#include "source/logic/PipelineRuntimeHistory.h"
+#include "source/logic/JobServer.h"
+#include "source/logic/Tracer.h"
+#include "source/logic/ZipExtractor.h"
+#include "source/logic/ModelQuantizer.h"
+#include <QPointer>
+#include <FAST/Algorithms/NeuralNetwork/NeuralNetwork.hpp>
+#include <FAST/Algorithms/NeuralNetwork/InferenceEngineManager.hpp>
+#include <QFormLayout>
+#include <QListWidget>
+#include <QTimer>
+#include <algorithm>
+#include <map>
+#include <future>
 #include "source/gui/MainWindow.hpp"
 
 namespace fast {
+    // Process object types which run a neural network
+    static const std::vector<std::string> networkTypes = {"NeuralNetwork", "SegmentationNetwork", "BoundingBoxNetwork", "ImageToImageNetwork"};
+
+    // Whether only the first output of a network is used. The other output ports of a network are created when
+    // its model is loaded, so the pipeline can't be parsed without the model if they are connected.
+    static bool usesOnlyFirstOutput(const PipelineRewriter& rewriter, const std::string& id) {
+        std::vector<std::string> sources;
+        for(const auto& consumer : rewriter.getConsumers(id)) {
+            // Process objects have a few input ports at most
+            for(int port = 0; port < 8; ++port)
+                sources.push_back(rewriter.getInput(consumer, port));
+        }
+        for(const auto& output : rewriter.getPipelineOutputs())
+            sources.push_back(output.second);
+        for(const auto& source : sources) {
+            auto tokens = split(source, " ");
+            if(tokens.size() >= 2 && tokens[0] == id && tokens[1] != "0")
+                return false;
+        }
+        return true;
+    }
+
     ProcessWidget::ProcessWidget(MainWindow* mainWindow, QWidget* parent): QWidget(parent){
         m_mainWindow = mainWindow;
         m_computationThread = mainWindow->getComputationThread();
@@ -29,6 +72,8 @@ namespace fast {
 
         // Connection to show message in GUI in main thread
         QObject::connect(this, &ProcessWidget::messageSignal, this, &ProcessWidget::showMessage, Qt::QueuedConnection);
+
+        warmUpModels();
     }
 
     ProcessWidget::~ProcessWidget(){
@@ -55,6 +100,67 @@ namespace fast {
         _main_layout->addWidget(_page_combobox);
         _main_layout->addWidget(_stacked_widget);
 
+        // Overrides of the inference settings in the pipeline files, for all networks of a run
+        auto inferenceGroup = new QGroupBox("Inference");
+        auto inferenceLayout = new QFormLayout(inferenceGroup);
+        m_engineComboBox = new QComboBox;
+        m_engineComboBox->addItem("Pipeline default", "");
+        m_engineComboBox->addItem("Fastest (benchmark)", "fastest");
+        for(const auto& engine : InferenceEngineManager::getEngineList())
+            m_engineComboBox->addItem(QString::fromStdString(engine), QString::fromStdString(engine));
+        m_engineComboBox->setToolTip("Inference engine used for all networks. The fastest engine for a model is "
+                                     "measured the first time it is used on this computer.");
+        inferenceLayout->addRow("Engine", m_engineComboBox);
+        m_deviceComboBox = new QComboBox;
+        m_deviceComboBox->addItem("Default", "");
+        m_deviceComboBox->addItem("CPU", "CPU");
+        m_deviceComboBox->addItem("GPU", "GPU");
+        m_deviceComboBox->setToolTip("Device the neural networks run on. Pipelines can't select a device, so the "
+                                     "models are loaded again on the selected device.");
+        inferenceLayout->addRow("Device", m_deviceComboBox);
+        m_threadsSpinBox = new QSpinBox;
+        m_threadsSpinBox->setRange(0, 256);
+        m_threadsSpinBox->setSpecialValueText("Default");
+        m_threadsSpinBox->setToolTip("Number of CPU threads used by the inference engine. Set when a run starts, before "
+                                     "its models are loaded. Engines which share a thread pool across runs keep the "
+                                     "thread count of their first run.");
+        inferenceLayout->addRow("Threads", m_threadsSpinBox);
+        m_batchInferenceCheckBox = new QCheckBox("Batch inference");
+        m_batchInferenceCheckBox->setToolTip("Run the neural networks on batches of patches. The fastest batch size is "
+                                             "measured the first time a model is used on this computer.");
+        m_batchInferenceCheckBox->setChecked(true);
+        inferenceLayout->addRow(m_batchInferenceCheckBox);
+        _main_layout->addWidget(inferenceGroup);
+
+        // Jobs of the shared job server, see JobServer
+        auto jobGroup = new QGroupBox("Job queue");
+        auto jobLayout = new QVBoxLayout(jobGroup);
+        m_jobList = new QListWidget;
+        m_jobList->setMaximumHeight(120);
+        jobLayout->addWidget(m_jobList);
+        auto jobButtonLayout = new QHBoxLayout;
+        jobButtonLayout->addWidget(new QLabel("Priority"));
+        m_jobPrioritySpinBox = new QSpinBox;
+        m_jobPrioritySpinBox->setRange(-10, 10);
+        m_jobPrioritySpinBox->setToolTip("Priority of submitted jobs, higher runs first");
+        jobButtonLayout->addWidget(m_jobPrioritySpinBox);
+        m_cancelJobButton = new QPushButton("Cancel job");
+        jobButtonLayout->addWidget(m_cancelJobButton);
+        jobLayout->addLayout(jobButtonLayout);
+        connect(m_cancelJobButton, &QPushButton::clicked, [this]() {
+            auto item = m_jobList->currentItem();
+            if(item == nullptr)
+                return;
+            if(!JobClient().cancel(item->data(Qt::UserRole).toInt()))
+                showMessage("The job has already finished");
+            refreshJobQueue();
+        });
+        _main_layout->addWidget(jobGroup);
+        auto jobTimer = new QTimer(this);
+        connect(jobTimer, &QTimer::timeout, this, &ProcessWidget::refreshJobQueue);
+        jobTimer->start(2000);
+        refreshJobQueue();
+
         _main_layout->addStretch();
 
         auto addPipelinesButton = new QPushButton();
@@ -89,6 +195,8 @@ namespace fast {
         int counter = 0;
         // Load pipelines and create one button for each.
         std::string pipelineFolder = this->_cwd + "/pipelines/";
+        // Reads the registry file once for all pipelines
+        ModelRegistry registry;
         for(auto& filename : getDirectoryList(pipelineFolder)) {
             try {
                 auto pipeline = Pipeline(join(pipelineFolder, filename));
@@ -109,6 +217,22 @@ namespace fast {
                 description->setWordWrap(true);
                 layout->addWidget(description);
 
+                // Models which are not indexed yet are indexed in the background, and shown on the next refresh
+                PipelineRewriter rewriter(join(pipelineFolder, filename));
+                QString models;
+                for(const auto& type : networkTypes) {
+                    for(const auto& id : rewriter.getProcessObjects(type)) {
+                        ModelInfo info;
+                        if(registry.findModel(rewriter.getAttribute(id, "model"), info))
+                            models += QString::fromStdString("Model " + getFileName(info.filename) + ": " + info.toString() + "\n");
+                    }
+                }
+                if(!models.isEmpty()) {
+                    auto modelLabel = new QLabel(models.trimmed());
+                    modelLabel->setWordWrap(true);
+                    layout->addWidget(modelLabel);
+                }
+
                 auto button = new QPushButton;
                 button->setText("Run pipeline for this image");
                 button->setStyleSheet("background-color: #ADD8E6;");
@@ -124,6 +248,26 @@ namespace fast {
                     runInThread(join(pipelineFolder, filename), pipeline.getName(), true);
                 });
 
+                auto submitButton = new QPushButton;
+                submitButton->setText("Submit to job queue");
+                submitButton->setToolTip("Run the pipeline for all images on the job server of this computer, "
+                                         "which shares the cores between the jobs of all users");
+                layout->addWidget(submitButton);
+                QObject::connect(submitButton, &QPushButton::clicked, [=]() {
+                    submitJob(join(pipelineFolder, filename));
+                });
+
+                auto estimateLabel = new QLabel;
+                estimateLabel->setWordWrap(true);
+                auto estimateButton = new QPushButton;
+                estimateButton->setText("Estimate patches and runtime");
+                estimateButton->setToolTip("Count the patches with tissue in this image, using a low resolution level");
+                layout->addWidget(estimateButton);
+                layout->addWidget(estimateLabel);
+                QObject::connect(estimateButton, &QPushButton::clicked, [=]() {
+                    estimatePipeline(join(pipelineFolder, filename), pipeline.getName(), estimateLabel);
+                });
+
                 layout->addSpacing(20);
 
                 auto editButton = new QPushButton;
@@ -143,6 +287,77 @@ namespace fast {
         _stacked_layout->setCurrentIndex(index);
     }
 
+    void ProcessWidget::submitJob(std::string pipelineFilename) {
+        Job job;
+        // The job server may run as another user, so the project is given by its folder
+        job.project = QDir(QString::fromStdString(m_mainWindow->getCurrentProject()->getRootFolder())).absolutePath().toStdString();
+        job.pipeline = pipelineFilename;
+        job.priority = m_jobPrioritySpinBox->value();
+        job.threads = m_threadsSpinBox->value();
+        try {
+            const int id = JobClient().submit(job);
+            showMessage("Submitted job " + QString::number(id));
+        } catch(std::exception& e) {
+            showMessage(QString("Unable to submit job: ") + e.what());
+        }
+        refreshJobQueue();
+    }
+
+    void ProcessWidget::refreshJobQueue() {
+        // The previous request may still wait for a busy server
+        if(m_jobRequestPending)
+            return;
+        m_jobRequestPending = true;
+        JobClient().requestJobs(this, [this](const std::vector<Job>& jobs, const std::string& error) {
+            m_jobRequestPending = false;
+            updateJobList(jobs, error.empty());
+        });
+    }
+
+    void ProcessWidget::updateJobList(const std::vector<Job>& jobs, bool available) {
+        if(!available) {
+            // Job ids start at 1, the message has none
+            if(m_jobList->count() != 1 || m_jobList->item(0)->data(Qt::UserRole).toInt() != 0) {
+                m_jobList->clear();
+                m_jobList->addItem("No job server is running");
+            }
+            m_cancelJobButton->setEnabled(false);
+            return;
+        }
+        m_cancelJobButton->setEnabled(true);
+        // Items are updated in place, so that the selection and scroll position are kept
+        std::map<int, QListWidgetItem*> items;
+        for(int row = m_jobList->count() - 1; row >= 0; --row) {
+            auto item = m_jobList->item(row);
+            const int id = item->data(Qt::UserRole).toInt();
+            const bool exists = std::any_of(jobs.begin(), jobs.end(), [id](const Job& job) { return job.id == id; });
+            if(exists) {
+                items[id] = item;
+            } else {
+                delete m_jobList->takeItem(row);
+            }
+        }
+        // Newest first
+        int row = 0;
+        for(auto job = jobs.rbegin(); job != jobs.rend(); ++job, ++row) {
+            // The server leaves out the paths of other users' jobs
+            std::string text = "#" + std::to_string(job->id) + (job->pipeline.empty() ? "" : " " + getFileName(job->pipeline) + " on " + getFileName(job->project)) +
+                    " by " + job->user + ": " + Job::getStateName(job->state);
+            if(job->slides > 0)
+                text += " " + std::to_string(job->processedSlides) + "/" + std::to_string(job->slides);
+            if(job->failedSlides > 0)
+                text += ", " + std::to_string(job->failedSlides) + " failed";
+            auto item = items.find(job->id);
+            if(item == items.end()) {
+                auto newItem = new QListWidgetItem(QString::fromStdString(text));
+                newItem->setData(Qt::UserRole, job->id);
+                m_jobList->insertItem(row, newItem);
+            } else if(item->second->text().toStdString() != text) {
+                item->second->setText(QString::fromStdString(text));
+            }
+        }
+    }
+
     void ProcessWidget::runInThread(std::string pipelineFilename, std::string pipelineName, bool runForAll) {
         stopProcessing(); // Have to stop any renderers etc first.
 
@@ -158,11 +373,26 @@ namespace fast {
         if (!context->isSharing())
             throw Exception("The custom Qt GL context is not sharing!");
 
+        m_batchInference = m_batchInferenceCheckBox->isChecked();
+        m_inferenceEngine = m_engineComboBox->currentData().toString().toStdString();
+        m_inferenceDevice = m_deviceComboBox->currentData().toString().toStdString();
+        m_inferenceThreads = m_threadsSpinBox->value();
+        // The GUI runs one slide at a time, in the first slot of the execution policy. The thread count is set
+        // before the run's thread starts, so that the engines of the run are created with it.
+        m_executionPolicy = ExecutionPolicy::load();
+        if(m_inferenceThreads > 0)
+            m_executionPolicy.inferenceThreads = m_inferenceThreads;
+        m_executionPolicy.concurrentSlides = 1;
+        m_executionPolicy.applyEnvironment();
+        m_stopPreparing = false;
+
         auto thread = new QThread();
         context->makeCurrent();
         context->doneCurrent();
         context->moveToThread(thread);
         QObject::connect(thread, &QThread::started, [=](){
+            // Threads created while parsing and running the pipeline inherit the cores and NUMA node of this thread
+            m_executionPolicy.apply(0);
             context->makeCurrent();
             if (runForAll) {
                 batchProcessPipeline(pipelineFilename);
@@ -185,9 +415,11 @@ namespace fast {
         QObject::connect(m_progressDialog, &QProgressDialog::finished, timer, &QTimer::stop);
         QObject::connect(m_progressDialog, &QProgressDialog::canceled, timer, &QTimer::stop);
         QObject::connect(m_progressDialog, &QProgressDialog::canceled, [this, thread]() {
-            std::cout << "canceled.." << std::endl;
+            Logger::debug("ProcessWidget") << "canceled..";
+            // Benchmarks and batch size tuning stop after their current batch, instead of blocking the GUI
+            m_stopPreparing = true;
             thread->wait();
-            std::cout << "done waiting" << std::endl;
+            Logger::debug("ProcessWidget") << "done waiting";
             stop();
         });
         thread->start();
@@ -195,14 +427,51 @@ namespace fast {
         // TODO should delete QThread safely somehow..
     }
 
+    void ProcessWidget::estimatePipeline(std::string pipelineFilename, std::string pipelineName, QLabel* label) {
+        auto project = m_mainWindow->getCurrentProject();
+        const std::string uid = m_mainWindow->getCurrentWSIUID();
+        if(!project || uid.empty()) {
+            label->setText("Select an image to estimate the number of patches");
+            return;
+        }
+        label->setText("Estimating..");
+        auto image = project->getImage(uid);
+        const std::string cacheFolder = project->getSlideCacheFolder(uid);
+        QPointer<QLabel> target = label;
+        auto thread = QThread::create([=]() {
+            QString text;
+            try {
+                const int patches = PatchScheduler::countPatches(pipelineFilename, image->get_image_pyramid(), cacheFolder);
+                const float secondsPerPatch = PipelineRuntimeHistory().getSecondsPerPatch(pipelineName);
+                text = QString::number(patches) + " patches to process";
+                if(secondsPerPatch > 0) {
+                    text += ", about " + QString::fromStdString(PipelineRuntimeHistory::formatDuration(patches*secondsPerPatch));
+                } else {
+                    text += ". The runtime is estimated after the pipeline has been run once on this computer.";
+                }
+            } catch(std::exception& e) {
+                text = "Unable to estimate: " + QString(e.what());
+            }
+            QMetaObject::invokeMethod(this, [target, text]() {
+                if(target)
+                    target->setText(text);
+            }, Qt::QueuedConnection);
+        });
+        QObject::connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+        thread->start();
+    }
+
     void ProcessWidget::stopProcessing() {
         m_procesessing = false;
-        std::cout << "stopping pipeline" << std::endl;
+        m_patchPrefetchers.clear();
+        m_memoryMonitor.reset();
+        m_memoryReservation.reset();
+        Logger::debug("ProcessWidget") << "stopping pipeline";
         m_view->stopPipeline();
-        std::cout << "done" << std::endl;
-        std::cout << "removing renderers.." << std::endl;
+        Logger::debug("ProcessWidget") << "done";
+        Logger::debug("ProcessWidget") << "removing renderers..";
         m_view->removeAllRenderers();
-        std::cout << "done" << std::endl;
+        Logger::debug("ProcessWidget") << "done";
     }
 
     void ProcessWidget::stop() {
@@ -245,8 +514,31 @@ namespace fast {
     }
 
     void ProcessWidget::done() {
-        if(m_procesessing)
+        if(m_procesessing && m_runPatches > 0) {
+            std::chrono::duration<float> runtime = std::chrono::steady_clock::now() - m_runStart;
+            PipelineRuntimeHistory().record(m_runningPipeline->getName(), m_runPatches, runtime.count());
+        }
+        if(m_procesessing && m_memoryMonitor) {
+            m_memoryMonitor->stop();
+            PipelineRuntimeHistory().recordMemory(m_runningPipeline->getName(), m_memoryMonitor->getPeakIncrease());
+            Logger::info("ProcessWidget") << "Peak memory " << MemoryMonitor::formatSize(m_memoryMonitor->getPeak()) << ", "
+                    << MemoryMonitor::formatSize(m_memoryMonitor->getPeakIncrease()) << " for the pipeline. Open slides "
+                    << MemoryMonitor::formatSize(m_mainWindow->getCurrentProject()->getOpenImageMemory()) << ", prefetched results "
+                    << MemoryMonitor::formatSize(m_mainWindow->getSlidePrefetcher()->getMemoryUsage());
+        }
+        m_memoryMonitor.reset();
+        m_memoryReservation.reset();
+        for(auto prefetcher : m_patchPrefetchers) {
+            prefetcher->stop();
+            Logger::debug("ProcessWidget") << "Patch prefetch: " << prefetcher->getStatistics().toString();
+        }
+        m_patchPrefetchers.clear();
+        if(m_procesessing) {
             saveResults();
+            if(m_traceStart >= 0)
+                Tracer::stop(m_traceStart, Tracer::getTraceFilename(m_runningPipeline->getName()));
+            m_traceStart = -1;
+        }
         if(m_batchProcesessing) {
             if(m_currentWSI == m_mainWindow->getCurrentProject()->getWSICountInProject()-1) {
                 // All processed. Stop.
@@ -260,7 +552,7 @@ namespace fast {
                 // Run next
                 m_currentWSI += 1;
                 m_progressDialog->setValue(m_currentWSI*100);
-                std::cout << "Processing WSI " << m_currentWSI << std::endl;
+                Logger::info("ProcessWidget") << "Processing WSI " << m_currentWSI;
                 processPipeline(m_runningPipeline->getFilename(), m_mainWindow->getCurrentProject()->getImage(m_currentWSI)->get_image_pyramid());
             }
         } else if(m_procesessing) {
@@ -273,17 +565,25 @@ namespace fast {
     }
 
     void ProcessWidget::processPipeline(std::string pipelinePath, std::shared_ptr<ImagePyramid> WSI) {
-        std::cout << "Processing pipeline: " << pipelinePath << std::endl;
+        Logger::info("ProcessWidget") << "Processing pipeline: " << pipelinePath;
         stopProcessing();
+        // The warm-up measurements would compete with the pipeline
+        if(m_modelWarmUp)
+            m_modelWarmUp->stop();
         m_procesessing = true;
         auto view = m_view;
 
         // Load pipeline and give it a WSI
-        std::cout << "Loading pipeline in thread: " << std::this_thread::get_id() << std::endl;
-        m_runningPipeline = std::make_shared<Pipeline>(pipelinePath);
-        std::cout << "OK" << std::endl;
+        Logger::debug("ProcessWidget") << "Loading pipeline in thread: " << std::this_thread::get_id();
+        // Each slide is a run of its own. The trace of a run which was stopped is discarded.
+        if(m_traceStart >= 0)
+            Tracer::stop(m_traceStart, "");
+        m_traceStart = m_executionPolicy.trace ? Tracer::start() : -1;
         try {
-            std::cout << "parsing" << std::endl;
+            TraceSpan span("pipeline", "parse");
+            m_runningPipeline = std::make_shared<Pipeline>(preparePipeline(pipelinePath));
+            Logger::debug("ProcessWidget") << "OK";
+            Logger::debug("ProcessWidget") << "parsing";
             if(!WSI) {
                 auto uids = m_mainWindow->getCurrentProject()->getAllWsiUids();
                 auto currentUID = m_mainWindow->getCurrentWSIUID();
@@ -296,18 +596,47 @@ namespace fast {
                 }
                 WSI = m_mainWindow->getCurrentProject()->getImage(currentUID)->get_image_pyramid();
             }
+            if(m_executionPolicy.memoryBudget > 0) {
+                // The GUI runs one slide at a time, so the budget only closes idle slides to make room for the run
+                auto project = m_mainWindow->getCurrentProject();
+                m_memoryBudget = std::make_unique<MemoryBudget>(m_executionPolicy.memoryBudget);
+                m_memoryBudget->setEvictor([project](int64_t bytes) {
+                    return project->evictIdleImages(bytes);
+                });
+                // Held until the run is done, so that slides opened while it runs are evicted to make room for it
+                m_memoryReservation = std::make_unique<MemoryReservation>(*m_memoryBudget, PipelineRuntimeHistory().getPeakMemory(m_runningPipeline->getName()));
+            }
+            m_memoryMonitor = std::make_unique<MemoryMonitor>();
             m_runningPipeline->parse({{"WSI", WSI}});
-            std::cout << "OK" << std::endl;
+            Tracer::watch(m_runningPipeline);
+            setInferenceDevice();
+            // Patches with tissue are scheduled from a low resolution level, and cached in the slide cache
+            const std::string cacheFolder = m_mainWindow->getCurrentProject()->getSlideCacheFolder(m_mainWindow->getCurrentProject()->getAllWsiUids()[m_currentWSI]);
+            try {
+                m_runPatches = PatchScheduler::countPatches(m_runningPipeline->getFilename(), WSI, cacheFolder);
+            } catch(std::exception& e) {
+                m_runPatches = 0;
+            }
+            m_runStart = std::chrono::steady_clock::now();
+            m_patchPrefetchers = PatchPrefetcher::attach(m_runningPipeline, m_runningPipeline->getFilename(), WSI,
+                                                         m_executionPolicy.decoderThreads, m_executionPolicy.prefetchPatches, cacheFolder);
+            Logger::debug("ProcessWidget") << "OK";
         } catch(Exception &e) {
             m_procesessing = false;
             m_batchProcesessing = false;
+            m_memoryReservation.reset();
             m_runningPipeline.reset();
+            if(m_traceStart >= 0)
+                Tracer::stop(m_traceStart, "");
+            m_traceStart = -1;
+            if(m_stopPreparing)
+                return;
             // Syntax error in pipeline file. Raise error and return to avoid crash.
             std::string msg = "Error parsing pipeline! " + std::string(e.what());
             emit messageSignal(msg.c_str());
             return;
         }
-        std::cout << "Done" << std::endl;
+        Logger::debug("ProcessWidget") << "Done";
 
         for(auto renderer : m_runningPipeline->getRenderers()) {
             view->addRenderer(renderer);
@@ -315,6 +644,95 @@ namespace fast {
         m_computationThread->reset();
     }
 
+    std::string ProcessWidget::preparePipeline(const std::string& pipelinePath) {
+        m_deferredModels.clear();
+        PipelineRewriter rewriter(pipelinePath);
+        // Engines and batch sizes are chosen for the model variants which run
+        bool changed = ModelQuantizer::selectPrecision(rewriter, ModelQuantizer::getPrecision(rewriter, m_executionPolicy.modelPrecision));
+        if(!m_batchInference && m_inferenceEngine.empty() && m_inferenceDevice.empty() && !changed)
+            return pipelinePath;
+        BatchSizeTuner tuner;
+        tuner.setStopFlag(&m_stopPreparing);
+        InferenceBenchmark benchmark;
+        benchmark.setStopFlag(&m_stopPreparing);
+        ModelRegistry registry;
+        for(const auto& type : networkTypes) {
+            for(const auto& id : rewriter.getProcessObjects(type)) {
+                // The same model is benchmarked and tuned once, also when prepared by the model warm-up
+                const std::string model = ModelRegistry::getCanonicalFilename(rewriter.getAttribute(id, "model"));
+                std::vector<std::string> patchSize;
+                auto input = split(rewriter.getInput(id, 0), " ");
+                auto generators = rewriter.getProcessObjects("PatchGenerator");
+                if(!input.empty() && std::find(generators.begin(), generators.end(), input[0]) != generators.end())
+                    patchSize = split(rewriter.getAttribute(input[0], "patch-size"), " ");
+                ModelInfo info;
+                int width, height, channels;
+                if(patchSize.size() < 2 && registry.findModel(model, info) && info.getInputSize(width, height, channels))
+                    patchSize = {std::to_string(width), std::to_string(height)};
+
+                std::string engine = m_inferenceEngine;
+                if(engine == "fastest") {
+                    // Benchmarking requires the input size, from the patch generator or the indexed model
+                    engine = patchSize.size() < 2 ? "" : benchmark.getFastestEngine(model, m_inferenceDevice, std::stoi(patchSize[0]), std::stoi(patchSize[1]));
+                }
+                if(!engine.empty()) {
+                    rewriter.setAttribute(id, "inference-engine", engine);
+                    changed = true;
+                }
+                engine = rewriter.getAttribute(id, "inference-engine");
+
+                if(!m_batchInference || !rewriter.canBatch(id) || patchSize.size() < 2)
+                    continue;
+                Logger::info("ProcessWidget") << "Finding batch size for " << id;
+                const int batchSize = tuner.getBatchSize(model, engine, m_inferenceDevice, std::stoi(patchSize[0]), std::stoi(patchSize[1]));
+                if(batchSize > 1) {
+                    rewriter.enableBatching(id, batchSize);
+                    changed = true;
+                }
+            }
+        }
+        if(!m_inferenceDevice.empty()) {
+            // The device can't be set in the pipeline file, and FAST loads the model while parsing. The networks are
+            // therefore parsed without their model, which setInferenceDevice loads on the selected device.
+            for(const auto& type : networkTypes) {
+                for(const auto& id : rewriter.getProcessObjects(type)) {
+                    if(!usesOnlyFirstOutput(rewriter, id))
+                        continue;
+                    m_deferredModels[id] = rewriter.getAttribute(id, "model");
+                    rewriter.removeAttribute(id, "model");
+                    changed = true;
+                }
+            }
+        }
+        if(!changed)
+            return pipelinePath;
+        // The pipeline name is kept, so results are stored as for the original pipeline
+        const std::string filename = join(m_preparedPipelineFolder.path().toStdString(), getFileName(pipelinePath));
+        rewriter.save(filename);
+        return filename;
+    }
+
+    void ProcessWidget::setInferenceDevice() {
+        if(m_inferenceDevice.empty())
+            return;
+        std::unique_ptr<PipelineRewriter> rewriter;
+        for(auto PO : m_runningPipeline->getProcessObjects()) {
+            auto network = std::dynamic_pointer_cast<NeuralNetwork>(PO.second);
+            if(!network)
+                continue;
+            network->getInferenceEngine()->setDeviceType(m_inferenceDevice == "GPU" ? InferenceDeviceType::GPU : InferenceDeviceType::CPU);
+            auto model = m_deferredModels.find(PO.first);
+            if(model != m_deferredModels.end()) {
+                network->load(model->second);
+                continue;
+            }
+            // Networks with several outputs were parsed with their model, and are loaded again on the device
+            if(!rewriter)
+                rewriter = std::make_unique<PipelineRewriter>(m_runningPipeline->getFilename());
+            network->load(rewriter->getAttribute(PO.first, "model"));
+        }
+    }
+
     void ProcessWidget::batchProcessPipeline(std::string pipelineFilename) {
         m_currentWSI = 0;
         m_batchProcesessing = true;
@@ -354,23 +772,58 @@ namespace fast {
         auto progDialog = new QProgressDialog(nullptr);
         progDialog->setRange(0, ls.count() - 1);
         progDialog->setAutoClose(true);
+        progDialog->setWindowModality(Qt::ApplicationModal);
+        progDialog->setLabelText("Checking models...");
+        progDialog->show();
+
+        // Hashing large models takes seconds, so it is done in a thread while the dialog stays responsive
+        std::vector<std::string> filepaths;
+        for(const QString& filename : ls)
+            filepaths.push_back(filename.toStdString());
+        auto hashing = std::async(std::launch::async, [filepaths]() {
+            std::map<std::string, std::string> hashes;
+            for(const auto& filepath : filepaths) {
+                if(!ModelRegistry::getFormat(filepath).empty())
+                    hashes[filepath] = ZipExtractor::getSHA256(filepath);
+            }
+            return hashes;
+        });
+        while(hashing.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready)
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 0);
+        const auto hashes = hashing.get();
         progDialog->setLabelText("Adding models...");
 
         int counter = 0;
+        ModelRegistry registry;
+        std::vector<std::string> added;
         // now iterate over all selected files and add selected files and corresponding ones to Models/
         for (QString& filename : ls) {
             std::string filepath = filename.toStdString();
             QString newPath = QString::fromStdString(join(m_mainWindow->getRootFolder(), "models", getFileName(filepath)));
+            const std::string existing = hashes.count(filepath) == 0 ? "" : registry.findModelByHash(hashes.at(filepath));
             if(QDir().exists(newPath)) {
                 QMessageBox::warning(nullptr, "File exists", "File " + newPath + " exists and will not be copied.");
+            } else if(!existing.empty()) {
+                QMessageBox::warning(nullptr, "Model exists", "The model " + filename + " is already added as " + QString::fromStdString(existing) + " and will not be copied.");
             } else {
-                std::cout << "copying " << filepath << " to " << newPath.toStdString() << std::endl;
+                Logger::info("ProcessWidget") << "copying " << filepath << " to " << newPath.toStdString();
                 QFile::copy(filename, newPath);
+                if(!ModelRegistry::getFormat(filepath).empty())
+                    added.push_back(newPath.toStdString());
             }
             counter++;
             progDialog->setValue(counter);
         }
         progDialog->close();
+        if(!added.empty())
+            warmUpModels(added);
+    }
+
+    void ProcessWidget::warmUpModels(std::vector<std::string> filenames) {
+        // Stops the previous warm-up, which waits at most for the model it is indexing or the batch it is measuring
+        m_modelWarmUp.reset();
+        m_modelWarmUp = std::make_unique<ModelWarmUp>(join(m_mainWindow->getRootFolder(), "models"), join(m_mainWindow->getRootFolder(), "pipelines"),
+                                                      filenames, m_inferenceEngine, m_inferenceDevice, m_batchInference);
     }
 
     void ProcessWidget::addPipelinesFromDisk() {
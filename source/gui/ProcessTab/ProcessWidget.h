@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <chrono>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <QWidget>
@@ -19,13 +21,21 @@
 #include <QComboBox>
 #include <QGroupBox>
 #include <QPlainTextEdit>
+#include <QCheckBox>
+#include <QSpinBox>
+#include <QTemporaryDir>
 #include <FAST/Visualization/Renderer.hpp>
 #include "source/utils/utilities.h"
 #include "source/utils/qutilities.h"
 #include "source/gui/ProcessTab/PipelineScriptEditorWidget.h"
 #include <FAST/Pipeline.hpp>
+#include "source/logic/ExecutionPolicy.h"
+#include "source/logic/MemoryMonitor.h"
+#include "source/logic/MemoryBudget.h"
+#include "source/logic/ModelRegistry.h"
 
 class QStackedLayout;
+class QListWidget;
 
 namespace fast {
 
@@ -33,6 +43,7 @@ class View;
 class ComputationThread;
 class MainWindow;
 class ImagePyramid;
+class PatchPrefetcher;
 
 class ProcessWidget: public QWidget {
 Q_OBJECT
@@ -54,6 +65,30 @@ public:
     void showMessage(QString msg);
     void runInThread(std::string pipelineFilename, std::string pipelineName, bool runForAll);
 protected:
+    /**
+     * Adapt a pipeline to the current run, e.g. by selecting model variants or inserting batching in front of the networks.
+     * @param pipelinePath Disk location of the pipeline.
+     * @return Disk location of the adapted pipeline, or pipelinePath if it wasn't changed.
+     */
+    std::string preparePipeline(const std::string& pipelinePath);
+    /**
+     * Load the networks of the running pipeline on the selected inference device, if any.
+     */
+    void setInferenceDevice();
+    /**
+     * Show the number of patches a pipeline will process for the current image, and the expected runtime, in a label.
+     * The patches are counted in a background thread.
+     */
+    void estimatePipeline(std::string pipelineFilename, std::string pipelineName, QLabel* label);
+    /**
+     * Submit a pipeline for all images of the current project to the job server, instead of running it here.
+     */
+    void submitJob(std::string pipelineFilename);
+    /**
+     * Request the jobs of the job server, if one is running, without waiting for the reply.
+     */
+    void refreshJobQueue();
+    void updateJobList(const std::vector<Job>& jobs, bool available);
     /**
      * Define the interface for the current global widget.
      */
@@ -91,9 +126,33 @@ private:
     QStackedLayout* _stacked_layout;
     QWidget* _stacked_widget;
     QComboBox* _page_combobox;
+    QCheckBox* m_batchInferenceCheckBox;
+    QComboBox* m_engineComboBox;
+    QComboBox* m_deviceComboBox;
+    QSpinBox* m_threadsSpinBox;
+    QListWidget* m_jobList; /* Jobs of the job server, with the job id as item data */
+    bool m_jobRequestPending = false;
+    QSpinBox* m_jobPrioritySpinBox;
+    QPushButton* m_cancelJobButton;
 
     bool m_procesessing = false;
     bool m_batchProcesessing = false;
+    bool m_batchInference = false; /* Insert batching with a tuned batch size in front of the networks */
+    std::string m_inferenceEngine; /* Engine for all networks, "fastest" to benchmark, pipeline default if empty */
+    std::string m_inferenceDevice; /* CPU or GPU, engine default if empty */
+    int m_inferenceThreads = 0; /* Engine default if 0 */
+    std::map<std::string, std::string> m_deferredModels; /* Models of the networks which are loaded after parsing, by network id */
+    std::atomic_bool m_stopPreparing{false}; /* Stops benchmarking and batch size tuning when a run is canceled */
+    ExecutionPolicy m_executionPolicy; /* Policy of the current run */
+    std::vector<std::shared_ptr<PatchPrefetcher>> m_patchPrefetchers; /* Read patches ahead of the running pipeline */
+    int m_runPatches = 0; /* Patches of the running pipeline, for the runtime history */
+    std::chrono::steady_clock::time_point m_runStart;
+    int64_t m_traceStart = -1; /* Start of the trace of the running pipeline, -1 if it isn't traced */
+    std::unique_ptr<MemoryMonitor> m_memoryMonitor; /* Peak memory of the running pipeline, for the runtime history */
+    std::unique_ptr<MemoryBudget> m_memoryBudget;
+    std::unique_ptr<MemoryReservation> m_memoryReservation; /* Memory of the running pipeline, released when it is done */
+    QTemporaryDir m_preparedPipelineFolder; /* Pipelines adapted to the current run */
+    std::unique_ptr<ModelWarmUp> m_modelWarmUp; /* Indexes the models, and prepares added models for their first run */
     int m_currentWSI = 0;
     std::shared_ptr<Pipeline> m_runningPipeline;
     QProgressDialog* m_progressDialog;
@@ -0,0 +1,289 @@
+#include "ProjectThumbnailModel.h"
+#include <FAST/Utility.hpp>
+#include <FAST/Reporter.hpp>
+#include <QFileInfo>
+#include <algorithm>
+#include <QThread>
+#include <QPointer>
+#include <QCoreApplication>
+#include "source/logic/Project.h"
+
+namespace fast {
+    ProjectThumbnailModel::ProjectThumbnailModel(QObject* parent): QAbstractListModel(parent)
+    {
+        m_cache.setMaxCost(256); // Number of decoded thumbnails kept in memory
+        m_placeholder = QPixmap(thumbnailHeight, thumbnailHeight);
+        m_placeholder.fill(Qt::lightGray);
+        m_loader = std::thread(&ProjectThumbnailModel::runLoader, this);
+    }
+
+    ProjectThumbnailModel::~ProjectThumbnailModel()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        m_loader.join();
+    }
+
+    void ProjectThumbnailModel::clear()
+    {
+        beginResetModel();
+        m_slides.clear();
+        m_cache.clear();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.clear();
+            m_pending.clear();
+            ++m_generation;
+        }
+        endResetModel();
+    }
+
+    void ProjectThumbnailModel::setProject(std::shared_ptr<Project> project)
+    {
+        clear();
+        m_project = project;
+        if(!project)
+            return;
+
+        beginResetModel();
+        std::vector<std::pair<QString, std::string>> files;
+        for(auto uid : project->getAllWsiUids()) {
+            Slide slide;
+            slide.uid = QString::fromStdString(uid);
+            slide.image = project->getImage(uid);
+            if(project->hasSlideMetadata(uid)) {
+                slide.size = project->getSlideMetadata(uid).fileSize;
+            } else {
+                files.push_back({slide.uid, slide.image->get_filename()});
+            }
+            m_slides.push_back(slide);
+        }
+        endResetModel();
+
+        // Slides without stored metadata may live on slow network storage, so their sizes are read in the background,
+        // together with the results of all slides
+        int generation;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            generation = m_generation;
+        }
+        // The model may be destroyed before the sizes are read, so the thread only holds a guarded pointer to it,
+        // which is checked in the GUI thread
+        const QPointer<ProjectThumbnailModel> model(this);
+        const std::string resultsFolder = join(project->getRootFolder(), "results");
+        auto thread = QThread::create([model, files, resultsFolder, generation]() {
+            auto sizes = std::make_shared<std::map<QString, qint64>>();
+            for(const auto& file : files)
+                (*sizes)[file.first] = QFileInfo(QString::fromStdString(file.second)).size();
+            // The results folder is listed once, instead of checking every slide
+            auto statuses = std::make_shared<std::map<QString, int>>();
+            if(isDir(resultsFolder)) {
+                for(auto uid : getDirectoryList(resultsFolder, false, true))
+                    (*statuses)[QString::fromStdString(uid)] = countResults(join(resultsFolder, uid));
+            }
+            QMetaObject::invokeMethod(qApp, [model, sizes, statuses, generation]() {
+                if(model)
+                    model->slidesLoaded(generation, *sizes, *statuses);
+            }, Qt::QueuedConnection);
+        });
+        QObject::connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+        thread->start();
+    }
+
+    void ProjectThumbnailModel::slidesLoaded(int generation, const std::map<QString, qint64>& sizes, const std::map<QString, int>& statuses)
+    {
+        if(generation != m_generation)
+            return;
+        for(auto& slide : m_slides) {
+            if(sizes.count(slide.uid) > 0)
+                slide.size = sizes.at(slide.uid);
+            if(statuses.count(slide.uid) > 0)
+                slide.status = statuses.at(slide.uid);
+        }
+        if(!m_slides.empty())
+            emit dataChanged(index(0), index(m_slides.size() - 1), {SizeRole, StatusRole, Qt::ToolTipRole});
+    }
+
+    void ProjectThumbnailModel::addSlide(const std::string& uid)
+    {
+        // Duplicate imports of a slide return the uid of the slide already in the project
+        if(findRow(QString::fromStdString(uid)) >= 0)
+            return;
+        Slide slide;
+        slide.uid = QString::fromStdString(uid);
+        slide.image = m_project->getImage(uid);
+        slide.size = m_project->getSlideMetadata(uid).fileSize;
+        beginInsertRows(QModelIndex(), m_slides.size(), m_slides.size());
+        m_slides.push_back(slide);
+        endInsertRows();
+    }
+
+    void ProjectThumbnailModel::removeSlide(const std::string& uid)
+    {
+        const int row = findRow(QString::fromStdString(uid));
+        if(row < 0)
+            return;
+        beginRemoveRows(QModelIndex(), row, row);
+        m_cache.remove(m_slides[row].uid);
+        m_slides.erase(m_slides.begin() + row);
+        endRemoveRows();
+    }
+
+    void ProjectThumbnailModel::updateStatus(const std::string& uid)
+    {
+        const int row = findRow(QString::fromStdString(uid));
+        if(row < 0)
+            return;
+        m_slides[row].status = countResults(join(m_project->getRootFolder(), "results", uid));
+        emit dataChanged(index(row), index(row), {StatusRole, Qt::ToolTipRole});
+    }
+
+    int ProjectThumbnailModel::findRow(const QString& uid) const
+    {
+        for(int row = 0; row < m_slides.size(); ++row) {
+            if(m_slides[row].uid == uid)
+                return row;
+        }
+        return -1;
+    }
+
+    int ProjectThumbnailModel::countResults(const std::string& folder)
+    {
+        if(!isDir(folder))
+            return 0;
+        // Hidden folders hold the results of runs which haven't finished
+        const auto pipelines = getDirectoryList(folder, false, true);
+        return std::count_if(pipelines.begin(), pipelines.end(), [](const std::string& name) {
+            return name.empty() || name[0] != '.';
+        });
+    }
+
+    int ProjectThumbnailModel::rowCount(const QModelIndex& parent) const
+    {
+        if(parent.isValid())
+            return 0;
+        return m_slides.size();
+    }
+
+    QVariant ProjectThumbnailModel::data(const QModelIndex& index, int role) const
+    {
+        if(!index.isValid() || index.row() >= m_slides.size())
+            return QVariant();
+        const auto& slide = m_slides[index.row()];
+        switch(role) {
+            case Qt::DisplayRole:
+            case UidRole:
+                return slide.uid;
+            case SizeRole:
+                return slide.size;
+            case StatusRole:
+                return slide.status;
+            case Qt::ToolTipRole:
+                return slide.uid + "\n" + QString::fromStdString(slide.image->get_filename()) +
+                    (slide.size >= 0 ? "\nSize: " + QString::number(slide.size / (1024*1024)) + " MB" : "") +
+                    "\nPipelines with results: " + QString::number(slide.status);
+            case Qt::DecorationRole: {
+                // Only rows that are being shown are asked for their thumbnail
+                if(auto pixmap = m_cache.object(slide.uid))
+                    return *pixmap;
+                requestThumbnail(slide);
+                return m_placeholder;
+            }
+            default:
+                return QVariant();
+        }
+    }
+
+    void ProjectThumbnailModel::requestThumbnail(const Slide& slide) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_pending.count(slide.uid) > 0)
+                return;
+            m_pending.insert(slide.uid);
+            m_queue.push_back({slide.uid, slide.image});
+            // Requests are served newest first. The oldest ones are most likely scrolled out of view already,
+            // and are dropped if the queue grows; they are requested again if they become visible.
+            while(m_queue.size() > m_cache.maxCost()) {
+                m_pending.erase(m_queue.front().first);
+                m_queue.pop_front();
+            }
+        }
+        m_condition.notify_one();
+    }
+
+    void ProjectThumbnailModel::runLoader()
+    {
+        while(true) {
+            QString uid;
+            std::shared_ptr<WholeSlideImage> image;
+            int generation;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+                if(m_stop)
+                    return;
+                uid = m_queue.back().first;
+                image = m_queue.back().second;
+                m_queue.pop_back();
+                generation = m_generation;
+            }
+            QImage thumbnail;
+            try {
+                thumbnail = image->get_thumbnail();
+                if(!thumbnail.isNull())
+                    thumbnail = thumbnail.scaled(thumbnailHeight, thumbnailHeight, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            } catch(std::exception &e) {
+                Reporter::warning() << "Unable to create thumbnail for " << uid.toStdString() << ": " << e.what() << Reporter::end();
+            }
+            // Pixmaps must be created in the GUI thread
+            QMetaObject::invokeMethod(this, [this, generation, uid, thumbnail]() {
+                thumbnailLoaded(generation, uid, thumbnail);
+            }, Qt::QueuedConnection);
+        }
+    }
+
+    void ProjectThumbnailModel::thumbnailLoaded(int generation, QString uid, QImage thumbnail)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(generation != m_generation)
+                return;
+            m_pending.erase(uid);
+        }
+        const int row = findRow(uid);
+        if(row < 0)
+            return;
+        // Slides without a thumbnail keep the placeholder, instead of being requested over and over again
+        m_cache.insert(uid, new QPixmap(thumbnail.isNull() ? m_placeholder : QPixmap::fromImage(thumbnail)));
+        emit dataChanged(index(row), index(row), {Qt::DecorationRole});
+    }
+
+    ProjectThumbnailFilterModel::ProjectThumbnailFilterModel(QObject* parent): QSortFilterProxyModel(parent)
+    {
+        setFilterCaseSensitivity(Qt::CaseInsensitive);
+        setSortCaseSensitivity(Qt::CaseInsensitive);
+        setFilterRole(ProjectThumbnailModel::UidRole);
+        setSortRole(ProjectThumbnailModel::UidRole);
+        setDynamicSortFilter(true);
+    }
+
+    void ProjectThumbnailFilterModel::setStatusFilter(StatusFilter filter)
+    {
+        m_statusFilter = filter;
+        invalidateFilter();
+    }
+
+    bool ProjectThumbnailFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const
+    {
+        if(m_statusFilter != ALL) {
+            const int status = sourceModel()->index(sourceRow, 0, sourceParent).data(ProjectThumbnailModel::StatusRole).toInt();
+            if((m_statusFilter == PROCESSED) != (status > 0))
+                return false;
+        }
+        return QSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent);
+    }
+}
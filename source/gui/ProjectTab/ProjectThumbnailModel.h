@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <QAbstractListModel>
+#include <QSortFilterProxyModel>
+#include <QCache>
+#include <QPixmap>
+
+namespace fast {
+    class Project;
+    class WholeSlideImage;
+
+    /**
+     * @brief List model of the slides in a project. Thumbnails are only loaded for the rows the view asks for,
+     * by a background thread, and kept in a bounded LRU cache of decoded pixmaps. Memory use is therefore
+     * independent of the number of slides in the project.
+     */
+    class ProjectThumbnailModel: public QAbstractListModel {
+        Q_OBJECT
+        public:
+            enum Roles {
+                UidRole = Qt::UserRole + 1,
+                SizeRole,   /* Size of the slide file in bytes, -1 if not known yet */
+                StatusRole, /* Number of pipelines with results for the slide, 0 until read */
+            };
+
+            ProjectThumbnailModel(QObject* parent = nullptr);
+            ~ProjectThumbnailModel();
+
+            /**
+             * @brief setProject Replace all rows with the slides of a project.
+             */
+            void setProject(std::shared_ptr<Project> project);
+            void addSlide(const std::string& uid);
+            void removeSlide(const std::string& uid);
+            /**
+             * @brief updateStatus Re-read the processing status of a slide, e.g. after a pipeline has finished.
+             */
+            void updateStatus(const std::string& uid);
+            void clear();
+
+            int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+            QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+            static constexpr int thumbnailHeight = 135;
+        private:
+            struct Slide {
+                QString uid;
+                std::shared_ptr<WholeSlideImage> image;
+                qint64 size = -1;
+                int status = 0;
+            };
+            int findRow(const QString& uid) const;
+            static int countResults(const std::string& folder);
+            void requestThumbnail(const Slide& slide) const;
+            void thumbnailLoaded(int generation, QString uid, QImage thumbnail);
+            void slidesLoaded(int generation, const std::map<QString, qint64>& sizes, const std::map<QString, int>& statuses);
+            void runLoader();
+
+            std::shared_ptr<Project> m_project;
+            std::vector<Slide> m_slides;
+            mutable QCache<QString, QPixmap> m_cache;
+            QPixmap m_placeholder;
+
+            // Background loader, accessed from both threads
+            mutable std::mutex m_mutex;
+            mutable std::condition_variable m_condition;
+            mutable std::deque<std::pair<QString, std::shared_ptr<WholeSlideImage>>> m_queue;
+            mutable std::set<QString> m_pending;
+            int m_generation = 0; /* Incremented when the project changes, to discard thumbnails still in flight */
+            bool m_stop = false;
+            std::thread m_loader;
+    };
+
+    /**
+     * @brief Filtering and sorting of the slide list on name, size and processing status.
+     */
+    class ProjectThumbnailFilterModel: public QSortFilterProxyModel {
+        Q_OBJECT
+        public:
+            enum StatusFilter {
+                ALL,
+                PROCESSED,
+                UNPROCESSED,
+            };
+            ProjectThumbnailFilterModel(QObject* parent = nullptr);
+            void setStatusFilter(StatusFilter filter);
+        protected:
+            bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const override;
+        private:
+            StatusFilter m_statusFilter = ALL;
+    };
+}
@@ -3,6 +3,10 @@
 #include <FAST/Visualization/ImagePyramidRenderer/ImagePyramidRenderer.hpp>
 #include <FAST/Data/ImagePyramid.hpp>
 #include <FAST/Reporter.hpp>
+#include <QMenu>
+#include <QThread>
+#include <QPointer>
+#include <QCoreApplication>
 #include "source/gui/MainWindow.hpp"
 
 namespace fast {
@@ -35,16 +39,20 @@ namespace fast {
         _selectFileButton->setFixedHeight(50);
         //selectFileButton->setStyleSheet("color: white; background-color: blue");
 
+        m_relinkButton = new QPushButton(this);
+        m_relinkButton->setText("Relink missing images");
+        m_relinkButton->setToolTip("Find images which have been moved, by searching a folder");
+
         _main_layout = new QVBoxLayout(this);
         _main_layout->addWidget(m_projectLabel);
         _main_layout->addWidget(_selectFileButton);
+        _main_layout->addWidget(m_relinkButton);
         createWSIScrollAreaWidget();
     }
 
     void ProjectWidget::resetInterface()
     {
-        _wsi_scroll_listwidget->clear();
-        _thumbnail_qpushbutton_map.clear();
+        m_thumbnailModel->clear();
         emit resetDisplay();
         QCoreApplication::processEvents(QEventLoop::AllEvents, 0);
         // TODO m_mainWindow->doEmpty();
@@ -52,58 +60,68 @@ namespace fast {
 
     void ProjectWidget::setupConnections() {
         QObject::connect(_selectFileButton, &QPushButton::clicked, this, &ProjectWidget::selectFile);
+        QObject::connect(m_relinkButton, &QPushButton::clicked, this, &ProjectWidget::relinkMissingSlides);
+        QObject::connect(m_filterLineEdit, &QLineEdit::textChanged, m_filterModel, &QSortFilterProxyModel::setFilterFixedString);
+        QObject::connect(m_sortComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+            const int roles[] = {ProjectThumbnailModel::UidRole, ProjectThumbnailModel::SizeRole, ProjectThumbnailModel::StatusRole};
+            m_filterModel->setSortRole(roles[index]);
+            m_filterModel->sort(0, index == 0 ? Qt::AscendingOrder : Qt::DescendingOrder);
+        });
+        QObject::connect(m_statusComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+            m_filterModel->setStatusFilter((ProjectThumbnailFilterModel::StatusFilter)index);
+        });
+        QObject::connect(m_thumbnailView, &QListView::clicked, [this](const QModelIndex& index) {
+            changeWSIDisplayReceived(index.data(ProjectThumbnailModel::UidRole).toString().toStdString(), true);
+            prefetchNeighbours(index.row());
+        });
+        QObject::connect(m_thumbnailView, &QListView::customContextMenuRequested, [this](const QPoint& position) {
+            auto selected = m_thumbnailView->selectionModel()->selectedIndexes();
+            if(selected.empty())
+                return;
+            QMenu menu;
+            auto removeAction = menu.addAction("Remove from project");
+            if(menu.exec(m_thumbnailView->viewport()->mapToGlobal(position)) != removeAction)
+                return;
+            std::vector<std::string> uids;
+            for(const auto& index : selected)
+                uids.push_back(index.data(ProjectThumbnailModel::UidRole).toString().toStdString());
+            for(const auto& uid : uids)
+                removeImage(uid);
+        });
     }
 
     void ProjectWidget::createWSIScrollAreaWidget() {
-        //auto scrollAreaDialog = new QDialog();
-        //scrollAreaDialog->setGeometry(100, 100, 260, 260);
-
-        // TODO: Need to substitute this with QListWidget or similar as it's quite slow and memory expensive for
-        //        larger number of elements
-        _wsi_scroll_area = new QScrollArea(this);  //scrollAreaDialog);
-        _wsi_scroll_area->setAlignment(Qt::AlignTop);
-        //scrollArea->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
-        _wsi_scroll_area->setWidgetResizable(true);
-        _wsi_scroll_area->setGeometry(10, 10, 200, 200);
-
-        _wsi_scroll_listwidget = new QListWidget(this);
-        //scrollList->setStyleSheet("border: none, padding: 0, background: white, color: none");
-        _wsi_scroll_listwidget->setSelectionMode(QAbstractItemView::ExtendedSelection);
-        _wsi_scroll_listwidget->setItemAlignment(Qt::AlignTop);
-        _wsi_scroll_listwidget->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
-        _wsi_scroll_listwidget->setResizeMode(QListView::Adjust);  // resizable adaptively
-        _wsi_scroll_listwidget->setGeometry(10, 10, 200, 200);
-        //scrollList->setStyleSheet("*:hover {background:blue;}");  // setting color of widget when hovering
-        //scrollList->setStyleSheet("QListWidget:item:selected:active {background: blue;}; QListWidget:item:selected:!active {background: gray};");
-        //scrollList->setFocus();
-        //scrollList->setViewMode(QListWidget::IconMode);
-        //scrollList->setIconSize(QSize(100, 100));
-        //scrollList->setFlow(QListView::TopToBottom);
-        //scrollList->setResizeMode(QListWidget::Adjust);
-        //QObject::connect(scrollList, &QPushButton::clicked, std::bind(&MainWindow::selectFileInProject, this, 1));
-        //QObject::connect(scrollList, &QListWidget::itemPressed, std::bind(&MainWindow::selectFileInProject, this, 1));  // this, SLOT(onListMailItemClicked(QListWidgetItem*)));
-        //QObject::connect(scrollList,itemClicked(QListWidgetItem*), std::bind(&MainWindow::selectFileInProject, this, 1));
-        //connect(ui->listMail, SIGNAL(itemClicked(QListWidgetItem*)), this, SLOT(onListMailItemClicked(QListWidgetItem*)));
-        // QListWidget::itemPressed(QListWidgetItem *item)
-        //QObject::connect(scrollList, SIGNAL(itemClicked(QListWidgetItem*)), this, SLOT(&MainWindow::selectFileInProject));
-
-        //scrollList->setSelectionMode(QListWidgetItem::NoSelection);
-        //QObject::connect(scrollList, SIGNAL(itemDoubleClicked(QListWidgetItem*)), this, SLOT(itemDoubleClicked(QListWidgetItem*)));
-
-        _wsi_scroll_area->setWidget(_wsi_scroll_listwidget);
-
-        _wsi_scroll_widget = new QWidget(this);
-        //scrollArea->setWidget(scrollWidget);
-
-        _wsi_scroll_layout = new QVBoxLayout;
-        _wsi_scroll_widget->setLayout(_wsi_scroll_layout);
-
-        //connect(scrollList, SIGNAL(activated(int)), scrollLayout, SLOT(setCurrentIndex(int)));
-
-        //fileLayout->insertWidget(2, scrollArea);  //widget);
-        _main_layout->addWidget(_wsi_scroll_area);
-
-        //scrollAreaDialog->show();
+        auto filterLayout = new QHBoxLayout;
+        m_filterLineEdit = new QLineEdit(this);
+        m_filterLineEdit->setPlaceholderText("Filter by name");
+        m_filterLineEdit->setClearButtonEnabled(true);
+        filterLayout->addWidget(m_filterLineEdit);
+
+        m_sortComboBox = new QComboBox(this);
+        m_sortComboBox->addItems({"Sort by name", "Sort by size", "Sort by status"});
+        filterLayout->addWidget(m_sortComboBox);
+
+        m_statusComboBox = new QComboBox(this);
+        m_statusComboBox->addItems({"All", "Processed", "Unprocessed"});
+        filterLayout->addWidget(m_statusComboBox);
+        _main_layout->addLayout(filterLayout);
+
+        // Model/view based list, which only materialises the thumbnails of the visible rows
+        m_thumbnailModel = new ProjectThumbnailModel(this);
+        m_filterModel = new ProjectThumbnailFilterModel(this);
+        m_filterModel->setSourceModel(m_thumbnailModel);
+        m_filterModel->sort(0);
+
+        m_thumbnailView = new QListView(this);
+        m_thumbnailView->setModel(m_filterModel);
+        m_thumbnailView->setSelectionMode(QAbstractItemView::ExtendedSelection);
+        m_thumbnailView->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+        m_thumbnailView->setResizeMode(QListView::Adjust);  // resizable adaptively
+        m_thumbnailView->setIconSize(QSize(ProjectThumbnailModel::thumbnailHeight, ProjectThumbnailModel::thumbnailHeight));
+        m_thumbnailView->setUniformItemSizes(true); // Avoids measuring every row, needed for large projects
+        m_thumbnailView->setLayoutMode(QListView::Batched);
+        m_thumbnailView->setContextMenuPolicy(Qt::CustomContextMenu);
+        _main_layout->addWidget(m_thumbnailView);
     }
 
     void ProjectWidget::selectFile() {
@@ -128,14 +146,6 @@ namespace fast {
 
     void ProjectWidget::loadSelectedWSIs(const QList<QString> &fileNames)
     {
-        auto currentPosition = 0; // curr_pos <=?
-
-        // need to handle scenario where a WSI is added, but there already exists N WSIs from before
-        auto nb_wsis_in_list = 0; //wsiList.size();
-        if (nb_wsis_in_list != 0)
-            currentPosition = nb_wsis_in_list;
-
-        int counter = 0;
         for (QString fileName : fileNames)
         {
             if (fileName == "")
@@ -144,20 +154,7 @@ namespace fast {
             auto currFileName = fileName.toStdString();
             Reporter::info() << "Selected file: " << currFileName << Reporter::end();
             const std::string id_name = m_mainWindow->getCurrentProject()->includeImage(currFileName);
-
-            // @TODO. Shouldn't we keep a class attribute list with those buttons, so that it's easier to retrieve them
-            // and delete them on the fly?
-            auto button = new ProjectThumbnailPushButton(m_mainWindow, id_name, this);
-            _thumbnail_qpushbutton_map[id_name] = button;
-            int width_val = 100;
-            int height_val = 150;
-            auto listItem = new QListWidgetItem;
-            listItem->setSizeHint(QSize(width_val, height_val));
-            QObject::connect(button, &ProjectThumbnailPushButton::clicked, this, &ProjectWidget::changeWSIDisplayReceived);
-            QObject::connect(button, &ProjectThumbnailPushButton::rightClicked, this, &ProjectWidget::removeImage);
-            _wsi_scroll_listwidget->addItem(listItem);
-            _wsi_scroll_listwidget->setItemWidget(listItem, button);
-            _wsi_thumbnails_listitem[id_name] = listItem;
+            m_thumbnailModel->addSlide(id_name);
 
 //            emit newImageFilename(id_name);
             // to render straight away (avoid waiting on all WSIs to be handled before rendering)
@@ -167,62 +164,83 @@ namespace fast {
 
     void ProjectWidget::loadProject()
     {
-        auto currentPosition = 0; // curr_pos <=?
-
-        // need to handle scenario where a WSI is added, but there already exists N WSIs from before
-        auto nb_wsis_in_list = 0; //wsiList.size();
-        if (nb_wsis_in_list != 0)
-            currentPosition = nb_wsis_in_list;
-
-        int counter = 0;
-        for (auto uid : m_mainWindow->getCurrentProject()->getAllWsiUids())
-        {
-            auto fileName = m_mainWindow->getCurrentProject()->getImage(uid)->get_filename();
-            auto currFileName = fileName;
-            Reporter::info() << "Selected file: " << currFileName << Reporter::end();
-            //const std::string id_name = m_mainWindow->getCurrentProject()->includeImage(currFileName);
-
-            // @TODO. Shouldn't we keep a class attribute list with those buttons, so that it's easier to retrieve them
-            // and delete them on the fly?
-            auto button = new ProjectThumbnailPushButton(m_mainWindow, uid, this);
-            _thumbnail_qpushbutton_map[uid] = button;
-            int width_val = 100;
-            int height_val = 150;
-            auto listItem = new QListWidgetItem;
-            listItem->setSizeHint(QSize(width_val, height_val));
-            QObject::connect(button, &ProjectThumbnailPushButton::clicked, this, &ProjectWidget::changeWSIDisplayReceived);
-            QObject::connect(button, &ProjectThumbnailPushButton::rightClicked, this, &ProjectWidget::removeImage);
-            _wsi_scroll_listwidget->addItem(listItem);
-            _wsi_scroll_listwidget->setItemWidget(listItem, button);
-            _wsi_thumbnails_listitem[uid] = listItem;
-
-            //            emit newImageFilename(id_name);
-            // to render straight away (avoid waiting on all WSIs to be handled before rendering)
-            QCoreApplication::processEvents(QEventLoop::AllEvents, 0);
-        }
+        // Slides are listed straight away, thumbnails are loaded in the background when their rows become visible
+        m_thumbnailModel->setProject(m_mainWindow->getCurrentProject());
     }
 
     void ProjectWidget::removeImage(std::string uid)
     {
-        _wsi_scroll_listwidget->removeItemWidget(_wsi_thumbnails_listitem[uid]);
-        _wsi_thumbnails_listitem.erase(uid);
-        _thumbnail_qpushbutton_map.erase(uid);
-        _wsi_scroll_listwidget->update();
-        emit changeWSIDisplayTriggered(uid, false);
+        m_thumbnailModel->removeSlide(uid);
+        if(m_mainWindow->getCurrentWSIUID() == uid)
+            emit resetDisplay();
         m_mainWindow->getCurrentProject()->removeImage(uid);
         QCoreApplication::processEvents(QEventLoop::AllEvents, 0);
     }
 
-    void ProjectWidget::changeWSIDisplayReceived(std::string id_name, bool state)
+    void ProjectWidget::updateProcessingStatus(std::string uid)
     {
-        if(state)
-        {
-            for(auto it = _thumbnail_qpushbutton_map.begin(); it != _thumbnail_qpushbutton_map.end(); it++)
-            {
-                if(it->first != id_name)
-                    it->second->setCheckedState(false);
+        m_thumbnailModel->updateStatus(uid);
+    }
+
+    void ProjectWidget::relinkMissingSlides()
+    {
+        auto project = m_mainWindow->getCurrentProject();
+        const auto missing = project->getMissingSlides();
+        if(missing.empty()) {
+            QMessageBox::information(this, "Relink missing images", "All images in the project were found.");
+            return;
+        }
+        const QString folder = QFileDialog::getExistingDirectory(this,
+                "Select folder with the " + QString::number(missing.size()) + " missing images", nullptr, QFileDialog::DontUseNativeDialog);
+        if(folder.isEmpty())
+            return;
+
+        auto progressDialog = new QProgressDialog("Searching for missing images...", QString(), 0, 0, this);
+        progressDialog->setModal(true);
+        progressDialog->show();
+
+        // Fingerprinting candidate files can take a while on network storage, so it is done in the background,
+        // and the project is only modified in the GUI thread. The widget may be destroyed before the search is done,
+        // so the thread only holds a guarded pointer to it, which is checked in the GUI thread.
+        const auto metadata = project->getAllSlideMetadata();
+        const QPointer<ProjectWidget> widget(this);
+        auto thread = QThread::create([widget, project, missing, metadata, folder, progressDialog]() {
+            auto found = std::make_shared<std::map<std::string, std::string>>(
+                    Project::findMovedSlides(missing, metadata, {folder.toStdString()}));
+            QMetaObject::invokeMethod(qApp, [widget, project, missing, found, progressDialog]() {
+                // The progress dialog is a child of the widget
+                if(!widget)
+                    return;
+                progressDialog->close();
+                progressDialog->deleteLater();
+                if(project != widget->m_mainWindow->getCurrentProject())
+                    return;
+                project->relinkSlides(*found);
+                widget->m_mainWindow->getSlidePrefetcher()->clear();
+                widget->loadProject();
+                QMessageBox::information(widget, "Relink missing images",
+                        "Found " + QString::number(found->size()) + " of " + QString::number(missing.size()) + " missing images.");
+            }, Qt::QueuedConnection);
+        });
+        QObject::connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+        thread->start();
+    }
+
+    void ProjectWidget::prefetchNeighbours(int row)
+    {
+        // Neighbours in the order shown, nearest first, as the user is most likely to step to those next
+        std::vector<std::string> uids;
+        for(int distance = 1; distance <= m_prefetchDistance; ++distance) {
+            for(int neighbour : {row + distance, row - distance}) {
+                if(neighbour >= 0 && neighbour < m_filterModel->rowCount())
+                    uids.push_back(m_filterModel->index(neighbour, 0).data(ProjectThumbnailModel::UidRole).toString().toStdString());
             }
         }
+        m_mainWindow->getSlidePrefetcher()->prefetch(m_mainWindow->getCurrentProject(), uids);
+    }
+
+    void ProjectWidget::changeWSIDisplayReceived(std::string id_name, bool state)
+    {
         emit changeWSIDisplayTriggered(id_name, state);
     }
 
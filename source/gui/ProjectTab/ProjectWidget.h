@@ -17,10 +17,12 @@
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QDirIterator>
-#include <iostream>
 #include <FAST/Visualization/Renderer.hpp>
 #include "source/utils/utilities.h"
-#include "source/gui/ProjectTab/ProjectThumbnailPushButton.h"
+#include <QListView>
+#include <QLineEdit>
+#include <QComboBox>
+#include "source/gui/ProjectTab/ProjectThumbnailModel.h"
 
 
 namespace fast {
@@ -63,6 +65,15 @@ public slots:
     void removeImage(std::string uid);
     void loadProject();
     void updateTitle();
+    /**
+     * @brief updateProcessingStatus Refresh the processing status shown for a WSI, e.g. after running a pipeline.
+     * @param uid Unique name for the considered WSI.
+     */
+    void updateProcessingStatus(std::string uid);
+    /**
+     * @brief relinkMissingSlides Ask for a folder, and search it for the WSIs of the project which have been moved.
+     */
+    void relinkMissingSlides();
 signals:
     void changeWSIDisplayTriggered(std::string, bool);
     void resetDisplay();
@@ -85,17 +96,25 @@ protected:
 
     void loadSelectedWSIs(const QList<QString> &fileNames);
 
+    /**
+     * Prefetch the slides next to a row of the list in the background.
+     * @param row Row of the slide being viewed.
+     */
+    void prefetchNeighbours(int row);
+
 private:
     QPushButton* _selectFileButton;
+    QPushButton* m_relinkButton;
     QVBoxLayout* _main_layout;
-    QScrollArea* _wsi_scroll_area;
-    QListWidget* _wsi_scroll_listwidget;
-    QWidget* _wsi_scroll_widget;
-    QVBoxLayout* _wsi_scroll_layout;
-    std::map<std::string, QListWidgetItem*> _wsi_thumbnails_listitem;
-    std::map<std::string, ProjectThumbnailPushButton*> _thumbnail_qpushbutton_map;
+    QLineEdit* m_filterLineEdit;
+    QComboBox* m_sortComboBox;
+    QComboBox* m_statusComboBox;
+    QListView* m_thumbnailView;
+    ProjectThumbnailModel* m_thumbnailModel;
+    ProjectThumbnailFilterModel* m_filterModel;
     MainWindow* m_mainWindow;
     QLabel* m_projectLabel;
+    int m_prefetchDistance = 2; /* Number of slides on each side of the viewed slide to prefetch */
 };
 
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <QLabel>
 #include <QVBoxLayout>
 #include "SplashWidget.hpp"
+#include "source/logic/Logger.h"
 #include <QApplication>
 #include <QDesktopWidget>
 #include <QPushButton>
@@ -12,7 +13,9 @@
 #include <fstream>
 #include <QDesktopServices>
 #include <QTextEdit>
+#include <QThread>
 #include "source/utils/utilities.h"
+#include "source/logic/ProjectIndex.h"
 
 namespace fast{
 
@@ -60,27 +63,31 @@ ProjectSplashWidget::ProjectSplashWidget(std::string rootFolder, bool allowClose
     leftLayout->addWidget(recentLabel);
 
     auto recentList = new QListWidget();
-    std::map<std::string, std::string> sortedFolders;
-    for(auto folder : getDirectoryList(rootFolder, false, true)) {
-        std::ifstream file(join(rootFolder, folder, "/timestamp.txt"));
-        if(file.is_open()) {
-            std::string timestamp;
-            std::getline(file, timestamp);
-            file.close();
-            sortedFolders[timestamp] = folder;
-        } else {
-            std::cout << "Project " << folder << " was missing timestmap.txt" << std::endl;
+    // Show the indexed projects straight away, and reconcile the index with the projects folder in the background
+    auto index = std::make_shared<ProjectIndex>(rootFolder);
+    auto populateList = [recentList](const std::vector<ProjectIndexEntry>& entries) {
+        QStringList selected;
+        for(auto item : recentList->selectedItems())
+            selected << item->text();
+        recentList->clear();
+        for(const auto& entry : entries) {
+            auto item = new QListWidgetItem(QString::fromStdString(entry.name), recentList);
+            item->setToolTip(QString::fromStdString("Last modified: " + entry.lastModified +
+                    "\nSlides: " + std::to_string(entry.slideCount) +
+                    "\nSize on disk: " + std::to_string(entry.sizeOnDisk / (1024*1024)) + " MB"));
+            item->setSelected(selected.contains(item->text()));
         }
-    }
-    // Create a map reverse iterator
-    decltype(sortedFolders)::reverse_iterator it;
-
-    for (it = sortedFolders.rbegin(); it != sortedFolders.rend(); it++) {
-        auto item = new QListWidgetItem(
-                QString::fromStdString(it->second),
-                recentList);
-        //"Last modified: " + QString::fromStdString(it->first),
-    }
+    };
+    populateList(index->getEntries());
+    auto reconciled = std::make_shared<std::vector<ProjectIndexEntry>>();
+    auto reconcileThread = QThread::create([index, reconciled]() {
+        *reconciled = index->reconcile();
+    });
+    connect(reconcileThread, &QThread::finished, recentList, [populateList, reconciled]() {
+        populateList(*reconciled);
+    });
+    connect(reconcileThread, &QThread::finished, reconcileThread, &QObject::deleteLater);
+    reconcileThread->start();
     leftLayout->addWidget(recentList);
     connect(recentList, &QListWidget::itemDoubleClicked, [=](QListWidgetItem* item) {
         close();
@@ -98,9 +105,10 @@ ProjectSplashWidget::ProjectSplashWidget(std::string rootFolder, bool allowClose
                       QMessageBox::Yes|QMessageBox::No);
         if (reply == QMessageBox::Yes) {
             for(auto item : recentList->selectedItems()) {
-                std::cout << "Deleting " << (QString::fromStdString(rootFolder) + item->text() + "/").toStdString() << std::endl;
+                Logger::info("SplashWidget") << "Deleting " << (QString::fromStdString(rootFolder) + item->text() + "/").toStdString();
                 auto dir = QDir(QString::fromStdString(rootFolder) + item->text() + "/");
                 dir.removeRecursively();
+                index->remove(item->text().toStdString());
                 recentList->removeItemWidget(item);
                 delete item;
             }
@@ -220,7 +228,8 @@ void ProjectSplashWidget::aboutProgram() {
 }
 
 void ProjectSplashWidget::downloadTestData() {
-    downloadZipFile("http://fast.eriksmistad.no/download/fastpathology-test-images-v1.0.0.zip", join(m_rootFolder, "..", "images"), "test dataset");
+    if(!downloadZipFile(Downloader::getDownloadUrl("fastpathology-test-images-v1.0.0.zip"), join(m_rootFolder, "..", "images"), "test dataset"))
+        return;
     // Create new project
     emit newProjectSignal("Test project");
     emit loadTestDataIntoProject();
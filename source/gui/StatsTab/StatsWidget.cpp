@@ -3,6 +3,7 @@
 //
 
 #include "StatsWidget.h"
+#include "source/logic/Logger.h"
 
 #include <FAST/Importers/WholeSlideImageImporter.hpp>
 #include <FAST/Visualization/ImagePyramidRenderer/ImagePyramidRenderer.hpp>
@@ -39,7 +40,7 @@ namespace fast {
     }
 
     const bool StatsWidget::calcTissueHist() {
-        std::cout << "Calculating histogram..."<<std::endl;
+        Logger::debug("StatsWidget") << "Calculating histogram...";
 
         int barWidth = 9;
         int boxWidth = 250;
@@ -66,7 +67,7 @@ namespace fast {
         painters->setPen(QColor(140, 140, 210));
 
         for (int i = 0; i < len; i++) {
-            std::cout << std::to_string(i) << std::endl;
+            Logger::debug("StatsWidget") << std::to_string(i);
             qreal h = y_vec[i] * maxHeight;
             // draw level
             painters->fillRect(drawMinWidth / 2 + (double)(i + 1) * (double)(newWidth) / (double)(len + 1) - (double)((double)(barWidth)/(double)(2)),
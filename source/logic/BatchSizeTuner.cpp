@@ -0,0 +1,108 @@
+#include "BatchSizeTuner.h"
+#include "Logger.h"
+#include <FAST/Utility.hpp>
+#include <FAST/Reporter.hpp>
+#include "InferenceBenchmark.h"
+#include <QDir>
+#include <QSysInfo>
+#include <QSaveFile>
+#include <fstream>
+#include <sstream>
+
+namespace fast{
+    std::mutex BatchSizeTuner::m_mutex;
+
+    BatchSizeTuner::BatchSizeTuner()
+    {
+        m_filename = QDir::home().path().toStdString() + "/fastpathology/batch_sizes.txt";
+        load();
+    }
+
+    void BatchSizeTuner::load()
+    {
+        std::ifstream file(m_filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            const auto separator = line.rfind('\t');
+            if(separator == std::string::npos)
+                continue;
+            try {
+                m_batchSizes[line.substr(0, separator)] = std::stoi(line.substr(separator + 1));
+            } catch(std::exception& e) {
+            }
+        }
+    }
+
+    void BatchSizeTuner::save() const
+    {
+        QSaveFile file(QString::fromStdString(m_filename));
+        if(!file.open(QIODevice::WriteOnly)) {
+            Logger::warning("BatchSizeTuner") << "Unable to write batch sizes " << m_filename;
+            return;
+        }
+        std::stringstream stream;
+        for(const auto& batchSize : m_batchSizes)
+            stream << batchSize.first << "\t" << batchSize.second << "\n";
+        file.write(QByteArray::fromStdString(stream.str()));
+        file.commit();
+    }
+
+    std::string BatchSizeTuner::getKey(const std::string& model, const std::string& engine, const std::string& device, int width, int height, int channels) const
+    {
+        return QSysInfo::machineHostName().toStdString() + "\t" + (engine.empty() ? "default" : engine) + "\t" +
+            (device.empty() ? "default" : device) + "\t" + model + "\t" +
+            std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(channels);
+    }
+
+    void BatchSizeTuner::setStopFlag(const std::atomic_bool* stop)
+    {
+        m_stop = stop;
+    }
+
+    int BatchSizeTuner::getBatchSize(const std::string& model, const std::string& engine, const std::string& device, int width, int height, int channels)
+    {
+        const std::string key = getKey(model, engine, device, width, height, channels);
+        auto it = m_batchSizes.find(key);
+        if(it != m_batchSizes.end())
+            return it->second;
+        const int batchSize = tune(model, engine, device, width, height, channels, {1, 2, 4, 8, 16, 32}, 5, m_stop);
+        // Reload, as another run may have stored batch sizes in the meantime
+        m_batchSizes.clear();
+        load();
+        m_batchSizes[key] = batchSize;
+        save();
+        return batchSize;
+    }
+
+    int BatchSizeTuner::tune(const std::string& model, const std::string& engine, const std::string& device, int width, int height, int channels,
+            const std::vector<int>& candidates, int iterations, const std::atomic_bool* stop)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int bestBatchSize = 1;
+        float bestThroughput = 0;
+        for(int batchSize : candidates) {
+            // A partial tuning isn't a result, as larger batch sizes weren't measured
+            if(stop && *stop)
+                throw Exception("Batch size tuning of " + model + " was stopped");
+            float throughput;
+            try {
+                throughput = InferenceBenchmark::measureThroughput(model, engine, device, width, height, channels, batchSize, iterations, stop);
+            } catch(std::exception& e) {
+                if(stop && *stop)
+                    throw Exception("Batch size tuning of " + model + " was stopped");
+                Reporter::info() << "Batch size " << batchSize << " not supported for model " << model << ": " << e.what() << Reporter::end();
+                break;
+            }
+            Reporter::info() << "Batch size " << batchSize << ": " << throughput << " patches per second" << Reporter::end();
+            // Larger batches use more memory, so they have to be clearly faster to be chosen
+            if(throughput > bestThroughput*1.05f) {
+                bestThroughput = throughput;
+                bestBatchSize = batchSize;
+            } else if(throughput < bestThroughput*0.9f) {
+                break;
+            }
+        }
+        Reporter::info() << "Selected batch size " << bestBatchSize << " for model " << model << Reporter::end();
+        return bestBatchSize;
+    }
+} // End of namespace fast
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+
+namespace fast{
+    /**
+     * @brief Finds the batch size with the highest inference throughput for a model on the current machine, by
+     * running a few batches of each candidate size. The choices are stored per host, engine, device and model in
+     * batch_sizes.txt in the fastpathology folder, so each model is only tuned once per machine.
+     */
+    class BatchSizeTuner {
+        public:
+            BatchSizeTuner();
+            /**
+             * @brief getBatchSize Get the stored batch size of a model, or tune and store it.
+             * @param model Disk location of the model.
+             * @param engine Inference engine, the default engine if empty.
+             * @param device Device type, e.g. CPU or GPU, the engine's default if empty.
+             * @param width Patch width.
+             * @param height Patch height.
+             * @param channels Number of patch channels.
+             * Throws an Exception if stopped, see setStopFlag.
+             */
+            int getBatchSize(const std::string& model, const std::string& engine, const std::string& device, int width, int height, int channels = 3);
+            /**
+             * @brief tune Measure the throughput of a model for increasing batch sizes, and return the fastest.
+             * Stops when a batch size is clearly slower than the best so far, or isn't supported by the model.
+             * @param iterations Number of timed batches per batch size, after one warm-up batch.
+             * @param stop Throws an Exception between batches once this is set, if given.
+             */
+            static int tune(const std::string& model, const std::string& engine, const std::string& device, int width, int height, int channels,
+                    const std::vector<int>& candidates = {1, 2, 4, 8, 16, 32}, int iterations = 5, const std::atomic_bool* stop = nullptr);
+            /**
+             * @brief setStopFlag Stop tuning when the flag is set, e.g. from another thread.
+             */
+            void setStopFlag(const std::atomic_bool* stop);
+        private:
+            void load();
+            void save() const;
+            std::string getKey(const std::string& model, const std::string& engine, const std::string& device, int width, int height, int channels) const;
+
+            std::string m_filename;
+            std::map<std::string, int> m_batchSizes;
+            const std::atomic_bool* m_stop = nullptr;
+            static std::mutex m_mutex; /* Only one model is tuned at a time, as concurrent runs distort the measurements */
+    };
+} // End of namespace fast
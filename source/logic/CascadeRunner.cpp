@@ -0,0 +1,275 @@
+#include "CascadeRunner.h"
+#include "source/logic/Logger.h"
+#include "source/logic/PipelineRewriter.h"
+#include "source/logic/Tracer.h"
+#include "source/logic/PatchGrid.h"
+#include "source/logic/PatchScheduler.h"
+#include <FAST/Pipeline.hpp>
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Data/Image.hpp>
+#include <FAST/Data/Tensor.hpp>
+#include <FAST/Utility.hpp>
+#include <QTemporaryDir>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+
+namespace fast{
+    namespace {
+        // Finds the network classifying the patches of a PatchGenerator reading the slide, with only stitched output
+        bool findClassifier(const PipelineRewriter& pipeline, std::string& networkId, std::string& generatorId) {
+            const auto networks = pipeline.getProcessObjects("NeuralNetwork");
+            if(networks.size() != 1)
+                return false;
+            const auto generators = pipeline.getProcessObjects("PatchGenerator");
+            auto input = split(pipeline.getInput(networks[0], 0), " ");
+            if(input.empty() || std::find(generators.begin(), generators.end(), input[0]) == generators.end())
+                return false;
+            if(pipeline.getInput(input[0], 0) != "WSI")
+                return false;
+            for(const auto& consumer : pipeline.getConsumers(networks[0])) {
+                if(pipeline.getType(consumer) != "PatchStitcher")
+                    return false;
+            }
+            networkId = networks[0];
+            generatorId = input[0];
+            return true;
+        }
+
+        int argmax(const float* values, int size) {
+            return std::max_element(values, values + size) - values;
+        }
+
+        float sum(const float* values, int size) {
+            float result = 0;
+            for(int i = 0; i < size; ++i)
+                result += values[i];
+            return result;
+        }
+    }
+
+    std::string CascadeResult::toString() const
+    {
+        std::stringstream stream;
+        stream << "Cascade: " << coarsePatches << " patches in the first pass (" << coarseSeconds << " s), "
+               << refinedPatches << " of " << fullPatches << " patches refined (" << refineSeconds << " s)";
+        if(agreement >= 0) {
+            stream << ", full run " << fullSeconds << " s, speed-up " << fullSeconds / (coarseSeconds + refineSeconds)
+                   << ", agreement " << agreement*100 << "%";
+        }
+        return stream.str();
+    }
+
+    CascadeRunner::CascadeRunner(std::string pipelineFilename, CascadeSettings settings)
+    {
+        m_pipelineFilename = pipelineFilename;
+        m_settings = settings;
+    }
+
+    bool CascadeRunner::isSupported(const std::string& pipelineFilename)
+    {
+        std::string networkId, generatorId;
+        return findClassifier(PipelineRewriter(pipelineFilename), networkId, generatorId);
+    }
+
+    std::map<std::string, std::shared_ptr<DataObject>> CascadeRunner::runPipeline(const std::string& filename, std::map<std::string, std::shared_ptr<DataObject>> input, std::shared_ptr<Pipeline>& pipeline, double& seconds) const
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            TraceSpan span("pipeline", "parse");
+            pipeline = std::make_shared<Pipeline>(filename);
+            pipeline->parse(input, {}, false);
+        }
+        Tracer::watch(pipeline);
+        TraceSpan span("pipeline", "run");
+        auto data = pipeline->getAllPipelineOutputData();
+        std::chrono::duration<double> runtime = std::chrono::high_resolution_clock::now() - start;
+        seconds = runtime.count();
+        return data;
+    }
+
+    std::shared_ptr<Tensor> CascadeRunner::getTensor(const std::map<std::string, std::shared_ptr<DataObject>>& data, std::string& name)
+    {
+        for(const auto& output : data) {
+            if(auto tensor = std::dynamic_pointer_cast<Tensor>(output.second)) {
+                // Stitched classifications are rows x columns x classes
+                if(tensor->getShape().getNrOfDimensions() != 3)
+                    continue;
+                name = output.first;
+                return tensor;
+            }
+        }
+        throw Exception("The pipeline has no stitched classification output");
+    }
+
+    int CascadeRunner::countPatches(const std::shared_ptr<Tensor>& tensor)
+    {
+        const auto shape = tensor->getShape();
+        const int cells = shape[0]*shape[1];
+        const int channels = shape[2];
+        auto access = tensor->getAccess(ACCESS_READ);
+        const float* values = access->getRawData();
+        int patches = 0;
+        for(int i = 0; i < cells; ++i)
+            patches += sum(&values[i*channels], channels) > 0 ? 1 : 0;
+        return patches;
+    }
+
+    CascadeResult CascadeRunner::run(std::shared_ptr<ImagePyramid> pyramid, const std::string& cacheFolder)
+    {
+        PipelineRewriter original(m_pipelineFilename);
+        std::string networkId, generatorId;
+        if(!findClassifier(original, networkId, generatorId))
+            throw Exception("Cascade mode requires a pipeline with a single patch classifier, " + m_pipelineFilename + " has none");
+        QTemporaryDir folder;
+        CascadeResult result;
+
+        // First pass at a lower magnification, or one level further down if the pipeline uses levels
+        PipelineRewriter coarse = original;
+        const std::string magnification = original.getAttribute(generatorId, "patch-magnification");
+        if(m_settings.magnification > 0) {
+            coarse.setAttribute(generatorId, "patch-magnification", std::to_string(m_settings.magnification));
+        } else if(!magnification.empty()) {
+            coarse.setAttribute(generatorId, "patch-magnification", std::to_string(std::stof(magnification) / 2));
+        } else {
+            const std::string level = original.getAttribute(generatorId, "patch-level");
+            coarse.setAttribute(generatorId, "patch-level", std::to_string((level.empty() ? 0 : std::stoi(level)) + 1));
+        }
+        if(!m_settings.model.empty())
+            coarse.setAttribute(networkId, "model", "\"" + m_settings.model + "\"");
+        const std::string coarseFilename = folder.filePath("coarse.fpl").toStdString();
+        coarse.save(coarseFilename);
+        std::shared_ptr<Pipeline> coarsePipeline;
+        auto coarseData = runPipeline(coarseFilename, {{"WSI", pyramid}}, coarsePipeline, result.coarseSeconds);
+        std::string outputName;
+        auto coarseTensor = getTensor(coarseData, outputName);
+        result.coarsePatches = countPatches(coarseTensor);
+
+        // Select the tissue patches of the full resolution grid whose first pass classification is uncertain or positive
+        const auto grid = PatchGrid::fromPipeline(original, generatorId, pyramid);
+        std::vector<int> tissue;
+        PatchScheduler scheduler;
+        if(PatchScheduler::fromPipeline(original, generatorId, scheduler)) {
+            tissue = scheduler.schedule(pyramid, grid, cacheFolder);
+        } else {
+            for(int i = 0; i < grid.getPatchCount(); ++i)
+                tissue.push_back(i);
+        }
+        result.fullPatches = tissue.size();
+        const auto coarseShape = coarseTensor->getShape();
+        const int coarseRows = coarseShape[0];
+        const int coarseColumns = coarseShape[1];
+        const int classes = coarseShape[2];
+        std::vector<uchar> mask(grid.getPatchCount(), 0);
+        {
+            auto access = coarseTensor->getAccess(ACCESS_READ);
+            const float* values = access->getRawData();
+            for(int index : tissue) {
+                const int row = std::min(coarseRows - 1, (index / grid.patchesX)*coarseRows / grid.patchesY);
+                const int column = std::min(coarseColumns - 1, (index % grid.patchesX)*coarseColumns / grid.patchesX);
+                const float* probabilities = &values[(row*coarseColumns + column)*classes];
+                // Tissue the first pass skipped is refined as well
+                const bool refine = sum(probabilities, classes) <= 0 ||
+                        1 - probabilities[argmax(probabilities, classes)] > m_settings.uncertainty ||
+                        (m_settings.normalClass < classes && 1 - probabilities[m_settings.normalClass] > m_settings.positivity);
+                if(refine) {
+                    mask[index] = 1;
+                    ++result.refinedPatches;
+                }
+            }
+        }
+
+        if(result.refinedPatches == 0) {
+            // The result is stored on the grid of the full resolution pipeline, as when patches are refined, so
+            // that results of the cascade and the original pipeline can be compared and overlaid the same way
+            auto values = std::make_unique<float[]>((size_t)grid.patchesY*grid.patchesX*classes);
+            {
+                auto coarseAccess = coarseTensor->getAccess(ACCESS_READ);
+                const float* coarseValues = coarseAccess->getRawData();
+                for(int row = 0; row < grid.patchesY; ++row) {
+                    for(int column = 0; column < grid.patchesX; ++column) {
+                        const int coarseRow = std::min(coarseRows - 1, row*coarseRows / grid.patchesY);
+                        const int coarseColumn = std::min(coarseColumns - 1, column*coarseColumns / grid.patchesX);
+                        std::copy_n(&coarseValues[(coarseRow*coarseColumns + coarseColumn)*classes], classes,
+                                    &values[((size_t)row*grid.patchesX + column)*classes]);
+                    }
+                }
+            }
+            auto resampled = Tensor::create(std::move(values), TensorShape({grid.patchesY, grid.patchesX, classes}));
+            auto spacing = coarseTensor->getSpacing();
+            if(spacing.size() >= 2) {
+                spacing[0] *= (float)coarseRows / grid.patchesY;
+                spacing[1] *= (float)coarseColumns / grid.patchesX;
+                resampled->setSpacing(spacing);
+            }
+            result.pipeline = coarsePipeline;
+            result.data = coarseData;
+            result.data[outputName] = resampled;
+        } else {
+            // Second pass at full resolution, with the selection as the tissue mask of the PatchGenerator.
+            // The mask has one pixel per patch. The region of a patch can straddle neighbouring mask pixels, so a
+            // patch is generated if at least a quarter of it is selected.
+            PipelineRewriter fine = original;
+            fine.addInputData("cascadeMask", "Patches to classify at full resolution");
+            fine.setInput(generatorId, 1, "cascadeMask");
+            fine.setAttribute(generatorId, "mask-threshold", "0.25");
+            const std::string fineFilename = folder.filePath("fine.fpl").toStdString();
+            fine.save(fineFilename);
+            auto maskImage = Image::create(grid.patchesX, grid.patchesY, TYPE_UINT8, 1, mask.data());
+            auto fineData = runPipeline(fineFilename, {{"WSI", pyramid}, {"cascadeMask", maskImage}}, result.pipeline, result.refineSeconds);
+            auto fineTensor = getTensor(fineData, outputName);
+
+            // Cells which weren't refined keep the classification of the first pass
+            const auto fineShape = fineTensor->getShape();
+            if(fineShape[2] != classes)
+                throw Exception("The cascade model has " + std::to_string(classes) + " classes, but the pipeline's model has " + std::to_string(fineShape[2]));
+            auto fineAccess = fineTensor->getAccess(ACCESS_READ_WRITE);
+            float* fineValues = fineAccess->getRawData();
+            auto coarseAccess = coarseTensor->getAccess(ACCESS_READ);
+            const float* coarseValues = coarseAccess->getRawData();
+            for(int row = 0; row < fineShape[0]; ++row) {
+                for(int column = 0; column < fineShape[1]; ++column) {
+                    float* cell = &fineValues[(row*fineShape[1] + column)*classes];
+                    if(sum(cell, classes) > 0)
+                        continue;
+                    const int coarseRow = std::min(coarseRows - 1, row*coarseRows / fineShape[0]);
+                    const int coarseColumn = std::min(coarseColumns - 1, column*coarseColumns / fineShape[1]);
+                    std::copy_n(&coarseValues[(coarseRow*coarseColumns + coarseColumn)*classes], classes, cell);
+                }
+            }
+            result.data = fineData;
+        }
+
+        if(m_settings.validate) {
+            std::shared_ptr<Pipeline> fullPipeline;
+            auto fullData = runPipeline(m_pipelineFilename, {{"WSI", pyramid}}, fullPipeline, result.fullSeconds);
+            auto fullTensor = getTensor(fullData, outputName);
+            auto cascadeTensor = std::dynamic_pointer_cast<Tensor>(result.data.at(outputName));
+            result.fullPatches = countPatches(fullTensor);
+            const auto fullShape = fullTensor->getShape();
+            if(fullShape[2] != classes)
+                throw Exception("The cascade model has " + std::to_string(classes) + " classes, but the pipeline's model has " + std::to_string(fullShape[2]));
+            const auto cascadeShape = cascadeTensor->getShape();
+            auto fullAccess = fullTensor->getAccess(ACCESS_READ);
+            auto cascadeAccess = cascadeTensor->getAccess(ACCESS_READ);
+            const float* fullValues = fullAccess->getRawData();
+            const float* cascadeValues = cascadeAccess->getRawData();
+            int compared = 0, agreeing = 0;
+            for(int row = 0; row < fullShape[0]; ++row) {
+                for(int column = 0; column < fullShape[1]; ++column) {
+                    const float* full = &fullValues[(row*fullShape[1] + column)*classes];
+                    if(sum(full, classes) <= 0)
+                        continue;
+                    const int cascadeRow = std::min(cascadeShape[0] - 1, row*cascadeShape[0] / fullShape[0]);
+                    const int cascadeColumn = std::min(cascadeShape[1] - 1, column*cascadeShape[1] / fullShape[1]);
+                    const float* cascade = &cascadeValues[(cascadeRow*cascadeShape[1] + cascadeColumn)*classes];
+                    ++compared;
+                    agreeing += argmax(full, classes) == argmax(cascade, classes) ? 1 : 0;
+                }
+            }
+            result.agreement = compared > 0 ? (float)agreeing / compared : 1;
+        }
+        Logger::info("CascadeRunner") << result.toString();
+        return result;
+    }
+} // End of namespace fast
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+namespace fast{
+    class ImagePyramid;
+    class DataObject;
+    class Pipeline;
+    class Tensor;
+
+    /**
+     * @brief Settings of a cascaded run of a patch classification pipeline.
+     */
+    class CascadeSettings {
+        public:
+            float magnification = 0; /* Magnification of the first pass, half of the pipeline's if 0 */
+            std::string model; /* Cheaper model for the first pass, the pipeline's model if empty */
+            float uncertainty = 0.3f; /* Re-run regions where 1 - the highest probability is above this */
+            float positivity = 0.5f; /* Re-run regions where 1 - the probability of the normal class is above this */
+            int normalClass = 0;
+            bool validate = false; /* Also run the full pipeline, to measure speed-up and agreement */
+    };
+
+    /**
+     * @brief Outcome of a cascaded run, with the merged pipeline output.
+     */
+    class CascadeResult {
+        public:
+            std::shared_ptr<Pipeline> pipeline; /* Pipeline of the second pass, for saving the results */
+            std::map<std::string, std::shared_ptr<DataObject>> data; /* Merged output */
+            int coarsePatches = 0; /* Patches classified in the first pass */
+            int refinedPatches = 0; /* Patches classified at full resolution in the second pass */
+            int fullPatches = 0; /* Patches a full run classifies */
+            double coarseSeconds = 0;
+            double refineSeconds = 0;
+            double fullSeconds = 0; /* Only measured when validating */
+            float agreement = -1; /* Fraction of tissue cells with the same class as a full run, -1 if not validated */
+
+            std::string toString() const;
+    };
+
+    /**
+     * @brief Runs a patch classification pipeline as a cascade. The slide is first classified at a lower
+     * magnification, or with a cheaper model, and only the regions which are uncertain or not normal are classified
+     * again at the pipeline's magnification. The full resolution classifications replace the first pass ones where
+     * they exist, and the first pass classifications are kept elsewhere.
+     *
+     * The second pass is restricted to the selected regions by replacing the tissue mask of the PatchGenerator with
+     * a mask of the selected patches, so the pipeline itself needs no changes.
+     */
+    class CascadeRunner {
+        public:
+            /**
+             * @param pipelineFilename Pipeline with a single NeuralNetwork classifying the patches of a PatchGenerator,
+             *      stitched by a PatchStitcher.
+             */
+            CascadeRunner(std::string pipelineFilename, CascadeSettings settings = CascadeSettings());
+            /**
+             * @brief isSupported Whether a pipeline can be run as a cascade.
+             */
+            static bool isSupported(const std::string& pipelineFilename);
+            /**
+             * @brief run Run the cascade on a slide, without visualization.
+             * @param cacheFolder Slide cache folder for the tissue patch schedule.
+             */
+            CascadeResult run(std::shared_ptr<ImagePyramid> pyramid, const std::string& cacheFolder = "");
+        private:
+            std::map<std::string, std::shared_ptr<DataObject>> runPipeline(const std::string& filename, std::map<std::string, std::shared_ptr<DataObject>> input, std::shared_ptr<Pipeline>& pipeline, double& seconds) const;
+            static std::shared_ptr<Tensor> getTensor(const std::map<std::string, std::shared_ptr<DataObject>>& data, std::string& name);
+            static int countPatches(const std::shared_ptr<Tensor>& tensor);
+
+            std::string m_pipelineFilename;
+            CascadeSettings m_settings;
+    };
+} // End of namespace fast
@@ -0,0 +1,232 @@
+#include "DistributedRunner.h"
+#include "source/logic/Logger.h"
+#include "source/logic/Project.h"
+#include <FAST/Pipeline.hpp>
+#include <FAST/Utility.hpp>
+#include <QCoreApplication>
+#include <QSysInfo>
+#include <QFile>
+#include <QSaveFile>
+#include <fstream>
+#include <sstream>
+
+namespace fast{
+    namespace {
+        std::string readFile(const std::string& filename) {
+            std::ifstream file(filename);
+            std::stringstream content;
+            content << file.rdbuf();
+            return content.str();
+        }
+
+        std::string getOwner(const std::string& lease) {
+            return lease.substr(0, lease.find('\n'));
+        }
+    }
+
+    std::string DistributedRunner::getWorkerId()
+    {
+        return QSysInfo::machineHostName().toStdString() + "-" + std::to_string(QCoreApplication::applicationPid());
+    }
+
+    DistributedRunner::DistributedRunner(std::shared_ptr<Project> project, std::string pipelineFilename, ExecutionPolicy policy) :
+            m_runner(project, pipelineFilename, policy)
+    {
+        m_project = project;
+        m_worker = getWorkerId();
+        m_folder = join(project->getRootFolder(), "leases", Pipeline(pipelineFilename).getName());
+        createDirectories(m_folder);
+        m_project->setResultStaging(m_worker);
+        m_runner.setSlideClaim([this](const std::string& uid) {
+            return claim(uid);
+        });
+        m_runner.setSlideCallback([this](const std::string& uid, bool success) {
+            release(uid, success);
+            return true;
+        });
+    }
+
+    DistributedRunner::~DistributedRunner()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_stopCondition.notify_all();
+        if(m_heartbeat.joinable())
+            m_heartbeat.join();
+    }
+
+    void DistributedRunner::setCascade(CascadeSettings settings)
+    {
+        m_runner.setCascade(settings);
+    }
+
+    void DistributedRunner::setLeaseTimeout(int seconds)
+    {
+        m_leaseTimeout = std::chrono::seconds(std::max(4, seconds));
+    }
+
+    std::string DistributedRunner::getFilename(const std::string& uid, const std::string& extension) const
+    {
+        return join(m_folder, uid + extension);
+    }
+
+    bool DistributedRunner::isFinished(const std::string& uid) const
+    {
+        return fileExists(getFilename(uid, ".done")) || fileExists(getFilename(uid, ".failed"));
+    }
+
+    int DistributedRunner::run()
+    {
+        Logger::info("DistributedRunner") << "Worker " << m_worker << " processing slides, leases in " << m_folder;
+        if(!m_heartbeat.joinable())
+            m_heartbeat = std::thread(&DistributedRunner::heartbeat, this);
+        int failed = 0;
+        while(true) {
+            std::vector<std::string> remaining;
+            for(const auto& uid : m_project->getAllWsiUids()) {
+                if(!isFinished(uid))
+                    remaining.push_back(uid);
+            }
+            if(remaining.empty())
+                break;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_processed = 0;
+            }
+            failed += m_runner.run(remaining);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            // The remaining slides are processed by other workers, wait for them to finish or for their leases to go stale
+            if(m_processed == 0)
+                m_stopCondition.wait_for(lock, m_leaseTimeout / 4, [this]() { return m_stopped; });
+        }
+        const auto status = getStatus();
+        Logger::info("DistributedRunner") << "Worker " << m_worker << " done, " << failed << " slides failed. Project: " << status.done << " of "
+                  << status.slides << " slides done, " << status.failed << " failed";
+        return failed;
+    }
+
+    bool DistributedRunner::claim(const std::string& uid)
+    {
+        if(isFinished(uid))
+            return false;
+        const std::string filename = getFilename(uid, ".lease");
+        QFile file(QString::fromStdString(filename));
+        // Fails if the lease exists, also on NFS
+        if(file.open(QIODevice::WriteOnly | QIODevice::NewOnly)) {
+            file.write(QByteArray::fromStdString(m_worker + "\n0\n"));
+            file.close();
+            // The slide may have been finished between the check above and creating the lease
+            if(isFinished(uid)) {
+                QFile::remove(QString::fromStdString(filename));
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_leases[uid] = 0;
+            return true;
+        }
+
+        const std::string lease = readFile(filename);
+        if(lease.empty() || !isStale(uid, lease))
+            return false;
+        // Only one worker can move the stale lease away
+        const QString reclaimed = QString::fromStdString(filename + "." + m_worker + ".reclaimed");
+        if(!QFile::rename(QString::fromStdString(filename), reclaimed))
+            return false;
+        if(readFile(reclaimed.toStdString()) != lease) {
+            // Another worker reclaimed the lease and claimed the slide in the meantime
+            QFile::rename(reclaimed, QString::fromStdString(filename));
+            return false;
+        }
+        QFile::remove(reclaimed);
+        Logger::warning("DistributedRunner") << "Worker " << m_worker << " reclaiming " << uid << " from " << getOwner(lease);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_observed.erase(uid);
+        }
+        return claim(uid);
+    }
+
+    bool DistributedRunner::isStale(const std::string& uid, const std::string& lease)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto now = std::chrono::steady_clock::now();
+        auto it = m_observed.find(uid);
+        if(it == m_observed.end() || it->second.first != lease) {
+            m_observed[uid] = std::make_pair(lease, now);
+            return false;
+        }
+        return now - it->second.second > m_leaseTimeout;
+    }
+
+    void DistributedRunner::release(const std::string& uid, bool success)
+    {
+        QSaveFile marker(QString::fromStdString(getFilename(uid, success ? ".done" : ".failed")));
+        if(marker.open(QIODevice::WriteOnly)) {
+            marker.write(QByteArray::fromStdString(m_worker + "\n" + currentDateTime() + "\n"));
+            marker.commit();
+        }
+        // Keeps the heartbeat from renewing the lease after it is removed
+        std::lock_guard<std::mutex> leaseLock(m_leaseFileMutex);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_leases.erase(uid);
+            ++m_processed;
+        }
+        const std::string filename = getFilename(uid, ".lease");
+        if(getOwner(readFile(filename)) == m_worker)
+            QFile::remove(QString::fromStdString(filename));
+    }
+
+    void DistributedRunner::heartbeat()
+    {
+        while(true) {
+            std::map<std::string, int> leases;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if(m_stopCondition.wait_for(lock, m_leaseTimeout / 4, [this]() { return m_stopped; }))
+                    return;
+                for(auto& lease : m_leases)
+                    leases[lease.first] = ++lease.second;
+            }
+            // The lease files may be on slow shared storage, so they are written without holding m_mutex, which
+            // would block claiming and releasing slides
+            std::lock_guard<std::mutex> leaseLock(m_leaseFileMutex);
+            for(const auto& lease : leases) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if(m_leases.count(lease.first) == 0)
+                        continue;
+                }
+                const std::string filename = getFilename(lease.first, ".lease");
+                if(getOwner(readFile(filename)) != m_worker) {
+                    Logger::warning("DistributedRunner") << "Worker " << m_worker << " lost the lease of " << lease.first << ", which may be processed twice";
+                    continue;
+                }
+                // Replaced instead of rewritten, so that other workers never read a partial lease
+                QSaveFile file(QString::fromStdString(filename));
+                if(file.open(QIODevice::WriteOnly)) {
+                    file.write(QByteArray::fromStdString(m_worker + "\n" + std::to_string(lease.second) + "\n"));
+                    file.commit();
+                }
+            }
+        }
+    }
+
+    DistributedRunner::Status DistributedRunner::getStatus() const
+    {
+        Status status;
+        for(const auto& uid : m_project->getAllWsiUids()) {
+            ++status.slides;
+            if(fileExists(getFilename(uid, ".done"))) {
+                ++status.done;
+            } else if(fileExists(getFilename(uid, ".failed"))) {
+                ++status.failed;
+            } else if(fileExists(getFilename(uid, ".lease"))) {
+                ++status.leased;
+            }
+        }
+        return status;
+    }
+} // End of namespace fast
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "source/logic/HeadlessRunner.h"
+
+namespace fast{
+    class Project;
+
+    /**
+     * @brief Runs a pipeline on the slides of a project together with other worker processes, on the same or other
+     * nodes which mount the project folder from shared storage.
+     *
+     * Workers coordinate through files in the leases/<pipeline name>/ folder of the project:
+     *   <uid>.lease    Slide claimed by a worker. Created exclusively, so only one worker can claim a slide, and
+     *                  rewritten by the worker's heartbeat while it processes the slide.
+     *   <uid>.done     Slide processed, its results are in results/<uid>/<pipeline name>/.
+     *   <uid>.failed   Slide failed, and is skipped by all workers. Remove the file to process the slide again.
+     * A lease which hasn't changed for the lease timeout, as measured by the clock of the worker looking at it, is
+     * from a worker which died, and is reclaimed. Since only local clocks are compared, the clocks of the nodes don't
+     * have to be in sync.
+     *
+     * Results are written to a hidden staging folder and moved into place when the slide is done, see
+     * Project::setResultStaging, so that other workers and the GUI never see partial results.
+     */
+    class DistributedRunner {
+        public:
+            /**
+             * @param policy Execution policy of this worker. Each worker processes as many slides at the same time
+             *      as its policy has slots.
+             */
+            DistributedRunner(std::shared_ptr<Project> project, std::string pipelineFilename, ExecutionPolicy policy = ExecutionPolicy::load());
+            ~DistributedRunner();
+            /**
+             * @brief setCascade Run the pipeline as a cascade, see CascadeRunner.
+             */
+            void setCascade(CascadeSettings settings);
+            /**
+             * @brief setLeaseTimeout Time without a heartbeat after which a lease is reclaimed. Leases are renewed four
+             * times per timeout. Default is 5 minutes.
+             */
+            void setLeaseTimeout(int seconds);
+            /**
+             * @brief run Process slides until no slide of the project is left, including the slides claimed by other
+             * workers, so that slides of workers which die are processed by the remaining ones.
+             * @return Number of slides which failed in this worker.
+             */
+            int run();
+
+            struct Status {
+                int slides = 0;
+                int done = 0;
+                int failed = 0;
+                int leased = 0;
+            };
+            /**
+             * @brief getStatus Progress of all workers.
+             */
+            Status getStatus() const;
+            /**
+             * @brief getWorkerId Name of this worker in lease files: host name and process id.
+             */
+            static std::string getWorkerId();
+        private:
+            std::string getFilename(const std::string& uid, const std::string& extension) const;
+            bool isFinished(const std::string& uid) const;
+            /**
+             * Claim a slide, or reclaim it if its lease is stale.
+             */
+            bool claim(const std::string& uid);
+            /**
+             * Mark a slide as done or failed, and remove its lease.
+             */
+            void release(const std::string& uid, bool success);
+            bool isStale(const std::string& uid, const std::string& lease);
+            void heartbeat();
+
+            std::shared_ptr<Project> m_project;
+            HeadlessRunner m_runner;
+            std::string m_worker;
+            std::string m_folder;
+            std::chrono::seconds m_leaseTimeout = std::chrono::seconds(300);
+            std::map<std::string, int> m_leases; /* Heartbeat count of the leases of this worker, indexed by uid */
+            std::map<std::string, std::pair<std::string, std::chrono::steady_clock::time_point>> m_observed; /* Content of leases of other workers, and since when */
+            int m_processed = 0; /* Slides processed in the current pass */
+            bool m_stopped = false;
+            std::thread m_heartbeat;
+            std::condition_variable m_stopCondition;
+            mutable std::mutex m_mutex;
+            std::mutex m_leaseFileMutex; /* Serializes renewing and removing the lease files of this worker */
+    };
+} // End of namespace fast
@@ -0,0 +1,245 @@
+#include "Downloader.h"
+#include "Logger.h"
+#include "ZipExtractor.h"
+#include <FAST/Utility.hpp>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QEventLoop>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <cctype>
+#include <cstdlib>
+
+namespace fast{
+    namespace {
+        const int64_t chunkSize = 1024*1024;
+
+        std::string readFile(const std::string& filename) {
+            std::ifstream file(filename, std::ios::binary);
+            std::stringstream content;
+            content << file.rdbuf();
+            return content.str();
+        }
+
+        void writeFile(const std::string& filename, const std::string& content) {
+            QSaveFile file(QString::fromStdString(filename));
+            if(file.open(QIODevice::WriteOnly)) {
+                file.write(QByteArray::fromStdString(content));
+                file.commit();
+            }
+        }
+    }
+
+    Downloader::Downloader(std::string url, std::string destination)
+    {
+        m_url = url;
+        m_destination = destination;
+        m_name = url.substr(url.rfind('/') + 1);
+    }
+
+    void Downloader::setProgressCallback(std::function<bool(int64_t, int64_t)> callback)
+    {
+        m_progressCallback = callback;
+    }
+
+    std::string Downloader::getDownloadUrl(const std::string& filename)
+    {
+        const char* server = std::getenv("FASTPATHOLOGY_DOWNLOAD_URL");
+        std::string url = server == nullptr ? "http://fast.eriksmistad.no/download/" : server;
+        if(url.back() != '/')
+            url += "/";
+        return url + filename;
+    }
+
+    std::string Downloader::getDownloadFolder()
+    {
+        return join(QDir::homePath().toStdString(), "fastpathology", "downloads");
+    }
+
+    std::string Downloader::get(const std::string& url)
+    {
+        QNetworkAccessManager manager;
+        QNetworkRequest request(QUrl(QString::fromStdString(url)));
+        request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+        std::unique_ptr<QNetworkReply> reply(manager.get(request));
+        QEventLoop loop;
+        QObject::connect(reply.get(), &QNetworkReply::finished, &loop, &QEventLoop::quit);
+        loop.exec();
+        if(reply->error() != QNetworkReply::NoError)
+            return "";
+        return reply->readAll().toStdString();
+    }
+
+    std::map<std::string, std::string> Downloader::parseManifest(const std::string& manifest)
+    {
+        std::map<std::string, std::string> files;
+        std::stringstream stream(manifest);
+        std::string line;
+        while(std::getline(stream, line)) {
+            trim(line);
+            const auto separator = line.find(' ');
+            if(line.empty() || separator == std::string::npos)
+                continue;
+            std::string name = line.substr(separator + 1);
+            trim(name);
+            // Files hashed in binary mode are marked with *
+            if(!name.empty() && name[0] == '*')
+                name = name.substr(1);
+            std::string hash = line.substr(0, separator);
+            for(auto& c : hash)
+                c = std::tolower(c);
+            files[name] = hash;
+        }
+        return files;
+    }
+
+    bool Downloader::isPresent(const std::map<std::string, std::string>& manifest) const
+    {
+        if(manifest.empty())
+            return false;
+        for(const auto& file : manifest) {
+            if(ZipExtractor::getSHA256(join(m_destination, file.first)) != file.second)
+                return false;
+        }
+        return true;
+    }
+
+    void Downloader::run()
+    {
+        createDirectories(getDownloadFolder());
+        const std::string partialFilename = join(getDownloadFolder(), m_name + ".partial");
+        const std::string validatorFilename = partialFilename + ".validator";
+        const std::string manifestFilename = join(getDownloadFolder(), m_name + ".sha256");
+
+        std::string manifestText = get(m_url + ".sha256");
+        if(manifestText.empty()) {
+            Logger::info("Downloader") << "No manifest of " << m_url << " on the server, using the manifest of the previous download";
+            manifestText = readFile(manifestFilename);
+        }
+        const auto manifest = parseManifest(manifestText);
+        if(isPresent(manifest)) {
+            Logger::info("Downloader") << "All " << manifest.size() << " files of " << m_name << " are present in " << m_destination;
+            return;
+        }
+
+        auto extractor = std::make_unique<ZipExtractor>(m_destination, manifest);
+        // Extract the part which was downloaded before
+        int64_t offset = 0;
+        if(fileExists(partialFilename)) {
+            std::ifstream partial(partialFilename, std::ios::binary);
+            std::vector<char> buffer(chunkSize);
+            try {
+                while(partial.read(buffer.data(), chunkSize) || partial.gcount() > 0) {
+                    extractor->write(buffer.data(), partial.gcount());
+                    offset += partial.gcount();
+                }
+                Logger::info("Downloader") << "Resuming download of " << m_name << " after " << offset << " bytes";
+            } catch(Exception& e) {
+                Logger::warning("Downloader") << "Discarding partial download of " << m_name << ": " << e.what();
+                extractor = std::make_unique<ZipExtractor>(m_destination, manifest);
+                offset = 0;
+            }
+        }
+
+        if(!extractor->isFinished()) {
+            std::ofstream partial(partialFilename, std::ios::binary | (offset > 0 ? std::ios::app : std::ios::trunc));
+            if(!partial.is_open())
+                throw Exception("Unable to write " + partialFilename);
+            QNetworkAccessManager manager;
+            QNetworkRequest request(QUrl(QString::fromStdString(m_url)));
+            request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+            if(offset > 0) {
+                request.setRawHeader("Range", QByteArray::fromStdString("bytes=" + std::to_string(offset) + "-"));
+                // The server sends the whole archive instead, if it has changed since the partial download
+                const std::string validator = readFile(validatorFilename);
+                if(!validator.empty())
+                    request.setRawHeader("If-Range", QByteArray::fromStdString(validator));
+            }
+            std::unique_ptr<QNetworkReply> reply(manager.get(request));
+            QEventLoop loop;
+            bool started = false;
+            int64_t received = offset;
+            int64_t total = 0;
+            std::string error;
+            bool corrupt = false;
+            QObject::connect(reply.get(), &QNetworkReply::readyRead, [&]() {
+                try {
+                    if(!started) {
+                        started = true;
+                        const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+                        if(status != 200 && status != 206)
+                            throw Exception("Server replied with HTTP status " + std::to_string(status));
+                        if(status == 200 && offset > 0) {
+                            Logger::info("Downloader") << "Server sent all of " << m_name << ", restarting download";
+                            extractor = std::make_unique<ZipExtractor>(m_destination, manifest);
+                            partial.close();
+                            partial.open(partialFilename, std::ios::binary | std::ios::trunc);
+                            received = 0;
+                        }
+                        QByteArray validator = reply->rawHeader("ETag");
+                        if(validator.isEmpty())
+                            validator = reply->rawHeader("Last-Modified");
+                        writeFile(validatorFilename, validator.toStdString());
+                        const int64_t length = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+                        total = length > 0 ? received + length : 0;
+                    }
+                    const QByteArray data = reply->readAll();
+                    partial.write(data.constData(), data.size());
+                    try {
+                        extractor->write(data.constData(), data.size());
+                    } catch(Exception& e) {
+                        corrupt = true;
+                        throw;
+                    }
+                    received += data.size();
+                    if(m_progressCallback && !m_progressCallback(received, total))
+                        throw Exception("Download of " + m_name + " was canceled");
+                } catch(Exception& e) {
+                    error = e.what();
+                    reply->abort();
+                }
+            });
+            QObject::connect(reply.get(), &QNetworkReply::finished, &loop, &QEventLoop::quit);
+            loop.exec();
+            partial.close();
+            if(corrupt) {
+                // Resuming would extract the same data again
+                QFile::remove(QString::fromStdString(partialFilename));
+            }
+            if(!error.empty())
+                throw Exception(error);
+            if(reply->error() != QNetworkReply::NoError)
+                throw Exception("Download of " + m_url + " failed: " + reply->errorString().toStdString());
+        }
+        extractor->finish();
+        // Files of the manifest which the archive doesn't contain would otherwise only be noticed when used
+        const auto files = extractor->getFiles();
+        std::vector<std::string> missing;
+        for(const auto& file : manifest) {
+            if(files.count(file.first) == 0)
+                missing.push_back(file.first);
+        }
+        if(!missing.empty()) {
+            // The archive is complete, resuming it would extract the same files again
+            QFile::remove(QString::fromStdString(partialFilename));
+            QFile::remove(QString::fromStdString(validatorFilename));
+            throw Exception("The archive " + m_name + " lacks " + std::to_string(missing.size()) + " files of its manifest, such as " + missing.front());
+        }
+
+        // The manifest of this download verifies the files of the next, if the server has no manifest
+        std::stringstream stream;
+        for(const auto& file : files)
+            stream << file.second << "  " << file.first << "\n";
+        writeFile(manifestFilename, stream.str());
+        QFile::remove(QString::fromStdString(partialFilename));
+        QFile::remove(QString::fromStdString(validatorFilename));
+        Logger::info("Downloader") << "Extracted " << files.size() - extractor->getSkippedFiles() << " files of " << m_name
+                  << " to " << m_destination << ", " << extractor->getSkippedFiles() << " were already present";
+    }
+} // End of namespace fast
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <functional>
+#include <cstdint>
+
+namespace fast{
+    /**
+     * @brief Downloads a zip archive and extracts it while it is downloaded, see ZipExtractor.
+     *
+     * Files are verified against the SHA-256 manifest next to the archive on the server, <archive>.sha256 in the
+     * format of sha256sum, if there is one, and otherwise against the manifest of the previous download. Files which
+     * are already present with the SHA-256 of the manifest are not extracted again, and nothing is downloaded if all
+     * files are present.
+     *
+     * The downloaded part of the archive is kept in the downloads folder, so that an interrupted or canceled download
+     * is resumed with an HTTP range request: the kept part is extracted again from disk, and only the rest of the
+     * archive is downloaded. If the server doesn't support range requests, or the archive has changed on the server,
+     * the whole archive is downloaded again.
+     */
+    class Downloader {
+        public:
+            /**
+             * @param url URL of the zip archive.
+             * @param destination Folder to extract the archive to.
+             */
+            Downloader(std::string url, std::string destination);
+            /**
+             * @brief setProgressCallback Called while downloading, from the calling thread.
+             * @param callback Gets the bytes of the archive received, including a resumed part, and the size of the
+             *      archive, 0 if it is not known yet. Returns false to cancel the download.
+             */
+            void setProgressCallback(std::function<bool(int64_t received, int64_t total)> callback);
+            /**
+             * @brief run Download and extract the archive, and wait until it is done. Throws an exception if the
+             * download fails or is canceled, in which case it is resumed by the next run, or if the archive lacks
+             * files of the manifest.
+             */
+            void run();
+            /**
+             * @brief parseManifest Parse a manifest in the format of sha256sum.
+             * @return SHA-256 as lower case hex, by file name.
+             */
+            static std::map<std::string, std::string> parseManifest(const std::string& manifest);
+
+            /**
+             * @brief getDownloadUrl URL of a file on the FastPathology download server. The server can be replaced,
+             * e.g. by a local HTTP server for testing, with the FASTPATHOLOGY_DOWNLOAD_URL environment variable.
+             */
+            static std::string getDownloadUrl(const std::string& filename);
+            /**
+             * @brief getDownloadFolder Folder with the partial downloads and the manifests of previous downloads.
+             */
+            static std::string getDownloadFolder();
+        private:
+            /**
+             * Download a small file, such as the manifest, into memory.
+             * @return The file, or an empty string if it doesn't exist.
+             */
+            static std::string get(const std::string& url);
+            bool isPresent(const std::map<std::string, std::string>& manifest) const;
+
+            std::string m_url;
+            std::string m_destination;
+            std::string m_name; /* File name of the archive */
+            std::function<bool(int64_t, int64_t)> m_progressCallback;
+    };
+} // End of namespace fast
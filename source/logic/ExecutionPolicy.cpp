@@ -0,0 +1,212 @@
+#include "ExecutionPolicy.h"
+#include "Logger.h"
+#include "MemoryMonitor.h"
+#include <FAST/Utility.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <QByteArray>
+#include <QtGlobal>
+#include <map>
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace fast{
+    std::string ExecutionPolicy::getDefaultFilename()
+    {
+        const char* home = std::getenv("HOME");
+        if(home == nullptr)
+            home = std::getenv("USERPROFILE");
+        return join(home == nullptr ? "." : home, "fastpathology", "execution_policy.txt");
+    }
+
+    ExecutionPolicy ExecutionPolicy::load(const std::string& filename)
+    {
+        ExecutionPolicy policy;
+        std::ifstream file(filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            trim(line);
+            if(line.empty() || line[0] == '#')
+                continue;
+            std::stringstream stream(line);
+            std::string name, value;
+            stream >> name >> value;
+            try {
+                if(name == "inference-threads") {
+                    policy.inferenceThreads = std::stoi(value);
+                } else if(name == "concurrent-slides") {
+                    policy.concurrentSlides = std::max(1, std::stoi(value));
+                } else if(name == "decoder-threads") {
+                    policy.decoderThreads = std::max(0, std::stoi(value));
+                } else if(name == "prefetch-patches") {
+                    policy.prefetchPatches = std::max(1, std::stoi(value));
+                } else if(name == "stream-results") {
+                    policy.streamResults = value == "on" || value == "true";
+                } else if(name == "trace") {
+                    policy.trace = value == "on" || value == "true";
+                } else if(name == "memory-budget") {
+                    policy.memoryBudget = value == "off" ? 0 : MemoryMonitor::parseSize(value);
+                } else if(name == "model-precision") {
+                    policy.modelPrecision = value;
+                } else if(name == "cores") {
+                    policy.cores = parseCpuList(value);
+                } else if(name == "numa") {
+                    policy.numa = value;
+                } else {
+                    Logger::warning("ExecutionPolicy") << "Unknown execution policy setting " << name;
+                }
+            } catch(std::exception& e) {
+                Logger::warning("ExecutionPolicy") << "Invalid execution policy setting: " << line;
+            }
+        }
+        return policy;
+    }
+
+    std::vector<int> ExecutionPolicy::parseCpuList(const std::string& list)
+    {
+        std::vector<int> cores;
+        std::stringstream stream(list);
+        std::string range;
+        while(std::getline(stream, range, ',')) {
+            trim(range);
+            if(range.empty())
+                continue;
+            const auto dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for(int core = first; core <= last; ++core)
+                cores.push_back(core);
+        }
+        return cores;
+    }
+
+    std::vector<int> ExecutionPolicy::getNumaNodeCores(int node)
+    {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        std::getline(file, list);
+        return parseCpuList(list);
+    }
+
+    int ExecutionPolicy::getNumaNodeCount()
+    {
+        int nodes = 0;
+        while(isDir("/sys/devices/system/node/node" + std::to_string(nodes)))
+            ++nodes;
+        return nodes;
+    }
+
+    int ExecutionPolicy::getNumaNode(int slot) const
+    {
+        if(numa == "off")
+            return -1;
+        const int nodes = getNumaNodeCount();
+        if(nodes == 0)
+            return -1;
+        if(numa == "auto")
+            return slot % nodes;
+        const int node = std::stoi(numa);
+        return node < nodes ? node : -1;
+    }
+
+    std::vector<int> ExecutionPolicy::getCores(int slot) const
+    {
+        std::vector<int> available = cores;
+        const int node = getNumaNode(slot);
+        int slots = concurrentSlides;
+        if(node >= 0) {
+            // Only the cores of the node, shared by the slots bound to the node
+            const auto nodeCores = getNumaNodeCores(node);
+            if(available.empty()) {
+                available = nodeCores;
+            } else {
+                std::vector<int> intersection;
+                for(int core : available) {
+                    if(std::find(nodeCores.begin(), nodeCores.end(), core) != nodeCores.end())
+                        intersection.push_back(core);
+                }
+                available = intersection;
+            }
+            if(numa == "auto") {
+                const int nodes = getNumaNodeCount();
+                slots = concurrentSlides / nodes + (slot % nodes < concurrentSlides % nodes ? 1 : 0);
+                slot = slot / nodes;
+            }
+        }
+        if(available.empty() || slots <= 1)
+            return available;
+        // Contiguous, equally sized groups of cores, so that a slot shares as few caches as possible with others
+        const int begin = available.size() * slot / slots;
+        const int end = available.size() * (slot + 1) / slots;
+        if(begin == end)
+            return {available[begin % available.size()]};
+        return std::vector<int>(available.begin() + begin, available.begin() + end);
+    }
+
+    void ExecutionPolicy::applyEnvironment() const
+    {
+        // Variables set by the user are restored by a policy without thread count, e.g. when the GUI goes back to
+        // the default thread count
+        static const std::map<std::string, QByteArray> original = []() {
+            std::map<std::string, QByteArray> variables;
+            for(const char* name : {"OMP_NUM_THREADS", "TF_NUM_INTRAOP_THREADS", "TF_NUM_INTEROP_THREADS"}) {
+                if(qEnvironmentVariableIsSet(name))
+                    variables[name] = qgetenv(name);
+            }
+            return variables;
+        }();
+        const QByteArray threads = QByteArray::number(inferenceThreads);
+        // qputenv is serialized with Qt's own environment access, e.g. QDir::homePath in the logger thread
+        for(const auto& variable : std::map<std::string, QByteArray>{{"OMP_NUM_THREADS", threads}, {"TF_NUM_INTRAOP_THREADS", threads}, {"TF_NUM_INTEROP_THREADS", "1"}}) {
+            const char* name = variable.first.c_str();
+            if(inferenceThreads > 0)
+                qputenv(name, variable.second);
+            else if(original.count(variable.first) > 0)
+                qputenv(name, original.at(variable.first));
+            else
+                qunsetenv(name);
+        }
+    }
+
+    void ExecutionPolicy::apply(int slot) const
+    {
+#ifdef __linux__
+        const auto slotCores = getCores(slot);
+        if(!slotCores.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for(int core : slotCores)
+                CPU_SET(core, &set);
+            if(sched_setaffinity(0, sizeof(set), &set) != 0)
+                Logger::warning("ExecutionPolicy") << "Unable to pin thread to cores of execution slot " << slot;
+        }
+        const int node = getNumaNode(slot);
+        if(node >= 0 && node < 64) {
+            // set_mempolicy(MPOL_PREFERRED) through the system call, to avoid a dependency on libnuma. Preferred
+            // instead of bind, so that allocations fall back to other nodes instead of failing when a node is full.
+            const int MPOL_PREFERRED_MODE = 1;
+            unsigned long mask = 1UL << node;
+            if(syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, &mask, sizeof(mask)*8) != 0)
+                Logger::warning("ExecutionPolicy") << "Unable to bind execution slot " << slot << " to NUMA node " << node;
+        }
+#endif
+    }
+
+    std::string ExecutionPolicy::toString() const
+    {
+        std::stringstream stream;
+        stream << "inference-threads " << inferenceThreads << ", concurrent-slides " << concurrentSlides
+               << ", decoder-threads " << decoderThreads << ", prefetch-patches " << prefetchPatches
+               << ", stream-results " << (streamResults ? "on" : "off") << ", trace " << (trace ? "on" : "off")
+               << ", memory-budget " << (memoryBudget > 0 ? MemoryMonitor::formatSize(memoryBudget) : "off")
+               << ", model-precision " << (modelPrecision.empty() ? "pipeline" : modelPrecision)
+               << ", cores " << (cores.empty() ? "all" : std::to_string(cores.size())) << ", numa " << numa;
+        return stream.str();
+    }
+} // End of namespace fast
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace fast{
+    /**
+     * @brief How the threads of a pipeline run are placed on the CPUs: thread counts, core pinning and NUMA node
+     * binding. Each concurrently processed slide gets its own slot, with its own cores and NUMA node, so that the
+     * slot threads and the patch generator and decoder threads they start don't compete for the same cores and
+     * memory bandwidth. Thread pools which inference engines share across the process are created once, and are not
+     * placed per slot, but the thread count of each network is set when its model is loaded.
+     *
+     * The policy is read from execution_policy.txt in the fastpathology folder, with one setting per line:
+     *   inference-threads 8    Threads of each network's inference engine, 0 for the engine default
+     *   concurrent-slides 2    Number of slides processed at the same time by the headless runner
+     *   decoder-threads 2      Threads warming the slide caches ahead of each patch generator, see
+     *                          PatchPrefetcher. 0, the default, disables prefetching
+     *   prefetch-patches 16    Maximum number of patches read ahead of each patch generator
+     *   stream-results on      Stitch segmentations to disk while the pipeline runs, see StreamingStitcher
+     *   trace on               Write a timeline of each run to the traces folder, see Tracer
+     *   memory-budget 24G      Memory of the process, as a size or a percentage of the physical memory, see
+     *                          MemoryBudget. Concurrent slides wait while it is used, and idle slides are closed
+     *   model-precision int8   Run the fp16 or int8 variants of the models, see ModelQuantizer. Overrides the
+     *                          model-precision attribute of the pipelines, and fp32 runs the original models
+     *   cores 0-15,32-47       Cores to run on, split evenly between the slots. All cores if not set
+     *   numa auto              Bind each slot to a NUMA node, round robin. A node number binds all slots to that
+     *                          node, and off disables NUMA binding
+     * Core pinning and NUMA binding are only supported on Linux.
+     */
+    class ExecutionPolicy {
+        public:
+            int inferenceThreads = 0;
+            int concurrentSlides = 1;
+            int decoderThreads = 0;
+            int prefetchPatches = 16;
+            bool streamResults = false;
+            bool trace = false;
+            int64_t memoryBudget = 0; /* Bytes, 0 for no budget */
+            std::string modelPrecision; /* fp32, fp16 or int8, the pipeline's choice if empty */
+            std::vector<int> cores;
+            std::string numa = "off";
+
+            /**
+             * @brief load Read a policy file. Settings not in the file keep their default.
+             */
+            static ExecutionPolicy load(const std::string& filename = getDefaultFilename());
+            static std::string getDefaultFilename();
+
+            /**
+             * @brief getNumaNode NUMA node of a slot.
+             * @return The node, or -1 if the slot isn't bound to a node.
+             */
+            int getNumaNode(int slot) const;
+            /**
+             * @brief getCores Cores of a slot.
+             * @return The cores, empty if the slot may run on all cores.
+             */
+            std::vector<int> getCores(int slot) const;
+            /**
+             * @brief apply Pin the calling thread to the cores of a slot, and prefer memory of its NUMA node.
+             * Threads created afterwards by the calling thread, e.g. the patch generator and patch decoder threads,
+             * inherit the placement. Must be called before the pipeline is parsed. Only affects the calling thread,
+             * so it may be called from several slot threads at the same time.
+             */
+            void apply(int slot) const;
+            /**
+             * @brief applyEnvironment Set the thread count environment variables of the engines which only read
+             * their thread count from the environment, such as TensorFlow, or restore the variables of the user
+             * if the policy has no thread count. The environment is shared by the whole process, so this is called
+             * at startup, before any pipeline thread is started, and only affects engines created afterwards.
+             */
+            void applyEnvironment() const;
+            std::string toString() const;
+
+            /**
+             * @brief parseCpuList Parse a list of cores such as 0-3,8,10-11, as used by Linux.
+             */
+            static std::vector<int> parseCpuList(const std::string& list);
+        private:
+            /**
+             * Cores of a NUMA node, as reported by Linux.
+             */
+            static std::vector<int> getNumaNodeCores(int node);
+            static int getNumaNodeCount();
+    };
+} // End of namespace fast
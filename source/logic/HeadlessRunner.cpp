@@ -0,0 +1,202 @@
+#include "HeadlessRunner.h"
+#include "source/logic/Logger.h"
+#include "source/logic/Project.h"
+#include "source/logic/PatchPrefetcher.h"
+#include "source/logic/PatchScheduler.h"
+#include "source/logic/PipelineRewriter.h"
+#include "source/logic/StreamingStitcher.h"
+#include "source/logic/Tracer.h"
+#include "source/logic/MemoryMonitor.h"
+#include "source/logic/PipelineRuntimeHistory.h"
+#include "source/logic/ModelQuantizer.h"
+#include <FAST/Pipeline.hpp>
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Utility.hpp>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+namespace fast{
+    // Opening and closing slides and the result bookkeeping of the project are not thread safe. Results are
+    // exported to a folder of their own per slide, so exports of several slides run at the same time.
+    static std::mutex projectMutex;
+
+    HeadlessRunner::HeadlessRunner(std::shared_ptr<Project> project, std::string pipelineFilename, ExecutionPolicy policy)
+    {
+        m_project = project;
+        m_pipelineFilename = pipelineFilename;
+        m_policy = policy;
+        PipelineRewriter rewriter(pipelineFilename);
+        const std::string precision = ModelQuantizer::getPrecision(rewriter, policy.modelPrecision);
+        if(ModelQuantizer::selectPrecision(rewriter, precision)) {
+            // The pipeline name is kept, so results are stored as for the original pipeline
+            m_pipelineFilename = join(m_preparedPipelineFolder.path().toStdString(), getFileName(pipelineFilename));
+            rewriter.save(m_pipelineFilename);
+            Logger::info("HeadlessRunner") << "Running the " << precision << " variants of the models";
+        }
+        m_memoryBudget = std::make_unique<MemoryBudget>(policy.memoryBudget);
+        m_memoryBudget->setEvictor([this](int64_t bytes) {
+            std::lock_guard<std::mutex> lock(projectMutex);
+            return m_project->evictIdleImages(bytes);
+        });
+    }
+
+    void HeadlessRunner::setCascade(CascadeSettings settings)
+    {
+        if(!CascadeRunner::isSupported(m_pipelineFilename))
+            throw Exception("Cascade mode requires a pipeline with a single patch classifier");
+        m_cascade = true;
+        m_cascadeSettings = settings;
+    }
+
+    void HeadlessRunner::setSlideCallback(std::function<bool(const std::string&, bool)> callback)
+    {
+        m_slideCallback = callback;
+    }
+
+    void HeadlessRunner::setSlideClaim(std::function<bool(const std::string&)> claim)
+    {
+        m_slideClaim = claim;
+    }
+
+    int HeadlessRunner::run(std::vector<std::string> uids)
+    {
+        if(uids.empty())
+            uids = m_project->getAllWsiUids();
+        const int slots = std::min<int>(m_policy.concurrentSlides, uids.size());
+        Logger::info("HeadlessRunner") << "Processing " << uids.size() << " slides with execution policy: " << m_policy.toString();
+        m_pipelineName = Pipeline(m_pipelineFilename).getName();
+        m_peakMemory = PipelineRuntimeHistory().getPeakMemory(m_pipelineName);
+        const int64_t traceStart = m_policy.trace ? Tracer::start() : -1;
+
+        std::atomic_int next(0);
+        std::atomic_int failed(0);
+        std::atomic_bool stopped(false);
+        std::vector<std::thread> threads;
+        for(int slot = 0; slot < slots; ++slot) {
+            threads.emplace_back([this, slot, &uids, &next, &failed, &stopped]() {
+                // Must happen before any pipeline is created, so that its threads inherit the placement
+                m_policy.apply(slot);
+                Tracer::setThreadName("Slot " + std::to_string(slot));
+                for(int i = next++; i < uids.size() && !stopped; i = next++) {
+                    if(m_slideClaim && !m_slideClaim(uids[i]))
+                        continue;
+                    const bool success = processSlide(uids[i], slot);
+                    if(!success)
+                        ++failed;
+                    if(m_slideCallback && !m_slideCallback(uids[i], success))
+                        stopped = true;
+                }
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+        Logger::info("HeadlessRunner") << "Done processing " << uids.size() << " slides, " << failed << " failed. Memory: "
+                  << MemoryMonitor::formatSize(MemoryMonitor::getResidentMemory()) << " used, " << MemoryMonitor::formatSize(m_peakMemory)
+                  << " per slide, " << MemoryMonitor::formatSize(m_project->getOpenImageMemory()) << " of open slides";
+        if(m_policy.trace)
+            Tracer::stop(traceStart, Tracer::getTraceFilename(m_pipelineName));
+        return failed;
+    }
+
+    bool HeadlessRunner::processSlide(const std::string& uid, int slot)
+    {
+        Logger::info("HeadlessRunner") << "Slot " << slot << ": processing " << uid;
+        MemoryReservation reservation(*m_memoryBudget, m_peakMemory);
+        // The memory of a slide is only known if no other slide was processed at the same time
+        bool alone = ++m_activeSlides == 1;
+        MemoryMonitor memory;
+        auto start = std::chrono::high_resolution_clock::now();
+        std::shared_ptr<Pipeline> pipeline;
+        TraceSpan slideSpan("pipeline", "slide");
+        try {
+            std::shared_ptr<WholeSlideImage> image;
+            std::string cacheFolder;
+            {
+                std::lock_guard<std::mutex> lock(projectMutex);
+                image = m_project->getImage(uid);
+                cacheFolder = m_project->getSlideCacheFolder(uid);
+            }
+            std::map<std::string, std::shared_ptr<DataObject>> data;
+            std::vector<std::string> streamed;
+            int patches = 0;
+            std::chrono::duration<float> runtime(0);
+            if(m_cascade) {
+                auto result = CascadeRunner(m_pipelineFilename, m_cascadeSettings).run(image->get_image_pyramid(), cacheFolder);
+                pipeline = result.pipeline;
+                data = result.data;
+            } else {
+                {
+                    TraceSpan span("pipeline", "parse");
+                    pipeline = std::make_shared<Pipeline>(m_pipelineFilename);
+                    pipeline->parse({{"WSI", image->get_image_pyramid()}}, {}, false);
+                }
+                Tracer::watch(pipeline);
+                try {
+                    patches = PatchScheduler::countPatches(m_pipelineFilename, image->get_image_pyramid(), cacheFolder);
+                } catch(std::exception& e) {
+                    patches = 0;
+                }
+                const auto runStart = std::chrono::steady_clock::now();
+                auto prefetchers = PatchPrefetcher::attach(pipeline, m_pipelineFilename, image->get_image_pyramid(),
+                                                           m_policy.decoderThreads, m_policy.prefetchPatches, cacheFolder);
+                // Segmentations are stitched to disk, if all outputs of the pipeline can be
+                PipelineRewriter rewriter(m_pipelineFilename);
+                const auto streamable = StreamingStitcher::getStreamableOutputs(rewriter);
+                if(m_policy.streamResults && !streamable.empty() && streamable.size() == rewriter.getPipelineOutputs().size()) {
+                    std::map<std::string, std::string> filenames;
+                    {
+                        std::lock_guard<std::mutex> lock(projectMutex);
+                        for(const auto& output : streamable) {
+                            filenames[output.first] = m_project->getResultFilename(uid, pipeline->getName(), output.first, ".tiff");
+                            streamed.push_back(output.first);
+                        }
+                    }
+                    StreamingStitcher::stream(pipeline, rewriter, filenames);
+                } else {
+                    TraceSpan span("pipeline", "run");
+                    data = pipeline->getAllPipelineOutputData();
+                }
+                runtime = std::chrono::steady_clock::now() - runStart;
+                for(auto prefetcher : prefetchers) {
+                    prefetcher->stop();
+                    Logger::debug("HeadlessRunner") << "Slot " << slot << ": patch prefetch: " << prefetcher->getStatistics().toString();
+                }
+            }
+            {
+                TraceSpan span("export", "save results");
+                if(streamed.empty()) {
+                    m_project->saveResults(uid, pipeline, data);
+                } else {
+                    m_project->saveStreamedResults(uid, pipeline, streamed);
+                }
+            }
+            std::lock_guard<std::mutex> lock(projectMutex);
+            m_project->commitResults(uid, pipeline->getName());
+            // Runs of slides processed at the same time slow each other down, so like the peak memory, only the
+            // time per patch of a slide processed alone is recorded. Cascade runs read fewer patches.
+            if(patches > 0 && m_activeSlides == 1 && alone)
+                PipelineRuntimeHistory().record(m_pipelineName, patches, runtime.count());
+        } catch(std::exception& e) {
+            --m_activeSlides;
+            Logger::error("HeadlessRunner") << "Slot " << slot << ": failed to process " << uid << ": " << e.what();
+            if(pipeline) {
+                std::lock_guard<std::mutex> lock(projectMutex);
+                m_project->discardResults(uid, pipeline->getName());
+            }
+            return false;
+        }
+        memory.stop();
+        alone = m_activeSlides-- == 1 && alone;
+        std::chrono::duration<double> runtime = std::chrono::high_resolution_clock::now() - start;
+        Logger::info("HeadlessRunner") << "Slot " << slot << ": done processing " << uid << " in " << runtime.count() << " s, peak memory "
+                  << MemoryMonitor::formatSize(memory.getPeak()) << ", " << MemoryMonitor::formatSize(memory.getPeakIncrease()) << " for the slide";
+        if(alone && memory.getPeakIncrease() > m_peakMemory) {
+            m_peakMemory = memory.getPeakIncrease();
+            std::lock_guard<std::mutex> lock(projectMutex);
+            PipelineRuntimeHistory().recordMemory(m_pipelineName, memory.getPeakIncrease());
+        }
+        return true;
+    }
+} // End of namespace fast
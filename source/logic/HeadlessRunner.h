@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <QTemporaryDir>
+#include "source/logic/ExecutionPolicy.h"
+#include "source/logic/CascadeRunner.h"
+#include "source/logic/MemoryBudget.h"
+
+namespace fast{
+    class Project;
+
+    /**
+     * @brief Runs a pipeline on the slides of a project without the GUI, and stores the results in the project.
+     * Slides are processed concurrently, one per slot of the execution policy, each slot pinned to its own cores
+     * and NUMA node. A slide only starts when the memory the pipeline needed before fits the memory budget of the
+     * policy, see MemoryBudget. The models run with the precision of the policy or pipeline, see ModelQuantizer.
+     */
+    class HeadlessRunner {
+        public:
+            HeadlessRunner(std::shared_ptr<Project> project, std::string pipelineFilename, ExecutionPolicy policy = ExecutionPolicy::load());
+            /**
+             * @brief run Process slides and wait until all are done.
+             * @param uids Slides to process, all slides of the project if empty.
+             * @return Number of slides which failed.
+             */
+            int run(std::vector<std::string> uids = {});
+            /**
+             * @brief setCascade Run the pipeline as a cascade, see CascadeRunner.
+             */
+            void setCascade(CascadeSettings settings);
+            /**
+             * @brief setSlideCallback Called after each slide, from the thread which processed it, so possibly from
+             * several threads at the same time.
+             * @param callback Gets the uid of the slide and whether it was processed. Returns false to stop processing
+             *      further slides.
+             */
+            void setSlideCallback(std::function<bool(const std::string& uid, bool success)> callback);
+            /**
+             * @brief setSlideClaim Called before each slide, from the thread which is to process it.
+             * @param claim Gets the uid of the slide. Returns false to skip the slide, e.g. because another process
+             *      has claimed it.
+             */
+            void setSlideClaim(std::function<bool(const std::string& uid)> claim);
+        private:
+            bool processSlide(const std::string& uid, int slot);
+
+            std::shared_ptr<Project> m_project;
+            std::string m_pipelineFilename;
+            QTemporaryDir m_preparedPipelineFolder; /* Pipeline with the model variants of the selected precision */
+            ExecutionPolicy m_policy;
+            bool m_cascade = false;
+            CascadeSettings m_cascadeSettings;
+            std::function<bool(const std::string&, bool)> m_slideCallback;
+            std::function<bool(const std::string&)> m_slideClaim;
+            std::string m_pipelineName;
+            std::unique_ptr<MemoryBudget> m_memoryBudget;
+            std::atomic<int64_t> m_peakMemory{0}; /* Memory a slide needs, 0 if unknown */
+            std::atomic_int m_activeSlides{0};
+    };
+} // End of namespace fast
@@ -0,0 +1,275 @@
+#include "HeatmapFile.h"
+#include "Tracer.h"
+#include <FAST/Data/Tensor.hpp>
+#include <FAST/Utility.hpp>
+#include <hdf5.h>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <mutex>
+
+namespace fast{
+    namespace {
+        /**
+         * The HDF5 library is not built thread safe, and heatmaps are read by the slide prefetcher and the GUI, and
+         * written by the pipeline threads. Errors are reported with exceptions, so HDF5's own printing is disabled.
+         */
+        std::recursive_mutex& getHDF5Mutex() {
+            static std::recursive_mutex mutex;
+            static std::once_flag initialized;
+            std::call_once(initialized, []() {
+                H5Eset_auto(H5E_DEFAULT, nullptr, nullptr);
+            });
+            return mutex;
+        }
+
+        void check(herr_t status, const std::string& message) {
+            if(status < 0)
+                throw Exception(message);
+        }
+
+        void writeDataset(hid_t file, const std::string& name, const std::vector<hsize_t>& dims, const float* data, int chunkSize) {
+            hid_t space = H5Screate_simple(dims.size(), dims.data(), nullptr);
+            hid_t properties = H5Pcreate(H5P_DATASET_CREATE);
+            if(chunkSize > 0) {
+                std::vector<hsize_t> chunk = dims;
+                for(int i = 0; i < std::min<int>(2, chunk.size()); ++i)
+                    chunk[i] = std::min<hsize_t>(chunk[i], chunkSize);
+                H5Pset_chunk(properties, chunk.size(), chunk.data());
+                // Filters of plugins, e.g. zstd, would make the file unreadable without the plugin, also for FAST's
+                // HDF5TensorImporter, so only the built-in deflate is used
+                if(H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0) {
+                    // Probabilities compress much better with their bytes grouped
+                    H5Pset_shuffle(properties);
+                    H5Pset_deflate(properties, 1);
+                }
+            }
+            hid_t dataset = H5Dcreate2(file, name.c_str(), H5T_NATIVE_FLOAT, space, H5P_DEFAULT, properties, H5P_DEFAULT);
+            H5Pclose(properties);
+            H5Sclose(space);
+            if(dataset < 0)
+                throw Exception("Unable to create dataset " + name);
+            const herr_t status = H5Dwrite(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
+            H5Dclose(dataset);
+            check(status, "Unable to write dataset " + name);
+        }
+
+        bool hasCell(const float* values, int classes) {
+            for(int i = 0; i < classes; ++i) {
+                if(values[i] > 0)
+                    return true;
+            }
+            return false;
+        }
+    }
+
+    std::string HeatmapStatistics::toString() const
+    {
+        std::stringstream stream;
+        stream << cells << " cells";
+        for(size_t i = 0; i < meanProbability.size(); ++i)
+            stream << ", class " << i << ": mean " << std::setprecision(3) << meanProbability[i] << " fraction " << fraction[i];
+        return stream.str();
+    }
+
+    void HeatmapFile::write(const std::string& filename, std::shared_ptr<Tensor> tensor, int chunkSize, int overviewSize)
+    {
+        TraceSpan span("export", "write heatmap");
+        const auto shape = tensor->getShape();
+        std::vector<hsize_t> dims;
+        for(int i = 0; i < shape.getNrOfDimensions(); ++i)
+            dims.push_back(shape[i]);
+        std::lock_guard<std::recursive_mutex> lock(getHDF5Mutex());
+        hid_t file = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        if(file < 0)
+            throw Exception("Unable to create HDF5 file " + filename);
+        try {
+            auto access = tensor->getAccess(ACCESS_READ);
+            const float* values = access->getRawData();
+            writeDataset(file, "tensor", dims, values, chunkSize);
+            const auto spacing = tensor->getSpacing();
+            writeDataset(file, "spacing", {(hsize_t)spacing.size()}, spacing.data(), 0);
+
+            if(dims.size() == 3 && std::max(shape[0], shape[1]) > overviewSize) {
+                // Mean of the cells with tissue in each block, so that the border of the tissue doesn't fade
+                const int tensorRows = shape[0];
+                const int tensorColumns = shape[1];
+                int factor = 2;
+                while((std::max(tensorRows, tensorColumns) + factor - 1) / factor > overviewSize)
+                    factor *= 2;
+                const int rows = (tensorRows + factor - 1) / factor;
+                const int columns = (tensorColumns + factor - 1) / factor;
+                const int classes = shape[2];
+                std::vector<float> overview(rows*columns*classes, 0);
+                std::vector<int> counts(rows*columns, 0);
+                for(int row = 0; row < tensorRows; ++row) {
+                    for(int column = 0; column < tensorColumns; ++column) {
+                        const float* cell = &values[((size_t)row*tensorColumns + column)*classes];
+                        if(!hasCell(cell, classes))
+                            continue;
+                        const int index = (row / factor)*columns + column / factor;
+                        for(int i = 0; i < classes; ++i)
+                            overview[index*classes + i] += cell[i];
+                        ++counts[index];
+                    }
+                }
+                for(int index = 0; index < rows*columns; ++index) {
+                    for(int i = 0; counts[index] > 0 && i < classes; ++i)
+                        overview[index*classes + i] /= counts[index];
+                }
+                writeDataset(file, "overview", {(hsize_t)rows, (hsize_t)columns, (hsize_t)classes}, overview.data(), chunkSize);
+                hid_t dataset = H5Dopen2(file, "overview", H5P_DEFAULT);
+                hid_t space = H5Screate(H5S_SCALAR);
+                hid_t attribute = H5Acreate2(dataset, "downsampling", H5T_NATIVE_INT, space, H5P_DEFAULT, H5P_DEFAULT);
+                H5Awrite(attribute, H5T_NATIVE_INT, &factor);
+                H5Aclose(attribute);
+                H5Sclose(space);
+                H5Dclose(dataset);
+            }
+        } catch(Exception& e) {
+            H5Fclose(file);
+            throw;
+        }
+        H5Fclose(file);
+    }
+
+    HeatmapFile::HeatmapFile(std::string filename)
+    {
+        m_filename = filename;
+        std::lock_guard<std::recursive_mutex> lock(getHDF5Mutex());
+        m_file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if(m_file < 0)
+            throw Exception("Unable to open HDF5 file " + filename);
+        hid_t dataset = H5Dopen2(m_file, "tensor", H5P_DEFAULT);
+        if(dataset < 0) {
+            H5Fclose(m_file);
+            throw Exception("No tensor in " + filename);
+        }
+        hid_t space = H5Dget_space(dataset);
+        std::vector<hsize_t> dims(H5Sget_simple_extent_ndims(space));
+        H5Sget_simple_extent_dims(space, dims.data(), nullptr);
+        m_shape.assign(dims.begin(), dims.end());
+        H5Sclose(space);
+        H5Dclose(dataset);
+        if(H5Lexists(m_file, "overview", H5P_DEFAULT) > 0) {
+            hid_t overview = H5Dopen2(m_file, "overview", H5P_DEFAULT);
+            hid_t attribute = H5Aopen(overview, "downsampling", H5P_DEFAULT);
+            if(attribute >= 0) {
+                H5Aread(attribute, H5T_NATIVE_INT, &m_overviewFactor);
+                H5Aclose(attribute);
+            }
+            H5Dclose(overview);
+        }
+    }
+
+    HeatmapFile::~HeatmapFile()
+    {
+        std::lock_guard<std::recursive_mutex> lock(getHDF5Mutex());
+        H5Fclose(m_file);
+    }
+
+    std::shared_ptr<Tensor> HeatmapFile::readDataset(const std::string& name, float spacingScale)
+    {
+        std::lock_guard<std::recursive_mutex> lock(getHDF5Mutex());
+        hid_t dataset = H5Dopen2(m_file, name.c_str(), H5P_DEFAULT);
+        if(dataset < 0)
+            throw Exception("No dataset " + name + " in " + m_filename);
+        hid_t space = H5Dget_space(dataset);
+        std::vector<hsize_t> dims(H5Sget_simple_extent_ndims(space));
+        H5Sget_simple_extent_dims(space, dims.data(), nullptr);
+        H5Sclose(space);
+        std::vector<int> shape(dims.begin(), dims.end());
+        const TensorShape tensorShape(shape);
+        auto values = std::make_unique<float[]>(tensorShape.getTotalSize());
+        const herr_t status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.get());
+        H5Dclose(dataset);
+        check(status, "Unable to read dataset " + name + " from " + m_filename);
+        auto tensor = Tensor::create(std::move(values), tensorShape);
+
+        if(H5Lexists(m_file, "spacing", H5P_DEFAULT) > 0) {
+            auto spacing = tensor->getSpacing();
+            hid_t spacingDataset = H5Dopen2(m_file, "spacing", H5P_DEFAULT);
+            hid_t spacingSpace = H5Dget_space(spacingDataset);
+            if(H5Sget_simple_extent_npoints(spacingSpace) == (hssize_t)spacing.size()) {
+                H5Dread(spacingDataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, spacing.data());
+                // Only the spatial dimensions are downsampled
+                for(int i = 0; i < std::min(2, (int)spacing.size()); ++i)
+                    spacing[i] *= spacingScale;
+                tensor->setSpacing(spacing);
+            }
+            H5Sclose(spacingSpace);
+            H5Dclose(spacingDataset);
+        }
+        return tensor;
+    }
+
+    std::shared_ptr<Tensor> HeatmapFile::read()
+    {
+        return readDataset("tensor", 1);
+    }
+
+    std::shared_ptr<Tensor> HeatmapFile::readOverview()
+    {
+        if(!hasOverview())
+            return read();
+        return readDataset("overview", m_overviewFactor);
+    }
+
+    std::vector<float> HeatmapFile::readRegion(int row, int column, int rows, int columns)
+    {
+        if(m_shape.size() != 3)
+            throw Exception("Regions can only be read from heatmaps with rows, columns and classes");
+        rows = std::min(rows, m_shape[0] - row);
+        columns = std::min(columns, m_shape[1] - column);
+        if(row < 0 || column < 0 || rows <= 0 || columns <= 0)
+            throw Exception("Region is outside of the heatmap " + m_filename);
+        const hsize_t offset[3] = {(hsize_t)row, (hsize_t)column, 0};
+        const hsize_t count[3] = {(hsize_t)rows, (hsize_t)columns, (hsize_t)m_shape[2]};
+        std::vector<float> values((size_t)rows*columns*m_shape[2]);
+        std::lock_guard<std::recursive_mutex> lock(getHDF5Mutex());
+        hid_t dataset = H5Dopen2(m_file, "tensor", H5P_DEFAULT);
+        hid_t space = H5Dget_space(dataset);
+        H5Sselect_hyperslab(space, H5S_SELECT_SET, offset, nullptr, count, nullptr);
+        hid_t memory = H5Screate_simple(3, count, nullptr);
+        const herr_t status = H5Dread(dataset, H5T_NATIVE_FLOAT, memory, space, H5P_DEFAULT, values.data());
+        H5Sclose(memory);
+        H5Sclose(space);
+        H5Dclose(dataset);
+        check(status, "Unable to read region from " + m_filename);
+        return values;
+    }
+
+    void HeatmapFile::forEachChunk(std::function<void(int, int, int, int, const float*)> callback, int chunkSize)
+    {
+        for(int row = 0; row < m_shape[0]; row += chunkSize) {
+            for(int column = 0; column < m_shape[1]; column += chunkSize) {
+                const auto values = readRegion(row, column, chunkSize, chunkSize);
+                callback(row, column, std::min(chunkSize, m_shape[0] - row), std::min(chunkSize, m_shape[1] - column), values.data());
+            }
+        }
+    }
+
+    HeatmapStatistics HeatmapFile::computeStatistics()
+    {
+        HeatmapStatistics statistics;
+        const int classes = m_shape.size() == 3 ? m_shape[2] : 0;
+        statistics.meanProbability.resize(classes, 0);
+        statistics.fraction.resize(classes, 0);
+        forEachChunk([&](int row, int column, int rows, int columns, const float* values) {
+            for(int index = 0; index < rows*columns; ++index) {
+                const float* cell = &values[index*classes];
+                if(!hasCell(cell, classes))
+                    continue;
+                ++statistics.cells;
+                for(int i = 0; i < classes; ++i)
+                    statistics.meanProbability[i] += cell[i];
+                statistics.fraction[std::max_element(cell, cell + classes) - cell] += 1;
+            }
+        });
+        for(int i = 0; statistics.cells > 0 && i < classes; ++i) {
+            statistics.meanProbability[i] /= statistics.cells;
+            statistics.fraction[i] /= statistics.cells;
+        }
+        return statistics;
+    }
+} // End of namespace fast
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+namespace fast{
+    class Tensor;
+
+    /**
+     * @brief Class statistics of a heatmap, over the cells with tissue, i.e. with any probabilities.
+     */
+    class HeatmapStatistics {
+        public:
+            int64_t cells = 0; /* Number of cells with tissue */
+            std::vector<double> meanProbability; /* Per class */
+            std::vector<double> fraction; /* Per class, fraction of the cells where the class is the most probable */
+
+            std::string toString() const;
+    };
+
+    /**
+     * @brief Heatmap tensors stored in HDF5, readable by the HDF5TensorImporter: a "tensor" dataset of
+     * rows x columns x classes, and the tensor's "spacing". The tensor is stored in compressed spatial chunks, so
+     * that regions of it can be read without reading the whole tensor. Heatmaps larger than the overview size
+     * also get an "overview" dataset, with the mean of blocks of cells, which is all that is read for display.
+     *
+     * Chunks are compressed with shuffle and deflate, which every HDF5 library can read without filter plugins.
+     * All HDF5 calls of the class are serialized, since the HDF5 library shipped with FAST isn't thread safe.
+     */
+    class HeatmapFile {
+        public:
+            /**
+             * @brief write Store a tensor, replacing the file if it exists.
+             * @param chunkSize Rows and columns of each chunk.
+             * @param overviewSize Largest number of rows and columns of the overview. Heatmaps which fit get no overview.
+             */
+            static void write(const std::string& filename, std::shared_ptr<Tensor> tensor, int chunkSize = 64, int overviewSize = 512);
+
+            HeatmapFile(std::string filename);
+            ~HeatmapFile();
+            HeatmapFile(const HeatmapFile&) = delete;
+            HeatmapFile& operator=(const HeatmapFile&) = delete;
+
+            /**
+             * @brief getShape Shape of the full tensor.
+             */
+            std::vector<int> getShape() const { return m_shape; }
+            bool hasOverview() const { return m_overviewFactor > 1; }
+            /**
+             * @brief readOverview Read the overview, with its spacing scaled so that it covers the same area as the
+             * tensor. Files without an overview, e.g. saved by the HDF5TensorExporter, are read whole.
+             */
+            std::shared_ptr<Tensor> readOverview();
+            /**
+             * @brief read Read the whole tensor.
+             */
+            std::shared_ptr<Tensor> read();
+            /**
+             * @brief readRegion Read a block of cells of the tensor, with all classes.
+             */
+            std::vector<float> readRegion(int row, int column, int rows, int columns);
+            /**
+             * @brief forEachChunk Read the tensor one block of chunkSize x chunkSize cells at a time, so that
+             * statistics of large heatmaps can be computed without holding them in memory.
+             * @param callback Called with the position and size of each block, and its rows x columns x classes values.
+             */
+            void forEachChunk(std::function<void(int row, int column, int rows, int columns, const float* values)> callback, int chunkSize = 64);
+            HeatmapStatistics computeStatistics();
+        private:
+            std::shared_ptr<Tensor> readDataset(const std::string& name, float spacingScale);
+
+            std::string m_filename;
+            int64_t m_file; /* HDF5 file handle */
+            std::vector<int> m_shape;
+            int m_overviewFactor = 1;
+    };
+} // End of namespace fast
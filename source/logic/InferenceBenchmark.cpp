@@ -0,0 +1,127 @@
+#include "InferenceBenchmark.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <FAST/Utility.hpp>
+#include <FAST/Reporter.hpp>
+#include <FAST/Data/Image.hpp>
+#include <FAST/Data/Batch.hpp>
+#include <FAST/Algorithms/NeuralNetwork/NeuralNetwork.hpp>
+#include <FAST/Algorithms/NeuralNetwork/InferenceEngineManager.hpp>
+#include <QDir>
+#include <QSysInfo>
+#include <QSaveFile>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+namespace fast{
+    InferenceBenchmark::InferenceBenchmark()
+    {
+        m_filename = QDir::home().path().toStdString() + "/fastpathology/inference_engines.txt";
+        load();
+    }
+
+    void InferenceBenchmark::load()
+    {
+        std::ifstream file(m_filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            const auto separator = line.rfind('\t');
+            if(separator != std::string::npos)
+                m_engines[line.substr(0, separator)] = line.substr(separator + 1);
+        }
+    }
+
+    void InferenceBenchmark::save() const
+    {
+        QSaveFile file(QString::fromStdString(m_filename));
+        if(!file.open(QIODevice::WriteOnly)) {
+            Logger::warning("InferenceBenchmark") << "Unable to write inference engines " << m_filename;
+            return;
+        }
+        std::stringstream stream;
+        for(const auto& engine : m_engines)
+            stream << engine.first << "\t" << engine.second << "\n";
+        file.write(QByteArray::fromStdString(stream.str()));
+        file.commit();
+    }
+
+    float InferenceBenchmark::measureThroughput(const std::string& model, const std::string& engine, const std::string& device,
+            int width, int height, int channels, int batchSize, int iterations, const std::atomic_bool* stop)
+    {
+        // The content of the patches doesn't affect the inference time, so synthetic patches are used. That way the
+        // measurements don't depend on the slide, and don't compete with a pipeline for the slide reader.
+        auto patch = Image::create(width, height, TYPE_UINT8, channels);
+        patch->fill(127);
+
+        auto network = NeuralNetwork::New();
+        if(!engine.empty())
+            network->setInferenceEngine(engine);
+        if(device == "CPU") {
+            network->getInferenceEngine()->setDeviceType(InferenceDeviceType::CPU);
+        } else if(device == "GPU") {
+            network->getInferenceEngine()->setDeviceType(InferenceDeviceType::GPU);
+        }
+        network->getInferenceEngine()->setMaxBatchSize(batchSize);
+        network->load(model);
+        std::vector<Image::pointer> patches(batchSize, patch);
+
+        // First batch is warm-up, e.g. engine initialization and memory allocation
+        network->connect(Batch::create(patches));
+        {
+            TraceSpan span("inference", "warm-up batch");
+            network->runAndGetOutputData<DataObject>();
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < iterations; ++i) {
+            if(stop && *stop)
+                throw Exception("Benchmark of " + model + " was stopped");
+            // A new batch object is needed for the network to execute again
+            network->connect(Batch::create(patches));
+            TraceSpan span("inference", "benchmark batch");
+            network->runAndGetOutputData<DataObject>();
+        }
+        std::chrono::duration<float> time = std::chrono::high_resolution_clock::now() - start;
+        return batchSize*iterations/time.count();
+    }
+
+    void InferenceBenchmark::setStopFlag(const std::atomic_bool* stop)
+    {
+        m_stop = stop;
+    }
+
+    std::string InferenceBenchmark::getFastestEngine(const std::string& model, const std::string& device, int width, int height, int channels)
+    {
+        const std::string key = QSysInfo::machineHostName().toStdString() + "\t" + (device.empty() ? "default" : device) + "\t" + model;
+        auto it = m_engines.find(key);
+        if(it != m_engines.end())
+            return it->second;
+
+        std::string fastestEngine;
+        float fastestThroughput = 0;
+        for(const auto& engine : InferenceEngineManager::getEngineList()) {
+            // A partial benchmark isn't stored
+            if(m_stop && *m_stop)
+                throw Exception("Benchmark of " + model + " was stopped");
+            try {
+                const float throughput = measureThroughput(model, engine, device, width, height, channels, 1, 5, m_stop);
+                Reporter::info() << engine << ": " << throughput << " patches per second" << Reporter::end();
+                if(throughput > fastestThroughput) {
+                    fastestThroughput = throughput;
+                    fastestEngine = engine;
+                }
+            } catch(std::exception& e) {
+                // Not all engines support all model formats and devices
+                Reporter::info() << engine << " unable to run " << model << ": " << e.what() << Reporter::end();
+            }
+        }
+        if(fastestEngine.empty())
+            return "";
+        Reporter::info() << "Selected inference engine " << fastestEngine << " for model " << model << Reporter::end();
+        m_engines.clear();
+        load();
+        m_engines[key] = fastestEngine;
+        save();
+        return fastestEngine;
+    }
+} // End of namespace fast
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+
+namespace fast{
+    /**
+     * @brief Short inference calibration runs on the current machine, used to choose the inference engine, device
+     * and batch size of a model. The fastest engine of each model is stored per host and device in
+     * inference_engines.txt in the fastpathology folder.
+     */
+    class InferenceBenchmark {
+        public:
+            InferenceBenchmark();
+            /**
+             * @brief measureThroughput Run a model on synthetic patches and measure the throughput.
+             * Throws an Exception if the engine, device or batch size isn't supported.
+             * @param engine Inference engine, the default engine if empty.
+             * @param device Device type, e.g. CPU or GPU, the engine's default if empty.
+             * @param iterations Number of timed batches, after one warm-up batch.
+             * @param stop Throws an Exception between batches once this is set, if given.
+             * @return Patches per second.
+             */
+            static float measureThroughput(const std::string& model, const std::string& engine, const std::string& device,
+                    int width, int height, int channels, int batchSize = 1, int iterations = 5, const std::atomic_bool* stop = nullptr);
+            /**
+             * @brief getFastestEngine Get the stored fastest engine of a model, or benchmark all available engines
+             * and store the fastest. Throws an Exception if stopped, see setStopFlag.
+             * @return The fastest engine, or an empty string if no engine could run the model.
+             */
+            std::string getFastestEngine(const std::string& model, const std::string& device, int width, int height, int channels = 3);
+            /**
+             * @brief setStopFlag Stop benchmarks when the flag is set, e.g. from another thread.
+             */
+            void setStopFlag(const std::atomic_bool* stop);
+        private:
+            void load();
+            void save() const;
+
+            std::string m_filename;
+            std::map<std::string, std::string> m_engines;
+            const std::atomic_bool* m_stop = nullptr;
+    };
+} // End of namespace fast
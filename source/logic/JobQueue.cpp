@@ -0,0 +1,153 @@
+#include "JobQueue.h"
+#include <FAST/Utility.hpp>
+#include <algorithm>
+
+namespace fast{
+    // Finished jobs kept for the status list
+    static const int maxFinishedJobs = 100;
+
+    std::string Job::getStateName(State state)
+    {
+        switch(state) {
+            case State::Queued:
+                return "queued";
+            case State::Running:
+                return "running";
+            case State::Done:
+                return "done";
+            case State::Failed:
+                return "failed";
+            case State::Cancelled:
+                return "cancelled";
+        }
+        return "";
+    }
+
+    Job::State Job::getState(const std::string& name)
+    {
+        for(auto state : {State::Queued, State::Running, State::Done, State::Failed, State::Cancelled}) {
+            if(getStateName(state) == name)
+                return state;
+        }
+        throw Exception("Unknown job state " + name);
+    }
+
+    JobQueue::JobQueue(std::vector<int> cores, int defaultThreads)
+    {
+        m_freeCores = cores;
+        m_totalCores = cores.size();
+        m_defaultThreads = std::max(1, std::min(defaultThreads, m_totalCores));
+    }
+
+    int JobQueue::submit(Job job)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job.id = m_nextId++;
+        job.state = Job::State::Queued;
+        job.threads = std::min(job.threads > 0 ? job.threads : m_defaultThreads, m_totalCores);
+        job.submitted = currentDateTime("%Y-%m-%d %H:%M:%S");
+        job.cores.clear();
+        m_jobs[job.id] = job;
+
+        // Forget the oldest finished jobs
+        int finished = 0;
+        for(auto it = m_jobs.rbegin(); it != m_jobs.rend(); ++it) {
+            if(it->second.state != Job::State::Queued && it->second.state != Job::State::Running)
+                ++finished;
+        }
+        for(auto it = m_jobs.begin(); it != m_jobs.end() && finished > maxFinishedJobs;) {
+            if(it->second.state != Job::State::Queued && it->second.state != Job::State::Running) {
+                it = m_jobs.erase(it);
+                --finished;
+            } else {
+                ++it;
+            }
+        }
+        return job.id;
+    }
+
+    bool JobQueue::cancel(int id)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_jobs.find(id);
+        if(it == m_jobs.end())
+            return false;
+        if(it->second.state == Job::State::Queued) {
+            it->second.state = Job::State::Cancelled;
+            return true;
+        }
+        if(it->second.state == Job::State::Running) {
+            m_cancelled.push_back(id);
+            return true;
+        }
+        return false;
+    }
+
+    bool JobQueue::isCancelled(int id) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::find(m_cancelled.begin(), m_cancelled.end(), id) != m_cancelled.end();
+    }
+
+    std::vector<Job> JobQueue::getJobs() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<Job> jobs;
+        for(const auto& job : m_jobs)
+            jobs.push_back(job.second);
+        return jobs;
+    }
+
+    std::vector<Job> JobQueue::schedule()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<Job*> queued;
+        for(auto& job : m_jobs) {
+            if(job.second.state == Job::State::Queued)
+                queued.push_back(&job.second);
+        }
+        std::stable_sort(queued.begin(), queued.end(), [this](const Job* a, const Job* b) {
+            if(a->priority != b->priority)
+                return a->priority > b->priority;
+            return (a->pipeline == m_lastPipeline) > (b->pipeline == m_lastPipeline);
+        });
+
+        std::vector<Job> started;
+        for(auto job : queued) {
+            if(job->threads > (int)m_freeCores.size())
+                break;
+            job->cores.assign(m_freeCores.begin(), m_freeCores.begin() + job->threads);
+            m_freeCores.erase(m_freeCores.begin(), m_freeCores.begin() + job->threads);
+            job->state = Job::State::Running;
+            m_lastPipeline = job->pipeline;
+            started.push_back(*job);
+        }
+        return started;
+    }
+
+    void JobQueue::update(int id, int slides, int processedSlides, int failedSlides)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& job = m_jobs.at(id);
+        job.slides = slides;
+        job.processedSlides = processedSlides;
+        job.failedSlides = failedSlides;
+    }
+
+    void JobQueue::finish(int id, bool failed)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& job = m_jobs.at(id);
+        auto cancelled = std::find(m_cancelled.begin(), m_cancelled.end(), id);
+        if(cancelled != m_cancelled.end()) {
+            job.state = Job::State::Cancelled;
+            m_cancelled.erase(cancelled);
+        } else {
+            job.state = failed ? Job::State::Failed : Job::State::Done;
+        }
+        // Keep the cores sorted, so that jobs get neighbouring cores
+        m_freeCores.insert(m_freeCores.end(), job.cores.begin(), job.cores.end());
+        std::sort(m_freeCores.begin(), m_freeCores.end());
+        job.cores.clear();
+    }
+} // End of namespace fast
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+namespace fast{
+    /**
+     * @brief A pipeline run on the slides of a project, submitted to the job server.
+     */
+    class Job {
+        public:
+            enum class State {
+                Queued,
+                Running,
+                Done,
+                Failed,
+                Cancelled,
+            };
+
+            int id = 0;
+            std::string user; /* Who submitted the job */
+            std::string project; /* Absolute path of the project folder */
+            std::string pipeline; /* Disk location of the pipeline file */
+            std::vector<std::string> uids; /* Slides to process, all slides of the project if empty */
+            int priority = 0; /* Higher runs first */
+            int threads = 0; /* Cores reserved for the job, the server default if 0 */
+            State state = State::Queued;
+            std::string submitted; /* Date and time */
+            int slides = 0; /* Number of slides, once running */
+            int processedSlides = 0;
+            int failedSlides = 0;
+            std::vector<int> cores; /* Cores of a running job */
+
+            static std::string getStateName(State state);
+            static State getState(const std::string& name);
+    };
+
+    /**
+     * @brief Queue of the jobs of the job server, which schedules them on a budget of cores.
+     *
+     * Jobs start in order of priority, then submission. Each running job gets its own cores, so that jobs don't
+     * compete for them. A job which doesn't fit in the free cores waits for running jobs to finish, and so do all jobs
+     * after it, so that large jobs are not starved by smaller ones. Among jobs of the same priority, jobs with the
+     * pipeline which ran last go first, as its models and patches are still in the caches.
+     */
+    class JobQueue {
+        public:
+            /**
+             * @param cores Cores the jobs may run on.
+             * @param defaultThreads Cores of jobs which don't ask for a number of cores.
+             */
+            JobQueue(std::vector<int> cores, int defaultThreads);
+
+            /**
+             * @brief submit Queue a job.
+             * @return Id of the job.
+             */
+            int submit(Job job);
+            /**
+             * @brief cancel Cancel a queued job, or stop a running job after the slides it is processing.
+             * @return False if the job doesn't exist or has already finished.
+             */
+            bool cancel(int id);
+            bool isCancelled(int id) const;
+            /**
+             * @brief getJobs All jobs which haven't finished, and the most recently finished ones.
+             */
+            std::vector<Job> getJobs() const;
+            /**
+             * @brief schedule Start the jobs which fit in the free cores.
+             * @return Started jobs, with their cores assigned.
+             */
+            std::vector<Job> schedule();
+            /**
+             * @brief update Progress of a running job.
+             */
+            void update(int id, int slides, int processedSlides, int failedSlides);
+            /**
+             * @brief finish Mark a running job as done, and free its cores.
+             */
+            void finish(int id, bool failed);
+        private:
+            std::vector<int> m_freeCores;
+            int m_totalCores;
+            int m_defaultThreads;
+            int m_nextId = 1;
+            std::string m_lastPipeline;
+            std::map<int, Job> m_jobs;
+            std::vector<int> m_cancelled; /* Running jobs which are to stop */
+            mutable std::mutex m_mutex;
+    };
+} // End of namespace fast
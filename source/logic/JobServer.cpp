@@ -0,0 +1,436 @@
+#include "JobServer.h"
+#include "source/logic/Logger.h"
+#include "source/logic/Project.h"
+#include "source/logic/HeadlessRunner.h"
+#include <FAST/Utility.hpp>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDir>
+#include <QFileInfo>
+#include <QTimer>
+#include <memory>
+#include <atomic>
+#include <cstdlib>
+#include <algorithm>
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <pwd.h>
+#include <unistd.h>
+#endif
+
+namespace fast{
+    namespace {
+        QJsonObject jobToJson(const Job& job) {
+            QJsonObject object;
+            object["id"] = job.id;
+            object["user"] = QString::fromStdString(job.user);
+            object["project"] = QString::fromStdString(job.project);
+            object["pipeline"] = QString::fromStdString(job.pipeline);
+            QJsonArray uids;
+            for(const auto& uid : job.uids)
+                uids.append(QString::fromStdString(uid));
+            object["uids"] = uids;
+            object["priority"] = job.priority;
+            object["threads"] = job.threads;
+            object["state"] = QString::fromStdString(Job::getStateName(job.state));
+            object["submitted"] = QString::fromStdString(job.submitted);
+            object["slides"] = job.slides;
+            object["processed-slides"] = job.processedSlides;
+            object["failed-slides"] = job.failedSlides;
+            return object;
+        }
+
+        Job jobFromJson(const QJsonObject& object) {
+            Job job;
+            job.id = object["id"].toInt();
+            job.user = object["user"].toString().toStdString();
+            job.project = object["project"].toString().toStdString();
+            job.pipeline = object["pipeline"].toString().toStdString();
+            for(const auto& uid : object["uids"].toArray())
+                job.uids.push_back(uid.toString().toStdString());
+            job.priority = object["priority"].toInt();
+            job.threads = object["threads"].toInt();
+            if(object.contains("state"))
+                job.state = Job::getState(object["state"].toString().toStdString());
+            job.submitted = object["submitted"].toString().toStdString();
+            job.slides = object["slides"].toInt();
+            job.processedSlides = object["processed-slides"].toInt();
+            job.failedSlides = object["failed-slides"].toInt();
+            return job;
+        }
+
+        QJsonObject error(const std::string& message) {
+            QJsonObject reply;
+            reply["ok"] = false;
+            reply["error"] = QString::fromStdString(message);
+            return reply;
+        }
+
+        /**
+         * User id of the process on the other end of a local socket, or -1 if the platform doesn't tell, e.g. for
+         * the named pipes of Windows.
+         */
+        int64_t getPeerUser(QLocalSocket* socket) {
+#if defined(__linux__)
+            struct ucred credentials;
+            socklen_t size = sizeof(credentials);
+            if(getsockopt(socket->socketDescriptor(), SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0)
+                return credentials.uid;
+#elif defined(__APPLE__)
+            uid_t uid;
+            gid_t group;
+            if(getpeereid(socket->socketDescriptor(), &uid, &group) == 0)
+                return uid;
+#endif
+            return -1;
+        }
+
+        /**
+         * Name of a user, as stored in the jobs of the user.
+         */
+        std::string getUserName(int64_t user) {
+#ifndef WIN32
+            const struct passwd* account = getpwuid((uid_t)user);
+            if(account != nullptr)
+                return account->pw_name;
+#endif
+            return std::to_string(user);
+        }
+
+        /**
+         * Resolve the project and pipeline of a submitted job to canonical paths, and check that the submitting user
+         * may run them: the project must belong to the user, and the pipeline must be the user's or readable by all
+         * users. Without the credentials of the user, only projects in the server's own projects folder are run.
+         * @return An error message, or an empty string if the job may run.
+         */
+        std::string authorize(Job& job, int64_t user) {
+            const QString project = QString::fromStdString(job.project);
+            const QString pipeline = QString::fromStdString(job.pipeline);
+            if(!QDir::isAbsolutePath(project) || !QDir::isAbsolutePath(pipeline))
+                return "The project and pipeline must be given as absolute paths";
+            // Resolves .. and symbolic links, so that the checks apply to the files which are actually used
+            const QString projectFolder = QFileInfo(project).canonicalFilePath();
+            const QString pipelineFile = QFileInfo(pipeline).canonicalFilePath();
+            if(projectFolder.isEmpty() || !QFileInfo(projectFolder).isDir() || !QFileInfo(projectFolder + "/project.txt").isFile())
+                return "Project " + job.project + " doesn't exist";
+            if(pipelineFile.isEmpty() || !QFileInfo(pipelineFile).isFile())
+                return "Pipeline file " + job.pipeline + " doesn't exist";
+#ifndef WIN32
+            if(user >= 0) {
+                struct stat status;
+                if(stat(projectFolder.toLocal8Bit().constData(), &status) != 0 || status.st_uid != (uid_t)user)
+                    return "Project " + job.project + " doesn't belong to the submitting user";
+                if(stat(pipelineFile.toLocal8Bit().constData(), &status) != 0 || (status.st_uid != (uid_t)user && (status.st_mode & S_IROTH) == 0))
+                    return "Pipeline file " + job.pipeline + " isn't readable by the submitting user";
+                job.user = getUserName(user);
+                job.project = projectFolder.toStdString();
+                job.pipeline = pipelineFile.toStdString();
+                return "";
+            }
+#endif
+            const QString projectsFolder = QFileInfo(QString::fromStdString(Project::getProjectsFolder())).canonicalFilePath();
+            if(projectsFolder.isEmpty() || !projectFolder.startsWith(projectsFolder + "/"))
+                return "Project " + job.project + " isn't in the projects folder of the job server";
+            job.project = projectFolder.toStdString();
+            job.pipeline = pipelineFile.toStdString();
+            return "";
+        }
+
+        /**
+         * Whether a client may see the paths of a job and cancel it: the user who submitted it and the user of the
+         * server may. Clients without credentials are trusted, as they can only run jobs in the projects folder of
+         * the server.
+         */
+        bool isOwner(const Job& job, int64_t user) {
+#ifndef WIN32
+            if(user >= 0)
+                return (uid_t)user == getuid() || job.user == getUserName(user);
+#endif
+            return true;
+        }
+
+        std::vector<int> getAllCores(const ExecutionPolicy& policy) {
+            if(!policy.cores.empty())
+                return policy.cores;
+            std::vector<int> cores;
+            const int count = std::max(1, (int)std::thread::hardware_concurrency());
+            for(int core = 0; core < count; ++core)
+                cores.push_back(core);
+            return cores;
+        }
+    }
+
+    std::string JobServer::getDefaultName()
+    {
+        return "fastpathology-jobs";
+    }
+
+    JobServer::JobServer(std::string name, ExecutionPolicy policy) :
+            m_queue(getAllCores(policy), policy.inferenceThreads > 0 ? policy.inferenceThreads : 4)
+    {
+        m_name = name;
+        m_policy = policy;
+        m_server = new QLocalServer();
+    }
+
+    JobServer::~JobServer()
+    {
+        for(const auto& job : m_queue.getJobs())
+            m_queue.cancel(job.id);
+        for(auto& thread : m_threads)
+            thread.second.join();
+        delete m_server;
+    }
+
+    bool JobServer::listen()
+    {
+        if(JobClient(m_name).isAvailable()) {
+            Logger::error("JobServer") << "A job server is already running as " << m_name;
+            return false;
+        }
+        // Remove the socket file of a server which crashed
+        QLocalServer::removeServer(QString::fromStdString(m_name));
+        // Other users of the computer may submit jobs if they are in the group of the server's user
+        m_server->setSocketOptions(QLocalServer::UserAccessOption | QLocalServer::GroupAccessOption);
+        if(!m_server->listen(QString::fromStdString(m_name))) {
+            Logger::error("JobServer") << "Unable to start job server: " << m_server->errorString().toStdString();
+            return false;
+        }
+        QObject::connect(m_server, &QLocalServer::newConnection, [this]() { handleConnection(); });
+        Logger::info("JobServer") << "Job server listening on " << m_server->fullServerName().toStdString() << " with " << m_policy.toString();
+        return true;
+    }
+
+    void JobServer::handleConnection()
+    {
+        while(auto socket = m_server->nextPendingConnection()) {
+            QObject::connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+            // Jobs run with the server's permissions, so the paths of a job are checked against the submitting user
+            const int64_t user = getPeerUser(socket);
+            QObject::connect(socket, &QLocalSocket::readyRead, [this, socket, user]() {
+                while(socket->canReadLine()) {
+                    const auto document = QJsonDocument::fromJson(socket->readLine());
+                    const QJsonObject reply = document.isObject() ? handleRequest(document.object(), user) : error("Invalid request");
+                    socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + "\n");
+                }
+            });
+        }
+    }
+
+    QJsonObject JobServer::handleRequest(const QJsonObject& request, int64_t user)
+    {
+        const std::string command = request["command"].toString().toStdString();
+        QJsonObject reply;
+        reply["ok"] = true;
+        if(command == "submit") {
+            Job job = jobFromJson(request);
+            const std::string message = authorize(job, user);
+            if(!message.empty()) {
+                Logger::warning("JobServer") << "Rejected job of " << job.user << ": " << message;
+                return error(message);
+            }
+            const int id = m_queue.submit(job);
+            Logger::info("JobServer") << "Job " << id << " submitted by " << job.user << ": " << job.pipeline << " on " << job.project;
+            reply["id"] = id;
+            startJobs();
+        } else if(command == "list") {
+            QJsonArray jobs;
+            for(auto job : m_queue.getJobs()) {
+                // Jobs of other users are listed for their place in the queue, without their paths
+                if(!isOwner(job, user)) {
+                    job.project.clear();
+                    job.pipeline.clear();
+                    job.uids.clear();
+                }
+                jobs.append(jobToJson(job));
+            }
+            reply["jobs"] = jobs;
+        } else if(command == "cancel") {
+            const int id = request["id"].toInt();
+            const auto jobs = m_queue.getJobs();
+            auto job = std::find_if(jobs.begin(), jobs.end(), [id](const Job& job) { return job.id == id; });
+            if(job == jobs.end())
+                return error("Job " + std::to_string(id) + " doesn't exist");
+            if(!isOwner(*job, user)) {
+                Logger::warning("JobServer") << "Rejected cancelling job " << id << " of " << job->user << " by " << getUserName(user);
+                return error("Job " + std::to_string(id) + " belongs to another user");
+            }
+            if(!m_queue.cancel(id))
+                return error("Job " + std::to_string(id) + " has already finished");
+            Logger::info("JobServer") << "Job " << id << " cancelled";
+        } else {
+            return error("Unknown command " + command);
+        }
+        return reply;
+    }
+
+    void JobServer::startJobs()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(int id : m_finished) {
+            m_threads.at(id).join();
+            m_threads.erase(id);
+        }
+        m_finished.clear();
+        for(const auto& job : m_queue.schedule()) {
+            Logger::info("JobServer") << "Starting job " << job.id << " on " << job.cores.size() << " cores";
+            m_threads[job.id] = std::thread(&JobServer::runJob, this, job);
+        }
+    }
+
+    void JobServer::runJob(Job job)
+    {
+        bool failed = false;
+        try {
+            std::shared_ptr<Project> project;
+            {
+                // Opening a project updates the project index, which jobs must not do at the same time
+                std::lock_guard<std::mutex> lock(m_mutex);
+                project = std::make_shared<Project>(job.project, true);
+            }
+            // The job runs one slide at a time on its own cores. The inference engines use the thread count the
+            // server was started with, see ExecutionPolicy::applyEnvironment.
+            ExecutionPolicy policy = m_policy;
+            policy.concurrentSlides = 1;
+            policy.cores = job.cores;
+            HeadlessRunner runner(project, job.pipeline, policy);
+            const auto uids = job.uids.empty() ? project->getAllWsiUids() : job.uids;
+            std::atomic_int processed(0);
+            std::atomic_int failedSlides(0);
+            m_queue.update(job.id, uids.size(), 0, 0);
+            runner.setSlideCallback([&](const std::string& uid, bool success) {
+                ++processed;
+                if(!success)
+                    ++failedSlides;
+                m_queue.update(job.id, uids.size(), processed, failedSlides);
+                return !m_queue.isCancelled(job.id);
+            });
+            failed = runner.run(uids) > 0;
+        } catch(std::exception& e) {
+            Logger::error("JobServer") << "Job " << job.id << " failed: " << e.what();
+            failed = true;
+        }
+        m_queue.finish(job.id, failed);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished.push_back(job.id);
+        }
+        // Freed cores may fit the next jobs
+        QMetaObject::invokeMethod(m_server, [this]() { startJobs(); }, Qt::QueuedConnection);
+    }
+
+    JobClient::JobClient(std::string name)
+    {
+        m_name = name;
+    }
+
+    QJsonObject JobClient::request(const QJsonObject& request) const
+    {
+        QLocalSocket socket;
+        socket.connectToServer(QString::fromStdString(m_name));
+        if(!socket.waitForConnected(500))
+            throw Exception("No job server is running");
+        socket.write(QJsonDocument(request).toJson(QJsonDocument::Compact) + "\n");
+        socket.waitForBytesWritten(1000);
+        while(!socket.canReadLine()) {
+            if(!socket.waitForReadyRead(5000))
+                throw Exception("No reply from the job server");
+        }
+        const QJsonObject reply = QJsonDocument::fromJson(socket.readLine()).object();
+        if(!reply["ok"].toBool())
+            throw Exception(reply["error"].toString().toStdString());
+        return reply;
+    }
+
+    bool JobClient::isAvailable() const
+    {
+        QLocalSocket socket;
+        socket.connectToServer(QString::fromStdString(m_name));
+        return socket.waitForConnected(200);
+    }
+
+    int JobClient::submit(Job job) const
+    {
+        // The server runs as another user, so the project is given by the path of this user's project
+        if(!QDir::isAbsolutePath(QString::fromStdString(job.project)))
+            job.project = Project::getProjectsFolder() + job.project;
+        if(job.user.empty()) {
+            const char* user = std::getenv("USER");
+            if(user == nullptr)
+                user = std::getenv("USERNAME");
+            job.user = user == nullptr ? "" : user;
+        }
+        QJsonObject object = jobToJson(job);
+        object.remove("state");
+        object["command"] = "submit";
+        return request(object)["id"].toInt();
+    }
+
+    std::vector<Job> JobClient::getJobs() const
+    {
+        QJsonObject object;
+        object["command"] = "list";
+        std::vector<Job> jobs;
+        for(const auto& job : request(object)["jobs"].toArray())
+            jobs.push_back(jobFromJson(job.toObject()));
+        return jobs;
+    }
+
+    void JobClient::requestJobs(QObject* context, std::function<void(const std::vector<Job>&, const std::string&)> callback) const
+    {
+        // Deleted with the context, which disconnects the callbacks
+        auto socket = new QLocalSocket(context);
+        auto finished = std::make_shared<bool>(false);
+        auto finish = [socket, finished, callback](const std::vector<Job>& jobs, const std::string& error) {
+            if(*finished)
+                return;
+            *finished = true;
+            socket->deleteLater();
+            callback(jobs, error);
+        };
+        QObject::connect(socket, &QLocalSocket::connected, [socket]() {
+            QJsonObject object;
+            object["command"] = "list";
+            socket->write(QJsonDocument(object).toJson(QJsonDocument::Compact) + "\n");
+        });
+        QObject::connect(socket, &QLocalSocket::readyRead, [socket, finish]() {
+            if(!socket->canReadLine())
+                return;
+            const QJsonObject reply = QJsonDocument::fromJson(socket->readLine()).object();
+            if(!reply["ok"].toBool()) {
+                finish({}, reply["error"].toString().toStdString());
+                return;
+            }
+            std::vector<Job> jobs;
+            for(const auto& job : reply["jobs"].toArray())
+                jobs.push_back(jobFromJson(job.toObject()));
+            finish(jobs, "");
+        });
+        QObject::connect(socket, &QLocalSocket::stateChanged, [finish](QLocalSocket::LocalSocketState state) {
+            if(state == QLocalSocket::UnconnectedState)
+                finish({}, "No job server is running");
+        });
+        QTimer::singleShot(5000, socket, [finish]() {
+            finish({}, "No reply from the job server");
+        });
+        socket->connectToServer(QString::fromStdString(m_name));
+    }
+
+    bool JobClient::cancel(int id) const
+    {
+        QJsonObject object;
+        object["command"] = "cancel";
+        object["id"] = id;
+        try {
+            request(object);
+        } catch(Exception& e) {
+            return false;
+        }
+        return true;
+    }
+} // End of namespace fast
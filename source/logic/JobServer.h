@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <cstdint>
+#include <functional>
+#include "source/logic/JobQueue.h"
+#include "source/logic/ExecutionPolicy.h"
+
+class QLocalServer;
+class QLocalSocket;
+class QJsonObject;
+class QObject;
+
+namespace fast{
+    /**
+     * @brief Local job server, which runs pipelines on projects for all users of a workstation or server, instead of
+     * each user running pipelines from their own GUI in competition for the same cores.
+     *
+     * Clients connect to a local socket (a UNIX domain socket on Linux and macOS, a named pipe on Windows), so the
+     * server is only reachable from the same computer. Requests and replies are single lines of JSON:
+     *   {"command": "submit", "project": ..., "pipeline": ..., "priority": 0, "threads": 0, "uids": [...], "user": ...}
+     *      -> {"ok": true, "id": 1}
+     * The project and pipeline are absolute paths. Jobs run with the permissions of the server, so the server takes
+     * the user from the credentials of the socket where the platform provides them, and only runs projects of that
+     * user.
+     *   {"command": "list"} -> {"ok": true, "jobs": [...]}
+     *   {"command": "cancel", "id": 1} -> {"ok": true}
+     * Jobs can only be cancelled by the user who submitted them and by the user of the server, and the list only
+     * has the project and pipeline of the requesting user's own jobs.
+     * Errors are replied with {"ok": false, "error": ...}.
+     *
+     * Jobs are scheduled by a JobQueue on the cores of the execution policy, and run by a HeadlessRunner pinned to
+     * the cores of the job. The server is a single long-running process, so model files, inference engine caches
+     * and tuned batch sizes stay warm between jobs.
+     */
+    class JobServer {
+        public:
+            /**
+             * @param name Name of the local socket.
+             * @param policy Cores the jobs may use, and the cores of jobs which don't ask for a number of cores, from
+             *      its inference-threads.
+             */
+            JobServer(std::string name = getDefaultName(), ExecutionPolicy policy = ExecutionPolicy::load());
+            /**
+             * Cancels the running jobs, and waits for them to stop.
+             */
+            ~JobServer();
+            /**
+             * @brief listen Start accepting clients. Requires a running Qt event loop.
+             * @return False if the socket couldn't be created.
+             */
+            bool listen();
+            static std::string getDefaultName();
+        private:
+            void handleConnection();
+            /**
+             * @param user User id of the client, or -1 if unknown.
+             */
+            QJsonObject handleRequest(const QJsonObject& request, int64_t user);
+            /**
+             * Start the jobs which fit, and clean up the threads of finished jobs.
+             */
+            void startJobs();
+            void runJob(Job job);
+
+            std::string m_name;
+            ExecutionPolicy m_policy;
+            JobQueue m_queue;
+            QLocalServer* m_server;
+            std::map<int, std::thread> m_threads; /* Threads of running jobs, indexed by job id */
+            std::vector<int> m_finished; /* Jobs whose thread has finished and can be joined */
+            std::mutex m_mutex;
+    };
+
+    /**
+     * @brief Client of the JobServer, e.g. for the GUI. All requests except requestJobs block until the server replies.
+     */
+    class JobClient {
+        public:
+            JobClient(std::string name = JobServer::getDefaultName());
+            /**
+             * @brief isAvailable Whether a job server is running.
+             */
+            bool isAvailable() const;
+            /**
+             * @brief submit Queue a job. The user is set to the current user if empty.
+             * @return Id of the job.
+             */
+            int submit(Job job) const;
+            std::vector<Job> getJobs() const;
+            /**
+             * @brief requestJobs Get the jobs without blocking, from a thread with a Qt event loop.
+             * @param context Owner of the request. The callback isn't called if it is deleted first.
+             * @param callback Called with the jobs, or with an error message if no server replied.
+             */
+            void requestJobs(QObject* context, std::function<void(const std::vector<Job>& jobs, const std::string& error)> callback) const;
+            bool cancel(int id) const;
+        private:
+            QJsonObject request(const QJsonObject& request) const;
+
+            std::string m_name;
+    };
+} // End of namespace fast
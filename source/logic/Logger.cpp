@@ -0,0 +1,358 @@
+#include "Logger.h"
+#include <FAST/Utility.hpp>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+
+namespace fast{
+    namespace {
+        const int64_t maxFileSize = 10*1024*1024;
+        const int maxOldFiles = 5;
+
+        struct Entry {
+            LogLevel level;
+            const char* module;
+            std::string text;
+            std::chrono::system_clock::time_point time;
+        };
+
+        typedef std::map<std::string, LogLevel> ModuleLevels;
+
+        // Never destroyed, so that messages can be logged from static destructors, see shutdown
+        struct State {
+            std::mutex mutex;
+            // The levels are read without the mutex by isEnabled. Module levels are replaced instead of modified,
+            // with std::atomic_load and std::atomic_store.
+            std::atomic_int level{(int)LogLevel::Info};
+            LogLevel consoleLevel = LogLevel::Info;
+            std::shared_ptr<const ModuleLevels> moduleLevels = std::make_shared<const ModuleLevels>();
+            std::atomic_int minimumLevel{(int)LogLevel::Info}; /* Lowest level of all modules */
+            std::deque<Entry> queue;
+            std::condition_variable queued;
+            std::condition_variable written;
+            bool writing = false; /* The writer thread is writing entries it took from the queue */
+            bool stopped = false; /* Messages are written by the calling thread after the program has exited */
+            std::thread writer;
+            std::ofstream file;
+            std::string filename;
+        };
+
+        void run();
+
+        void shutdown();
+
+        State& getState() {
+            static State* state = new State();
+            return *state;
+        }
+
+        std::atomic_bool configured(false);
+
+        // Read the default settings file before the levels are first used, unless settings were read already
+        void loadSettings() {
+            if(configured)
+                return;
+            static std::once_flag once;
+            std::call_once(once, []() {
+                if(!configured)
+                    Logger::configure();
+            });
+        }
+
+        // Called with the mutex
+        void setLevels(State& state, LogLevel level, std::shared_ptr<const ModuleLevels> moduleLevels) {
+            LogLevel minimum = level;
+            for(const auto& module : *moduleLevels)
+                minimum = std::min(minimum, module.second);
+            state.level = (int)level;
+            std::atomic_store(&state.moduleLevels, moduleLevels);
+            state.minimumLevel = (int)minimum;
+        }
+
+        // Start the writer thread before the first message
+        void start() {
+            static std::once_flag started;
+            std::call_once(started, []() {
+                auto& state = getState();
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.writer = std::thread(run);
+                std::atexit(shutdown);
+            });
+        }
+
+        std::string format(const Entry& entry) {
+            const std::time_t time = std::chrono::system_clock::to_time_t(entry.time);
+            const int milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(entry.time.time_since_epoch()).count() % 1000;
+            std::tm local;
+#ifdef WIN32
+            localtime_s(&local, &time);
+#else
+            localtime_r(&time, &local);
+#endif
+            std::ostringstream stream;
+            stream << std::put_time(&local, "%Y-%m-%d %H:%M:%S") << "." << std::setfill('0') << std::setw(3) << milliseconds
+                   << " " << std::setfill(' ') << std::left << std::setw(7) << Logger::getLevelName(entry.level)
+                   << " " << entry.module << ": " << entry.text << "\n";
+            return stream.str();
+        }
+
+        // Move the full file to fastpathology.1.log, and older files one number up. Several processes, such as the
+        // GUI, the job server and distributed workers, append to the same file. The lock file makes sure that only
+        // one of them rotates it, the others only reopen the new file.
+        void rotate(State& state) {
+            state.file.close();
+            QLockFile lockFile(QString::fromStdString(state.filename + ".lock"));
+            lockFile.setStaleLockTime(30*1000);
+            if(lockFile.tryLock(10*1000) && QFileInfo(QString::fromStdString(state.filename)).size() > maxFileSize) {
+                const std::string base = state.filename.substr(0, state.filename.size() - std::string(".log").size());
+                QFile::remove(QString::fromStdString(base + "." + std::to_string(maxOldFiles) + ".log"));
+                for(int i = maxOldFiles - 1; i >= 1; --i)
+                    QFile::rename(QString::fromStdString(base + "." + std::to_string(i) + ".log"), QString::fromStdString(base + "." + std::to_string(i + 1) + ".log"));
+                QFile::rename(QString::fromStdString(state.filename), QString::fromStdString(base + ".1.log"));
+            }
+            state.file.open(state.filename, std::ios::app);
+        }
+
+        // Called without the lock, only by one thread at a time
+        void writeEntries(State& state, const std::deque<Entry>& entries, LogLevel consoleLevel) {
+            if(!state.file.is_open()) {
+                createDirectories(Logger::getLogFolder());
+                state.filename = join(Logger::getLogFolder(), "fastpathology.log");
+                state.file.open(state.filename, std::ios::app);
+            }
+            for(const auto& entry : entries) {
+                const std::string line = format(entry);
+                // Standard output is left to the results of command line runs, such as CSV statistics
+                if(entry.level >= consoleLevel)
+                    std::clog << line;
+                if(state.file.is_open())
+                    state.file << line;
+            }
+            std::clog.flush();
+            if(state.file.is_open()) {
+                state.file.flush();
+                const int64_t position = state.file.tellp();
+                // The file is smaller than what was written to it if another process rotated it, in which case
+                // this process still appends to the old file
+                if(position > maxFileSize || QFileInfo(QString::fromStdString(state.filename)).size() < position)
+                    rotate(state);
+            }
+        }
+
+        void run() {
+            auto& state = getState();
+            std::unique_lock<std::mutex> lock(state.mutex);
+            while(true) {
+                state.queued.wait(lock, [&state]() { return state.stopped || !state.queue.empty(); });
+                if(state.queue.empty())
+                    break;
+                std::deque<Entry> entries;
+                entries.swap(state.queue);
+                const LogLevel consoleLevel = state.consoleLevel;
+                state.writing = true;
+                lock.unlock();
+                writeEntries(state, entries, consoleLevel);
+                lock.lock();
+                state.writing = false;
+                state.written.notify_all();
+            }
+        }
+
+        void shutdown() {
+            auto& state = getState();
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.stopped = true;
+            }
+            state.queued.notify_all();
+            if(state.writer.joinable())
+                state.writer.join();
+        }
+    }
+
+    LogMessage::LogMessage(LogLevel level, const char* module, bool enabled)
+    {
+        m_level = level;
+        m_module = module;
+        if(enabled)
+            m_stream = std::make_unique<std::ostringstream>();
+    }
+
+    LogMessage::~LogMessage()
+    {
+        if(m_stream)
+            Logger::write(m_level, m_module, m_stream->str());
+    }
+
+    LogMessage Logger::debug(const char* module)
+    {
+        return LogMessage(LogLevel::Debug, module, isEnabled(LogLevel::Debug, module));
+    }
+
+    LogMessage Logger::info(const char* module)
+    {
+        return LogMessage(LogLevel::Info, module, isEnabled(LogLevel::Info, module));
+    }
+
+    LogMessage Logger::warning(const char* module)
+    {
+        return LogMessage(LogLevel::Warning, module, isEnabled(LogLevel::Warning, module));
+    }
+
+    LogMessage Logger::error(const char* module)
+    {
+        return LogMessage(LogLevel::Error, module, isEnabled(LogLevel::Error, module));
+    }
+
+    bool Logger::isEnabled(LogLevel level, const char* module)
+    {
+        loadSettings();
+        auto& state = getState();
+        if((int)level < state.minimumLevel || level == LogLevel::Off)
+            return false;
+        const auto moduleLevels = std::atomic_load(&state.moduleLevels);
+        if(moduleLevels->empty())
+            return (int)level >= state.level;
+        auto it = moduleLevels->find(module);
+        return it == moduleLevels->end() ? (int)level >= state.level : level >= it->second;
+    }
+
+    void Logger::write(LogLevel level, const char* module, std::string text)
+    {
+        start();
+        auto& state = getState();
+        Entry entry{level, module, std::move(text), std::chrono::system_clock::now()};
+        std::unique_lock<std::mutex> lock(state.mutex);
+        if(state.stopped) {
+            // The writer thread has stopped, as the program is exiting
+            const LogLevel consoleLevel = state.consoleLevel;
+            writeEntries(state, {entry}, consoleLevel);
+            return;
+        }
+        state.queue.push_back(std::move(entry));
+        lock.unlock();
+        state.queued.notify_one();
+    }
+
+    void Logger::flush()
+    {
+        start();
+        auto& state = getState();
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.written.wait(lock, [&state]() { return state.stopped || (state.queue.empty() && !state.writing); });
+    }
+
+    void Logger::configure(const std::string& filename)
+    {
+        LogLevel level = LogLevel::Info;
+        LogLevel consoleLevel = LogLevel::Info;
+        ModuleLevels moduleLevels;
+        std::vector<std::string> errors;
+        std::ifstream file(filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            trim(line);
+            if(line.empty() || line[0] == '#')
+                continue;
+            std::stringstream stream(line);
+            std::string name, value, moduleLevel;
+            stream >> name >> value >> moduleLevel;
+            try {
+                if(name == "level") {
+                    level = getLevel(value);
+                } else if(name == "console") {
+                    consoleLevel = getLevel(value);
+                } else if(name == "module") {
+                    moduleLevels[value] = getLevel(moduleLevel);
+                } else {
+                    errors.push_back("Unknown logging setting " + name);
+                }
+            } catch(Exception& e) {
+                errors.push_back("Invalid logging setting: " + line);
+            }
+        }
+        auto& state = getState();
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            setLevels(state, level, std::make_shared<const ModuleLevels>(moduleLevels));
+            state.consoleLevel = consoleLevel;
+            configured = true;
+            // Queued directly, as logging them may configure the logger
+            for(const auto& error : errors)
+                state.queue.push_back({LogLevel::Warning, "Logger", error, std::chrono::system_clock::now()});
+        }
+        if(!errors.empty())
+            start();
+    }
+
+    void Logger::setLevel(LogLevel level, const std::string& module)
+    {
+        loadSettings();
+        auto& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if(module.empty()) {
+            setLevels(state, level, std::atomic_load(&state.moduleLevels));
+        } else {
+            auto moduleLevels = std::make_shared<ModuleLevels>(*state.moduleLevels);
+            (*moduleLevels)[module] = level;
+            setLevels(state, (LogLevel)state.level.load(), moduleLevels);
+        }
+    }
+
+    void Logger::setConsoleLevel(LogLevel level)
+    {
+        loadSettings();
+        auto& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.consoleLevel = level;
+    }
+
+    std::string Logger::getDefaultFilename()
+    {
+        return join(QDir::homePath().toStdString(), "fastpathology", "logging.txt");
+    }
+
+    std::string Logger::getLogFolder()
+    {
+        return join(QDir::homePath().toStdString(), "fastpathology", "logs");
+    }
+
+    LogLevel Logger::getLevel(const std::string& name)
+    {
+        for(auto level : {LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error, LogLevel::Off}) {
+            if(getLevelName(level) == name)
+                return level;
+        }
+        throw Exception("Unknown log level " + name);
+    }
+
+    std::string Logger::getLevelName(LogLevel level)
+    {
+        switch(level) {
+            case LogLevel::Debug:
+                return "debug";
+            case LogLevel::Info:
+                return "info";
+            case LogLevel::Warning:
+                return "warning";
+            case LogLevel::Error:
+                return "error";
+            case LogLevel::Off:
+                return "off";
+        }
+        return "";
+    }
+} // End of namespace fast
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <sstream>
+
+namespace fast{
+    enum class LogLevel {
+        Debug,
+        Info,
+        Warning,
+        Error,
+        Off,
+    };
+
+    /**
+     * @brief A log message, which is formatted with << and logged when it goes out of scope at the end of the
+     * statement. Messages of disabled levels are not formatted.
+     */
+    class LogMessage {
+        public:
+            LogMessage(LogLevel level, const char* module, bool enabled);
+            ~LogMessage();
+            template <class T>
+            LogMessage& operator<<(const T& value) {
+                if(m_stream)
+                    *m_stream << value;
+                return *this;
+            }
+        private:
+            LogLevel m_level;
+            const char* m_module;
+            std::unique_ptr<std::ostringstream> m_stream; /* Null if the message is disabled */
+    };
+
+    /**
+     * @brief Leveled logging to the console, on standard error, and to rotating files in the logs folder, e.g.
+     *   Logger::info("Project") << "Saved " << count << " results";
+     * Modules are named by string literals, usually the name of the class which logs.
+     *
+     * Messages are written by a background thread, so that logging doesn't block the calling thread on console or
+     * disk I/O. The file is rotated when it reaches 10 MB, keeping the 5 previous files. All processes of the
+     * application append to the same file, and a lock file makes sure only one of them rotates it.
+     *
+     * Levels are read from logging.txt in the fastpathology folder, with one setting per line:
+     *   level info             Lowest level which is logged: debug, info, warning, error or off
+     *   console warning        Lowest level which is also printed to the console
+     *   module Project debug   Lowest level which is logged for a module, overriding the level
+     */
+    class Logger {
+        public:
+            static LogMessage debug(const char* module);
+            static LogMessage info(const char* module);
+            static LogMessage warning(const char* module);
+            static LogMessage error(const char* module);
+            /**
+             * @brief isEnabled Whether messages of a level are logged for a module. Doesn't lock, so that messages
+             * of other threads aren't serialized on the level check.
+             */
+            static bool isEnabled(LogLevel level, const char* module);
+            /**
+             * @brief configure Read the levels from a settings file, replacing the current ones. Done automatically,
+             * with the default file, before the first message.
+             */
+            static void configure(const std::string& filename = getDefaultFilename());
+            /**
+             * @brief setLevel Lowest level which is logged, for all modules or for one module.
+             */
+            static void setLevel(LogLevel level, const std::string& module = "");
+            /**
+             * @brief setConsoleLevel Lowest level which is also printed to the console.
+             */
+            static void setConsoleLevel(LogLevel level);
+            /**
+             * @brief flush Wait until all messages have been written.
+             */
+            static void flush();
+            static std::string getDefaultFilename();
+            static std::string getLogFolder();
+            /**
+             * @brief getLevel Parse a level name, such as info.
+             */
+            static LogLevel getLevel(const std::string& name);
+            static std::string getLevelName(LogLevel level);
+        private:
+            friend class LogMessage;
+            static void write(LogLevel level, const char* module, std::string text);
+    };
+} // End of namespace fast
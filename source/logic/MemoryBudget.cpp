@@ -0,0 +1,93 @@
+#include "MemoryBudget.h"
+#include "MemoryMonitor.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <chrono>
+
+namespace fast{
+    MemoryBudget::MemoryBudget(int64_t budget)
+    {
+        m_budget = std::max<int64_t>(0, budget);
+    }
+
+    void MemoryBudget::setEvictor(std::function<int64_t(int64_t)> evictor)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_evictor = evictor;
+    }
+
+    int64_t MemoryBudget::getBudget() const
+    {
+        return m_budget;
+    }
+
+    int64_t MemoryBudget::getReserved() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_reserved;
+    }
+
+    int64_t MemoryBudget::getUsed() const
+    {
+        const int64_t resident = MemoryMonitor::getResidentMemory();
+        if(m_runs == 0)
+            return resident;
+        // Running runs may not have reached their peak yet
+        return std::max(resident, m_baseline + m_reserved);
+    }
+
+    int64_t MemoryBudget::reserve(int64_t bytes)
+    {
+        if(m_budget == 0)
+            return 0;
+        // A run of unknown memory reserves the whole budget, so that it runs alone
+        const int64_t reservation = bytes > 0 ? std::min(bytes, m_budget) : m_budget;
+        const int64_t start = Tracer::now();
+        bool waited = false;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while(true) {
+            // Memory is only freed for the expected memory of a run, not for the reservation of a run of unknown memory
+            const int64_t missing = getUsed() + std::min(bytes, m_budget) - m_budget;
+            if(missing > 0 && m_evictor) {
+                auto evictor = m_evictor;
+                lock.unlock();
+                const int64_t freed = evictor(missing);
+                lock.lock();
+                m_baseline = std::max<int64_t>(0, m_baseline - freed);
+            }
+            if(m_runs == 0 || getUsed() + reservation <= m_budget)
+                break;
+            if(!waited) {
+                Logger::info("MemoryBudget") << "Waiting for memory, a run needs " << MemoryMonitor::formatSize(reservation)
+                                             << " and " << MemoryMonitor::formatSize(getUsed()) << " of " << MemoryMonitor::formatSize(m_budget) << " is used";
+                waited = true;
+            }
+            // Also woken regularly, as memory may be freed outside of the runs
+            m_released.wait_for(lock, std::chrono::seconds(1));
+        }
+        if(m_runs == 0) {
+            m_baseline = MemoryMonitor::getResidentMemory();
+            if(m_baseline + bytes > m_budget)
+                Logger::warning("MemoryBudget") << "A run needs " << MemoryMonitor::formatSize(bytes) << " with " << MemoryMonitor::formatSize(m_baseline)
+                                                << " used, which exceeds the budget of " << MemoryMonitor::formatSize(m_budget) << ", running it alone";
+        }
+        ++m_runs;
+        m_reserved += reservation;
+        if(waited)
+            Tracer::record("memory", "wait for memory", start, Tracer::now());
+        return reservation;
+    }
+
+    void MemoryBudget::release(int64_t bytes)
+    {
+        if(m_budget == 0)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_reserved -= bytes;
+            --m_runs;
+        }
+        m_released.notify_all();
+    }
+} // End of namespace fast
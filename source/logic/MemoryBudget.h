@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+namespace fast{
+    /**
+     * @brief Memory budget of the pipeline runs of a process, see the memory-budget setting of ExecutionPolicy.
+     *
+     * A run reserves the memory it is expected to use before it starts, and waits while the memory used by the
+     * process and the reservations of the running runs leave no room for it. A run which doesn't fit the budget on
+     * its own, or whose memory is unknown, runs alone instead of being refused. Before a run waits, the evictor is
+     * asked to free memory, e.g. by closing the pyramids of idle slides.
+     */
+    class MemoryBudget {
+        public:
+            /**
+             * @param budget Memory of the process in bytes, 0 for no budget.
+             */
+            MemoryBudget(int64_t budget = 0);
+            /**
+             * @brief setEvictor Set the function which frees memory when a run doesn't fit.
+             * @param evictor Gets the number of bytes to free, and returns the estimated number of bytes freed.
+             */
+            void setEvictor(std::function<int64_t(int64_t bytes)> evictor);
+            /**
+             * @brief reserve Wait until a run fits the budget, and reserve its memory.
+             * @param bytes Expected memory of the run, 0 if unknown.
+             * @return The reserved memory, which must be released with release when the run is done.
+             */
+            int64_t reserve(int64_t bytes);
+            void release(int64_t bytes);
+            int64_t getBudget() const;
+            /**
+             * @brief getReserved Memory reserved by the running runs.
+             */
+            int64_t getReserved() const;
+        private:
+            /**
+             * Memory which is used, or will be used by the running runs. Must be called with m_mutex locked.
+             */
+            int64_t getUsed() const;
+
+            int64_t m_budget;
+            int64_t m_reserved = 0;
+            int64_t m_baseline = 0; /* Memory of the process when the first of the running runs started */
+            int m_runs = 0;
+            std::function<int64_t(int64_t)> m_evictor;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_released;
+    };
+
+    /**
+     * @brief Reserves the memory of a run in a budget until it goes out of scope, see MemoryBudget::reserve.
+     */
+    class MemoryReservation {
+        public:
+            MemoryReservation(MemoryBudget& budget, int64_t bytes) : m_budget(budget), m_bytes(budget.reserve(bytes)) {};
+            ~MemoryReservation() {
+                m_budget.release(m_bytes);
+            };
+            MemoryReservation(const MemoryReservation&) = delete;
+            MemoryReservation& operator=(const MemoryReservation&) = delete;
+        private:
+            MemoryBudget& m_budget;
+            int64_t m_bytes;
+    };
+} // End of namespace fast
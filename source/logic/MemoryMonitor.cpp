@@ -0,0 +1,183 @@
+#include "MemoryMonitor.h"
+#include "Tracer.h"
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Data/Image.hpp>
+#include <FAST/Data/Tensor.hpp>
+#include <FAST/Data/DataTypes.hpp>
+#include <FAST/Utility.hpp>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace fast{
+    namespace {
+        // OpenSlide caches decoded tiles of each open slide, up to this size
+        const int64_t slideTileCacheSize = 32*1024*1024;
+
+        // Value of a field of /proc/meminfo, in bytes
+        int64_t readMemoryInfo(const std::string& field) {
+            std::ifstream file("/proc/meminfo");
+            std::string name;
+            int64_t kilobytes;
+            std::string unit;
+            while(file >> name >> kilobytes) {
+                std::getline(file, unit);
+                if(name == field + ":")
+                    return kilobytes*1024;
+            }
+            return 0;
+        }
+    }
+
+    MemoryMonitor::MemoryMonitor(int intervalMilliseconds)
+    {
+        m_interval = std::max(1, intervalMilliseconds);
+        m_start = getResidentMemory();
+        m_peak = m_start;
+        m_thread = std::thread(&MemoryMonitor::run, this);
+    }
+
+    MemoryMonitor::~MemoryMonitor()
+    {
+        stop();
+    }
+
+    void MemoryMonitor::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_condition.notify_all();
+        if(m_thread.joinable()) {
+            m_thread.join();
+            sample();
+        }
+    }
+
+    void MemoryMonitor::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while(!m_condition.wait_for(lock, std::chrono::milliseconds(m_interval), [this]() { return m_stopped; })) {
+            lock.unlock();
+            sample();
+            lock.lock();
+        }
+    }
+
+    void MemoryMonitor::sample()
+    {
+        const int64_t memory = getResidentMemory();
+        Tracer::recordCounter("resident memory", memory);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_peak = std::max(m_peak, memory);
+    }
+
+    int64_t MemoryMonitor::getStart() const
+    {
+        return m_start;
+    }
+
+    int64_t MemoryMonitor::getPeak() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_peak;
+    }
+
+    int64_t MemoryMonitor::getPeakIncrease() const
+    {
+        return std::max<int64_t>(0, getPeak() - m_start);
+    }
+
+    int64_t MemoryMonitor::getResidentMemory()
+    {
+#ifdef __linux__
+        // Total and resident pages
+        std::ifstream file("/proc/self/statm");
+        int64_t pages, residentPages;
+        if(file >> pages >> residentPages)
+            return residentPages*sysconf(_SC_PAGESIZE);
+#endif
+        return 0;
+    }
+
+    int64_t MemoryMonitor::getTotalMemory()
+    {
+        return readMemoryInfo("MemTotal");
+    }
+
+    int64_t MemoryMonitor::getAvailableMemory()
+    {
+        return readMemoryInfo("MemAvailable");
+    }
+
+    int64_t MemoryMonitor::getMemoryUsage(std::shared_ptr<DataObject> data)
+    {
+        if(auto pyramid = std::dynamic_pointer_cast<ImagePyramid>(data))
+            return getMemoryUsage(pyramid);
+        if(auto image = std::dynamic_pointer_cast<Image>(data))
+            return (int64_t)image->getWidth()*image->getHeight()*image->getDepth()*getSizeOfDataType(image->getDataType(), image->getNrOfChannels());
+        // Results of patch classification pipelines, which are stored as float tensors
+        if(auto tensor = std::dynamic_pointer_cast<Tensor>(data))
+            return (int64_t)tensor->getShape().getTotalSize()*sizeof(float);
+        return 0;
+    }
+
+    int64_t MemoryMonitor::getMemoryUsage(std::shared_ptr<ImagePyramid> pyramid)
+    {
+        if(!pyramid)
+            return 0;
+        if(pyramid->usesOpenSlide())
+            return slideTileCacheSize;
+        if(pyramid->usesTIFF())
+            return 0;
+        // Pyramids created by pipelines, such as segmentations which are not streamed, keep all levels in memory
+        int64_t size = 0;
+        for(int level = 0; level < pyramid->getNrOfLevels(); ++level)
+            size += (int64_t)pyramid->getLevelWidth(level)*pyramid->getLevelHeight(level)*pyramid->getNrOfChannels();
+        return size;
+    }
+
+    std::string MemoryMonitor::formatSize(int64_t bytes)
+    {
+        std::stringstream stream;
+        if(bytes < 1024*1024) {
+            stream << bytes / 1024 << " kB";
+        } else if(bytes < 1024*1024*1024) {
+            stream << bytes / (1024*1024) << " MB";
+        } else {
+            stream << std::fixed << std::setprecision(1) << bytes / (1024.0*1024.0*1024.0) << " GB";
+        }
+        return stream.str();
+    }
+
+    int64_t MemoryMonitor::parseSize(const std::string& size)
+    {
+        if(size.empty())
+            throw Exception("Empty memory size");
+        const char unit = std::toupper(size.back());
+        if(unit == '%')
+            return getTotalMemory() * std::stod(size.substr(0, size.size() - 1)) / 100;
+        const std::string number = std::isdigit(unit) ? size : size.substr(0, size.size() - 1);
+        const double value = std::stod(number);
+        switch(unit) {
+            case 'K':
+                return value*1024;
+            case 'M':
+                return value*1024*1024;
+            case 'G':
+                return value*1024*1024*1024;
+            case 'T':
+                return value*1024*1024*1024*1024;
+        }
+        if(!std::isdigit(unit))
+            throw Exception("Unknown unit of memory size " + size);
+        return value;
+    }
+} // End of namespace fast
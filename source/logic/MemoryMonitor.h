@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace fast{
+    class DataObject;
+    class ImagePyramid;
+
+    /**
+     * @brief Samples the resident memory of the process in a background thread while it exists, to find the peak
+     * memory of a pipeline run. The samples are also recorded in the trace of the run, see Tracer. The static
+     * functions account for the memory of the process and of data objects. Memory of the process is only reported
+     * on Linux, elsewhere it is 0.
+     */
+    class MemoryMonitor {
+        public:
+            /**
+             * @brief Start sampling.
+             * @param intervalMilliseconds Time between samples. Peaks shorter than this may be missed.
+             */
+            MemoryMonitor(int intervalMilliseconds = 100);
+            ~MemoryMonitor();
+            /**
+             * @brief stop Take a last sample and stop sampling.
+             */
+            void stop();
+            /**
+             * @brief getStart Resident memory when sampling started, in bytes.
+             */
+            int64_t getStart() const;
+            /**
+             * @brief getPeak Highest resident memory sampled, in bytes.
+             */
+            int64_t getPeak() const;
+            /**
+             * @brief getPeakIncrease Memory used by the run, i.e. the peak above the memory used before it started.
+             * Includes the memory of other runs in the same process at the same time.
+             */
+            int64_t getPeakIncrease() const;
+
+            /**
+             * @brief getResidentMemory Physical memory used by the process, in bytes.
+             */
+            static int64_t getResidentMemory();
+            /**
+             * @brief getTotalMemory Physical memory of the computer, in bytes.
+             */
+            static int64_t getTotalMemory();
+            /**
+             * @brief getAvailableMemory Physical memory which can be used without swapping, in bytes.
+             */
+            static int64_t getAvailableMemory();
+            /**
+             * @brief getMemoryUsage Estimated memory of a data object, in bytes. Pyramids which are read from a file
+             * only count the tiles cached by the reader.
+             */
+            static int64_t getMemoryUsage(std::shared_ptr<DataObject> data);
+            static int64_t getMemoryUsage(std::shared_ptr<ImagePyramid> pyramid);
+            /**
+             * @brief formatSize A size as e.g. "512 MB" or "3.2 GB".
+             */
+            static std::string formatSize(int64_t bytes);
+            /**
+             * @brief parseSize Parse a size such as 512M, 24G, or 75% of the physical memory.
+             * @return The size in bytes.
+             */
+            static int64_t parseSize(const std::string& size);
+        private:
+            void run();
+            void sample();
+
+            int m_interval;
+            int64_t m_start = 0;
+            int64_t m_peak = 0;
+            bool m_stopped = false;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_condition;
+            std::thread m_thread;
+    };
+} // End of namespace fast
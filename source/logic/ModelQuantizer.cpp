@@ -0,0 +1,404 @@
+#include "ModelQuantizer.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include "Project.h"
+#include "ModelRegistry.h"
+#include "PatchGrid.h"
+#include "PatchScheduler.h"
+#include "PipelineRewriter.h"
+#include "BatchSizeTuner.h"
+#include <FAST/Utility.hpp>
+#include <FAST/Data/Image.hpp>
+#include <FAST/Data/Tensor.hpp>
+#include <FAST/Data/Batch.hpp>
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Algorithms/NeuralNetwork/NeuralNetwork.hpp>
+#include <FAST/Algorithms/ImageResizer/ImageResizer.hpp>
+#include <QCoreApplication>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+
+namespace fast{
+    namespace {
+        // Class of each position of an output. Classification outputs are a vector of class probabilities, with a
+        // batch dimension of 1 for some models. Segmentation outputs have two spatial dimensions, followed by the
+        // classes, which are left out by some models with a single class. A single class is a foreground probability.
+        std::vector<int> getLabels(const std::shared_ptr<Tensor>& tensor, int& classes, bool& segmentation) {
+            const auto shape = tensor->getShape();
+            const int dimensions = shape.getNrOfDimensions();
+            segmentation = dimensions >= 3 || (dimensions == 2 && shape[0] > 1);
+            const int channels = dimensions == 2 && segmentation ? 1 : shape[dimensions - 1];
+            const int positions = shape.getTotalSize() / std::max(channels, 1);
+            classes = std::max(channels, 2);
+            auto access = tensor->getAccess(ACCESS_READ);
+            const float* values = access->getRawData();
+            std::vector<int> labels(positions);
+            for(int i = 0; i < positions; ++i) {
+                const float* position = &values[i*channels];
+                labels[i] = channels == 1 ? (position[0] > 0.5f ? 1 : 0) : std::max_element(position, position + channels) - position;
+            }
+            return labels;
+        }
+
+        std::string getPython() {
+            const char* python = std::getenv("FASTPATHOLOGY_PYTHON");
+            return python == nullptr ? "python3" : python;
+        }
+
+        // Python modules which can't be imported, so that a missing module is reported before the script runs
+        std::vector<std::string> getMissingModules(const std::vector<std::string>& modules) {
+            QStringList arguments = {"-c", "import importlib.util, sys; print(' '.join(m for m in sys.argv[1:] if importlib.util.find_spec(m) is None))"};
+            for(const auto& module : modules)
+                arguments << QString::fromStdString(module);
+            QProcess process;
+            process.start(QString::fromStdString(getPython()), arguments);
+            if(!process.waitForStarted())
+                throw Exception("Unable to start Python, set FASTPATHOLOGY_PYTHON to the Python executable");
+            process.waitForFinished(-1);
+            if(process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+                throw Exception("Unable to check the Python modules: " + process.readAllStandardError().toStdString());
+            const std::string missing = process.readAllStandardOutput().trimmed().toStdString();
+            if(missing.empty())
+                return {};
+            return split(missing, " ");
+        }
+    }
+
+    std::string QuantizationResult::toString() const
+    {
+        std::stringstream stream;
+        stream << precision << ": ";
+        if(!error.empty()) {
+            stream << "failed, " << error;
+            return stream.str();
+        }
+        stream << std::fixed << std::setprecision(2);
+        if(originalThroughput > 0)
+            stream << throughput / originalThroughput << "x the throughput of fp32 (" << throughput << " vs " << originalThroughput << " patches per second), ";
+        stream << std::setprecision(3) << metric << " " << agreement << " with fp32, " << filename;
+        return stream.str();
+    }
+
+    ModelQuantizer::ModelQuantizer(std::string model, std::shared_ptr<Project> project)
+    {
+        m_model = model;
+        m_project = project;
+    }
+
+    void ModelQuantizer::setPatches(int calibrationPatches, int evaluationPatches)
+    {
+        m_calibrationPatches = std::max(1, calibrationPatches);
+        m_evaluationPatches = std::max(1, evaluationPatches);
+    }
+
+    void ModelQuantizer::setInferenceEngine(std::string engine, std::string device)
+    {
+        m_engine = engine;
+        m_device = device;
+    }
+
+    std::string ModelQuantizer::getVariantFilename(const std::string& model, const std::string& precision)
+    {
+        const auto extension = model.rfind('.');
+        const auto folder = model.find_last_of("/\\");
+        if(extension == std::string::npos || (folder != std::string::npos && extension < folder))
+            return model + "_" + precision;
+        return model.substr(0, extension) + "_" + precision + model.substr(extension);
+    }
+
+    std::string ModelQuantizer::getPrecision(const PipelineRewriter& pipeline, const std::string& policyPrecision)
+    {
+        const std::string precision = policyPrecision.empty() ? pipeline.getPipelineAttribute("model-precision") : policyPrecision;
+        return precision == "fp32" ? "" : precision;
+    }
+
+    bool ModelQuantizer::selectPrecision(PipelineRewriter& pipeline, const std::string& precision)
+    {
+        if(precision.empty() || precision == "fp32")
+            return false;
+        bool changed = false;
+        for(const auto& type : ModelRegistry::getNetworkTypes()) {
+            for(const auto& id : pipeline.getProcessObjects(type)) {
+                const std::string model = pipeline.getAttribute(id, "model");
+                if(model.empty())
+                    continue;
+                const std::string variant = getVariantFilename(model, precision);
+                if(!fileExists(variant)) {
+                    Logger::warning("ModelQuantizer") << "No " << precision << " variant of " << model << ", using the original model";
+                    continue;
+                }
+                pipeline.setAttribute(id, "model", "\"" + variant + "\"");
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    std::vector<std::shared_ptr<Image>> ModelQuantizer::readPatches(const ModelInfo& info, int count) const
+    {
+        TraceSpan span("model", "read calibration patches");
+        int width, height, channels;
+        info.getInputSize(width, height, channels);
+        const auto uids = m_project->getAllWsiUids();
+        std::vector<std::shared_ptr<Image>> patches;
+        for(int slide = 0; slide < uids.size() && patches.size() < count; ++slide) {
+            // The remaining patches are spread over the remaining slides
+            const int remainingSlides = uids.size() - slide;
+            const int wanted = (count - patches.size() + remainingSlides - 1) / remainingSlides;
+            try {
+                auto pyramid = m_project->getImage(uids[slide])->get_image_pyramid();
+                const PatchGrid grid = PatchGrid::create(pyramid, width, height, info.magnification);
+                // Patches which are mostly tissue, as the background says little about the activation ranges
+                const auto tissue = PatchScheduler(0.5f).schedule(pyramid, grid);
+                const int selected = std::min<int>(wanted, tissue.size());
+                auto access = pyramid->getAccess(ACCESS_READ);
+                for(int i = 0; i < selected; ++i) {
+                    int x, y, regionWidth, regionHeight;
+                    grid.getRegion(tissue[(int64_t)i*tissue.size() / selected], x, y, regionWidth, regionHeight);
+                    // Patches at the border of the slide are cut off
+                    if(regionWidth < grid.regionWidth || regionHeight < grid.regionHeight)
+                        continue;
+                    auto patch = access->getPatchAsImage(grid.level, x, y, regionWidth, regionHeight);
+                    if(regionWidth != width || regionHeight != height)
+                        patch = ImageResizer::create(width, height)->connect(patch)->runAndGetOutputData<Image>();
+                    patches.push_back(patch);
+                }
+            } catch(std::exception& e) {
+                Logger::warning("ModelQuantizer") << "Unable to read patches of " << uids[slide] << ": " << e.what();
+            }
+        }
+        return patches;
+    }
+
+    void ModelQuantizer::writeCalibrationSet(const std::vector<std::shared_ptr<Image>>& patches, int channels, const std::string& filename)
+    {
+        // NumPy array of uint8 patches, patches x height x width x channels
+        const int width = patches[0]->getWidth();
+        const int height = patches[0]->getHeight();
+        std::string header = "{'descr': '|u1', 'fortran_order': False, 'shape': (" + std::to_string(patches.size()) + ", " +
+                std::to_string(height) + ", " + std::to_string(width) + ", " + std::to_string(channels) + "), }";
+        // The header is padded with spaces so that the data is 64 byte aligned, and ends with a newline
+        header.append(63 - (10 + header.size()) % 64, ' ');
+        header += "\n";
+        std::ofstream file(filename, std::ios::binary);
+        if(!file.is_open())
+            throw Exception("Unable to write " + filename);
+        file.write("\x93NUMPY\x01\x00", 8);
+        const uint16_t headerSize = header.size();
+        file.put(headerSize & 0xFF);
+        file.put(headerSize >> 8);
+        file << header;
+        std::vector<char> pixels(width*height*channels);
+        for(const auto& patch : patches) {
+            if(patch->getDataType() != TYPE_UINT8)
+                throw Exception("Calibration patches must be 8 bit");
+            const int patchChannels = patch->getNrOfChannels();
+            auto access = patch->getImageAccess(ACCESS_READ);
+            const auto data = (const uchar*)access->get();
+            // Extra channels of the slide, such as alpha, are dropped
+            for(int i = 0; i < width*height; ++i) {
+                for(int c = 0; c < channels; ++c)
+                    pixels[i*channels + c] = data[i*patchChannels + std::min(c, patchChannels - 1)];
+            }
+            file.write(pixels.data(), pixels.size());
+        }
+    }
+
+    std::string ModelQuantizer::getScriptFilename()
+    {
+        const char* script = std::getenv("FASTPATHOLOGY_QUANTIZE_SCRIPT");
+        if(script != nullptr)
+            return script;
+        // Installed next to the executable
+        if(QCoreApplication::instance() != nullptr) {
+            const std::string filename = join(QCoreApplication::applicationDirPath().toStdString(), "quantize_model.py");
+            if(fileExists(filename))
+                return filename;
+        }
+        throw Exception("quantize_model.py not found, set FASTPATHOLOGY_QUANTIZE_SCRIPT to its location");
+    }
+
+    void ModelQuantizer::createVariant(const ModelInfo& info, const std::string& precision, const std::string& calibrationFilename, const std::string& filename) const
+    {
+        TraceSpan span("model", Tracer::intern("create " + precision + " variant"));
+        // Module names and the pip packages which provide them
+        std::vector<std::pair<std::string, std::string>> modules = {{"numpy", "numpy"}, {"onnx", "onnx"}};
+        if(precision == "fp16") {
+            modules.push_back({"onnxconverter_common", "onnxconverter-common"});
+        } else {
+            modules.push_back({"onnxruntime", "onnxruntime"});
+        }
+        std::vector<std::string> names;
+        for(const auto& module : modules)
+            names.push_back(module.first);
+        std::string packages;
+        for(const auto& missing : getMissingModules(names)) {
+            for(const auto& module : modules) {
+                if(module.first == missing)
+                    packages += " " + module.second;
+            }
+        }
+        if(!packages.empty())
+            throw Exception("The " + precision + " variant requires Python packages which are not installed for " + getPython() + ", install them with: pip install" + packages);
+
+        QProcess process;
+        process.setProcessChannelMode(QProcess::MergedChannels);
+        process.start(QString::fromStdString(getPython()), {
+            QString::fromStdString(getScriptFilename()),
+            QString::fromStdString(info.filename),
+            QString::fromStdString(filename),
+            "--precision", QString::fromStdString(precision),
+            "--calibration", QString::fromStdString(calibrationFilename),
+            "--scale-factor", QString::number(info.scaleFactor),
+        });
+        if(!process.waitForStarted())
+            throw Exception("Unable to start Python, set FASTPATHOLOGY_PYTHON to the Python executable");
+        process.waitForFinished(-1);
+        const std::string output = process.readAll().toStdString();
+        Logger::debug("ModelQuantizer") << output;
+        if(process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+            throw Exception("quantize_model.py failed: " + output);
+    }
+
+    ModelQuantizer::Evaluation ModelQuantizer::evaluate(const std::string& model, float scaleFactor, int batchSize, const std::vector<std::shared_ptr<Image>>& patches) const
+    {
+        TraceSpan span("inference", "evaluate model");
+        // The model is loaded once, for both the outputs and the throughput
+        auto network = NeuralNetwork::New();
+        if(!m_engine.empty())
+            network->setInferenceEngine(m_engine);
+        if(m_device == "CPU") {
+            network->getInferenceEngine()->setDeviceType(InferenceDeviceType::CPU);
+        } else if(m_device == "GPU") {
+            network->getInferenceEngine()->setDeviceType(InferenceDeviceType::GPU);
+        }
+        network->getInferenceEngine()->setMaxBatchSize(batchSize);
+        network->setScaleFactor(scaleFactor);
+        network->load(model);
+        Evaluation evaluation;
+        for(const auto& patch : patches) {
+            network->connect(patch);
+            evaluation.outputs.push_back(network->runAndGetOutputData<Tensor>());
+        }
+
+        // Throughput in batches of the size pipelines run the model with, see BatchSizeTuner
+        std::vector<Image::pointer> batch;
+        for(int i = 0; i < batchSize; ++i)
+            batch.push_back(patches[i % patches.size()]);
+        const int warmUpBatches = 3;
+        const int timedBatches = 10;
+        std::chrono::high_resolution_clock::time_point start;
+        for(int i = 0; i < warmUpBatches + timedBatches; ++i) {
+            // Engines such as TensorRT and OpenVINO are slower for the first batches, which aren't timed
+            if(i == warmUpBatches)
+                start = std::chrono::high_resolution_clock::now();
+            // A new batch object is needed for the network to execute again
+            network->connect(Batch::create(batch));
+            network->runAndGetOutputData<DataObject>();
+        }
+        std::chrono::duration<float> time = std::chrono::high_resolution_clock::now() - start;
+        evaluation.throughput = batchSize*timedBatches / time.count();
+        return evaluation;
+    }
+
+    float ModelQuantizer::compare(const std::vector<std::shared_ptr<Tensor>>& original, const std::vector<std::shared_ptr<Tensor>>& variant, std::string& metric)
+    {
+        int agreeing = 0;
+        bool segmentation = false;
+        // Per foreground class, over all patches
+        std::vector<int64_t> intersection, originalSize, variantSize;
+        for(int i = 0; i < original.size(); ++i) {
+            int classes;
+            bool variantSegmentation;
+            const auto originalLabels = getLabels(original[i], classes, segmentation);
+            const auto variantLabels = getLabels(variant[i], classes, variantSegmentation);
+            if(originalLabels.size() != variantLabels.size() || segmentation != variantSegmentation)
+                throw Exception("The outputs of the variant have another shape than the original model's");
+            if(!segmentation) {
+                agreeing += originalLabels[0] == variantLabels[0] ? 1 : 0;
+                continue;
+            }
+            intersection.resize(classes);
+            originalSize.resize(classes);
+            variantSize.resize(classes);
+            for(int j = 0; j < originalLabels.size(); ++j) {
+                ++originalSize[originalLabels[j]];
+                ++variantSize[variantLabels[j]];
+                intersection[originalLabels[j]] += originalLabels[j] == variantLabels[j] ? 1 : 0;
+            }
+        }
+        if(!segmentation) {
+            metric = "agreement";
+            return original.empty() ? 1 : (float)agreeing / original.size();
+        }
+        metric = "Dice";
+        float dice = 0;
+        int present = 0;
+        // Class 0 is the background
+        for(int c = 1; c < intersection.size(); ++c) {
+            if(originalSize[c] + variantSize[c] == 0)
+                continue;
+            dice += 2.0f*intersection[c] / (originalSize[c] + variantSize[c]);
+            ++present;
+        }
+        return present > 0 ? dice / present : 1;
+    }
+
+    std::vector<QuantizationResult> ModelQuantizer::run(const std::vector<std::string>& precisions)
+    {
+        const ModelInfo info = ModelRegistry().getModel(m_model);
+        if(info.format != "ONNX")
+            throw Exception("Only ONNX models can be quantized, " + m_model + " is a " + info.format + " model");
+        int width, height, channels;
+        if(!info.getInputSize(width, height, channels))
+            throw Exception("The input size of " + m_model + " is unknown. The model must be used by a pipeline with a PatchGenerator, or have a fixed input shape");
+
+        auto patches = readPatches(info, m_calibrationPatches + m_evaluationPatches);
+        if(patches.size() < 2)
+            throw Exception("The project has too few patches with tissue to calibrate " + m_model);
+        // The calibration and evaluation patches come from all slides
+        std::shuffle(patches.begin(), patches.end(), std::mt19937(0));
+        const int calibrationCount = std::min<int>(patches.size() - 1, std::max<int>(1,
+                std::round((float)patches.size()*m_calibrationPatches / (m_calibrationPatches + m_evaluationPatches))));
+        const std::vector<std::shared_ptr<Image>> calibration(patches.begin(), patches.begin() + calibrationCount);
+        const std::vector<std::shared_ptr<Image>> evaluation(patches.begin() + calibrationCount, patches.end());
+        Logger::info("ModelQuantizer") << "Read " << calibration.size() << " calibration and " << evaluation.size()
+                                       << " evaluation patches of " << width << "x" << height << " for " << m_model;
+        QTemporaryDir folder;
+        const std::string calibrationFilename = join(folder.path().toStdString(), "calibration.npy");
+        writeCalibrationSet(calibration, channels, calibrationFilename);
+
+        // Each model is measured with its own batch size, as pipelines run it with batching enabled
+        BatchSizeTuner tuner;
+        const auto original = evaluate(info.filename, info.scaleFactor, tuner.getBatchSize(info.filename, m_engine, m_device, width, height, channels), evaluation);
+        std::vector<QuantizationResult> results;
+        for(const auto& precision : precisions) {
+            QuantizationResult result;
+            result.precision = precision;
+            result.filename = getVariantFilename(info.filename, precision);
+            result.originalThroughput = original.throughput;
+            try {
+                if(precision != "fp16" && precision != "int8")
+                    throw Exception("Unknown precision " + precision + ", must be fp16 or int8");
+                createVariant(info, precision, calibrationFilename, result.filename);
+                ModelRegistry().getModel(result.filename);
+                const auto variant = evaluate(result.filename, info.scaleFactor, tuner.getBatchSize(result.filename, m_engine, m_device, width, height, channels), evaluation);
+                result.throughput = variant.throughput;
+                result.agreement = compare(original.outputs, variant.outputs, result.metric);
+            } catch(std::exception& e) {
+                result.error = e.what();
+            }
+            Logger::info("ModelQuantizer") << result.toString();
+            results.push_back(result);
+        }
+        return results;
+    }
+} // End of namespace fast
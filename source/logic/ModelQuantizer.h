@@ -0,0 +1,113 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace fast{
+    class Project;
+    class Image;
+    class Tensor;
+    class PipelineRewriter;
+    struct ModelInfo;
+
+    /**
+     * @brief A reduced precision variant of a model, compared to the original model.
+     */
+    class QuantizationResult {
+        public:
+            std::string precision; /* fp16 or int8 */
+            std::string filename;
+            float throughput = 0; /* Patches per second of the variant, at its tuned batch size */
+            float originalThroughput = 0; /* Patches per second of the original model, at its tuned batch size */
+            std::string metric; /* Dice for segmentation, agreement for classification */
+            float agreement = 0; /* Of the variant's output with the original model's, from 0 to 1 */
+            std::string error; /* Why the variant couldn't be created or measured, empty if it could */
+
+            std::string toString() const;
+    };
+
+    /**
+     * @brief Creates fp16 and int8 variants of an ONNX model, and reports how much faster they are and how well
+     * their output agrees with the original model's.
+     *
+     * Patches with tissue are read from the slides of a project, at the magnification and patch size of the
+     * pipelines using the model, see ModelRegistry. One part is the calibration set for the int8 activation
+     * ranges, the other part is used to compare the outputs: the Dice score of the argmax segmentation, averaged
+     * over the foreground classes, or the fraction of patches with the same class.
+     *
+     * The variants are created by misc/quantize_model.py with ONNX Runtime, which needs the Python packages onnx
+     * and onnxconverter-common for fp16 and onnx and onnxruntime for int8. The variants are stored next to the
+     * model as <model>_fp16.onnx and <model>_int8.onnx, where pipelines select them with the model-precision
+     * attribute or execution policy setting. The throughput is measured at the batch size BatchSizeTuner selects
+     * for each model, after warm-up batches.
+     */
+    class ModelQuantizer {
+        public:
+            /**
+             * @param model Disk location of the ONNX model.
+             * @param project Project with the slides to read patches from.
+             */
+            ModelQuantizer(std::string model, std::shared_ptr<Project> project);
+            /**
+             * @brief setPatches Number of patches of the calibration set, and of the patches the outputs are
+             * compared on.
+             */
+            void setPatches(int calibrationPatches, int evaluationPatches);
+            /**
+             * @brief setInferenceEngine Engine and device for measuring the throughput and comparing the outputs.
+             * The engine's defaults if empty.
+             */
+            void setInferenceEngine(std::string engine, std::string device);
+            /**
+             * @brief run Create the variants of the model and compare them to the original. Throws an Exception
+             * if the model isn't an ONNX model, or the project has no patches with tissue.
+             * @param precisions fp16 and/or int8.
+             */
+            std::vector<QuantizationResult> run(const std::vector<std::string>& precisions = {"fp16", "int8"});
+
+            /**
+             * @brief getVariantFilename Disk location of a variant of a model, e.g. model_int8.onnx.
+             */
+            static std::string getVariantFilename(const std::string& model, const std::string& precision);
+            /**
+             * @brief getPrecision Precision a pipeline runs its models with: the execution policy's, if set, and
+             * otherwise the pipeline's model-precision attribute.
+             * @return fp16 or int8, or an empty string for the original models.
+             */
+            static std::string getPrecision(const PipelineRewriter& pipeline, const std::string& policyPrecision);
+            /**
+             * @brief selectPrecision Replace the models of a pipeline by their variants of a precision. Models
+             * without a variant are kept.
+             * @return Whether any model was replaced.
+             */
+            static bool selectPrecision(PipelineRewriter& pipeline, const std::string& precision);
+        private:
+            /**
+             * Patches with tissue, spread evenly over the slides of the project.
+             */
+            std::vector<std::shared_ptr<Image>> readPatches(const ModelInfo& info, int count) const;
+            static void writeCalibrationSet(const std::vector<std::shared_ptr<Image>>& patches, int channels, const std::string& filename);
+            void createVariant(const ModelInfo& info, const std::string& precision, const std::string& calibrationFilename, const std::string& filename) const;
+            struct Evaluation {
+                std::vector<std::shared_ptr<Tensor>> outputs; /* Of each patch */
+                float throughput = 0; /* Patches per second */
+            };
+            /**
+             * Outputs of a model for patches, and its throughput for batches of the patches, after warm-up batches.
+             */
+            Evaluation evaluate(const std::string& model, float scaleFactor, int batchSize, const std::vector<std::shared_ptr<Image>>& patches) const;
+            /**
+             * Agreement of the outputs of two models, with the task of the model inferred from the output shape.
+             */
+            static float compare(const std::vector<std::shared_ptr<Tensor>>& original, const std::vector<std::shared_ptr<Tensor>>& variant, std::string& metric);
+            static std::string getScriptFilename();
+
+            std::string m_model;
+            std::shared_ptr<Project> m_project;
+            int m_calibrationPatches = 200;
+            int m_evaluationPatches = 100;
+            std::string m_engine;
+            std::string m_device;
+    };
+} // End of namespace fast
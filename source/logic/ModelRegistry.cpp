@@ -0,0 +1,393 @@
+#include "ModelRegistry.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include "ZipExtractor.h"
+#include "PipelineRewriter.h"
+#include "InferenceBenchmark.h"
+#include "BatchSizeTuner.h"
+#include <FAST/Utility.hpp>
+#include <FAST/Algorithms/NeuralNetwork/NeuralNetwork.hpp>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+namespace fast{
+    namespace {
+        std::vector<std::string> splitFields(const std::string& text, char separator) {
+            std::vector<std::string> fields;
+            std::stringstream stream(text);
+            std::string field;
+            while(std::getline(stream, field, separator))
+                fields.push_back(field);
+            return fields;
+        }
+
+        // Nodes are stored as name:1x256x256x3;name:...
+        std::string formatNodes(const std::vector<ModelNode>& nodes) {
+            std::string text;
+            for(const auto& node : nodes) {
+                if(!text.empty())
+                    text += ";";
+                text += node.name + ":";
+                for(int i = 0; i < node.shape.size(); ++i)
+                    text += (i > 0 ? "x" : "") + std::to_string(node.shape[i]);
+            }
+            return text;
+        }
+
+        std::vector<ModelNode> parseNodes(const std::string& text) {
+            std::vector<ModelNode> nodes;
+            for(const auto& field : splitFields(text, ';')) {
+                const auto separator = field.rfind(':');
+                if(separator == std::string::npos)
+                    continue;
+                ModelNode node;
+                node.name = field.substr(0, separator);
+                for(const auto& dimension : splitFields(field.substr(separator + 1), 'x'))
+                    node.shape.push_back(std::stoi(dimension));
+                nodes.push_back(node);
+            }
+            return nodes;
+        }
+
+        template <class Nodes>
+        std::vector<ModelNode> getNodes(const Nodes& nodes) {
+            std::vector<ModelNode> result;
+            for(const auto& node : nodes)
+                result.push_back({node.first, node.second.shape.getAll()});
+            // The engines keep the nodes in a hash map
+            std::sort(result.begin(), result.end(), [](const ModelNode& a, const ModelNode& b) { return a.name < b.name; });
+            return result;
+        }
+    }
+
+    std::mutex ModelRegistry::m_mutex;
+
+    const std::vector<std::string>& ModelRegistry::getNetworkTypes()
+    {
+        static const std::vector<std::string> types = {"NeuralNetwork", "SegmentationNetwork", "BoundingBoxNetwork", "ImageToImageNetwork"};
+        return types;
+    }
+
+    bool ModelInfo::getInputSize(int& width, int& height, int& channels) const
+    {
+        channels = 3;
+        int shapeWidth = 0;
+        int shapeHeight = 0;
+        if(inputs.size() == 1 && inputs[0].shape.size() == 4) {
+            const auto& shape = inputs[0].shape;
+            if(shape[3] > 0 && shape[3] <= 4) {
+                // Channels last
+                shapeHeight = shape[1];
+                shapeWidth = shape[2];
+                channels = shape[3];
+            } else if(shape[1] > 0 && shape[1] <= 4) {
+                shapeHeight = shape[2];
+                shapeWidth = shape[3];
+                channels = shape[1];
+            }
+        }
+        width = patchWidth > 0 ? patchWidth : shapeWidth;
+        height = patchHeight > 0 ? patchHeight : shapeHeight;
+        return width > 0 && height > 0;
+    }
+
+    std::string ModelInfo::toString() const
+    {
+        std::stringstream stream;
+        stream << format;
+        int width, height, channels;
+        if(getInputSize(width, height, channels))
+            stream << ", input " << width << "x" << height << "x" << channels;
+        if(magnification > 0)
+            stream << " at " << magnification << "x";
+        if(!engine.empty())
+            stream << ", " << engine;
+        return stream.str();
+    }
+
+    ModelRegistry::ModelRegistry()
+    {
+        m_filename = QDir::home().path().toStdString() + "/fastpathology/model_registry.txt";
+        load();
+    }
+
+    void ModelRegistry::load()
+    {
+        std::ifstream file(m_filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            // filename \t size \t modified \t sha256 \t format \t engine \t inputs \t outputs \t magnification \t patch size
+            // \t scale factor, which registries of older versions don't have
+            const auto fields = splitFields(line, '\t');
+            if(fields.size() < 10)
+                continue;
+            try {
+                ModelInfo info;
+                info.filename = fields[0];
+                info.size = std::stoll(fields[1]);
+                info.modified = std::stoll(fields[2]);
+                info.sha256 = fields[3];
+                info.format = fields[4];
+                info.engine = fields[5];
+                info.inputs = parseNodes(fields[6]);
+                info.outputs = parseNodes(fields[7]);
+                info.magnification = std::stof(fields[8]);
+                const auto patchSize = splitFields(fields[9], 'x');
+                if(patchSize.size() == 2) {
+                    info.patchWidth = std::stoi(patchSize[0]);
+                    info.patchHeight = std::stoi(patchSize[1]);
+                }
+                if(fields.size() > 10)
+                    info.scaleFactor = std::stof(fields[10]);
+                m_models[info.filename] = info;
+            } catch(std::exception& e) {
+            }
+        }
+    }
+
+    void ModelRegistry::save() const
+    {
+        QSaveFile file(QString::fromStdString(m_filename));
+        if(!file.open(QIODevice::WriteOnly)) {
+            Logger::warning("ModelRegistry") << "Unable to write model registry " << m_filename;
+            return;
+        }
+        std::stringstream stream;
+        for(const auto& model : m_models) {
+            const auto& info = model.second;
+            stream << info.filename << "\t" << info.size << "\t" << info.modified << "\t" << info.sha256 << "\t"
+                   << info.format << "\t" << info.engine << "\t" << formatNodes(info.inputs) << "\t"
+                   << formatNodes(info.outputs) << "\t" << info.magnification << "\t"
+                   << info.patchWidth << "x" << info.patchHeight << "\t" << info.scaleFactor << "\n";
+        }
+        file.write(QByteArray::fromStdString(stream.str()));
+        file.commit();
+    }
+
+    std::string ModelRegistry::getFormat(const std::string& filename)
+    {
+        const std::string suffix = QFileInfo(QString::fromStdString(filename)).suffix().toLower().toStdString();
+        if(suffix == "onnx")
+            return "ONNX";
+        if(suffix == "xml")
+            return "OpenVINO";
+        if(suffix == "pb")
+            return "TensorFlow";
+        if(suffix == "uff")
+            return "UFF";
+        return "";
+    }
+
+    std::string ModelRegistry::getCanonicalFilename(const std::string& filename)
+    {
+        const QString canonical = QFileInfo(QString::fromStdString(filename)).canonicalFilePath();
+        // Empty if the file doesn't exist
+        return canonical.isEmpty() ? filename : canonical.toStdString();
+    }
+
+    bool ModelRegistry::findModel(const std::string& filename, ModelInfo& info) const
+    {
+        const std::string canonical = getCanonicalFilename(filename);
+        auto it = m_models.find(canonical);
+        if(it == m_models.end())
+            return false;
+        QFileInfo file(QString::fromStdString(canonical));
+        if(!file.exists() || file.size() != it->second.size || file.lastModified().toMSecsSinceEpoch() != it->second.modified)
+            return false;
+        info = it->second;
+        return true;
+    }
+
+    std::string ModelRegistry::findModelByHash(const std::string& sha256) const
+    {
+        for(const auto& model : m_models) {
+            if(model.second.sha256 == sha256 && fileExists(model.first))
+                return model.first;
+        }
+        return "";
+    }
+
+    ModelInfo ModelRegistry::index(const std::string& filename)
+    {
+        TraceSpan span("model", Tracer::intern("index " + getFileName(filename)));
+        ModelInfo info;
+        info.filename = filename;
+        info.format = getFormat(filename);
+        if(info.format.empty())
+            throw Exception("Unknown model format of " + filename);
+        QFileInfo file(QString::fromStdString(filename));
+        info.size = file.size();
+        info.modified = file.lastModified().toMSecsSinceEpoch();
+        info.sha256 = ZipExtractor::getSHA256(filename);
+        if(info.sha256.empty())
+            throw Exception("Unable to read model " + filename);
+
+        auto network = NeuralNetwork::New();
+        network->load(filename);
+        auto engine = network->getInferenceEngine();
+        info.engine = engine->getName();
+        info.inputs = getNodes(engine->getInputNodes());
+        info.outputs = getNodes(engine->getOutputNodes());
+        Logger::info("ModelRegistry") << "Indexed model " << filename << ": " << info.toString();
+        return info;
+    }
+
+    ModelInfo ModelRegistry::getModel(const std::string& filename)
+    {
+        ModelInfo info;
+        if(findModel(filename, info))
+            return info;
+        info = index(getCanonicalFilename(filename));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Reload, as another thread or process may have indexed models in the meantime
+        m_models.clear();
+        load();
+        // The magnification, patch size and scale factor come from the pipelines, and don't change with the model
+        auto previous = m_models.find(info.filename);
+        if(previous != m_models.end()) {
+            info.magnification = previous->second.magnification;
+            info.patchWidth = previous->second.patchWidth;
+            info.patchHeight = previous->second.patchHeight;
+            info.scaleFactor = previous->second.scaleFactor;
+        }
+        m_models[info.filename] = info;
+        save();
+        return info;
+    }
+
+    std::vector<std::string> ModelRegistry::getModelFilenames(const std::string& folder)
+    {
+        std::vector<std::string> filenames;
+        for(const auto& name : getDirectoryList(folder)) {
+            if(!getFormat(name).empty())
+                filenames.push_back(getCanonicalFilename(join(folder, name)));
+        }
+        return filenames;
+    }
+
+    void ModelRegistry::indexPipelines(const std::string& pipelineFolder)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_models.clear();
+        load();
+        for(auto it = m_models.begin(); it != m_models.end();) {
+            if(!fileExists(it->first)) {
+                it = m_models.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for(const auto& name : getDirectoryList(pipelineFolder)) {
+            try {
+                PipelineRewriter rewriter(join(pipelineFolder, name));
+                const auto generators = rewriter.getProcessObjects("PatchGenerator");
+                for(const auto& type : getNetworkTypes()) {
+                    for(const auto& id : rewriter.getProcessObjects(type)) {
+                        auto model = m_models.find(getCanonicalFilename(rewriter.getAttribute(id, "model")));
+                        if(model == m_models.end())
+                            continue;
+                        const std::string scaleFactor = rewriter.getAttribute(id, "scale-factor");
+                        if(!scaleFactor.empty())
+                            model->second.scaleFactor = std::stof(scaleFactor);
+                        const auto input = split(rewriter.getInput(id, 0), " ");
+                        if(input.empty() || std::find(generators.begin(), generators.end(), input[0]) == generators.end())
+                            continue;
+                        const std::string magnification = rewriter.getAttribute(input[0], "patch-magnification");
+                        const auto patchSize = split(rewriter.getAttribute(input[0], "patch-size"), " ");
+                        if(!magnification.empty())
+                            model->second.magnification = std::stof(magnification);
+                        if(patchSize.size() >= 2) {
+                            model->second.patchWidth = std::stoi(patchSize[0]);
+                            model->second.patchHeight = std::stoi(patchSize[1]);
+                        }
+                    }
+                }
+            } catch(std::exception& e) {
+                // Not a pipeline
+            }
+        }
+        save();
+    }
+
+    ModelWarmUp::ModelWarmUp(std::string modelFolder, std::string pipelineFolder, std::vector<std::string> filenames,
+                             std::string engine, std::string device, bool batching)
+    {
+        m_modelFolder = modelFolder;
+        m_pipelineFolder = pipelineFolder;
+        m_filenames = filenames;
+        m_engine = engine;
+        m_device = device;
+        m_batching = batching;
+        m_stop = false;
+        m_done = false;
+        m_thread = std::thread(&ModelWarmUp::run, this);
+    }
+
+    ModelWarmUp::~ModelWarmUp()
+    {
+        stop();
+        m_thread.join();
+    }
+
+    void ModelWarmUp::stop()
+    {
+        m_stop = true;
+    }
+
+    bool ModelWarmUp::isDone() const
+    {
+        return m_done;
+    }
+
+    void ModelWarmUp::run()
+    {
+        Tracer::setThreadName("Model warm-up");
+        for(const auto& filename : ModelRegistry::getModelFilenames(m_modelFolder)) {
+            if(m_stop)
+                break;
+            try {
+                ModelRegistry().getModel(filename);
+            } catch(std::exception& e) {
+                Logger::warning("ModelWarmUp") << "Unable to index model " << filename << ": " << e.what();
+            }
+        }
+        if(!m_stop)
+            ModelRegistry().indexPipelines(m_pipelineFolder);
+
+        for(const auto& filename : m_filenames) {
+            if(m_stop)
+                break;
+            try {
+                const ModelInfo info = ModelRegistry().getModel(filename);
+                int width, height, channels;
+                if(!info.getInputSize(width, height, channels))
+                    continue;
+                std::string engine = m_engine;
+                if(engine == "fastest") {
+                    InferenceBenchmark benchmark;
+                    benchmark.setStopFlag(&m_stop);
+                    engine = benchmark.getFastestEngine(info.filename, m_device, width, height, channels);
+                } else if(!m_batching) {
+                    // A single batch, which compiles the model for engines which cache it
+                    InferenceBenchmark::measureThroughput(info.filename, engine, m_device, width, height, channels, 1, 1, &m_stop);
+                }
+                if(m_batching) {
+                    BatchSizeTuner tuner;
+                    tuner.setStopFlag(&m_stop);
+                    tuner.getBatchSize(info.filename, engine, m_device, width, height, channels);
+                }
+                Logger::info("ModelWarmUp") << "Prepared model " << info.filename;
+            } catch(std::exception& e) {
+                if(m_stop)
+                    break;
+                Logger::warning("ModelWarmUp") << "Unable to prepare model " << filename << ": " << e.what();
+            }
+        }
+        m_done = true;
+    }
+} // End of namespace fast
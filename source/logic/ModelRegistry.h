@@ -0,0 +1,145 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+namespace fast{
+    /**
+     * @brief Input or output node of a model.
+     */
+    struct ModelNode {
+        std::string name;
+        std::vector<int> shape; /* Unknown dimensions, e.g. the batch dimension, are -1 */
+    };
+
+    /**
+     * @brief Metadata of a model, as indexed by the ModelRegistry.
+     */
+    struct ModelInfo {
+        std::string filename;
+        int64_t size = 0;
+        int64_t modified = 0; /* Milliseconds since epoch */
+        std::string sha256;
+        std::string format; /* ONNX, OpenVINO, TensorFlow or UFF */
+        std::string engine; /* Inference engine FAST selects for the format */
+        std::vector<ModelNode> inputs;
+        std::vector<ModelNode> outputs;
+        float magnification = 0; /* Patch magnification of the pipelines using the model, 0 if unknown */
+        int patchWidth = 0; /* Patch size of the pipelines using the model, 0 if unknown */
+        int patchHeight = 0;
+        float scaleFactor = 1; /* Intensity scale factor of the pipelines using the model */
+
+        /**
+         * @brief getInputSize Width, height and channels of the input patches, from the pipelines using the model
+         * or from the input shape. Returns false if they are not known.
+         */
+        bool getInputSize(int& width, int& height, int& channels) const;
+        /**
+         * @brief toString A summary such as "ONNX, input 256x256x3 at 20x, OpenVINO".
+         */
+        std::string toString() const;
+    };
+
+    /**
+     * @brief Index of the models on this machine, so that the metadata of a model is only read once, when it is
+     * added or changed, instead of each time a pipeline loads it. The registry is stored in model_registry.txt in
+     * the fastpathology folder, with one model per line.
+     */
+    class ModelRegistry {
+        public:
+            ModelRegistry();
+            /**
+             * @brief getModel Get the metadata of a model, and index it if it is new or has changed since it was
+             * indexed. Indexing loads the model, and throws an Exception if the model can't be loaded.
+             */
+            ModelInfo getModel(const std::string& filename);
+            /**
+             * @brief findModel Get the metadata of an indexed model, without indexing it.
+             * @return Whether the model is indexed and unchanged.
+             */
+            bool findModel(const std::string& filename, ModelInfo& info) const;
+            /**
+             * @brief findModelByHash Find an indexed model with the same content as a file.
+             * @return The filename of the indexed model, or an empty string.
+             */
+            std::string findModelByHash(const std::string& sha256) const;
+            /**
+             * @brief indexPipelines Store the magnification, patch size and scale factor of the models used by the
+             * pipelines of a folder, and remove models which no longer exist.
+             */
+            void indexPipelines(const std::string& pipelineFolder);
+
+            /**
+             * @brief getNetworkTypes Process object types which run a neural network.
+             */
+            static const std::vector<std::string>& getNetworkTypes();
+            /**
+             * @brief getModelFilenames Canonical filenames of the models in a folder.
+             */
+            static std::vector<std::string> getModelFilenames(const std::string& folder);
+            /**
+             * @brief getFormat Model format of a file, from its extension, or an empty string if it is not a model.
+             */
+            static std::string getFormat(const std::string& filename);
+            /**
+             * @brief getCanonicalFilename Absolute filename of a model, so that e.g. $CURRENT_PATH$/../models/ in a
+             * pipeline and the models folder give the same model.
+             */
+            static std::string getCanonicalFilename(const std::string& filename);
+        private:
+            void load();
+            void save() const;
+            static ModelInfo index(const std::string& filename);
+
+            std::string m_filename;
+            std::map<std::string, ModelInfo> m_models;
+            static std::mutex m_mutex; /* Serializes updates of the registry file */
+    };
+
+    /**
+     * @brief Indexes the models of a folder in a background thread, and prepares models for their first run: loads
+     * the model, which makes engines which cache compiled models on disk, such as TensorRT, compile it, and runs
+     * the engine benchmark and batch size tuning if a run would need them, see InferenceBenchmark and
+     * BatchSizeTuner. That way the first run of a pipeline doesn't pay for these.
+     */
+    class ModelWarmUp {
+        public:
+            /**
+             * @param modelFolder Folder of the models to index. Only new and changed models are loaded.
+             * @param pipelineFolder Folder of the pipelines, for the magnification and patch size of the models.
+             * @param filenames Models to prepare for their first run.
+             * @param engine Inference engine, "fastest" to benchmark the engines, or empty for the default.
+             * @param device Device type, e.g. CPU or GPU, the engine's default if empty.
+             * @param batching Tune the batch size of the models.
+             */
+            ModelWarmUp(std::string modelFolder, std::string pipelineFolder, std::vector<std::string> filenames,
+                        std::string engine, std::string device, bool batching);
+            /**
+             * Stops, and waits for the model being indexed or the batch being measured.
+             */
+            ~ModelWarmUp();
+            /**
+             * @brief stop Skip the remaining models and stop the measurements between two batches, e.g. so that they
+             * don't compete with a pipeline. Returns immediately. Measurements which were stopped aren't stored.
+             */
+            void stop();
+            bool isDone() const;
+        private:
+            void run();
+
+            std::string m_modelFolder;
+            std::string m_pipelineFolder;
+            std::vector<std::string> m_filenames;
+            std::string m_engine;
+            std::string m_device;
+            bool m_batching;
+            std::atomic_bool m_stop;
+            std::atomic_bool m_done;
+            std::thread m_thread;
+    };
+} // End of namespace fast
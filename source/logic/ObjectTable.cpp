@@ -0,0 +1,295 @@
+#include "ObjectTable.h"
+#include "Logger.h"
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Data/Image.hpp>
+#include <FAST/Data/Access/ImagePyramidAccess.hpp>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+namespace fast{
+    namespace {
+        struct ComponentStats {
+            int64_t area = 0;
+            double sumX = 0;
+            double sumY = 0;
+            int64_t perimeter = 0;
+            int minX = std::numeric_limits<int>::max();
+            int minY = std::numeric_limits<int>::max();
+            int maxX = -1;
+            int maxY = -1;
+            double sumIntensity = 0;
+
+            void merge(const ComponentStats& other) {
+                area += other.area;
+                sumX += other.sumX;
+                sumY += other.sumY;
+                perimeter += other.perimeter;
+                minX = std::min(minX, other.minX);
+                minY = std::min(minY, other.minY);
+                maxX = std::max(maxX, other.maxX);
+                maxY = std::max(maxY, other.maxY);
+                sumIntensity += other.sumIntensity;
+            }
+        };
+
+        /**
+         * Result of labelling a single tile. Only the labels along the tile border are kept, as those are
+         * the only ones needed to merge components with the neighbouring tiles.
+         */
+        struct TileResult {
+            int width = 0;
+            int height = 0;
+            std::vector<uint32_t> left, right, top, bottom; /* Local labels along each border, 0 is background */
+            std::vector<ComponentStats> components; /* Statistics of local label i+1 */
+        };
+
+        uint32_t findRoot(std::vector<uint32_t>& parents, uint32_t i) {
+            while(parents[i] != i) {
+                parents[i] = parents[parents[i]]; // Path halving
+                i = parents[i];
+            }
+            return i;
+        }
+
+        void unite(std::vector<uint32_t>& parents, uint32_t a, uint32_t b) {
+            a = findRoot(parents, a);
+            b = findRoot(parents, b);
+            if(a < b) {
+                parents[b] = a;
+            } else if(b < a) {
+                parents[a] = b;
+            }
+        }
+
+        TileResult labelTile(ImagePyramidAccess* segmentationAccess, ImagePyramidAccess* wsiAccess, int wsiLevel,
+                             int fullWidth, int fullHeight, int offsetX, int offsetY, int width, int height) {
+            // Read the tile with a one pixel halo, so that perimeters are exact also along tile borders
+            const int haloX = std::max(0, offsetX - 1);
+            const int haloY = std::max(0, offsetY - 1);
+            const int haloWidth = std::min(fullWidth, offsetX + width + 1) - haloX;
+            const int haloHeight = std::min(fullHeight, offsetY + height + 1) - haloY;
+            auto patch = segmentationAccess->getPatchAsImage(0, haloX, haloY, haloWidth, haloHeight, false);
+            auto patchAccess = patch->getImageAccess(ACCESS_READ);
+            const uchar* labelData = (const uchar*)patchAccess->get();
+            const int labelChannels = patch->getNrOfChannels();
+            auto isForeground = [&](int x, int y) -> bool { // Global coordinates
+                if(x < 0 || y < 0 || x >= fullWidth || y >= fullHeight)
+                    return false;
+                return labelData[((x - haloX) + (y - haloY) * haloWidth) * labelChannels] > 0;
+            };
+
+            const uchar* intensityData = nullptr;
+            int intensityChannels = 0;
+            std::shared_ptr<Image> intensityPatch;
+            std::unique_ptr<ImageAccess> intensityAccess;
+            if(wsiAccess != nullptr) {
+                intensityPatch = wsiAccess->getPatchAsImage(wsiLevel, offsetX, offsetY, width, height);
+                intensityAccess = intensityPatch->getImageAccess(ACCESS_READ);
+                intensityData = (const uchar*)intensityAccess->get();
+                intensityChannels = intensityPatch->getNrOfChannels();
+            }
+
+            // First pass: provisional labels with 4-connectivity
+            std::vector<uint32_t> labels(width*height, 0);
+            std::vector<uint32_t> parents = {0};
+            for(int y = 0; y < height; ++y) {
+                for(int x = 0; x < width; ++x) {
+                    if(!isForeground(offsetX + x, offsetY + y))
+                        continue;
+                    const uint32_t leftLabel = x > 0 ? labels[x - 1 + y*width] : 0;
+                    const uint32_t upLabel = y > 0 ? labels[x + (y - 1)*width] : 0;
+                    uint32_t label;
+                    if(leftLabel == 0 && upLabel == 0) {
+                        label = parents.size();
+                        parents.push_back(label);
+                    } else if(leftLabel == 0 || upLabel == 0) {
+                        label = std::max(leftLabel, upLabel);
+                    } else {
+                        label = std::min(leftLabel, upLabel);
+                        unite(parents, leftLabel, upLabel);
+                    }
+                    labels[x + y*width] = label;
+                }
+            }
+
+            // Compact the provisional labels to 1..N
+            std::vector<uint32_t> compact(parents.size(), 0);
+            uint32_t counter = 0;
+            for(uint32_t i = 1; i < parents.size(); ++i) {
+                const uint32_t root = findRoot(parents, i);
+                if(root == i)
+                    compact[i] = ++counter;
+            }
+            for(uint32_t i = 1; i < parents.size(); ++i)
+                compact[i] = compact[findRoot(parents, i)];
+
+            // Second pass: final labels and statistics
+            TileResult result;
+            result.width = width;
+            result.height = height;
+            result.components.resize(counter);
+            for(int y = 0; y < height; ++y) {
+                for(int x = 0; x < width; ++x) {
+                    uint32_t& label = labels[x + y*width];
+                    if(label == 0)
+                        continue;
+                    label = compact[label];
+                    const int globalX = offsetX + x;
+                    const int globalY = offsetY + y;
+                    auto& stats = result.components[label - 1];
+                    stats.area += 1;
+                    stats.sumX += globalX;
+                    stats.sumY += globalY;
+                    stats.minX = std::min(stats.minX, globalX);
+                    stats.minY = std::min(stats.minY, globalY);
+                    stats.maxX = std::max(stats.maxX, globalX);
+                    stats.maxY = std::max(stats.maxY, globalY);
+                    stats.perimeter += !isForeground(globalX - 1, globalY) + !isForeground(globalX + 1, globalY) +
+                                       !isForeground(globalX, globalY - 1) + !isForeground(globalX, globalY + 1);
+                    if(intensityData != nullptr) {
+                        const int channels = std::min(intensityChannels, 3);
+                        float intensity = 0;
+                        for(int c = 0; c < channels; ++c)
+                            intensity += intensityData[(x + y*width)*intensityChannels + c];
+                        stats.sumIntensity += intensity / channels;
+                    }
+                }
+            }
+
+            result.left.resize(height);
+            result.right.resize(height);
+            for(int y = 0; y < height; ++y) {
+                result.left[y] = labels[y*width];
+                result.right[y] = labels[width - 1 + y*width];
+            }
+            result.top.assign(labels.begin(), labels.begin() + width);
+            result.bottom.assign(labels.end() - width, labels.end());
+            return result;
+        }
+    }
+
+    void ObjectTable::writeCSV(const std::string& filename) const {
+        std::ofstream file(filename, std::ios::out);
+        if(!file.is_open())
+            throw Exception("Unable to write object table to " + filename);
+        file << "id;centroid_x;centroid_y;area;perimeter;bbox_x;bbox_y;bbox_width;bbox_height;mean_intensity\n";
+        for(size_t i = 0; i < size(); ++i) {
+            file << i + 1 << ";" << centroid_x[i] << ";" << centroid_y[i] << ";" << area[i] << ";" << perimeter[i] << ";"
+                 << bbox_x[i] << ";" << bbox_y[i] << ";" << bbox_width[i] << ";" << bbox_height[i] << ";" << mean_intensity[i] << "\n";
+        }
+        file.close();
+    }
+
+    ObjectTable computeObjectTable(std::shared_ptr<ImagePyramid> segmentation, std::shared_ptr<ImagePyramid> WSI, int tileSize, int threads) {
+        const int fullWidth = segmentation->getFullWidth();
+        const int fullHeight = segmentation->getFullHeight();
+
+        // The intensity is only measured if the WSI has a level with the same size as the segmentation
+        int wsiLevel = -1;
+        if(WSI) {
+            for(int level = 0; level < WSI->getNrOfLevels(); ++level) {
+                if(WSI->getLevelWidth(level) == fullWidth && WSI->getLevelHeight(level) == fullHeight) {
+                    wsiLevel = level;
+                    break;
+                }
+            }
+            if(wsiLevel < 0)
+                Logger::warning("ObjectTable") << "No WSI level matches the segmentation size, skipping intensity measurements";
+        }
+
+        const int tilesX = (int)std::ceil((float)fullWidth / tileSize);
+        const int tilesY = (int)std::ceil((float)fullHeight / tileSize);
+        std::vector<TileResult> tiles(tilesX*tilesY);
+
+        if(threads <= 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min(threads, (int)tiles.size());
+        std::atomic<int> nextTile(0);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        std::vector<std::thread> workers;
+        for(int i = 0; i < threads; ++i) {
+            workers.emplace_back([&]() {
+                try {
+                    auto segmentationAccess = segmentation->getAccess(ACCESS_READ);
+                    std::unique_ptr<ImagePyramidAccess> wsiAccess;
+                    if(wsiLevel >= 0)
+                        wsiAccess = WSI->getAccess(ACCESS_READ);
+                    int tile;
+                    while((tile = nextTile++) < (int)tiles.size()) {
+                        const int offsetX = (tile % tilesX)*tileSize;
+                        const int offsetY = (tile / tilesX)*tileSize;
+                        tiles[tile] = labelTile(segmentationAccess.get(), wsiAccess.get(), wsiLevel, fullWidth, fullHeight,
+                                                offsetX, offsetY, std::min(tileSize, fullWidth - offsetX), std::min(tileSize, fullHeight - offsetY));
+                    }
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    error = std::current_exception();
+                    nextTile = tiles.size(); // Stop the other workers
+                }
+            });
+        }
+        for(auto& worker : workers)
+            worker.join();
+        if(error)
+            std::rethrow_exception(error);
+
+        // Give every local component a global index, and merge components which touch across tile borders
+        std::vector<uint32_t> tileBase(tiles.size() + 1, 0);
+        for(size_t i = 0; i < tiles.size(); ++i)
+            tileBase[i + 1] = tileBase[i] + tiles[i].components.size();
+        std::vector<uint32_t> parents(tileBase.back());
+        std::iota(parents.begin(), parents.end(), 0);
+        for(int tileY = 0; tileY < tilesY; ++tileY) {
+            for(int tileX = 0; tileX < tilesX; ++tileX) {
+                const int index = tileX + tileY*tilesX;
+                const auto& tile = tiles[index];
+                if(tileX + 1 < tilesX) {
+                    const auto& neighbour = tiles[index + 1];
+                    for(int y = 0; y < tile.height; ++y) {
+                        if(tile.right[y] > 0 && neighbour.left[y] > 0)
+                            unite(parents, tileBase[index] + tile.right[y] - 1, tileBase[index + 1] + neighbour.left[y] - 1);
+                    }
+                }
+                if(tileY + 1 < tilesY) {
+                    const auto& neighbour = tiles[index + tilesX];
+                    for(int x = 0; x < tile.width; ++x) {
+                        if(tile.bottom[x] > 0 && neighbour.top[x] > 0)
+                            unite(parents, tileBase[index] + tile.bottom[x] - 1, tileBase[index + tilesX] + neighbour.top[x] - 1);
+                    }
+                }
+            }
+        }
+
+        // Accumulate the statistics of all merged components in their root component
+        std::vector<ComponentStats> merged(parents.size());
+        for(size_t i = 0; i < tiles.size(); ++i) {
+            for(size_t j = 0; j < tiles[i].components.size(); ++j)
+                merged[findRoot(parents, tileBase[i] + j)].merge(tiles[i].components[j]);
+        }
+
+        ObjectTable table;
+        for(uint32_t i = 0; i < parents.size(); ++i) {
+            if(findRoot(parents, i) != i)
+                continue;
+            const auto& stats = merged[i];
+            table.centroid_x.push_back(stats.sumX / stats.area);
+            table.centroid_y.push_back(stats.sumY / stats.area);
+            table.area.push_back(stats.area);
+            table.perimeter.push_back(stats.perimeter);
+            table.bbox_x.push_back(stats.minX);
+            table.bbox_y.push_back(stats.minY);
+            table.bbox_width.push_back(stats.maxX - stats.minX + 1);
+            table.bbox_height.push_back(stats.maxY - stats.minY + 1);
+            table.mean_intensity.push_back(wsiLevel >= 0 ? stats.sumIntensity / stats.area : std::nanf(""));
+        }
+        return table;
+    }
+} // End of namespace fast
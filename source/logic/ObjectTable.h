@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace fast{
+    class ImagePyramid;
+
+    /**
+     * @brief Columnar per-object measurements extracted from a segmentation result.
+     * All coordinates are in pixels of the highest resolution level of the segmentation.
+     */
+    class ObjectTable {
+        public:
+            std::vector<float> centroid_x;
+            std::vector<float> centroid_y;
+            std::vector<int64_t> area;
+            std::vector<float> perimeter; /* Number of pixel edges facing background (4-connectivity) */
+            std::vector<int> bbox_x;
+            std::vector<int> bbox_y;
+            std::vector<int> bbox_width;
+            std::vector<int> bbox_height;
+            std::vector<float> mean_intensity; /* Mean RGB intensity from the WSI, NaN if the WSI has no matching level */
+
+            size_t size() const { return area.size(); }
+            /**
+             * @brief writeCSV Dump the table as a ';'-separated CSV file, one row per object.
+             * @param filename Disk location of the CSV file.
+             */
+            void writeCSV(const std::string& filename) const;
+    };
+
+    /**
+     * @brief computeObjectTable Tiled connected-component labelling of a segmentation pyramid.
+     * Tiles are labelled in parallel, and components touching a tile border are merged afterwards,
+     * such that objects crossing patch boundaries are only reported once.
+     * @param segmentation Label image pyramid, any non-zero value is treated as foreground.
+     * @param WSI Whole-slide image used for the intensity measurements, can be nullptr.
+     * @param tileSize Size of the tiles read from the segmentation.
+     * @param threads Number of worker threads, 0 selects the number of hardware threads.
+     * @return Measurements of every object in the segmentation.
+     */
+    ObjectTable computeObjectTable(std::shared_ptr<ImagePyramid> segmentation, std::shared_ptr<ImagePyramid> WSI, int tileSize = 1024, int threads = 0);
+} // End of namespace fast
@@ -0,0 +1,64 @@
+#include "PatchGrid.h"
+#include "source/logic/PipelineRewriter.h"
+#include "source/logic/SlideMetadata.h"
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Utility.hpp>
+#include <cmath>
+#include <algorithm>
+
+namespace fast{
+    void PatchGrid::getRegion(int index, int& x, int& y, int& width, int& height) const
+    {
+        // Neighbouring patches share 2*overlap pixels, the first patch of a row and column starts before the border
+        const int stepX = regionWidth - 2*overlapX;
+        const int stepY = regionHeight - 2*overlapY;
+        x = std::max(0, (index % patchesX)*stepX - overlapX);
+        y = std::max(0, (index / patchesX)*stepY - overlapY);
+        width = std::min(regionWidth, levelWidth - x);
+        height = std::min(regionHeight, levelHeight - y);
+    }
+
+    PatchGrid PatchGrid::create(std::shared_ptr<ImagePyramid> pyramid, int patchWidth, int patchHeight, float magnification, float overlap, int level)
+    {
+        PatchGrid grid;
+        float scale = 1.0f;
+        const float fullMagnification = SlideMetadata::getMagnification(pyramid);
+        if(magnification > 0 && fullMagnification > 0) {
+            level = 0;
+            float levelMagnification = fullMagnification;
+            for(int i = 1; i < pyramid->getNrOfLevels(); ++i) {
+                const float downsample = (float)pyramid->getLevelWidth(0) / pyramid->getLevelWidth(i);
+                const float candidate = fullMagnification / downsample;
+                if(candidate < magnification*0.99f)
+                    break;
+                level = i;
+                levelMagnification = candidate;
+            }
+            scale = levelMagnification / magnification;
+        }
+        grid.level = std::min(std::max(level, 0), pyramid->getNrOfLevels() - 1);
+        grid.levelWidth = pyramid->getLevelWidth(grid.level);
+        grid.levelHeight = pyramid->getLevelHeight(grid.level);
+        grid.regionWidth = std::round(patchWidth*scale);
+        grid.regionHeight = std::round(patchHeight*scale);
+        grid.overlapX = std::round(grid.regionWidth*overlap);
+        grid.overlapY = std::round(grid.regionHeight*overlap);
+        const int stepX = std::max(1, grid.regionWidth - 2*grid.overlapX);
+        const int stepY = std::max(1, grid.regionHeight - 2*grid.overlapY);
+        grid.patchesX = std::ceil((float)grid.levelWidth / stepX);
+        grid.patchesY = std::ceil((float)grid.levelHeight / stepY);
+        return grid;
+    }
+
+    PatchGrid PatchGrid::fromPipeline(const PipelineRewriter& pipeline, const std::string& generatorId, std::shared_ptr<ImagePyramid> pyramid)
+    {
+        auto size = split(pipeline.getAttribute(generatorId, "patch-size"), " ");
+        if(size.size() < 2)
+            throw Exception("PatchGenerator " + generatorId + " has no patch-size");
+        auto number = [&](const std::string& name) {
+            const std::string value = pipeline.getAttribute(generatorId, name);
+            return value.empty() ? 0.0f : std::stof(value);
+        };
+        return create(pyramid, std::stoi(size[0]), std::stoi(size[1]), number("patch-magnification"), number("patch-overlap"), number("patch-level"));
+    }
+} // End of namespace fast
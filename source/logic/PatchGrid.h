@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+namespace fast{
+    class ImagePyramid;
+    class PipelineRewriter;
+
+    /**
+     * @brief The grid of patches a PatchGenerator reads from a slide, in the order they are generated: row by row,
+     * from the top left corner. Used to read patches ahead of a running generator and to plan patch reads.
+     */
+    class PatchGrid {
+        public:
+            int level = 0; /* Pyramid level the patches are read from */
+            int levelWidth = 0;
+            int levelHeight = 0;
+            int regionWidth = 0; /* Size of a patch region at the level, larger than the patch if it is downscaled */
+            int regionHeight = 0;
+            int overlapX = 0; /* Overlap in pixels at the level, on each side of a patch */
+            int overlapY = 0;
+            int patchesX = 0;
+            int patchesY = 0;
+
+            int getPatchCount() const { return patchesX*patchesY; }
+            /**
+             * @brief getRegion Region of a patch at the level, clamped to the level.
+             * @param index Patch number in generation order.
+             */
+            void getRegion(int index, int& x, int& y, int& width, int& height) const;
+
+            /**
+             * @brief create Grid of the patches of a slide.
+             * @param magnification Magnification of the patches. The lowest resolution level with at least this
+             *      magnification is used, and regions are scaled up if the level has a higher magnification.
+             *      If 0, level is used instead.
+             * @param overlap Overlap of neighbouring patches, as a fraction of the patch size.
+             */
+            static PatchGrid create(std::shared_ptr<ImagePyramid> pyramid, int patchWidth, int patchHeight, float magnification = 0, float overlap = 0, int level = 0);
+            /**
+             * @brief fromPipeline Grid of a PatchGenerator in a pipeline file, from its patch-size, patch-magnification,
+             * patch-level and patch-overlap attributes.
+             */
+            static PatchGrid fromPipeline(const PipelineRewriter& pipeline, const std::string& generatorId, std::shared_ptr<ImagePyramid> pyramid);
+    };
+} // End of namespace fast
@@ -0,0 +1,176 @@
+#include "PatchPrefetcher.h"
+#include "source/logic/Logger.h"
+#include "source/logic/PipelineRewriter.h"
+#include "source/logic/Tracer.h"
+#include "source/logic/PatchScheduler.h"
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Algorithms/ImagePatch/PatchGenerator.hpp>
+#include <FAST/Pipeline.hpp>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+namespace fast{
+    std::string PatchPrefetchStatistics::getBottleneck() const
+    {
+        if(fullFraction > 0.5f)
+            return "compute";
+        if(emptyFraction > 0.5f)
+            return "I/O";
+        return "balanced";
+    }
+
+    std::string PatchPrefetchStatistics::toString() const
+    {
+        std::stringstream stream;
+        stream << patches << " patches prefetched in " << decodeSeconds << " s decoder time, occupancy "
+               << (int)(averageOccupancy*100) << "%, full " << (int)(fullFraction*100) << "%, empty "
+               << (int)(emptyFraction*100) << "% of the time: " << getBottleneck() << " bound";
+        return stream.str();
+    }
+
+    PatchPrefetcher::PatchPrefetcher(std::shared_ptr<ImagePyramid> pyramid, std::shared_ptr<PatchGenerator> generator, PatchGrid grid, int decoderThreads, int capacity, std::vector<int> patches)
+    {
+        m_pyramid = pyramid;
+        m_generator = generator;
+        m_grid = grid;
+        m_capacity = std::max(1, capacity);
+        m_patches = patches;
+        if(m_patches.empty()) {
+            m_patches.resize(grid.getPatchCount());
+            for(int i = 0; i < m_patches.size(); ++i)
+                m_patches[i] = i;
+        }
+        m_completed = 0;
+        for(int i = 0; i < decoderThreads; ++i)
+            m_decoders.emplace_back(&PatchPrefetcher::runDecoder, this);
+        m_monitor = std::thread(&PatchPrefetcher::runMonitor, this);
+    }
+
+    PatchPrefetcher::~PatchPrefetcher()
+    {
+        stop();
+    }
+
+    void PatchPrefetcher::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        for(auto& decoder : m_decoders) {
+            if(decoder.joinable())
+                decoder.join();
+        }
+        if(m_monitor.joinable())
+            m_monitor.join();
+    }
+
+    PatchPrefetchStatistics PatchPrefetcher::getStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto statistics = m_statistics;
+        statistics.patches = m_completed;
+        if(statistics.samples > 0) {
+            statistics.averageOccupancy /= statistics.samples;
+            statistics.fullFraction /= statistics.samples;
+            statistics.emptyFraction /= statistics.samples;
+        }
+        return statistics;
+    }
+
+    void PatchPrefetcher::runDecoder()
+    {
+        Tracer::setThreadName("Patch prefetcher");
+        auto access = m_pyramid->getAccess(ACCESS_READ);
+        while(true) {
+            int index, position;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() {
+                    return m_stop || m_next >= m_patches.size() || m_next < m_position + m_capacity;
+                });
+                // Patches the generator has already passed are not worth reading
+                m_next = std::max(m_next, m_position);
+                if(m_stop || m_next >= m_patches.size())
+                    return;
+                position = m_next;
+                index = m_patches[m_next];
+                ++m_next;
+            }
+            int x, y, width, height;
+            m_grid.getRegion(index, x, y, width, height);
+            auto start = std::chrono::high_resolution_clock::now();
+            try {
+                TraceSpan span("io", "patch read");
+                // The patch itself is discarded, the read leaves its tiles in the caches
+                access->getPatchAsImage(m_grid.level, x, y, width, height);
+            } catch(std::exception& e) {
+                Logger::warning("PatchPrefetcher") << "Unable to prefetch patch " << index << ": " << e.what();
+            }
+            std::chrono::duration<double> runtime = std::chrono::high_resolution_clock::now() - start;
+            ++m_completed;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_statistics.decodeSeconds += runtime.count();
+            if(position >= m_position)
+                m_read.insert(position);
+        }
+    }
+
+    void PatchPrefetcher::runMonitor()
+    {
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if(m_condition.wait_for(lock, std::chrono::milliseconds(20), [this]() { return m_stop; }))
+                    return;
+                // The generator reports its progress over the whole grid, including the patches it skips
+                const int gridPosition = std::floor(m_generator->getProgress()*m_grid.getPatchCount());
+                m_position = std::lower_bound(m_patches.begin(), m_patches.end(), gridPosition) - m_patches.begin();
+                if(m_position >= m_patches.size())
+                    return;
+                // Only completed reads count, reads in flight would still make the generator wait
+                m_read.erase(m_read.begin(), m_read.lower_bound(m_position));
+                const int ahead = std::min<int>(m_capacity, m_read.size());
+                m_statistics.averageOccupancy += (float)ahead / m_capacity;
+                m_statistics.fullFraction += ahead >= m_capacity ? 1 : 0;
+                m_statistics.emptyFraction += ahead == 0 ? 1 : 0;
+                ++m_statistics.samples;
+            }
+            m_condition.notify_all();
+        }
+    }
+
+    std::vector<std::shared_ptr<PatchPrefetcher>> PatchPrefetcher::attach(std::shared_ptr<Pipeline> pipeline, const std::string& pipelineFilename, std::shared_ptr<ImagePyramid> pyramid,
+            int decoderThreads, int capacity, const std::string& cacheFolder)
+    {
+        std::vector<std::shared_ptr<PatchPrefetcher>> prefetchers;
+        if(decoderThreads <= 0)
+            return prefetchers;
+        PipelineRewriter rewriter(pipelineFilename);
+        for(auto processObject : pipeline->getProcessObjects()) {
+            auto generator = std::dynamic_pointer_cast<PatchGenerator>(processObject.second);
+            // Only generators reading the slide itself, not the output of another process object
+            if(!generator || rewriter.getInput(processObject.first, 0) != "WSI")
+                continue;
+            try {
+                auto grid = PatchGrid::fromPipeline(rewriter, processObject.first, pyramid);
+                // Reading background patches the generator skips would only waste I/O
+                std::vector<int> patches;
+                PatchScheduler scheduler;
+                if(PatchScheduler::fromPipeline(rewriter, processObject.first, scheduler)) {
+                    patches = scheduler.schedule(pyramid, grid, cacheFolder);
+                    if(patches.empty())
+                        continue;
+                }
+                prefetchers.push_back(std::make_shared<PatchPrefetcher>(pyramid, generator, grid, decoderThreads, capacity, patches));
+            } catch(std::exception& e) {
+                Logger::warning("PatchPrefetcher") << "Unable to prefetch patches of " << processObject.first << ": " << e.what();
+            }
+        }
+        return prefetchers;
+    }
+} // End of namespace fast
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include "source/logic/PatchGrid.h"
+
+namespace fast{
+    class ImagePyramid;
+    class PatchGenerator;
+    class Pipeline;
+
+    /**
+     * @brief Queue occupancy of a patch prefetcher, sampled while the pipeline runs.
+     */
+    class PatchPrefetchStatistics {
+        public:
+            int patches = 0; /* Patches read by the decoder threads */
+            int samples = 0;
+            float averageOccupancy = 0; /* Average fraction of the window which was read ahead of the generator, not counting reads in flight */
+            float fullFraction = 0; /* Fraction of samples with a full window, i.e. decoders waiting for inference */
+            float emptyFraction = 0; /* Fraction of samples with an empty window, i.e. inference waiting for reads */
+            double decodeSeconds = 0; /* Total time spent reading patches, summed over all decoder threads */
+
+            /**
+             * @brief getBottleneck "compute" if the decoders mostly wait for inference, "I/O" if inference mostly
+             * waits for patch reads, otherwise "balanced".
+             */
+            std::string getBottleneck() const;
+            std::string toString() const;
+    };
+
+    /**
+     * @brief Warms the caches for a running PatchGenerator: reads its patches ahead of it, with several decoder
+     * threads, so that its own reads are served from the tile cache of the slide reader and the page cache of the
+     * operating system instead of waiting for storage.
+     *
+     * The generator still reads and decodes every patch itself, so the decoding work is done twice. Prefetching
+     * only pays off when reading the slide is slow, e.g. slides on network storage or not in the page cache, and
+     * there are idle cores. It is disabled by default, see ExecutionPolicy.
+     *
+     * The decoders stay at most a fixed number of patches ahead of the generator, which bounds the memory used
+     * and keeps prefetched tiles from being evicted before they are used. The occupancy of this window shows
+     * whether a pipeline is I/O-bound or compute-bound.
+     */
+    class PatchPrefetcher {
+        public:
+            /**
+             * @param grid Patch grid of the generator.
+             * @param decoderThreads Number of threads reading patches.
+             * @param capacity Maximum number of patches read ahead of the generator.
+             * @param patches Grid indices of the patches the generator will read, in increasing order. All patches
+             *      of the grid if empty.
+             */
+            PatchPrefetcher(std::shared_ptr<ImagePyramid> pyramid, std::shared_ptr<PatchGenerator> generator, PatchGrid grid, int decoderThreads, int capacity, std::vector<int> patches = {});
+            ~PatchPrefetcher();
+            /**
+             * @brief stop Stop and join all threads. Called by the destructor.
+             */
+            void stop();
+            PatchPrefetchStatistics getStatistics() const;
+            /**
+             * @brief getScheduledPatches Number of patches the generator is expected to read.
+             */
+            int getScheduledPatches() const { return m_patches.size(); }
+
+            /**
+             * @brief attach Start a prefetcher for every PatchGenerator of a parsed pipeline. Generators with a tissue
+             * mask only get the patches with tissue prefetched, as scheduled by PatchScheduler.
+             * @param pipelineFilename File the pipeline was created from, for the generator attributes.
+             * @param cacheFolder Slide cache folder for the patch schedules, see Project::getSlideCacheFolder.
+             */
+            static std::vector<std::shared_ptr<PatchPrefetcher>> attach(std::shared_ptr<Pipeline> pipeline, const std::string& pipelineFilename, std::shared_ptr<ImagePyramid> pyramid,
+                    int decoderThreads, int capacity, const std::string& cacheFolder = "");
+        private:
+            void runDecoder();
+            void runMonitor();
+
+            std::shared_ptr<ImagePyramid> m_pyramid;
+            std::shared_ptr<PatchGenerator> m_generator;
+            PatchGrid m_grid;
+            std::vector<int> m_patches;
+            int m_capacity;
+
+            int m_next = 0; /* Next position in m_patches to read */
+            int m_position = 0; /* Position of the generator in m_patches */
+            std::set<int> m_read; /* Positions in m_patches which are read and not yet passed by the generator */
+            bool m_stop = false;
+            PatchPrefetchStatistics m_statistics;
+            std::atomic_int m_completed;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_condition;
+            std::vector<std::thread> m_decoders;
+            std::thread m_monitor;
+    };
+} // End of namespace fast
@@ -0,0 +1,171 @@
+#include "PatchScheduler.h"
+#include "source/logic/Logger.h"
+#include "source/logic/PipelineRewriter.h"
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Data/Image.hpp>
+#include <FAST/Utility.hpp>
+#include <QSaveFile>
+#include <QDir>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace fast{
+    PatchScheduler::PatchScheduler(float maskThreshold, int tissueThreshold, int maxMaskSize)
+    {
+        m_maskThreshold = maskThreshold;
+        m_tissueThreshold = tissueThreshold;
+        m_maxMaskSize = maxMaskSize;
+    }
+
+    bool PatchScheduler::fromPipeline(const PipelineRewriter& pipeline, const std::string& generatorId, PatchScheduler& scheduler)
+    {
+        auto mask = split(pipeline.getInput(generatorId, 1), " ");
+        if(mask.empty() || mask[0].empty())
+            return false;
+        const auto segmentations = pipeline.getProcessObjects("TissueSegmentation");
+        if(std::find(segmentations.begin(), segmentations.end(), mask[0]) == segmentations.end() || pipeline.getInput(mask[0], 0) != "WSI")
+            return false;
+        const std::string maskThreshold = pipeline.getAttribute(generatorId, "mask-threshold");
+        const std::string tissueThreshold = pipeline.getAttribute(mask[0], "threshold");
+        scheduler.m_maskThreshold = maskThreshold.empty() ? 0 : std::stof(maskThreshold);
+        scheduler.m_tissueThreshold = tissueThreshold.empty() ? 85 : std::stoi(tissueThreshold);
+        return true;
+    }
+
+    int PatchScheduler::countPatches(const std::string& pipelineFilename, std::shared_ptr<ImagePyramid> pyramid, const std::string& cacheFolder)
+    {
+        PipelineRewriter pipeline(pipelineFilename);
+        int patches = 0;
+        for(const auto& id : pipeline.getProcessObjects("PatchGenerator")) {
+            if(pipeline.getInput(id, 0) != "WSI")
+                continue;
+            const auto grid = PatchGrid::fromPipeline(pipeline, id, pyramid);
+            PatchScheduler scheduler;
+            if(fromPipeline(pipeline, id, scheduler)) {
+                patches += scheduler.schedule(pyramid, grid, cacheFolder).size();
+            } else {
+                patches += grid.getPatchCount();
+            }
+        }
+        return patches;
+    }
+
+    std::vector<uint32_t> PatchScheduler::getTissueTable(std::shared_ptr<Image> image, int& width, int& height) const
+    {
+        width = image->getWidth();
+        height = image->getHeight();
+        const int channels = image->getNrOfChannels();
+        auto access = image->getImageAccess(ACCESS_READ);
+        auto pixels = (const uchar*)access->get();
+        const int threshold = m_tissueThreshold*m_tissueThreshold;
+        std::vector<uint32_t> table((width + 1)*(height + 1), 0);
+        for(int y = 0; y < height; ++y) {
+            uint32_t row = 0;
+            for(int x = 0; x < width; ++x) {
+                // Tissue is anything sufficiently far from the white background
+                const uchar* pixel = &pixels[(x + y*width)*channels];
+                int distance = 0;
+                for(int c = 0; c < std::min(channels, 3); ++c)
+                    distance += (255 - pixel[c])*(255 - pixel[c]);
+                row += distance > threshold ? 1 : 0;
+                table[(x + 1) + (y + 1)*(width + 1)] = table[(x + 1) + y*(width + 1)] + row;
+            }
+        }
+        return table;
+    }
+
+    std::string PatchScheduler::getCacheFilename(const std::string& cacheFolder, const PatchGrid& grid) const
+    {
+        std::stringstream name;
+        name << "tissue_patches_" << grid.level << "_" << grid.regionWidth << "x" << grid.regionHeight << "_"
+             << grid.overlapX << "x" << grid.overlapY << "_" << m_maskThreshold << "_" << m_tissueThreshold << ".txt";
+        return join(cacheFolder, name.str());
+    }
+
+    std::vector<int> PatchScheduler::schedule(std::shared_ptr<ImagePyramid> pyramid, const PatchGrid& grid, const std::string& cacheFolder) const
+    {
+        std::vector<int> patches;
+        if(m_maskThreshold <= 0) {
+            // Like the generator, a threshold of 0 keeps every patch, also the ones without any tissue
+            patches.resize(grid.getPatchCount());
+            std::iota(patches.begin(), patches.end(), 0);
+            return patches;
+        }
+        if(!cacheFolder.empty()) {
+            std::ifstream file(getCacheFilename(cacheFolder, grid));
+            if(file.is_open()) {
+                int index;
+                while(file >> index)
+                    patches.push_back(index);
+                return patches;
+            }
+        }
+
+        // Highest resolution level small enough to read as a whole, but not above the resolution of the patches
+        int coarseLevel = pyramid->getNrOfLevels() - 1;
+        for(int level = grid.level; level < pyramid->getNrOfLevels(); ++level) {
+            if((int64_t)pyramid->getLevelWidth(level)*pyramid->getLevelHeight(level) <= m_maxMaskSize) {
+                coarseLevel = level;
+                break;
+            }
+        }
+        auto access = pyramid->getAccess(ACCESS_READ);
+        int width, height;
+        const auto table = getTissueTable(access->getLevelAsImage(coarseLevel), width, height);
+        const float scaleX = (float)width / grid.levelWidth;
+        const float scaleY = (float)height / grid.levelHeight;
+        auto countTissue = [](const std::vector<uint32_t>& table, int tableWidth, int x0, int y0, int x1, int y1) {
+            return table[x1 + y1*tableWidth] - table[x0 + y1*tableWidth] - table[x1 + y0*tableWidth] + table[x0 + y0*tableWidth];
+        };
+
+        // The level between the coarse level and the patch level used for patches close to the threshold
+        const int fineLevel = std::max(grid.level, coarseLevel - 2);
+        const float fineScale = (float)pyramid->getLevelWidth(fineLevel) / grid.levelWidth;
+        int refined = 0;
+        for(int index = 0; index < grid.getPatchCount(); ++index) {
+            int x, y, w, h;
+            grid.getRegion(index, x, y, w, h);
+            const int x0 = std::min(width, (int)std::floor(x*scaleX));
+            const int y0 = std::min(height, (int)std::floor(y*scaleY));
+            const int x1 = std::min(width, std::max(x0 + 1, (int)std::ceil((x + w)*scaleX)));
+            const int y1 = std::min(height, std::max(y0 + 1, (int)std::ceil((y + h)*scaleY)));
+            const int area = (x1 - x0)*(y1 - y0);
+            if(area <= 0)
+                continue;
+            const float tissue = (float)countTissue(table, width + 1, x0, y0, x1, y1) / area;
+            // A few coarse pixels per patch decide clear cases only: no tissue at all, or well above the threshold
+            bool accept = tissue >= m_maskThreshold;
+            const bool ambiguous = tissue > 0 && tissue < 2*m_maskThreshold && fineLevel < coarseLevel;
+            if(ambiguous) {
+                const int fx = std::floor(x*fineScale);
+                const int fy = std::floor(y*fineScale);
+                const int fw = std::max(1, std::min((int)std::ceil(w*fineScale), pyramid->getLevelWidth(fineLevel) - fx));
+                const int fh = std::max(1, std::min((int)std::ceil(h*fineScale), pyramid->getLevelHeight(fineLevel) - fy));
+                int patchWidth, patchHeight;
+                const auto patchTable = getTissueTable(access->getPatchAsImage(fineLevel, fx, fy, fw, fh), patchWidth, patchHeight);
+                accept = (float)patchTable.back() / (patchWidth*patchHeight) >= m_maskThreshold;
+                ++refined;
+            }
+            if(accept)
+                patches.push_back(index);
+        }
+        Logger::debug("PatchScheduler") << "Scheduled " << patches.size() << " of " << grid.getPatchCount() << " patches, " << refined
+                  << " checked on level " << fineLevel;
+
+        if(!cacheFolder.empty()) {
+            QDir().mkpath(QString::fromStdString(cacheFolder));
+            QSaveFile file(QString::fromStdString(getCacheFilename(cacheFolder, grid)));
+            if(file.open(QIODevice::WriteOnly)) {
+                std::stringstream stream;
+                for(int index : patches)
+                    stream << index << "\n";
+                file.write(QByteArray::fromStdString(stream.str()));
+                file.commit();
+            }
+        }
+        return patches;
+    }
+} // End of namespace fast
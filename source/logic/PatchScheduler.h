@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "source/logic/PatchGrid.h"
+
+namespace fast{
+    class ImagePyramid;
+    class Image;
+    class PipelineRewriter;
+
+    /**
+     * @brief Decides which patches of a grid contain tissue, without reading the slide at the patch resolution.
+     * Tissue is detected on a low resolution level, where each patch covers only a few pixels. Patches which are
+     * clearly background or clearly tissue are decided there, and only patches close to the mask threshold are
+     * checked again on a higher resolution level. The result is the list of patches that need full resolution reads.
+     *
+     * A PatchGenerator applies its own mask while the pipeline runs, so the schedule doesn't select the patches it
+     * reads. The schedule is used to prefetch these patches, to estimate the runtime, and by CascadeRunner to select
+     * the patches to refine.
+     */
+    class PatchScheduler {
+        public:
+            /**
+             * @param maskThreshold Minimum fraction of tissue in a patch, as the mask-threshold attribute of PatchGenerator.
+             * @param tissueThreshold Minimum color distance from white of tissue pixels, as the threshold attribute of
+             *      TissueSegmentation.
+             * @param maxMaskSize Tissue is detected on the highest resolution level with at most this many pixels.
+             */
+            PatchScheduler(float maskThreshold = 0, int tissueThreshold = 85, int maxMaskSize = 1024*1024);
+
+            /**
+             * @brief schedule Grid indices of the patches with tissue, in generation order.
+             * @param cacheFolder Folder to store the result in, so that it is only computed once per slide and grid.
+             *      Nothing is stored if empty.
+             */
+            std::vector<int> schedule(std::shared_ptr<ImagePyramid> pyramid, const PatchGrid& grid, const std::string& cacheFolder = "") const;
+
+            /**
+             * @brief fromPipeline Scheduler with the thresholds of a PatchGenerator in a pipeline file.
+             * @return False if the generator's mask isn't a TissueSegmentation of the slide, in which case the
+             *      patches can't be scheduled before the pipeline runs.
+             */
+            static bool fromPipeline(const PipelineRewriter& pipeline, const std::string& generatorId, PatchScheduler& scheduler);
+            /**
+             * @brief countPatches Number of patches the PatchGenerators of a pipeline file read from a slide.
+             * Generators without a tissue mask are counted with all patches of their grid, and generators which
+             * don't read the slide itself aren't counted.
+             */
+            static int countPatches(const std::string& pipelineFilename, std::shared_ptr<ImagePyramid> pyramid, const std::string& cacheFolder = "");
+        private:
+            /**
+             * Tissue mask of an image, 1 for tissue and 0 for background, as a summed area table with one extra row
+             * and column, so that the tissue in any rectangle can be counted in constant time.
+             */
+            std::vector<uint32_t> getTissueTable(std::shared_ptr<Image> image, int& width, int& height) const;
+            std::string getCacheFilename(const std::string& cacheFolder, const PatchGrid& grid) const;
+
+            float m_maskThreshold;
+            int m_tissueThreshold;
+            int m_maxMaskSize;
+    };
+} // End of namespace fast
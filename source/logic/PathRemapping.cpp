@@ -0,0 +1,94 @@
+#include "PathRemapping.h"
+#include "Logger.h"
+#include <FAST/Utility.hpp>
+#include <QDir>
+#include <QSaveFile>
+#include <fstream>
+#include <sstream>
+
+namespace fast{
+    PathRemapping::PathRemapping(): PathRemapping(QDir::home().path().toStdString() + "/fastpathology/path_remapping.txt")
+    {
+    }
+
+    PathRemapping::PathRemapping(std::string filename)
+    {
+        m_filename = filename;
+        load();
+    }
+
+    void PathRemapping::load()
+    {
+        std::ifstream file(m_filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            const auto separator = line.find('\t');
+            if(separator == std::string::npos || separator == 0)
+                continue;
+            m_rules.push_back({line.substr(0, separator), line.substr(separator + 1)});
+        }
+    }
+
+    void PathRemapping::save() const
+    {
+        QSaveFile file(QString::fromStdString(m_filename));
+        if(!file.open(QIODevice::WriteOnly)) {
+            Logger::warning("PathRemapping") << "Unable to write path remapping " << m_filename;
+            return;
+        }
+        std::stringstream stream;
+        for(const auto& rule : m_rules)
+            stream << rule.first << "\t" << rule.second << "\n";
+        file.write(QByteArray::fromStdString(stream.str()));
+        file.commit();
+    }
+
+    std::string PathRemapping::apply(const std::string& path) const
+    {
+        bool checked = false;
+        for(const auto& rule : m_rules) {
+            if(path.compare(0, rule.first.size(), rule.first) != 0)
+                continue;
+            // Files which are still in place are kept, e.g. if the old storage is still mounted. Paths which no
+            // rule applies to are not checked, so that opening a project doesn't touch every slide.
+            if(!checked) {
+                if(isFile(path))
+                    return path;
+                checked = true;
+            }
+            const std::string remapped = rule.second + path.substr(rule.first.size());
+            if(isFile(remapped))
+                return remapped;
+        }
+        return path;
+    }
+
+    void PathRemapping::addRule(const std::string& from, const std::string& to)
+    {
+        for(auto it = m_rules.begin(); it != m_rules.end(); ++it) {
+            if(it->first == from) {
+                m_rules.erase(it);
+                break;
+            }
+        }
+        m_rules.insert(m_rules.begin(), {from, to});
+        save();
+    }
+
+    std::pair<std::string, std::string> PathRemapping::inferRule(const std::string& oldPath, const std::string& newPath)
+    {
+        // Length of the common suffix, ending at a directory separator
+        int common = 0;
+        int separator = -1;
+        while(common < oldPath.size() && common < newPath.size() &&
+                oldPath[oldPath.size() - 1 - common] == newPath[newPath.size() - 1 - common]) {
+            const char c = oldPath[oldPath.size() - 1 - common];
+            ++common;
+            if(c == '/' || c == '\\')
+                separator = common;
+        }
+        if(separator < 0)
+            return {"", ""};
+        return {oldPath.substr(0, oldPath.size() - separator + 1), newPath.substr(0, newPath.size() - separator + 1)};
+    }
+} // End of namespace fast
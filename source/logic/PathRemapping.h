@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace fast{
+    /**
+     * @brief Path prefix remapping rules for slide storage which has been moved or remounted, e.g.
+     * /mnt/old_storage/ -> /mnt/new_storage/. The rules are shared by all projects, and are stored in
+     * path_remapping.txt in the fastpathology folder, one tab-separated rule per line.
+     */
+    class PathRemapping {
+        public:
+            /**
+             * @brief Load the rules from the default location.
+             */
+            PathRemapping();
+            /**
+             * @param filename Disk location of the rules file.
+             */
+            PathRemapping(std::string filename);
+
+            /**
+             * @brief apply Remap a missing file with the first rule matching its path, for which the remapped file
+             * exists.
+             * @return The remapped path, or the original path if it exists or no rule applies.
+             */
+            std::string apply(const std::string& path) const;
+            /**
+             * @brief addRule Add a rule, which takes precedence over the existing rules, and save the rules.
+             */
+            void addRule(const std::string& from, const std::string& to);
+            std::vector<std::pair<std::string, std::string>> getRules() const { return m_rules; }
+
+            /**
+             * @brief inferRule Find the prefix rule which maps a path to a new path, by stripping the longest
+             * common trailing directories. E.g. /a/b/slides/x.svs and /c/slides/x.svs give /a/b/ -> /c/.
+             * @return The rule, or empty strings if the file names differ.
+             */
+            static std::pair<std::string, std::string> inferRule(const std::string& oldPath, const std::string& newPath);
+        private:
+            void load();
+            void save() const;
+
+            std::string m_filename;
+            std::vector<std::pair<std::string, std::string>> m_rules; /* Prefix from, prefix to, in order of precedence */
+    };
+} // End of namespace fast
@@ -0,0 +1,245 @@
+#include "PipelineRewriter.h"
+#include <FAST/Utility.hpp>
+#include <fstream>
+#include <algorithm>
+
+namespace fast{
+    namespace {
+        std::vector<std::string> tokenize(std::string line) {
+            trim(line);
+            if(line.empty())
+                return {};
+            return split(line, " ");
+        }
+
+        bool isBlockHeader(const std::vector<std::string>& tokens) {
+            return !tokens.empty() && (tokens[0] == "ProcessObject" || tokens[0] == "Renderer") && tokens.size() >= 3;
+        }
+    }
+
+    PipelineRewriter::PipelineRewriter(std::string filename)
+    {
+        std::ifstream file(filename);
+        if(!file.is_open())
+            throw Exception("Unable to open pipeline file " + filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            if(!line.empty() && line.back() == '\r')
+                line.pop_back();
+            m_lines.push_back(line);
+        }
+        m_folder = getDirName(filename);
+    }
+
+    std::pair<int, int> PipelineRewriter::findBlock(const std::string& id) const
+    {
+        for(int i = 0; i < m_lines.size(); ++i) {
+            auto tokens = tokenize(m_lines[i]);
+            if(!isBlockHeader(tokens) || tokens[1] != id)
+                continue;
+            int end = i + 1;
+            while(end < m_lines.size() && !isBlockHeader(tokenize(m_lines[end])))
+                ++end;
+            // Trailing blank lines and comments belong to the next block
+            while(end > i + 1 && (tokenize(m_lines[end - 1]).empty() || m_lines[end - 1][0] == '#'))
+                --end;
+            return {i, end};
+        }
+        throw Exception("Pipeline has no process object " + id);
+    }
+
+    std::vector<std::string> PipelineRewriter::getProcessObjects(const std::string& type) const
+    {
+        std::vector<std::string> ids;
+        for(const auto& line : m_lines) {
+            auto tokens = tokenize(line);
+            if(isBlockHeader(tokens) && tokens[0] == "ProcessObject" && (type.empty() || tokens[2] == type))
+                ids.push_back(tokens[1]);
+        }
+        return ids;
+    }
+
+    std::string PipelineRewriter::getType(const std::string& id) const
+    {
+        return tokenize(m_lines[findBlock(id).first])[2];
+    }
+
+    std::string PipelineRewriter::getAttribute(const std::string& id, const std::string& name) const
+    {
+        auto block = findBlock(id);
+        for(int i = block.first + 1; i < block.second; ++i) {
+            auto tokens = tokenize(m_lines[i]);
+            if(tokens.size() < 3 || tokens[0] != "Attribute" || tokens[1] != name)
+                continue;
+            std::string value = m_lines[i].substr(m_lines[i].find(name) + name.size());
+            trim(value);
+            value.erase(std::remove(value.begin(), value.end(), '"'), value.end());
+            return substitutePath(value);
+        }
+        return "";
+    }
+
+    std::string PipelineRewriter::getPipelineAttribute(const std::string& name) const
+    {
+        // Pipeline attributes come before the first process object
+        for(const auto& line : m_lines) {
+            auto tokens = tokenize(line);
+            if(isBlockHeader(tokens))
+                break;
+            if(tokens.size() < 3 || tokens[0] != "Attribute" || tokens[1] != name)
+                continue;
+            std::string value = line.substr(line.find(name) + name.size());
+            trim(value);
+            value.erase(std::remove(value.begin(), value.end(), '"'), value.end());
+            return value;
+        }
+        return "";
+    }
+
+    void PipelineRewriter::setAttribute(const std::string& id, const std::string& name, const std::string& value)
+    {
+        auto block = findBlock(id);
+        const std::string line = "Attribute " + name + " " + value;
+        for(int i = block.first + 1; i < block.second; ++i) {
+            auto tokens = tokenize(m_lines[i]);
+            if(tokens.size() >= 2 && tokens[0] == "Attribute" && tokens[1] == name) {
+                m_lines[i] = line;
+                return;
+            }
+        }
+        m_lines.insert(m_lines.begin() + block.first + 1, line);
+    }
+
+    void PipelineRewriter::removeAttribute(const std::string& id, const std::string& name)
+    {
+        auto block = findBlock(id);
+        for(int i = block.first + 1; i < block.second; ++i) {
+            auto tokens = tokenize(m_lines[i]);
+            if(tokens.size() >= 2 && tokens[0] == "Attribute" && tokens[1] == name) {
+                m_lines.erase(m_lines.begin() + i);
+                return;
+            }
+        }
+    }
+
+    std::string PipelineRewriter::getInput(const std::string& id, int port) const
+    {
+        auto block = findBlock(id);
+        for(int i = block.first + 1; i < block.second; ++i) {
+            auto tokens = tokenize(m_lines[i]);
+            if(tokens.size() >= 3 && tokens[0] == "Input" && tokens[1] == std::to_string(port)) {
+                std::string source = tokens[2];
+                for(int j = 3; j < tokens.size(); ++j)
+                    source += " " + tokens[j];
+                return source;
+            }
+        }
+        return "";
+    }
+
+    void PipelineRewriter::setInput(const std::string& id, int port, const std::string& source)
+    {
+        auto block = findBlock(id);
+        const std::string line = "Input " + std::to_string(port) + " " + source;
+        for(int i = block.first + 1; i < block.second; ++i) {
+            auto tokens = tokenize(m_lines[i]);
+            if(tokens.size() >= 2 && tokens[0] == "Input" && tokens[1] == std::to_string(port)) {
+                m_lines[i] = line;
+                return;
+            }
+        }
+        m_lines.insert(m_lines.begin() + block.second, line);
+    }
+
+    std::vector<std::string> PipelineRewriter::getConsumers(const std::string& id) const
+    {
+        std::vector<std::string> consumers;
+        std::string current;
+        for(const auto& line : m_lines) {
+            auto tokens = tokenize(line);
+            if(isBlockHeader(tokens)) {
+                current = tokens[1];
+            } else if(!current.empty() && tokens.size() >= 3 && tokens[0] == "Input" && tokens[2] == id) {
+                if(consumers.empty() || consumers.back() != current)
+                    consumers.push_back(current);
+            }
+        }
+        return consumers;
+    }
+
+    std::map<std::string, std::string> PipelineRewriter::getPipelineOutputs() const
+    {
+        std::map<std::string, std::string> outputs;
+        for(const auto& line : m_lines) {
+            auto tokens = tokenize(line);
+            if(tokens.size() >= 3 && tokens[0] == "PipelineOutputData")
+                outputs[tokens[1]] = tokens[2] + (tokens.size() >= 4 ? " " + tokens[3] : "");
+        }
+        return outputs;
+    }
+
+    void PipelineRewriter::addProcessObject(const std::string& id, const std::string& type, const std::vector<std::string>& lines, const std::string& before)
+    {
+        std::vector<std::string> block = {"ProcessObject " + id + " " + type};
+        block.insert(block.end(), lines.begin(), lines.end());
+        block.push_back("");
+        const int position = findBlock(before).first;
+        m_lines.insert(m_lines.begin() + position, block.begin(), block.end());
+    }
+
+    bool PipelineRewriter::canBatch(const std::string& networkId) const
+    {
+        auto input = tokenize(getInput(networkId, 0));
+        if(input.empty())
+            return false;
+        auto producers = getProcessObjects();
+        if(std::find(producers.begin(), producers.end(), input[0]) == producers.end() || getType(input[0]) != "PatchGenerator")
+            return false;
+        // Only the patch stitcher knows how to split the batches again
+        for(const auto& consumer : getConsumers(networkId)) {
+            auto tokens = tokenize(m_lines[findBlock(consumer).first]);
+            if(tokens[0] != "ProcessObject" || tokens[2] != "PatchStitcher")
+                return false;
+        }
+        return true;
+    }
+
+    void PipelineRewriter::enableBatching(const std::string& networkId, int maxBatchSize)
+    {
+        const std::string id = networkId + "Batch";
+        addProcessObject(id, "ImageToBatchGenerator", {
+            "Attribute max-batch-size " + std::to_string(maxBatchSize),
+            "Input 0 " + getInput(networkId, 0)
+        }, networkId);
+        setInput(networkId, 0, id + " 0");
+    }
+
+    void PipelineRewriter::addInputData(const std::string& name, const std::string& description)
+    {
+        // Next to the existing inputs, or at the top if there are none
+        int position = 0;
+        for(int i = 0; i < m_lines.size(); ++i) {
+            auto tokens = tokenize(m_lines[i]);
+            if(!tokens.empty() && tokens[0] == "PipelineInputData")
+                position = i + 1;
+        }
+        m_lines.insert(m_lines.begin() + position, "PipelineInputData " + name + " \"" + description + "\"");
+    }
+
+    std::string PipelineRewriter::substitutePath(std::string text) const
+    {
+        const std::string variable = "$CURRENT_PATH$";
+        for(auto position = text.find(variable); position != std::string::npos; position = text.find(variable, position))
+            text.replace(position, variable.size(), m_folder);
+        return text;
+    }
+
+    void PipelineRewriter::save(const std::string& filename) const
+    {
+        std::ofstream file(filename, std::ios::out);
+        if(!file.is_open())
+            throw Exception("Unable to write pipeline file " + filename);
+        for(const auto& line : m_lines)
+            file << substitutePath(line) << "\n";
+    }
+} // End of namespace fast
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace fast{
+    /**
+     * @brief Text level editing of FAST pipeline (.fpl) files, used to adapt a pipeline to a run before it is
+     * parsed, e.g. to insert batching or to override attributes of all process objects of a type.
+     */
+    class PipelineRewriter {
+        public:
+            /**
+             * @param filename Disk location of the pipeline file to rewrite. The file itself is not modified.
+             */
+            PipelineRewriter(std::string filename);
+
+            /**
+             * @brief getProcessObjects Ids of all process objects of a type, in file order.
+             * @param type Process object type, e.g. NeuralNetwork. All process objects if empty.
+             */
+            std::vector<std::string> getProcessObjects(const std::string& type = "") const;
+            std::string getType(const std::string& id) const;
+            /**
+             * @brief getAttribute Get the value of an attribute of a process object, with quotes removed and
+             * $CURRENT_PATH$ substituted.
+             * @return The value, or an empty string if the attribute is not set.
+             */
+            std::string getAttribute(const std::string& id, const std::string& name) const;
+            /**
+             * @brief getPipelineAttribute Get the value of an attribute of the pipeline itself, such as classes,
+             * with quotes removed.
+             * @return The value, or an empty string if the attribute is not set.
+             */
+            std::string getPipelineAttribute(const std::string& name) const;
+            /**
+             * @brief setAttribute Set or replace an attribute of a process object.
+             * @param value Attribute value as written in the pipeline file, e.g. with quotes for strings.
+             */
+            void setAttribute(const std::string& id, const std::string& name, const std::string& value);
+            /**
+             * @brief removeAttribute Remove an attribute of a process object, if it is set.
+             */
+            void removeAttribute(const std::string& id, const std::string& name);
+            /**
+             * @brief getInput Get the source of an input port of a process object, e.g. "patch 0".
+             * @return The source, or an empty string if the port is not connected.
+             */
+            std::string getInput(const std::string& id, int port) const;
+            void setInput(const std::string& id, int port, const std::string& source);
+            /**
+             * @brief getConsumers Ids of all process objects and renderers with an input from a process object.
+             */
+            std::vector<std::string> getConsumers(const std::string& id) const;
+            /**
+             * @brief getPipelineOutputs Sources of the declared outputs of the pipeline, e.g. "stitcher 0",
+             * indexed by output name.
+             */
+            std::map<std::string, std::string> getPipelineOutputs() const;
+            /**
+             * @brief addProcessObject Insert a new process object right before another one.
+             * @param lines Attribute and Input lines of the new process object.
+             */
+            void addProcessObject(const std::string& id, const std::string& type, const std::vector<std::string>& lines, const std::string& before);
+
+            /**
+             * @brief addInputData Declare an additional input of the pipeline, which must be given when it is parsed.
+             */
+            void addInputData(const std::string& name, const std::string& description);
+
+            /**
+             * @brief canBatch Whether batching can be enabled for a network, which requires that it gets its patches
+             * from a PatchGenerator and that its output is only stitched.
+             */
+            bool canBatch(const std::string& networkId) const;
+            /**
+             * @brief enableBatching Insert an ImageToBatchGenerator in front of a network.
+             */
+            void enableBatching(const std::string& networkId, int maxBatchSize);
+
+            /**
+             * @brief save Write the rewritten pipeline. $CURRENT_PATH$ is replaced by the folder of the original
+             * pipeline, so the pipeline can be saved anywhere.
+             */
+            void save(const std::string& filename) const;
+        private:
+            /**
+             * Index of the header line of a process object or renderer, and the index after its last line.
+             */
+            std::pair<int, int> findBlock(const std::string& id) const;
+            std::string substitutePath(std::string text) const;
+
+            std::string m_folder;
+            std::vector<std::string> m_lines;
+    };
+} // End of namespace fast
@@ -0,0 +1,113 @@
+#include "PipelineRuntimeHistory.h"
+#include "Logger.h"
+#include <QDir>
+#include <QSysInfo>
+#include <QSaveFile>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace fast{
+    PipelineRuntimeHistory::PipelineRuntimeHistory()
+    {
+        m_filename = QDir::home().path().toStdString() + "/fastpathology/pipeline_runtimes.txt";
+        load();
+    }
+
+    void PipelineRuntimeHistory::load()
+    {
+        std::ifstream file(m_filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            // host \t pipeline \t seconds per patch \t runs \t peak memory, which files of older versions don't have
+            std::vector<std::string> fields;
+            std::stringstream stream(line);
+            std::string field;
+            while(std::getline(stream, field, '\t'))
+                fields.push_back(field);
+            if(fields.size() < 4)
+                continue;
+            try {
+                Runtime runtime;
+                runtime.secondsPerPatch = std::stof(fields[2]);
+                runtime.runs = std::stoi(fields[3]);
+                if(fields.size() > 4)
+                    runtime.peakMemory = std::stoll(fields[4]);
+                m_runtimes[fields[0] + "\t" + fields[1]] = runtime;
+            } catch(std::exception& e) {
+            }
+        }
+    }
+
+    void PipelineRuntimeHistory::save() const
+    {
+        QSaveFile file(QString::fromStdString(m_filename));
+        if(!file.open(QIODevice::WriteOnly)) {
+            Logger::warning("PipelineRuntimeHistory") << "Unable to write pipeline runtimes " << m_filename;
+            return;
+        }
+        std::stringstream stream;
+        for(const auto& runtime : m_runtimes)
+            stream << runtime.first << "\t" << runtime.second.secondsPerPatch << "\t" << runtime.second.runs << "\t" << runtime.second.peakMemory << "\n";
+        file.write(QByteArray::fromStdString(stream.str()));
+        file.commit();
+    }
+
+    std::string PipelineRuntimeHistory::getKey(const std::string& pipelineName) const
+    {
+        return QSysInfo::machineHostName().toStdString() + "\t" + pipelineName;
+    }
+
+    float PipelineRuntimeHistory::getSecondsPerPatch(const std::string& pipelineName) const
+    {
+        auto it = m_runtimes.find(getKey(pipelineName));
+        if(it == m_runtimes.end())
+            return 0;
+        return it->second.secondsPerPatch;
+    }
+
+    void PipelineRuntimeHistory::record(const std::string& pipelineName, int patches, float seconds)
+    {
+        if(patches <= 0 || seconds <= 0)
+            return;
+        auto& runtime = m_runtimes[getKey(pipelineName)];
+        // Recent runs weigh more, so that the estimate follows changes of engine, device and settings
+        const int runs = std::min(runtime.runs, 4);
+        runtime.secondsPerPatch = (runtime.secondsPerPatch*runs + seconds / patches) / (runs + 1);
+        runtime.runs += 1;
+        save();
+    }
+
+    int64_t PipelineRuntimeHistory::getPeakMemory(const std::string& pipelineName) const
+    {
+        auto it = m_runtimes.find(getKey(pipelineName));
+        if(it == m_runtimes.end())
+            return 0;
+        return it->second.peakMemory;
+    }
+
+    void PipelineRuntimeHistory::recordMemory(const std::string& pipelineName, int64_t bytes)
+    {
+        if(bytes <= 0)
+            return;
+        // The highest peak, as the memory of a run grows with the size of the slide
+        auto& runtime = m_runtimes[getKey(pipelineName)];
+        if(bytes <= runtime.peakMemory)
+            return;
+        runtime.peakMemory = bytes;
+        save();
+    }
+
+    std::string PipelineRuntimeHistory::formatDuration(float seconds)
+    {
+        const int total = std::round(seconds);
+        if(total < 60)
+            return std::to_string(total) + " s";
+        if(total < 3600)
+            return std::to_string(total / 60) + " min";
+        return std::to_string(total / 3600) + " h " + std::to_string((total % 3600) / 60) + " min";
+    }
+} // End of namespace fast
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <cstdint>
+
+namespace fast{
+    /**
+     * @brief Measured processing time per patch and peak memory of each pipeline on the current machine, used to
+     * estimate the runtime and memory of a pipeline before it is run. Stored per host and pipeline in
+     * pipeline_runtimes.txt in the fastpathology folder, as an average over the previous runs, and the highest
+     * peak memory of the previous runs.
+     */
+    class PipelineRuntimeHistory {
+        public:
+            PipelineRuntimeHistory();
+            /**
+             * @brief getSecondsPerPatch Average processing time per patch of a pipeline.
+             * @return The time in seconds, or 0 if the pipeline hasn't been run on this machine.
+             */
+            float getSecondsPerPatch(const std::string& pipelineName) const;
+            /**
+             * @brief record Add a finished run of a pipeline and save the history.
+             */
+            void record(const std::string& pipelineName, int patches, float seconds);
+            /**
+             * @brief getPeakMemory Memory a run of a pipeline needs, see MemoryMonitor::getPeakIncrease.
+             * @return The memory in bytes, or 0 if the memory of the pipeline hasn't been measured on this machine.
+             */
+            int64_t getPeakMemory(const std::string& pipelineName) const;
+            /**
+             * @brief recordMemory Add the peak memory of a finished run of a pipeline and save the history.
+             */
+            void recordMemory(const std::string& pipelineName, int64_t bytes);
+            /**
+             * @brief formatDuration A duration as e.g. "1 h 5 min" or "40 s".
+             */
+            static std::string formatDuration(float seconds);
+        private:
+            void load();
+            void save() const;
+            std::string getKey(const std::string& pipelineName) const;
+
+            struct Runtime {
+                float secondsPerPatch = 0;
+                int runs = 0;
+                int64_t peakMemory = 0;
+            };
+
+            std::string m_filename;
+            std::map<std::string, Runtime> m_runtimes;
+    };
+} // End of namespace fast
@@ -1,4 +1,13 @@
 #include "Project.h"
+#include "Logger.h"
+#include "MemoryMonitor.h"
+#include "ObjectTable.h"
+#include "ProjectIndex.h"
+#include "PathRemapping.h"
+#include "HeatmapFile.h"
+#include "StreamingStitcher.h"
+#include "PipelineRewriter.h"
+#include "Tracer.h"
 #include <FAST/Reporter.hpp>
 #include <FAST/Utility.hpp>
 #include <FAST/Pipeline.hpp>
@@ -6,19 +15,35 @@
 #include <FAST/Exporters/TIFFImagePyramidExporter.hpp>
 #include <FAST/Importers/MetaImageImporter.hpp>
 #include <FAST/Exporters/MetaImageExporter.hpp>
-#include <FAST/Importers/HDF5TensorImporter.hpp>
-#include <FAST/Exporters/HDF5TensorExporter.hpp>
 #include <FAST/Visualization/Renderer.hpp>
 #include <FAST/Visualization/SegmentationRenderer/SegmentationRenderer.hpp>
 #include <FAST/Visualization/HeatmapRenderer/HeatmapRenderer.hpp>
 #include <FAST/Visualization/View.hpp>
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Data/Image.hpp>
+#include <FAST/Data/Tensor.hpp>
+#include <QFileInfo>
+#include <QDirIterator>
+#include <QSaveFile>
+#include <QLockFile>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <set>
+#include <algorithm>
 
 namespace fast{
     Project::Project(std::string name, bool open)
     {
         m_name = name;
         // Default folder root from Qt temporary dir, automatically deleted.
-        this->_root_folder = QDir::home().path().toStdString() + "/fastpathology/projects/" + name + "/";
+        this->_root_folder = getProjectsFolder() + name + "/";
+        if(QDir::isAbsolutePath(QString::fromStdString(name))) {
+            // Projects of other users, opened by the job server
+            m_name = QFileInfo(QString::fromStdString(name)).fileName().toStdString();
+            _root_folder = name + "/";
+        }
         if(open) {
             std::vector<std::string> lines;
             std::ifstream file(_root_folder + "project.txt");
@@ -26,8 +51,20 @@ namespace fast{
             while (std::getline(file, line)) {
                 lines.push_back(line);
             }
-            for(int i = 0; i < lines.size(); i += 2) {
-                _images[lines[i]] = std::make_shared<WholeSlideImage>(lines[i+1]);
+            // Read first, as thumbnail locations depend on the slide fingerprints
+            m_metadata = readSlideMetadata(_root_folder + "metadata.txt");
+            // Slides are opened lazily, so that the project can be shown before all slides have been read.
+            // Paths on storage which has been moved are remapped, the files of other slides are not touched.
+            PathRemapping remapping;
+            bool remapped = false;
+            for(int i = 0; i + 1 < lines.size(); i += 2) {
+                const std::string path = remapping.apply(lines[i+1]);
+                remapped = remapped || path != lines[i+1];
+                _images[lines[i]] = std::make_shared<WholeSlideImage>(path, getThumbnailFilename(lines[i]));
+            }
+            if(remapped) {
+                Logger::info("Project") << "Remapped slide paths of project " << name;
+                writeSlideList();
             }
         } else {
             this->createFolderDirectoryArchitecture();
@@ -39,10 +76,70 @@ namespace fast{
     }
 
     void Project::writeTimestmap() {
-        std::ofstream timestampFile(_root_folder + "timestamp.txt");
-        timestampFile << currentDateTime();
-        timestampFile.close();
-        std::cout << "Writing timestamping.." << currentDateTime() << std::endl;
+        std::string timestamp = currentDateTime();
+        {
+            // Other processes sharing the project, e.g. distributed workers, may have written a later timestamp
+            // since this one was taken. The lock file makes the read and the replace a single step.
+            QLockFile lockFile(QString::fromStdString(_root_folder + "timestamp.txt.lock"));
+            lockFile.setStaleLockTime(30*1000);
+            if(!lockFile.tryLock(10*1000))
+                Logger::warning("Project") << "Unable to lock " << _root_folder << "timestamp.txt";
+            std::ifstream previousFile(_root_folder + "timestamp.txt");
+            std::string previous;
+            std::getline(previousFile, previous);
+            previousFile.close();
+            // The timestamp format sorts chronologically
+            if(previous > timestamp) {
+                timestamp = previous;
+            } else {
+                // Results of several slides may be saved at the same time, so the file is replaced instead of rewritten
+                QSaveFile timestampFile(QString::fromStdString(_root_folder + "timestamp.txt"));
+                if(timestampFile.open(QIODevice::WriteOnly)) {
+                    timestampFile.write(QByteArray::fromStdString(timestamp));
+                    timestampFile.commit();
+                } else {
+                    Logger::warning("Project") << "Unable to write " << _root_folder << "timestamp.txt";
+                }
+            }
+        }
+        Logger::debug("Project") << "Writing timestamping.." << timestamp;
+
+        // Keep the global project index in sync, so that the project list can be shown without scanning all projects
+        ProjectIndexEntry entry;
+        entry.name = m_name;
+        entry.path = _root_folder;
+        entry.lastModified = timestamp;
+        entry.slideCount = _images.size();
+        // Projects outside the projects folder, e.g. of other users run by the job server, aren't indexed
+        if(QDir(QString::fromStdString(getProjectsFolder() + m_name)) == QDir(QString::fromStdString(_root_folder)))
+            ProjectIndex(getProjectsFolder()).update(entry);
+    }
+
+    void Project::modifyMetadata(const std::function<void(std::map<std::string, SlideMetadata>&)>& change) {
+        // Other processes sharing the project may have added metadata since it was read. The lock file makes the
+        // read, merge and write of metadata.txt a single step across processes.
+        const std::string filename = _root_folder + "metadata.txt";
+        QLockFile lockFile(QString::fromStdString(filename + ".lock"));
+        lockFile.setStaleLockTime(30*1000);
+        if(!lockFile.tryLock(10*1000))
+            Logger::warning("Project") << "Unable to lock " << filename << ", metadata of other processes may be lost";
+        auto metadata = readSlideMetadata(filename);
+        change(metadata);
+        writeSlideMetadata(filename, metadata);
+        // Entries are updated in place, so that references returned by getSlideMetadata stay valid
+        for(auto it = m_metadata.begin(); it != m_metadata.end();) {
+            if(metadata.count(it->first) == 0) {
+                it = m_metadata.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for(const auto& slide : metadata)
+            m_metadata[slide.first] = slide.second;
+    }
+
+    std::string Project::getProjectsFolder() {
+        return QDir::home().path().toStdString() + "/fastpathology/projects/";
     }
 
     void Project::createFolderDirectoryArchitecture()
@@ -66,14 +163,53 @@ namespace fast{
 
     std::shared_ptr<WholeSlideImage> Project::getImage(const std::string& name)
     {
+        std::lock_guard<std::mutex> lock(m_imagesMutex);
         if (this->_images.find(name) != this->_images.end())
             return this->_images[name];
-        // else?
+        throw Exception("Project " + m_name + " has no image with uid " + name);
+    }
+
+    std::string Project::getThumbnailFilename(const std::string& uid) const
+    {
+        auto metadata = m_metadata.find(uid);
+        if(metadata != m_metadata.end() && !metadata->second.fingerprint.empty())
+            return join(getSlideCacheRoot(), metadata->second.fingerprint, "thumbnail.png");
+        return join(this->_root_folder, "thumbnails", uid + ".png");
+    }
+
+    std::string Project::getSlideCacheFolder(const std::string& uid)
+    {
+        const std::string folder = join(getSlideCacheRoot(), getSlideMetadata(uid).fingerprint);
+        createDirectories(folder);
+        return folder;
+    }
+
+    std::string Project::getSlideCacheRoot()
+    {
+        return QDir::home().path().toStdString() + "/fastpathology/cache/slides/";
+    }
+
+    const SlideMetadata& Project::getSlideMetadata(const std::string& uid)
+    {
+        if(m_metadata.count(uid) == 0) {
+            auto image = getImage(uid);
+            const SlideMetadata extracted = SlideMetadata::extract(image->get_filename(), image->get_image_pyramid());
+            modifyMetadata([&](std::map<std::string, SlideMetadata>& metadata) {
+                metadata[uid] = extracted;
+            });
+        }
+        return m_metadata[uid];
+    }
+
+    bool Project::hasSlideMetadata(const std::string& uid) const
+    {
+        return m_metadata.count(uid) > 0;
     }
 
     std::vector<std::string> Project::getAllWsiUids() const
     {
         std::vector<std::string> uids;
+        std::lock_guard<std::mutex> lock(m_imagesMutex);
         for(auto it = this->_images.begin(); it != this->_images.end(); ++it) {
           uids.push_back(it->first);
         }
@@ -83,29 +219,64 @@ namespace fast{
 
     void Project::emptyProject()
     {
+        std::lock_guard<std::mutex> lock(m_imagesMutex);
         this->_images.clear();
     }
 
     const std::string Project::includeImage(const std::string& image_filepath)
     {
+        // The fingerprint only reads a small part of the file, which makes it cheap to detect duplicates before
+        // opening the slide
+        const std::string fingerprint = SlideMetadata::computeFingerprint(image_filepath);
+        const int64_t fileSize = QFileInfo(QString::fromStdString(image_filepath)).size();
+        for(const auto& image : _images) {
+            auto metadata = m_metadata.find(image.first);
+            if(metadata == m_metadata.end() || metadata->second.fingerprint.empty()) {
+                // Slides of older projects may have no metadata or fingerprint yet. The fingerprint includes the
+                // file size, so only slides of the same size can be duplicates and need to be fingerprinted now.
+                if(QFileInfo(QString::fromStdString(image.second->get_filename())).size() != fileSize)
+                    continue;
+                try {
+                    if(metadata == m_metadata.end()) {
+                        getSlideMetadata(image.first);
+                    } else {
+                        SlideMetadata fingerprinted = metadata->second;
+                        fingerprinted.fingerprint = SlideMetadata::computeFingerprint(image.second->get_filename());
+                        modifyMetadata([&](std::map<std::string, SlideMetadata>& slides) {
+                            slides[image.first] = fingerprinted;
+                        });
+                    }
+                } catch(std::exception& e) {
+                    Logger::warning("Project") << "Unable to fingerprint " << image.first << ": " << e.what();
+                    continue;
+                }
+            }
+            if(m_metadata[image.first].fingerprint == fingerprint) {
+                Reporter::info() << image_filepath << " is already in the project as " << image.first << Reporter::end();
+                return image.first;
+            }
+        }
+
         auto image(std::make_shared<WholeSlideImage>(image_filepath));
         std::string img_name_short = splitCustom(splitCustom(image_filepath, "/").back(), ".").front();
-        bool in_use = this->_images.find(img_name_short) != _images.end();
-        if(in_use)
+        if(this->_images.find(img_name_short) != _images.end())
         {
-            bool new_in_use = true;
-            while(new_in_use)
-            {
-                int rand_int = rand() % 10000;
-                std::string new_name = img_name_short + "#" + std::to_string(rand_int);
-                if(this->_images.find(new_name) == this->_images.end())
-                {
-                    new_in_use = false;
-                    img_name_short = new_name;
-                }
-            }
+            // Different slides with the same name are numbered in import order
+            int number = 2;
+            while(this->_images.find(img_name_short + "#" + std::to_string(number)) != _images.end())
+                ++number;
+            img_name_short += "#" + std::to_string(number);
         }
-        this->_images[img_name_short] = image;
+        {
+            std::lock_guard<std::mutex> lock(m_imagesMutex);
+            this->_images[img_name_short] = image;
+        }
+        // The slide is open at this point, so this is the cheapest time to extract its metadata
+        const SlideMetadata extracted = SlideMetadata::extract(image_filepath, image->get_image_pyramid(), fingerprint);
+        modifyMetadata([&](std::map<std::string, SlideMetadata>& metadata) {
+            metadata[img_name_short] = extracted;
+        });
+        this->saveThumbnail(img_name_short);
 
         std::ofstream file(_root_folder + "project.txt", std::ios::app);
         file << img_name_short << "\n";
@@ -116,25 +287,66 @@ namespace fast{
         return img_name_short;
     }
 
-    void Project::includeImageFromProject(const std::string& uid_name, const std::string& image_filepath)
+    int64_t Project::getOpenImageMemory() const
     {
-        std::string thumbnail_filename = this->_root_folder + "/thumbnails" + uid_name + ".png";
-        if (QFile(QString::fromStdString(thumbnail_filename)).exists())
+        int64_t size = 0;
+        std::lock_guard<std::mutex> lock(m_imagesMutex);
+        for(const auto& image : _images)
+            size += image.second->get_memory_usage();
+        return size;
+    }
+
+    int64_t Project::evictIdleImages(int64_t bytes)
+    {
+        // Called by the memory budget of runs in other threads, while slides may be added or removed. The images
+        // are closed without the lock, which the shared pointers make safe.
+        std::vector<std::shared_ptr<WholeSlideImage>> images;
         {
-            QImage thumbnail = QImage(QString::fromStdString(thumbnail_filename));
-            auto image(std::make_shared<WholeSlideImage>(image_filepath, thumbnail));
-            this->_images[uid_name] = image;
+            std::lock_guard<std::mutex> lock(m_imagesMutex);
+            for(const auto& image : _images) {
+                if(image.second->is_open())
+                    images.push_back(image.second);
+            }
         }
-        else
-        {
-            auto image(std::make_shared<WholeSlideImage>(image_filepath));
-            this->_images[uid_name] = image;
+        std::sort(images.begin(), images.end(), [](const std::shared_ptr<WholeSlideImage>& a, const std::shared_ptr<WholeSlideImage>& b) {
+            return a->get_last_used() < b->get_last_used();
+        });
+        int64_t freed = 0;
+        int closed = 0;
+        for(const auto& image : images) {
+            if(freed >= bytes)
+                break;
+            const int64_t size = image->get_memory_usage();
+            if(image->close_if_idle()) {
+                freed += size;
+                ++closed;
+            }
         }
+        if(closed > 0)
+            Logger::info("Project") << "Closed " << closed << " idle slides, freeing about " << MemoryMonitor::formatSize(freed);
+        return freed;
+    }
+
+    void Project::includeImageFromProject(const std::string& uid_name, const std::string& image_filepath)
+    {
+        auto image(std::make_shared<WholeSlideImage>(image_filepath, getThumbnailFilename(uid_name)));
+        std::lock_guard<std::mutex> lock(m_imagesMutex);
+        this->_images[uid_name] = image;
     }
 
     void Project::removeImage(const std::string& uid)
     {
-        this->_images.erase(uid);
+        // Thumbnails in the slide cache may be shared with other projects, so only a project thumbnail is removed
+        QFile::remove(QString::fromStdString(join(this->_root_folder, "thumbnails", uid + ".png")));
+        {
+            std::lock_guard<std::mutex> lock(m_imagesMutex);
+            this->_images.erase(uid);
+        }
+        if(m_metadata.count(uid) > 0) {
+            modifyMetadata([&](std::map<std::string, SlideMetadata>& metadata) {
+                metadata.erase(uid);
+            });
+        }
 
         std::vector<std::string> lines;
         {
@@ -155,19 +367,154 @@ namespace fast{
             }
         }
 
-        // TODO remove any results and thumbnails
+        // TODO remove any results
         QDir().rmdir(QString::fromStdString(this->_root_folder + "/results/" + uid + "/"));
 
         writeTimestmap();
     }
 
+    void Project::writeSlideList()
+    {
+        // Slides keep their place in project.txt, which is the import order, only their paths are updated
+        std::vector<std::string> uids;
+        {
+            std::ifstream file(_root_folder + "project.txt");
+            std::string uid, path;
+            while(std::getline(file, uid) && std::getline(file, path)) {
+                if(_images.count(uid) > 0 && std::find(uids.begin(), uids.end(), uid) == uids.end())
+                    uids.push_back(uid);
+            }
+        }
+        for(const auto& image : _images) {
+            if(std::find(uids.begin(), uids.end(), image.first) == uids.end())
+                uids.push_back(image.first);
+        }
+        std::ofstream file(_root_folder + "project.txt", std::ios::out);
+        for(const auto& uid : uids) {
+            file << uid << "\n";
+            file << _images[uid]->get_filename() << "\n";
+        }
+    }
+
+    std::map<std::string, std::string> Project::getMissingSlides() const
+    {
+        std::map<std::string, std::string> missing;
+        for(const auto& image : _images) {
+            if(!isFile(image.second->get_filename()))
+                missing[image.first] = image.second->get_filename();
+        }
+        return missing;
+    }
+
+    std::map<std::string, std::string> Project::findMovedSlides(const std::map<std::string, std::string>& missing,
+            const std::map<std::string, SlideMetadata>& metadata, const std::vector<std::string>& folders, int threads)
+    {
+        if(threads <= 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        // Candidate files are listed by several threads, one sub-folder at a time
+        std::vector<std::string> roots;
+        std::vector<std::pair<std::string, int64_t>> candidates;
+        for(const auto& folder : folders) {
+            for(auto name : getDirectoryList(folder, true, false))
+                candidates.push_back({join(folder, name), QFileInfo(QString::fromStdString(join(folder, name))).size()});
+            for(auto name : getDirectoryList(folder, false, true))
+                roots.push_back(join(folder, name));
+        }
+        std::mutex mutex;
+        std::atomic<int> next(0);
+        auto runInParallel = [threads](std::function<void()> work) {
+            std::vector<std::thread> workers;
+            for(int i = 0; i < threads; ++i)
+                workers.push_back(std::thread(work));
+            for(auto& worker : workers)
+                worker.join();
+        };
+        runInParallel([&]() {
+            for(int i = next++; i < roots.size(); i = next++) {
+                std::vector<std::pair<std::string, int64_t>> files;
+                QDirIterator it(QString::fromStdString(roots[i]), QDir::Files, QDirIterator::Subdirectories);
+                while(it.hasNext()) {
+                    it.next();
+                    files.push_back({it.filePath().toStdString(), it.fileInfo().size()});
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                candidates.insert(candidates.end(), files.begin(), files.end());
+            }
+        });
+
+        // Only files with the size of a missing slide can be the same slide, and have to be fingerprinted
+        std::map<std::string, std::string> found;
+        std::map<std::string, std::set<std::string>> fingerprints; /* Fingerprint -> uids */
+        std::set<uint64_t> sizes;
+        std::map<std::string, std::string> names; /* File name -> uid, for slides without fingerprint */
+        for(const auto& slide : missing) {
+            auto it = metadata.find(slide.first);
+            if(it != metadata.end() && !it->second.fingerprint.empty()) {
+                fingerprints[it->second.fingerprint].insert(slide.first);
+                sizes.insert(it->second.fileSize);
+            } else {
+                names[getFileName(slide.second)] = slide.first;
+            }
+        }
+        std::vector<std::string> toFingerprint;
+        for(const auto& candidate : candidates) {
+            if(sizes.count(candidate.second) > 0) {
+                toFingerprint.push_back(candidate.first);
+            } else if(names.count(getFileName(candidate.first)) > 0 && found.count(names[getFileName(candidate.first)]) == 0) {
+                found[names[getFileName(candidate.first)]] = candidate.first;
+            }
+        }
+
+        next = 0;
+        runInParallel([&]() {
+            for(int i = next++; i < toFingerprint.size(); i = next++) {
+                std::string fingerprint;
+                try {
+                    fingerprint = SlideMetadata::computeFingerprint(toFingerprint[i]);
+                } catch(Exception& e) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = fingerprints.find(fingerprint);
+                if(it == fingerprints.end())
+                    continue;
+                // Duplicated slides in the project are all relinked to the same file
+                for(const auto& uid : it->second) {
+                    if(found.count(uid) == 0)
+                        found[uid] = toFingerprint[i];
+                }
+            }
+        });
+        return found;
+    }
+
+    void Project::relinkSlides(const std::map<std::string, std::string>& paths)
+    {
+        PathRemapping remapping;
+        std::set<std::pair<std::string, std::string>> rules;
+        for(const auto& path : paths) {
+            if(_images.count(path.first) == 0)
+                continue;
+            auto rule = PathRemapping::inferRule(_images[path.first]->get_filename(), path.second);
+            if(!rule.first.empty() && rule.first != rule.second)
+                rules.insert(rule);
+            auto image = std::make_shared<WholeSlideImage>(path.second, getThumbnailFilename(path.first));
+            std::lock_guard<std::mutex> lock(m_imagesMutex);
+            _images[path.first] = image;
+            Logger::info("Project") << "Relinked " << path.first << " to " << path.second;
+        }
+        for(const auto& rule : rules)
+            remapping.addRule(rule.first, rule.second);
+        writeSlideList();
+        writeTimestmap();
+    }
+
     void Project::saveThumbnails()
     {
         for (const auto currWSI : this->_images)
         {
-            QImage thumbnail = currWSI.second->get_thumbnail();
-            std::string dump_filename = this->_root_folder + "/thumbnails/" + splitCustom(splitCustom(currWSI.second->get_filename(), "/").back(), ".")[0] + ".png";
-            thumbnail.save(QString::fromStdString(dump_filename));
+            saveThumbnail(currWSI.first);
         }
     }
 
@@ -176,65 +523,161 @@ namespace fast{
         if (this->_images.find(wsi_uid) != this->_images.end())
         {
             QImage thumbnail = this->_images[wsi_uid]->get_thumbnail();
-            std::string dump_filename = this->_root_folder + "/thumbnails/" + splitCustom(splitCustom(this->_images[wsi_uid]->get_filename(), "/").back(), ".")[0] + ".png";
-            thumbnail.save(QString::fromStdString(dump_filename));
+            const QString filename = QString::fromStdString(getThumbnailFilename(wsi_uid));
+            QDir().mkpath(QFileInfo(filename).absolutePath());
+            thumbnail.save(filename);
         }
         else
-            std::cout<<"Requested saving thumbnail for WSI named: "<<wsi_uid<<", which is not in the project..."<<std::endl;
+            Logger::warning("Project") << "Requested saving thumbnail for WSI named: " << wsi_uid << ", which is not in the project...";
+    }
+
+    std::string Project::getResultFolder(const std::string& wsi_uid, const std::string& pipelineName) const {
+        if(m_resultStaging.empty())
+            return join(_root_folder, "results", wsi_uid, pipelineName);
+        // Hidden folders are ignored by getResultIndex
+        return join(_root_folder, "results", wsi_uid, "." + pipelineName + "." + m_resultStaging + ".partial");
+    }
+
+    void Project::setResultStaging(const std::string& id) {
+        m_resultStaging = id;
+    }
+
+    void Project::commitResults(const std::string& wsi_uid, const std::string& pipelineName) {
+        if(m_resultStaging.empty())
+            return;
+        const QString staged = QString::fromStdString(getResultFolder(wsi_uid, pipelineName));
+        const QString folder = QString::fromStdString(join(_root_folder, "results", wsi_uid, pipelineName));
+        if(!QDir(staged).exists())
+            return;
+        // A folder can't be renamed over another, so previous results are moved away first
+        const QString previous = QString::fromStdString(join(_root_folder, "results", wsi_uid, "." + pipelineName + "." + m_resultStaging + ".previous"));
+        QDir(previous).removeRecursively();
+        if(QDir(folder).exists() && !QDir().rename(folder, previous))
+            throw Exception("Unable to replace the results in " + folder.toStdString());
+        if(!QDir().rename(staged, folder))
+            throw Exception("Unable to move results to " + folder.toStdString());
+        QDir(previous).removeRecursively();
+    }
+
+    void Project::discardResults(const std::string& wsi_uid, const std::string& pipelineName) {
+        if(!m_resultStaging.empty())
+            QDir(QString::fromStdString(getResultFolder(wsi_uid, pipelineName))).removeRecursively();
+    }
+
+    std::string Project::getResultFilename(const std::string& wsi_uid, const std::string& pipelineName, const std::string& dataName, const std::string& extension) {
+        const std::string saveFolder = join(getResultFolder(wsi_uid, pipelineName), dataName);
+        createDirectories(saveFolder);
+        return join(saveFolder, dataName + extension);
     }
 
     void Project::saveResults(const std::string& wsi_uid, std::shared_ptr<Pipeline> pipeline, std::map<std::string, std::shared_ptr<DataObject>> pipelineData) {
+        // Only segmentations get label preserving overview levels, other images are exported as by FAST
+        const PipelineRewriter rewriter(pipeline->getFilename());
         for(auto data : pipelineData) {
             const std::string dataTypeName = data.second->getNameOfClass();
             const std::string dataName = data.first;
-            const std::string saveFolder = join(getRootFolder(), "results", wsi_uid, pipeline->getName(), dataName);
+            const std::string saveFolder = join(getResultFolder(wsi_uid, pipeline->getName()), dataName);
             createDirectories(saveFolder);
-            std::cout << "Saving " << dataTypeName << " data to " << saveFolder << std::endl;
+            TraceSpan span("export", Tracer::intern("save " + dataName));
+            Logger::info("Project") << "Saving " << dataTypeName << " data to " << saveFolder;
             if(dataTypeName == "ImagePyramid") {
                 const std::string saveFilename = join(saveFolder, data.first + ".tiff");
-                auto exporter = TIFFImagePyramidExporter::create(saveFilename)
-                        ->connect(data.second);
-                exporter->run();
+                auto pyramid = std::dynamic_pointer_cast<ImagePyramid>(data.second);
+                bool exported = false;
+                if(StreamingStitcher::isSegmentation(rewriter, dataName)) {
+                    try {
+                        // Replaces the overview levels of the pyramid with label preserving ones
+                        StreamingStitcher::write(saveFilename, pyramid, StreamingStitcher::Downsampling::Mode);
+                        exported = true;
+                    } catch(Exception& e) {
+                        Logger::warning("Project") << "Exporting " << dataName << " without label preserving overview levels: " << e.what();
+                    }
+                }
+                if(!exported) {
+                    auto exporter = TIFFImagePyramidExporter::create(saveFilename)
+                            ->connect(data.second);
+                    exporter->run();
+                }
+                saveObjectTable(wsi_uid, pipeline, std::dynamic_pointer_cast<ImagePyramid>(data.second), saveFilename);
             } else if(dataTypeName == "Image") {
-                const std::string saveFilename = join(saveFolder, data.first + ".mhd");
-                auto exporter = MetaImageExporter::create(saveFilename)
-                        ->connect(data.second);
-                exporter->run();
+                auto image = std::dynamic_pointer_cast<Image>(data.second);
+                // 2D segmentations get overview levels, so that they aren't read at full resolution when zoomed out
+                if(image->getDepth() == 1 && image->getDataType() == TYPE_UINT8 && image->getNrOfChannels() == 1 &&
+                        StreamingStitcher::isSegmentation(rewriter, dataName)) {
+                    const std::string saveFilename = join(saveFolder, data.first + ".tiff");
+                    StreamingStitcher::write(saveFilename, image, StreamingStitcher::Downsampling::Mode);
+                } else {
+                    const std::string saveFilename = join(saveFolder, data.first + ".mhd");
+                    auto exporter = MetaImageExporter::create(saveFilename)
+                            ->connect(data.second);
+                    exporter->run();
+                }
             } else if(dataTypeName == "Tensor") {
                 const std::string saveFilename = join(saveFolder, data.first + ".hdf5");
-                auto exporter = HDF5TensorExporter::create(saveFilename)
-                        ->connect(data.second);
-                exporter->run();
+                HeatmapFile::write(saveFilename, std::dynamic_pointer_cast<Tensor>(data.second));
             } else {
-                std::cout << "Unsupported data to export " << dataTypeName << std::endl;
+                Logger::warning("Project") << "Unsupported data to export " << dataTypeName;
             }
+            saveResultAttributes(saveFolder, pipeline);
+        }
+        writeTimestmap();
+    }
 
-            // TODO handle multiple renderes somehow
-            {
-                std::ofstream file(join(saveFolder, "renderer.attributes.txt"), std::iostream::out);
-                for(auto renderer : pipeline->getRenderers()) {
-                    if(renderer->getNameOfClass() != "ImagePyramidRenderer")
-                        file << renderer->attributesToString();
-                }
-                file.close();
+    void Project::saveStreamedResults(const std::string& wsi_uid, std::shared_ptr<Pipeline> pipeline, const std::vector<std::string>& dataNames) {
+        for(const auto& dataName : dataNames) {
+            const std::string saveFilename = getResultFilename(wsi_uid, pipeline->getName(), dataName, ".tiff");
+            if(getPipelineAttribute(pipeline, "object-table") == "true") {
+                auto segmentation = TIFFImagePyramidImporter::create(saveFilename)->runAndGetOutputData<ImagePyramid>();
+                saveObjectTable(wsi_uid, pipeline, segmentation, saveFilename);
             }
-            {
-                std::ofstream file(join(saveFolder, "pipeline.attributes.txt"), std::iostream::out);
-                try {
-                    file << pipeline->getPipelineAttribute("classes") << "\n";
-                } catch(Exception& e) {
+            saveResultAttributes(getDirName(saveFilename), pipeline);
+        }
+        writeTimestmap();
+    }
 
-                }
-                /*for(auto attribute : pipeline->getPipelineAttributes()) {
-                    file << "Attribute " << attribute.first << " \"" << attribute.second << "\"\n";
-                }*/
-                file.close();
+    void Project::saveObjectTable(const std::string& wsi_uid, std::shared_ptr<Pipeline> pipeline, std::shared_ptr<ImagePyramid> segmentation, const std::string& saveFilename) {
+        if(getPipelineAttribute(pipeline, "object-table") != "true")
+            return;
+        // Per-object measurements, stored next to the segmentation
+        auto table = computeObjectTable(segmentation, getImage(wsi_uid)->get_image_pyramid());
+        Logger::info("Project") << "Found " << table.size() << " objects in " << getFileName(saveFilename);
+        table.writeCSV(saveFilename.substr(0, saveFilename.size() - std::string(".tiff").size()) + ".objects.csv");
+    }
+
+    void Project::saveResultAttributes(const std::string& saveFolder, std::shared_ptr<Pipeline> pipeline) {
+        // TODO handle multiple renderes somehow
+        {
+            std::ofstream file(join(saveFolder, "renderer.attributes.txt"), std::iostream::out);
+            for(auto renderer : pipeline->getRenderers()) {
+                if(renderer->getNameOfClass() != "ImagePyramidRenderer")
+                    file << renderer->attributesToString();
             }
+            file.close();
+        }
+        {
+            std::ofstream file(join(saveFolder, "pipeline.attributes.txt"), std::iostream::out);
+            try {
+                file << pipeline->getPipelineAttribute("classes") << "\n";
+            } catch(Exception& e) {
+
+            }
+            /*for(auto attribute : pipeline->getPipelineAttributes()) {
+                file << "Attribute " << attribute.first << " \"" << attribute.second << "\"\n";
+            }*/
+            file.close();
+        }
+    }
+
+    std::string Project::getPipelineAttribute(std::shared_ptr<Pipeline> pipeline, const std::string& name) {
+        try {
+            return pipeline->getPipelineAttribute(name);
+        } catch(Exception& e) {
+            return "";
         }
-        writeTimestmap();
     }
 
     std::shared_ptr<WholeSlideImage> Project::getImage(int i) {
+        std::lock_guard<std::mutex> lock(m_imagesMutex);
         if(i >= _images.size())
             throw Exception("Out of bounds in Project::getImage");
         auto it = _images.begin();
@@ -243,12 +686,19 @@ namespace fast{
     }
 
     std::vector<Result> Project::loadResults(const std::string &wsi_uid) {
-        std::vector<Result> results;
+        return loadResults(getResultIndex(wsi_uid));
+    }
+
+    std::vector<ResultFile> Project::getResultIndex(const std::string &wsi_uid) const {
+        std::vector<ResultFile> files;
         // Load any results for current WSI
         const std::string saveFolder = join(_root_folder, "results", wsi_uid);
         if(!isDir(saveFolder))
             return {};
         for(auto pipelineName : getDirectoryList(saveFolder, false, true)) {
+            // Results being written by other processes, see setResultStaging
+            if(pipelineName[0] == '.')
+                continue;
             const std::string folder = join(saveFolder, pipelineName);
             if(!isDir(folder))
                 break;
@@ -257,70 +707,106 @@ namespace fast{
                 if(!isDir(folder))
                     break;
                 for(auto filename : getDirectoryList(folder, true, false)) {
-                    const std::string path = join(folder, filename);
                     const std::string extension = filename.substr(filename.rfind('.'));
-                    Renderer::pointer renderer;
-                    if(extension == ".tiff") {
-                        auto importer = TIFFImagePyramidImporter::create(path);
-                        renderer = SegmentationRenderer::create()->connect(importer);
-                    } else if(extension == ".mhd") {
-                        auto importer = MetaImageImporter::create(path);
-                        renderer = SegmentationRenderer::create()->connect(importer);
-                    } else if(extension == ".hdf5") {
-                        auto importer = HDF5TensorImporter::create(path);
-                        renderer = HeatmapRenderer::create()->connect(importer);
-                    }
-                    if(renderer) {
-                        // Read attributes from txt file
-                        std::ifstream file(join(folder, "renderer.attributes.txt"), std::iostream::in);
-                        if(!file.is_open())
-                            throw Exception("Error reading " + join(folder, "renderer.attributes.txt"));
-                        do {
+                    if(extension != ".tiff" && extension != ".mhd" && extension != ".hdf5")
+                        continue;
+
+                    ResultFile result;
+                    // Read attributes from txt file
+                    std::ifstream file(join(folder, "renderer.attributes.txt"), std::iostream::in);
+                    if(!file.is_open())
+                        throw Exception("Error reading " + join(folder, "renderer.attributes.txt"));
+                    do {
+                        std::string line;
+                        std::getline(file, line);
+                        trim(line);
+                        std::vector<std::string> tokens = split(line);
+                        if(tokens.empty() || tokens[0] != "Attribute")
+                            break;
+                        result.rendererAttributes.push_back(line);
+                    } while(!file.eof());
+
+                    // Read pipeline attributes
+                    {
+                        std::ifstream file(join(folder, "pipeline.attributes.txt"), std::iostream::in);
+                        if(file.is_open()) {
                             std::string line;
                             std::getline(file, line);
                             trim(line);
-                            std::cout << line << std::endl;
-
-                            std::vector<std::string> tokens = split(line);
-                            if(tokens[0] != "Attribute")
-                                break;
-
-                            if(tokens.size() < 3)
-                                throw Exception("Expecting at least 3 items on attribute line when parsing object " + renderer->getNameOfClass() + " but got " + line);
-
-                            std::string name = tokens[1];
-
-                            std::shared_ptr<Attribute> attribute = renderer->getAttribute(name);
-                            std::string attributeValues = line.substr(line.find(name) + name.size());
-                            trim(attributeValues);
-                            attribute->parseInput(attributeValues);
-                            std::cout << "Set attribute " << name << " to " << attributeValues  << " for object " << renderer->getNameOfClass() << std::endl;
-                        } while(!file.eof());
-                        renderer->loadAttributes();
-
-                        Result result;
-
-                        // Read pipeline attributes
-                        {
-                            std::ifstream file(join(folder, "pipeline.attributes.txt"), std::iostream::in);
-                            if(file.is_open()) {
-                                std::string line;
-                                std::getline(file, line);
-                                trim(line);
-                                std::cout << line << std::endl;
-                                result.classNames = split(line, ";");
-                            }
+                            result.classNames = split(line, ";");
                         }
-
-                        result.WSI_uid = wsi_uid;
-                        result.renderer = renderer;
-                        result.name = dataName;
-                        result.pipelineName = pipelineName;
-                        results.push_back(result);
                     }
+
+                    result.WSI_uid = wsi_uid;
+                    result.filename = join(folder, filename);
+                    result.name = dataName;
+                    result.pipelineName = pipelineName;
+                    files.push_back(result);
                 }
             }
         }
+        return files;
+    }
+
+    void Project::loadResultData(ResultFile& file) {
+        const std::string extension = file.filename.substr(file.filename.rfind('.'));
+        if(extension == ".tiff") {
+            file.data = TIFFImagePyramidImporter::create(file.filename)->runAndGetOutputData<DataObject>();
+        } else if(extension == ".mhd") {
+            file.data = MetaImageImporter::create(file.filename)->runAndGetOutputData<DataObject>();
+        } else if(extension == ".hdf5") {
+            // Only the overview is needed for display
+            file.data = HeatmapFile(file.filename).readOverview();
+        }
+    }
+
+    std::vector<Result> Project::loadResults(const std::vector<ResultFile>& files) {
+        std::vector<Result> results;
+        for(const auto& file : files) {
+            const std::string extension = file.filename.substr(file.filename.rfind('.'));
+            Renderer::pointer renderer;
+            if(file.data) {
+                // Already imported, e.g. by the slide prefetcher
+                if(extension == ".hdf5") {
+                    renderer = HeatmapRenderer::create()->connect(file.data);
+                } else {
+                    renderer = SegmentationRenderer::create()->connect(file.data);
+                }
+            } else if(extension == ".tiff") {
+                auto importer = TIFFImagePyramidImporter::create(file.filename);
+                renderer = SegmentationRenderer::create()->connect(importer);
+            } else if(extension == ".mhd") {
+                auto importer = MetaImageImporter::create(file.filename);
+                renderer = SegmentationRenderer::create()->connect(importer);
+            } else if(extension == ".hdf5") {
+                renderer = HeatmapRenderer::create()->connect(HeatmapFile(file.filename).readOverview());
+            }
+            if(!renderer)
+                continue;
+
+            for(const auto& line : file.rendererAttributes) {
+                std::vector<std::string> tokens = split(line);
+                if(tokens.size() < 3)
+                    throw Exception("Expecting at least 3 items on attribute line when parsing object " + renderer->getNameOfClass() + " but got " + line);
+
+                std::string name = tokens[1];
+
+                std::shared_ptr<Attribute> attribute = renderer->getAttribute(name);
+                std::string attributeValues = line.substr(line.find(name) + name.size());
+                trim(attributeValues);
+                attribute->parseInput(attributeValues);
+                Logger::debug("Project") << "Set attribute " << name << " to " << attributeValues  << " for object " << renderer->getNameOfClass();
+            }
+            renderer->loadAttributes();
+
+            Result result;
+            result.classNames = file.classNames;
+            result.WSI_uid = file.WSI_uid;
+            result.renderer = renderer;
+            result.name = file.name;
+            result.pipelineName = file.pipelineName;
+            results.push_back(result);
+        }
         return results;
     }
 } // End of namespace fast
@@ -2,6 +2,9 @@
 
 #include <iostream>
 #include <string>
+#include <map>
+#include <functional>
+#include <mutex>
 #include <QString>
 #include <QTemporaryDir>
 #include <QFile>
@@ -9,9 +12,11 @@
 #include <QTextStream>
 #include "source/utils/utilities.h"
 #include "source/logic/WholeSlideImage.h"
+#include "source/logic/SlideMetadata.h"
 
 namespace fast{
     class DataObject;
+    class ImagePyramid;
     class Pipeline;
     class Renderer;
 
@@ -24,8 +29,26 @@ namespace fast{
             std::shared_ptr<Renderer> renderer;
     };
 
+    /**
+     * @brief A result file on disk, with everything needed to create its renderer.
+     * Reading the index only requires small text files, the result data itself can be loaded separately.
+     */
+    class ResultFile {
+        public:
+            std::string name;
+            std::string pipelineName;
+            std::string WSI_uid;
+            std::string filename;
+            std::vector<std::string> classNames;
+            std::vector<std::string> rendererAttributes; /* Attribute lines of renderer.attributes.txt */
+            std::shared_ptr<DataObject> data; /* Loaded result data, if null it is imported when rendered */
+    };
+
     class Project {
         public:
+            /**
+             * @param name Name of a project in the projects folder, or the absolute path of a project folder.
+             */
             Project(std::string name, bool open = false);
             ~Project();
 
@@ -36,16 +59,81 @@ namespace fast{
             std::shared_ptr<WholeSlideImage> getImage(const std::string& name);
             std::shared_ptr<WholeSlideImage> getImage(int i);
             std::string getName() const { return m_name; };
+            /**
+             * @brief getThumbnailFilename Disk location of the cached thumbnail of a WSI.
+             * Thumbnails of slides with a fingerprint are stored in the slide cache, and shared between projects.
+             * @param uid Unique identifier for the WSI.
+             */
+            std::string getThumbnailFilename(const std::string& uid) const;
+            /**
+             * @brief getSlideMetadata Get the stored metadata of a WSI, without opening the slide.
+             * Slides imported before metadata was stored are opened once and their metadata is stored.
+             * @param uid Unique identifier for the WSI.
+             */
+            const SlideMetadata& getSlideMetadata(const std::string& uid);
+            /**
+             * @brief hasSlideMetadata Whether the metadata of a WSI is stored, i.e. can be queried without slide I/O.
+             */
+            bool hasSlideMetadata(const std::string& uid) const;
+            /**
+             * @brief getSlideCacheFolder Folder for data derived from a slide, such as thumbnails, tissue masks and
+             * inference results. It is keyed by the slide's content fingerprint, so it remains valid when the slide
+             * is moved or renamed, and is shared by all projects containing the slide.
+             * @param uid Unique identifier for the WSI.
+             */
+            std::string getSlideCacheFolder(const std::string& uid);
 
             void emptyProject();
             void saveResults(const std::string& wsi_uid, std::shared_ptr<Pipeline> pipeline, std::map<std::string, std::shared_ptr<DataObject>> data);
+            /**
+             * @brief saveStreamedResults Store the attributes of segmentations which were written to their result
+             * files while the pipeline ran, see StreamingStitcher, so that they are loaded like saved results.
+             * @param dataNames Names of the pipeline outputs which were streamed.
+             */
+            void saveStreamedResults(const std::string& wsi_uid, std::shared_ptr<Pipeline> pipeline, const std::vector<std::string>& dataNames);
+            /**
+             * @brief getResultFilename Disk location of the result file of a pipeline output. The folder is created
+             * if it doesn't exist.
+             * @param extension File extension, including the dot, which determines how the result is loaded.
+             */
+            std::string getResultFilename(const std::string& wsi_uid, const std::string& pipelineName, const std::string& dataName, const std::string& extension);
+            /**
+             * @brief setResultStaging Write results to a hidden folder next to their final folder, which commitResults
+             * moves into place, so that other processes sharing the project never see partial results.
+             * @param id Name of the staging folders, unique for each process. Empty to write results in place.
+             */
+            void setResultStaging(const std::string& id);
+            /**
+             * @brief commitResults Move the staged results of a pipeline into place, replacing its previous results.
+             * Does nothing if results are not staged.
+             */
+            void commitResults(const std::string& wsi_uid, const std::string& pipelineName);
+            /**
+             * @brief discardResults Remove the staged results of a pipeline which failed.
+             */
+            void discardResults(const std::string& wsi_uid, const std::string& pipelineName);
 
             std::vector<Result> loadResults(const std::string& wsi_uid);
+            /**
+             * @brief getResultIndex List the results of a WSI, without loading the result data.
+             * Only reads files, and is therefore safe to call from a background thread.
+             * @param wsi_uid Unique identifier for the WSI.
+             */
+            std::vector<ResultFile> getResultIndex(const std::string& wsi_uid) const;
+            /**
+             * @brief loadResultData Import the data of a result, so that it doesn't have to be imported when rendered.
+             */
+            static void loadResultData(ResultFile& file);
+            /**
+             * @brief loadResults Create the renderers for a set of results.
+             */
+            static std::vector<Result> loadResults(const std::vector<ResultFile>& files);
 
             /**
-             * @brief includeImage Include image to the current project.
+             * @brief includeImage Include image to the current project. A slide with the same content as a slide
+             * already in the project, is not included again.
              * @param image_filepath Disk location of the WSI to include.
-             * @return
+             * @return Unique identifier of the WSI, which is the identifier of the existing WSI for duplicates.
              */
             const std::string includeImage(const std::string& image_filepath);
             /**
@@ -60,13 +148,77 @@ namespace fast{
              */
             void removeImage(const std::string& uid);
 
+            /**
+             * @brief getMissingSlides Find the WSIs whose files don't exist, e.g. because the slide storage was moved.
+             * @return Disk location of each missing WSI, indexed by uid.
+             */
+            std::map<std::string, std::string> getMissingSlides() const;
+            /**
+             * @brief findMovedSlides Search folders recursively for missing slides. Files with the same size as a
+             * missing slide are fingerprinted in parallel, slides without a fingerprint are matched by file name.
+             * Doesn't modify the project, and is therefore safe to run in a background thread.
+             * @param missing Disk location of each missing WSI, indexed by uid, see getMissingSlides.
+             * @param metadata Metadata of the WSIs, used to match the files.
+             * @param folders Folders to search.
+             * @param threads Number of threads, 0 selects the number of hardware threads.
+             * @return New disk location of each found WSI, indexed by uid.
+             */
+            static std::map<std::string, std::string> findMovedSlides(const std::map<std::string, std::string>& missing,
+                    const std::map<std::string, SlideMetadata>& metadata, const std::vector<std::string>& folders, int threads = 0);
+            /**
+             * @brief relinkSlides Change the disk location of WSIs, and add path remapping rules for the moved
+             * folders, so that other projects using the same storage are relinked automatically when opened.
+             * @param paths New disk location of each WSI, indexed by uid.
+             */
+            void relinkSlides(const std::map<std::string, std::string>& paths);
+            std::map<std::string, SlideMetadata> getAllSlideMetadata() const { return m_metadata; }
+            /**
+             * @brief getOpenImageMemory Estimated memory of the open WSIs, see WholeSlideImage::get_memory_usage.
+             */
+            int64_t getOpenImageMemory() const;
+            /**
+             * @brief evictIdleImages Close the image pyramids of WSIs which nothing else uses, least recently used
+             * first, until enough memory is freed. They are opened again when requested.
+             * @param bytes Memory to free.
+             * @return Estimated memory freed.
+             */
+            int64_t evictIdleImages(int64_t bytes);
+
             void writeTimestmap();
+            /**
+             * @brief getProjectsFolder Folder on disk containing all projects.
+             */
+            static std::string getProjectsFolder();
        protected:
             /**
              * @brief createFolderDirectoryArchitecture Prepare the folder structure with sub-folders
              * such as thumbnails or results.
              */
             void createFolderDirectoryArchitecture();
+            /**
+             * @brief writeSlideList Replace project.txt with the current uids and disk locations of all WSIs, in
+             * the order of project.txt.
+             */
+            void writeSlideList();
+            /**
+             * @brief getPipelineAttribute Get an optional pipeline attribute.
+             * @return The attribute value, or an empty string if the pipeline doesn't have it.
+             */
+            static std::string getPipelineAttribute(std::shared_ptr<Pipeline> pipeline, const std::string& name);
+            /**
+             * @brief saveObjectTable Store per-object measurements of a segmentation next to it, if the pipeline
+             * has the object-table attribute.
+             */
+            void saveObjectTable(const std::string& wsi_uid, std::shared_ptr<Pipeline> pipeline, std::shared_ptr<ImagePyramid> segmentation, const std::string& saveFilename);
+            /**
+             * @brief saveResultAttributes Store the renderer and pipeline attributes of a result, which are needed
+             * to render it when it is loaded.
+             */
+            static void saveResultAttributes(const std::string& saveFolder, std::shared_ptr<Pipeline> pipeline);
+            /**
+             * @brief getSlideCacheRoot Folder containing the cache folders of all slides.
+             */
+            static std::string getSlideCacheRoot();
             /**
              * @brief saveThumbnails Iteratively saving on disk the thumbnail of each opened WSI.
              */
@@ -76,9 +228,22 @@ namespace fast{
              * @param wsi_uid unique id of the WSI whose thumbnail should be saved.
              */
             void saveThumbnail(const std::string& wsi_uid);
+            /**
+             * @brief getResultFolder Folder the results of a pipeline are written to, see setResultStaging.
+             */
+            std::string getResultFolder(const std::string& wsi_uid, const std::string& pipelineName) const;
        private:
+            /**
+             * @brief modifyMetadata Apply a change to metadata.txt as stored on disk, under a lock file, and merge
+             * the result into the metadata of this project.
+             */
+            void modifyMetadata(const std::function<void(std::map<std::string, SlideMetadata>&)>& change);
+
             std::string m_name;
             std::string _root_folder;  /* Location on disk where to save all data for the current project. */
             std::map<std::string, std::shared_ptr<WholeSlideImage>> _images; /* Loaded image objects. */
+            mutable std::mutex m_imagesMutex; /* Guards _images, which the memory budget of runs reads from other threads */
+            std::map<std::string, SlideMetadata> m_metadata; /* Stored in metadata.txt, indexed by uid */
+            std::string m_resultStaging; /* Id of the staging folders of results, results are written in place if empty */
     };
 } // End of namespace fast
@@ -0,0 +1,193 @@
+#include "ProjectIndex.h"
+#include "Logger.h"
+#include <FAST/Utility.hpp>
+#include <QSaveFile>
+#include <QLockFile>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+namespace fast{
+    ProjectIndex::ProjectIndex(std::string projectsFolder)
+    {
+        m_projectsFolder = projectsFolder;
+        m_filename = join(projectsFolder, "index.txt");
+        m_entries = read(m_filename);
+    }
+
+    std::map<std::string, ProjectIndexEntry> ProjectIndex::read(const std::string& filename)
+    {
+        std::map<std::string, ProjectIndexEntry> entries;
+        std::ifstream file(filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            // name \t path \t last modified \t slide count \t size on disk
+            std::vector<std::string> tokens;
+            std::stringstream stream(line);
+            std::string token;
+            while(std::getline(stream, token, '\t'))
+                tokens.push_back(token);
+            if(tokens.size() != 5)
+                continue;
+            ProjectIndexEntry entry;
+            entry.name = tokens[0];
+            entry.path = tokens[1];
+            entry.lastModified = tokens[2];
+            try {
+                entry.slideCount = std::stoi(tokens[3]);
+                entry.sizeOnDisk = std::stoull(tokens[4]);
+            } catch(std::exception& e) {
+                continue;
+            }
+            entries[entry.name] = entry;
+        }
+        return entries;
+    }
+
+    void ProjectIndex::modify(const std::function<void(std::map<std::string, ProjectIndexEntry>&)>& change)
+    {
+        // Other instances of the application may have changed the index since it was read. The lock file makes the
+        // read, merge and write of the index a single step across processes.
+        QLockFile lockFile(QString::fromStdString(m_filename + ".lock"));
+        lockFile.setStaleLockTime(30*1000);
+        if(!lockFile.tryLock(10*1000))
+            Logger::warning("ProjectIndex") << "Unable to lock project index " << m_filename << ", changes of other instances may be lost";
+        m_entries = read(m_filename);
+        change(m_entries);
+        save();
+    }
+
+    void ProjectIndex::save() const
+    {
+        // QSaveFile replaces the index atomically, so that concurrent readers never see a partial index
+        QSaveFile file(QString::fromStdString(m_filename));
+        if(!file.open(QIODevice::WriteOnly)) {
+            Logger::warning("ProjectIndex") << "Unable to write project index " << m_filename;
+            return;
+        }
+        std::stringstream stream;
+        for(const auto& entry : m_entries) {
+            stream << entry.second.name << "\t" << entry.second.path << "\t" << entry.second.lastModified << "\t"
+                   << entry.second.slideCount << "\t" << entry.second.sizeOnDisk << "\n";
+        }
+        file.write(QByteArray::fromStdString(stream.str()));
+        file.commit();
+    }
+
+    std::vector<ProjectIndexEntry> ProjectIndex::sortedEntries() const
+    {
+        std::vector<ProjectIndexEntry> entries;
+        for(const auto& entry : m_entries)
+            entries.push_back(entry.second);
+        // Entries are already sorted by name, a stable sort keeps that order for identical timestamps
+        std::stable_sort(entries.begin(), entries.end(), [](const ProjectIndexEntry& a, const ProjectIndexEntry& b) {
+            return a.lastModified > b.lastModified;
+        });
+        return entries;
+    }
+
+    std::vector<ProjectIndexEntry> ProjectIndex::getEntries() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return sortedEntries();
+    }
+
+    void ProjectIndex::update(ProjectIndexEntry entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        modify([&entry](std::map<std::string, ProjectIndexEntry>& entries) {
+            if(entry.sizeOnDisk == 0 && entries.count(entry.name) > 0)
+                entry.sizeOnDisk = entries[entry.name].sizeOnDisk;
+            entries[entry.name] = entry;
+        });
+    }
+
+    void ProjectIndex::remove(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        modify([&name](std::map<std::string, ProjectIndexEntry>& entries) {
+            entries.erase(name);
+        });
+    }
+
+    std::vector<ProjectIndexEntry> ProjectIndex::reconcile()
+    {
+        std::map<std::string, ProjectIndexEntry> previous;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            previous = m_entries;
+        }
+
+        std::map<std::string, ProjectIndexEntry> entries;
+        for(auto name : getDirectoryList(m_projectsFolder, false, true)) {
+            auto entry = scanProject(m_projectsFolder, name, false);
+            if(entry.lastModified.empty()) {
+                Logger::debug("ProjectIndex") << "Project " << name << " was missing timestmap.txt";
+                continue;
+            }
+            auto it = previous.find(name);
+            if(it != previous.end() && it->second.lastModified == entry.lastModified && it->second.sizeOnDisk > 0) {
+                entry.sizeOnDisk = it->second.sizeOnDisk;
+            } else {
+                entry = scanProject(m_projectsFolder, name, true);
+            }
+            entries[name] = entry;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        modify([&entries](std::map<std::string, ProjectIndexEntry>& current) {
+            // The scan takes a while: projects may have been deleted, added or modified since they were scanned.
+            // Existence is checked again now, and entries written in the meantime win if they are newer.
+            for(auto it = current.begin(); it != current.end();) {
+                if(entries.count(it->first) == 0 && !fileExists(join(it->second.path, "timestamp.txt"))) {
+                    it = current.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            for(const auto& entry : entries) {
+                if(!fileExists(join(entry.second.path, "timestamp.txt"))) {
+                    current.erase(entry.first);
+                    continue;
+                }
+                auto it = current.find(entry.first);
+                if(it == current.end() || it->second.lastModified <= entry.second.lastModified)
+                    current[entry.first] = entry.second;
+            }
+        });
+        return sortedEntries();
+    }
+
+    ProjectIndexEntry ProjectIndex::scanProject(const std::string& projectsFolder, const std::string& name, bool computeSize)
+    {
+        ProjectIndexEntry entry;
+        entry.name = name;
+        entry.path = join(projectsFolder, name);
+        {
+            std::ifstream file(join(entry.path, "timestamp.txt"));
+            if(file.is_open())
+                std::getline(file, entry.lastModified);
+        }
+        {
+            // project.txt holds two lines per slide: uid and path
+            std::ifstream file(join(entry.path, "project.txt"));
+            std::string line;
+            int lines = 0;
+            while(std::getline(file, line)) {
+                if(!line.empty())
+                    ++lines;
+            }
+            entry.slideCount = lines / 2;
+        }
+        if(computeSize) {
+            QDirIterator it(QString::fromStdString(entry.path), QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+            while(it.hasNext()) {
+                it.next();
+                entry.sizeOnDisk += it.fileInfo().size();
+            }
+        }
+        return entry;
+    }
+} // End of namespace fast
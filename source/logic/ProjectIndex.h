@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <functional>
+
+namespace fast{
+    /**
+     * @brief Summary of a project as stored in the global project index.
+     */
+    class ProjectIndexEntry {
+        public:
+            std::string name;
+            std::string path;
+            std::string lastModified; /* Content of the project's timestamp.txt */
+            int slideCount = 0;
+            uint64_t sizeOnDisk = 0; /* In bytes, including results and thumbnails */
+    };
+
+    /**
+     * @brief Global index of all projects in the projects folder, stored in a single file so that the list of
+     * projects can be read without opening every project folder. The index is updated by the projects themselves
+     * whenever they are modified, and can be reconciled against the file system to pick up external changes.
+     * Several instances of the application may share the index: changes are merged into the index on disk under a
+     * lock file, instead of overwriting it with the entries of one instance.
+     */
+    class ProjectIndex {
+        public:
+            /**
+             * @param projectsFolder Folder containing one sub-folder per project.
+             */
+            ProjectIndex(std::string projectsFolder);
+
+            /**
+             * @brief getEntries All indexed projects, most recently modified first.
+             * Projects with identical timestamps are all kept, sorted by name.
+             */
+            std::vector<ProjectIndexEntry> getEntries() const;
+            /**
+             * @brief update Insert or replace the entry of a single project and save the index.
+             * The size on disk of the previous entry is kept if the new entry doesn't specify one.
+             */
+            void update(ProjectIndexEntry entry);
+            /**
+             * @brief remove Remove a project from the index and save the index.
+             */
+            void remove(const std::string& name);
+            /**
+             * @brief reconcile Scan the projects folder and bring the index in sync with it.
+             * Projects whose timestamp didn't change keep their cached size on disk. Projects which were deleted
+             * while scanning are not added back, and projects added while scanning are kept. This is slow for large
+             * project folders and is meant to be run in a background thread.
+             * @return The reconciled entries, most recently modified first.
+             */
+            std::vector<ProjectIndexEntry> reconcile();
+
+            /**
+             * @brief scanProject Create an index entry by reading a project folder.
+             * @param computeSize Whether to compute the size on disk, which requires traversing all results.
+             */
+            static ProjectIndexEntry scanProject(const std::string& projectsFolder, const std::string& name, bool computeSize = true);
+        private:
+            static std::map<std::string, ProjectIndexEntry> read(const std::string& filename);
+            /**
+             * Re-read the index on disk, apply a change to it and save it, while holding the index lock file.
+             */
+            void modify(const std::function<void(std::map<std::string, ProjectIndexEntry>&)>& change);
+            void save() const;
+            std::vector<ProjectIndexEntry> sortedEntries() const;
+
+            std::string m_projectsFolder;
+            std::string m_filename;
+            std::map<std::string, ProjectIndexEntry> m_entries; /* Indexed by project name */
+            mutable std::mutex m_mutex;
+    };
+} // End of namespace fast
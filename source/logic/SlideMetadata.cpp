@@ -0,0 +1,282 @@
+#include "SlideMetadata.h"
+#include "Logger.h"
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Utility.hpp>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+namespace fast{
+    namespace {
+        // Returns the first of the metadata keys which is a number, or 0
+        float getNumber(const std::map<std::string, std::string>& metadata, const std::vector<std::string>& keys) {
+            for(const auto& key : keys) {
+                auto it = metadata.find(key);
+                if(it == metadata.end())
+                    continue;
+                try {
+                    return std::stof(it->second);
+                } catch(std::exception& e) {
+                }
+            }
+            return 0;
+        }
+
+        std::string joinNumbers(const std::vector<int>& values) {
+            std::string result;
+            for(int i = 0; i < values.size(); ++i)
+                result += (i > 0 ? "," : "") + std::to_string(values[i]);
+            return result;
+        }
+
+        std::vector<int> splitNumbers(const std::string& values) {
+            std::vector<int> result;
+            for(const auto& value : split(values, ","))
+                result.push_back(std::stoi(value));
+            return result;
+        }
+
+        // Hashes the start of a file and a number of blocks spread over the rest of it
+        void sampleFile(ContentHash& hash, std::ifstream& file, int64_t size, int sampledBlocks) {
+            constexpr int64_t blockSize = 64*1024;
+            std::vector<int64_t> offsets = {0};
+            if(size > blockSize) {
+                for(int i = 1; i <= sampledBlocks; ++i)
+                    offsets.push_back((size - blockSize) * i / sampledBlocks);
+            }
+            std::vector<char> buffer(blockSize);
+            for(auto offset : offsets) {
+                file.seekg(offset);
+                file.read(buffer.data(), blockSize);
+                hash.add(buffer.data(), file.gcount());
+                file.clear();
+            }
+        }
+    }
+
+    SlideMetadata SlideMetadata::extract(const std::string& filename, std::shared_ptr<ImagePyramid> pyramid, const std::string& fingerprint)
+    {
+        SlideMetadata result;
+        for(int level = 0; level < pyramid->getNrOfLevels(); ++level) {
+            result.levelWidths.push_back(pyramid->getLevelWidth(level));
+            result.levelHeights.push_back(pyramid->getLevelHeight(level));
+        }
+        result.tileWidth = pyramid->getLevelTileWidth(0);
+        result.tileHeight = pyramid->getLevelTileHeight(0);
+
+        // Vendor properties as reported by OpenSlide
+        const auto metadata = pyramid->getMetadata();
+        result.magnification = getMagnification(pyramid);
+        result.micronsPerPixel = getNumber(metadata, {"openslide.mpp-x", "aperio.MPP"});
+        auto vendor = metadata.find("openslide.vendor");
+        if(vendor != metadata.end())
+            result.vendor = vendor->second;
+
+        result.fileSize = QFileInfo(QString::fromStdString(filename)).size();
+        result.fingerprint = fingerprint.empty() ? SlideMetadata::computeFingerprint(filename) : fingerprint;
+        return result;
+    }
+
+    float SlideMetadata::getMagnification(std::shared_ptr<ImagePyramid> pyramid)
+    {
+        return getNumber(pyramid->getMetadata(), {"openslide.objective-power", "aperio.AppMag", "hamamatsu.SourceLens"});
+    }
+
+    std::string SlideMetadata::computeFingerprint(const std::string& filename)
+    {
+        // Slide files are hundreds of MBs to GBs, often on network storage, so only the header and a fixed number
+        // of blocks spread over the file are hashed. The header holds the dimensions, vendor properties and the
+        // tile offset table of most formats, and the sampled blocks cover tile data of all pyramid levels.
+        std::ifstream file(filename, std::ios::binary);
+        if(!file.is_open())
+            throw Exception("Unable to read " + filename);
+        file.seekg(0, std::ios::end);
+        const int64_t size = file.tellg();
+        ContentHash hash(size);
+        sampleFile(hash, file, size, 16);
+
+        // Formats such as MRXS and VSI keep the image data in companion files, and their main file may be the
+        // same for different slides. The name, size and a few blocks of each companion file are hashed too.
+        for(const auto& companion : getCompanionFiles(filename)) {
+            std::ifstream companionFile(companion, std::ios::binary);
+            if(!companionFile.is_open())
+                throw Exception("Unable to read " + companion);
+            companionFile.seekg(0, std::ios::end);
+            const int64_t companionSize = companionFile.tellg();
+            const std::string name = QFileInfo(QString::fromStdString(companion)).fileName().toStdString();
+            hash.add(name.data(), name.size());
+            hash.add((const char*)&companionSize, sizeof(companionSize));
+            sampleFile(hash, companionFile, companionSize, 4);
+        }
+        return hash.toString();
+    }
+
+    std::vector<std::string> SlideMetadata::getCompanionFiles(const std::string& filename)
+    {
+        const QFileInfo info(QString::fromStdString(filename));
+        const QString suffix = info.suffix().toLower();
+        QString folder;
+        if(suffix == "mrxs") {
+            // 3DHISTECH: Slidedat.ini and Data*.dat in a folder with the name of the slide
+            folder = info.absolutePath() + "/" + info.completeBaseName();
+        } else if(suffix == "vsi") {
+            // Olympus: .ets files in the stack folders of _<name>_
+            folder = info.absolutePath() + "/_" + info.completeBaseName() + "_";
+        } else {
+            return {};
+        }
+        std::vector<std::string> files;
+        QDirIterator it(folder, QDir::Files, QDirIterator::Subdirectories);
+        while(it.hasNext())
+            files.push_back(it.next().toStdString());
+        // Directory listing order depends on the file system
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    ContentHash::ContentHash(uint64_t seed)
+    {
+        for(int i = 0; i < lanes; ++i)
+            m_state[i] = seed + (i + 1) * prime1;
+    }
+
+    void ContentHash::add(const char* data, size_t size)
+    {
+        // Independent lanes, each consuming every fourth 64-bit word, so the multiplications of the lanes don't
+        // wait for each other
+        const size_t words = size / 8;
+        uint64_t state[lanes];
+        for(int i = 0; i < lanes; ++i)
+            state[i] = m_state[i];
+        size_t word = 0;
+        for(; word + lanes <= words; word += lanes) {
+            for(int i = 0; i < lanes; ++i) {
+                uint64_t value;
+                std::memcpy(&value, data + (word + i)*8, 8);
+                state[i] = mix(state[i], value);
+            }
+        }
+        // Remaining words and bytes
+        for(; word < words; ++word) {
+            uint64_t value;
+            std::memcpy(&value, data + word*8, 8);
+            state[word % lanes] = mix(state[word % lanes], value);
+        }
+        if(size % 8 != 0) {
+            uint64_t value = 0;
+            std::memcpy(&value, data + words*8, size % 8);
+            state[0] = mix(state[0], value ^ ((uint64_t)(size % 8) << 56));
+        }
+        for(int i = 0; i < lanes; ++i)
+            m_state[i] = state[i];
+        m_length += size;
+    }
+
+    std::string ContentHash::toString() const
+    {
+        uint64_t a = m_length * prime2;
+        uint64_t b = ~m_length;
+        for(int i = 0; i < lanes; ++i) {
+            a = mix(a, m_state[i]);
+            b = mix(b ^ (a >> 29), m_state[lanes - 1 - i]);
+        }
+        char result[33];
+        std::snprintf(result, sizeof(result), "%016llx%016llx", (unsigned long long)avalanche(a), (unsigned long long)avalanche(b));
+        return result;
+    }
+
+    uint64_t ContentHash::mix(uint64_t state, uint64_t value)
+    {
+        state += value * prime2;
+        state = (state << 31) | (state >> 33);
+        return state * prime1;
+    }
+
+    uint64_t ContentHash::avalanche(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= prime2;
+        value ^= value >> 29;
+        value *= prime3;
+        value ^= value >> 32;
+        return value;
+    }
+
+    std::string SlideMetadata::toString() const
+    {
+        std::stringstream stream;
+        stream << joinNumbers(levelWidths) << "\t" << joinNumbers(levelHeights) << "\t" << tileWidth << "\t" << tileHeight << "\t"
+               << magnification << "\t" << micronsPerPixel << "\t" << vendor << "\t" << fileSize << "\t" << fingerprint;
+        return stream.str();
+    }
+
+    SlideMetadata SlideMetadata::fromString(const std::string& line)
+    {
+        std::vector<std::string> tokens;
+        std::stringstream stream(line);
+        std::string token;
+        while(std::getline(stream, token, '\t'))
+            tokens.push_back(token);
+        // The vendor and fingerprint may be empty
+        while(tokens.size() < 9)
+            tokens.push_back("");
+        if(tokens.size() != 9)
+            throw Exception("Malformed slide metadata: " + line);
+        SlideMetadata result;
+        try {
+            result.levelWidths = splitNumbers(tokens[0]);
+            result.levelHeights = splitNumbers(tokens[1]);
+            result.tileWidth = std::stoi(tokens[2]);
+            result.tileHeight = std::stoi(tokens[3]);
+            result.magnification = std::stof(tokens[4]);
+            result.micronsPerPixel = std::stof(tokens[5]);
+            result.fileSize = std::stoull(tokens[7]);
+        } catch(std::exception& e) {
+            throw Exception("Malformed slide metadata: " + line);
+        }
+        if(result.levelWidths.size() != result.levelHeights.size())
+            throw Exception("Malformed slide metadata: " + line);
+        result.vendor = tokens[6];
+        result.fingerprint = tokens[8];
+        return result;
+    }
+
+    std::map<std::string, SlideMetadata> readSlideMetadata(const std::string& filename)
+    {
+        std::map<std::string, SlideMetadata> metadata;
+        std::ifstream file(filename);
+        std::string line;
+        while(std::getline(file, line)) {
+            const auto separator = line.find('\t');
+            if(separator == std::string::npos)
+                continue;
+            try {
+                metadata[line.substr(0, separator)] = SlideMetadata::fromString(line.substr(separator + 1));
+            } catch(Exception& e) {
+                // Extracted again when needed
+                Logger::warning("SlideMetadata") << e.what();
+            }
+        }
+        return metadata;
+    }
+
+    void writeSlideMetadata(const std::string& filename, const std::map<std::string, SlideMetadata>& metadata)
+    {
+        QSaveFile file(QString::fromStdString(filename));
+        if(!file.open(QIODevice::WriteOnly)) {
+            Logger::warning("SlideMetadata") << "Unable to write slide metadata " << filename;
+            return;
+        }
+        std::stringstream stream;
+        for(const auto& slide : metadata)
+            stream << slide.first << "\t" << slide.second.toString() << "\n";
+        file.write(QByteArray::fromStdString(stream.str()));
+        file.commit();
+    }
+} // End of namespace fast
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdint>
+
+namespace fast{
+    class ImagePyramid;
+
+    /**
+     * @brief Compact description of a slide, extracted once when the slide is imported and stored in the
+     * project, so that dimensions, resolution and size can be queried without opening the slide file.
+     */
+    class SlideMetadata {
+        public:
+            std::vector<int> levelWidths;
+            std::vector<int> levelHeights;
+            int tileWidth = 0;
+            int tileHeight = 0;
+            float magnification = 0; /* Objective power, 0 if unknown */
+            float micronsPerPixel = 0; /* Spacing of the highest resolution level, 0 if unknown */
+            std::string vendor;
+            uint64_t fileSize = 0; /* In bytes */
+            std::string fingerprint; /* Hash of the slide content, stays the same if the file is moved or renamed */
+
+            int getNrOfLevels() const { return levelWidths.size(); }
+            int getFullWidth() const { return levelWidths.empty() ? 0 : levelWidths[0]; }
+            int getFullHeight() const { return levelHeights.empty() ? 0 : levelHeights[0]; }
+
+            /**
+             * @brief extract Create the metadata record of an opened slide.
+             * @param filename Disk location of the slide.
+             * @param pyramid The opened slide.
+             * @param fingerprint Fingerprint of the slide if already computed, otherwise it is computed.
+             */
+            static SlideMetadata extract(const std::string& filename, std::shared_ptr<ImagePyramid> pyramid, const std::string& fingerprint = "");
+            /**
+             * @brief getMagnification Objective power of the highest resolution level of an opened slide.
+             * @return The magnification, or 0 if the slide doesn't report it.
+             */
+            static float getMagnification(std::shared_ptr<ImagePyramid> pyramid);
+            /**
+             * @brief computeFingerprint Compute the content fingerprint of a slide file, from its size, header and a fixed
+             * number of sampled blocks. Reads about 1 MB regardless of the slide size, plus a few blocks of each
+             * companion file of multi-file formats, see getCompanionFiles.
+             * Identical slides get the same fingerprint, independent of the file name and location.
+             */
+            static std::string computeFingerprint(const std::string& filename);
+            /**
+             * @brief getCompanionFiles Files which hold the image data of a multi-file slide format, such as the
+             * Data*.dat files of MRXS and the .ets files of VSI, sorted by path. Empty for single-file formats.
+             */
+            static std::vector<std::string> getCompanionFiles(const std::string& filename);
+
+            /**
+             * @brief toString Serialize to a single tab-separated line.
+             */
+            std::string toString() const;
+            /**
+             * @brief fromString Parse a line created by toString. Throws an Exception if the line is malformed.
+             */
+            static SlideMetadata fromString(const std::string& line);
+    };
+
+    /**
+     * @brief Fast non-cryptographic 128-bit hash of a byte stream, used for content fingerprints.
+     */
+    class ContentHash {
+        public:
+            ContentHash(uint64_t seed = 0);
+            void add(const char* data, size_t size);
+            /**
+             * @brief toString The hash as 32 hexadecimal characters.
+             */
+            std::string toString() const;
+        private:
+            static uint64_t mix(uint64_t state, uint64_t value);
+            static uint64_t avalanche(uint64_t value);
+            static constexpr int lanes = 4;
+            static constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+            static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+            static constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+            uint64_t m_state[lanes];
+            uint64_t m_length = 0;
+    };
+
+    /**
+     * @brief readSlideMetadata Read a metadata file, with one line per slide: uid followed by the record.
+     * @return Metadata records indexed by slide uid. Empty if the file doesn't exist.
+     */
+    std::map<std::string, SlideMetadata> readSlideMetadata(const std::string& filename);
+    /**
+     * @brief writeSlideMetadata Atomically replace a metadata file.
+     */
+    void writeSlideMetadata(const std::string& filename, const std::map<std::string, SlideMetadata>& metadata);
+} // End of namespace fast
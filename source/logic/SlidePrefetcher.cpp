@@ -0,0 +1,176 @@
+#include "SlidePrefetcher.h"
+#include "source/logic/WholeSlideImage.h"
+#include "source/logic/MemoryMonitor.h"
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Reporter.hpp>
+#include <algorithm>
+
+namespace fast{
+    SlidePrefetcher::SlidePrefetcher(int maxLowResolutionSize)
+    {
+        m_maxLowResolutionSize = maxLowResolutionSize;
+        m_thread = std::thread(&SlidePrefetcher::run, this);
+    }
+
+    SlidePrefetcher::~SlidePrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        m_thread.join();
+    }
+
+    void SlidePrefetcher::prefetch(std::shared_ptr<Project> project, const std::vector<std::string>& uids)
+    {
+        std::vector<std::shared_ptr<WholeSlideImage>> released;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(project != m_project) {
+                for(const auto& image : m_images)
+                    released.push_back(image.second);
+                m_results.clear();
+                m_images.clear();
+                ++m_generation;
+            }
+            m_project = project;
+            m_wanted = uids;
+            m_queue.clear();
+            for(const auto& uid : uids) {
+                if(m_results.count(uid) == 0)
+                    m_queue.push_back({uid, project->getImage(uid)});
+            }
+            // Release slides which are no longer close to the one being viewed
+            for(auto it = m_results.begin(); it != m_results.end();) {
+                if(std::find(uids.begin(), uids.end(), it->first) == uids.end()) {
+                    if(m_images.count(it->first) > 0)
+                        released.push_back(m_images[it->first]);
+                    m_images.erase(it->first);
+                    it = m_results.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        m_condition.notify_one();
+        release(released);
+    }
+
+    void SlidePrefetcher::release(const std::vector<std::shared_ptr<WholeSlideImage>>& images)
+    {
+        // The WSIs are also held by the project, which would keep their pyramids open. Pyramids which are still
+        // used, e.g. by the renderer of the slide being viewed, stay open.
+        for(const auto& image : images)
+            image->close_if_idle();
+    }
+
+    std::vector<ResultFile> SlidePrefetcher::getResultIndex(std::shared_ptr<Project> project, const std::string& uid)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(project == m_project && m_results.count(uid) > 0)
+                return m_results[uid];
+        }
+        return project->getResultIndex(uid);
+    }
+
+    void SlidePrefetcher::invalidate()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_results.clear();
+            m_queue.clear();
+            ++m_generation;
+            // Opened slides are still valid, only the results have to be read again
+            for(const auto& uid : m_wanted) {
+                if(m_images.count(uid) > 0)
+                    m_queue.push_back({uid, m_images[uid]});
+            }
+        }
+        m_condition.notify_one();
+    }
+
+    int64_t SlidePrefetcher::getMemoryUsage()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int64_t size = 0;
+        for(const auto& results : m_results) {
+            for(const auto& result : results.second)
+                size += MemoryMonitor::getMemoryUsage(result.data);
+        }
+        return size;
+    }
+
+    void SlidePrefetcher::clear()
+    {
+        std::vector<std::shared_ptr<WholeSlideImage>> released;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(const auto& image : m_images)
+                released.push_back(image.second);
+            m_project.reset();
+            m_wanted.clear();
+            m_queue.clear();
+            m_results.clear();
+            m_images.clear();
+            ++m_generation;
+        }
+        release(released);
+    }
+
+    void SlidePrefetcher::run()
+    {
+        while(true) {
+            std::string uid;
+            std::shared_ptr<WholeSlideImage> image;
+            std::shared_ptr<Project> project;
+            int generation;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+                if(m_stop)
+                    return;
+                uid = m_queue.front().first;
+                image = m_queue.front().second;
+                m_queue.pop_front();
+                project = m_project;
+                generation = m_generation;
+            }
+            std::vector<ResultFile> results;
+            try {
+                prefetchSlide(image);
+                results = project->getResultIndex(uid);
+                for(auto& result : results)
+                    Project::loadResultData(result);
+            } catch(std::exception &e) {
+                // The slide is loaded as usual when viewed, which will report the error
+                Reporter::warning() << "Unable to prefetch " << uid << ": " << e.what() << Reporter::end();
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(generation == m_generation && std::find(m_wanted.begin(), m_wanted.end(), uid) != m_wanted.end()) {
+                    m_results[uid] = results;
+                    m_images[uid] = image;
+                    continue;
+                }
+            }
+            // No longer wanted while it was being prefetched
+            release({image});
+        }
+    }
+
+    void SlidePrefetcher::prefetchSlide(std::shared_ptr<WholeSlideImage> image)
+    {
+        auto pyramid = image->get_image_pyramid();
+        // Reading the low resolution levels fills the slide reader's tile cache, which is where the
+        // renderer starts when a slide is shown
+        auto access = pyramid->getAccess(ACCESS_READ);
+        for(int level = pyramid->getNrOfLevels() - 1; level >= 0; --level) {
+            if((int64_t)pyramid->getLevelWidth(level)*pyramid->getLevelHeight(level) > m_maxLowResolutionSize)
+                break;
+            access->getLevelAsImage(level);
+        }
+    }
+} // End of namespace fast
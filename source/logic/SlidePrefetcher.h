@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "source/logic/Project.h"
+
+namespace fast{
+    class WholeSlideImage;
+
+    /**
+     * @brief Prepares the slides next to the one being viewed in a background thread, so that stepping through
+     * the slides of a project doesn't stall on every slide. For each slide the image pyramid is opened, the
+     * low resolution levels are read, and the results are indexed and imported.
+     */
+    class SlidePrefetcher {
+        public:
+            /**
+             * @param maxLowResolutionSize Levels with at most this many pixels are read when prefetching a slide.
+             */
+            SlidePrefetcher(int maxLowResolutionSize = 2048*2048);
+            ~SlidePrefetcher();
+
+            /**
+             * @brief prefetch Replace the set of slides to prefetch. Slides are prepared in the given order, and
+             * prefetched data of slides not in the list is released. Returns immediately.
+             * @param uids Unique identifiers of the slides to prefetch, most important first.
+             */
+            void prefetch(std::shared_ptr<Project> project, const std::vector<std::string>& uids);
+            /**
+             * @brief getResultIndex Get the results of a slide, using the prefetched results if available.
+             */
+            std::vector<ResultFile> getResultIndex(std::shared_ptr<Project> project, const std::string& uid);
+            /**
+             * @brief invalidate Drop all prefetched results, e.g. after new results have been saved.
+             */
+            void invalidate();
+            /**
+             * @brief getMemoryUsage Estimated memory of the prefetched results, see MemoryMonitor::getMemoryUsage.
+             */
+            int64_t getMemoryUsage();
+            /**
+             * @brief clear Stop prefetching and release all prefetched data.
+             */
+            void clear();
+        private:
+            void run();
+            void prefetchSlide(std::shared_ptr<WholeSlideImage> image);
+            /**
+             * Close the pyramids of released slides which nothing else uses.
+             */
+            static void release(const std::vector<std::shared_ptr<WholeSlideImage>>& images);
+
+            int m_maxLowResolutionSize;
+            std::shared_ptr<Project> m_project;
+            std::deque<std::pair<std::string, std::shared_ptr<WholeSlideImage>>> m_queue;
+            std::vector<std::string> m_wanted;
+            std::map<std::string, std::vector<ResultFile>> m_results; /* Prefetched results per slide */
+            std::map<std::string, std::shared_ptr<WholeSlideImage>> m_images; /* Keeps the prefetched slides open */
+            int m_generation = 0; /* Incremented when prefetched results become stale */
+            bool m_stop = false;
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            std::thread m_thread;
+    };
+} // End of namespace fast
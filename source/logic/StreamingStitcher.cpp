@@ -0,0 +1,492 @@
+#include "StreamingStitcher.h"
+#include "source/logic/Logger.h"
+#include "source/logic/PipelineRewriter.h"
+#include "source/logic/Tracer.h"
+#include <FAST/Pipeline.hpp>
+#include <FAST/DataStream.hpp>
+#include <FAST/Data/Image.hpp>
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Utility.hpp>
+#include <tiffio.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+namespace fast{
+    namespace {
+        int getFrameInt(std::shared_ptr<Image> patch, const std::string& name) {
+            return std::stoi(patch->getFrameData(name));
+        }
+
+        uint8_t mode(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+            const uint8_t values[4] = {a, b, c, d};
+            uint8_t best = 0;
+            int bestCount = 0;
+            for(int i = 0; i < 4; ++i) {
+                int count = 0;
+                for(int j = 0; j < 4; ++j)
+                    count += values[j] == values[i] ? 1 : 0;
+                // Ties go to the foreground, so that thin structures don't vanish from the overviews
+                if(count > bestCount || (count == bestCount && best == 0)) {
+                    best = values[i];
+                    bestCount = count;
+                }
+            }
+            return best;
+        }
+
+        /**
+         * Fixed set of threads, shared by all stitchers, which downsample the columns of tile rows. Starting threads
+         * for each tile row of each level would cost about as much as the downsampling itself.
+         */
+        class DownsamplingPool {
+            public:
+                static DownsamplingPool& get() {
+                    static DownsamplingPool pool(std::max(1, std::min(8, (int)std::thread::hardware_concurrency())) - 1);
+                    return pool;
+                }
+                ~DownsamplingPool() {
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_stop = true;
+                    }
+                    m_condition.notify_all();
+                    for(auto& worker : m_workers)
+                        worker.join();
+                }
+                /**
+                 * Threads which can run jobs at the same time, including the calling thread.
+                 */
+                int getThreads() const { return m_workers.size() + 1; }
+                /**
+                 * Run jobs 0 to count - 1, job 0 in the calling thread, and wait for all of them.
+                 */
+                void run(int count, const std::function<void(int)>& job) {
+                    std::mutex mutex;
+                    std::condition_variable done;
+                    int remaining = count - 1;
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        for(int i = 1; i < count; ++i) {
+                            m_jobs.push_back([&, i]() {
+                                job(i);
+                                std::lock_guard<std::mutex> lock(mutex);
+                                if(--remaining == 0)
+                                    done.notify_one();
+                            });
+                        }
+                    }
+                    m_condition.notify_all();
+                    job(0);
+                    std::unique_lock<std::mutex> lock(mutex);
+                    done.wait(lock, [&remaining]() { return remaining == 0; });
+                }
+            private:
+                explicit DownsamplingPool(int threads) {
+                    for(int i = 0; i < threads; ++i) {
+                        m_workers.emplace_back([this]() {
+                            while(true) {
+                                std::function<void()> job;
+                                {
+                                    std::unique_lock<std::mutex> lock(m_mutex);
+                                    m_condition.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+                                    if(m_jobs.empty())
+                                        return;
+                                    job = std::move(m_jobs.front());
+                                    m_jobs.pop_front();
+                                }
+                                job();
+                            }
+                        });
+                    }
+                }
+
+                std::vector<std::thread> m_workers;
+                std::deque<std::function<void()>> m_jobs;
+                std::mutex m_mutex;
+                std::condition_variable m_condition;
+                bool m_stop = false;
+        };
+    }
+
+    StreamingStitcher::StreamingStitcher(std::string filename, Downsampling downsampling, int tileWidth, int tileHeight)
+    {
+        m_filename = filename;
+        m_downsampling = downsampling;
+        // Lower levels are made by halving tile rows, which requires an even number of rows
+        m_tileWidth = tileWidth;
+        m_tileHeight = tileHeight + tileHeight % 2;
+    }
+
+    StreamingStitcher::~StreamingStitcher()
+    {
+        if(m_finished)
+            return;
+        close();
+        for(const auto& level : m_levels)
+            std::remove(level.filename.c_str());
+    }
+
+    void StreamingStitcher::close()
+    {
+        for(auto& level : m_levels) {
+            if(level.tiff != nullptr)
+                TIFFClose(level.tiff);
+            level.tiff = nullptr;
+        }
+    }
+
+    void StreamingStitcher::setFields(TIFF* tiff, const Level& level, int index) const
+    {
+        TIFFSetField(tiff, TIFFTAG_SUBFILETYPE, index == 0 ? 0 : FILETYPE_REDUCEDIMAGE);
+        TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, level.width);
+        TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, level.height);
+        TIFFSetField(tiff, TIFFTAG_TILEWIDTH, m_tileWidth);
+        TIFFSetField(tiff, TIFFTAG_TILELENGTH, m_tileHeight);
+        TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, m_channels);
+        TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+        TIFFSetField(tiff, TIFFTAG_PHOTOMETRIC, m_channels == 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tiff, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+        // Spacing is in millimeters, as in FAST, and stored as pixels per centimeter
+        const float scale = (float)m_levels[0].width / level.width;
+        TIFFSetField(tiff, TIFFTAG_RESOLUTIONUNIT, RESUNIT_CENTIMETER);
+        TIFFSetField(tiff, TIFFTAG_XRESOLUTION, 10.0f / (m_spacingX*scale));
+        TIFFSetField(tiff, TIFFTAG_YRESOLUTION, 10.0f / (m_spacingY*scale));
+    }
+
+    void StreamingStitcher::open(int width, int height, int channels, float spacingX, float spacingY)
+    {
+        if(channels != 1 && channels != 3)
+            throw Exception("Streaming stitcher only supports images with 1 or 3 channels");
+        m_channels = channels;
+        m_spacingX = spacingX;
+        m_spacingY = spacingY;
+        // Halve the resolution until the level fits in a few tiles, as for the pyramids of FAST
+        while(true) {
+            Level level;
+            level.filename = m_levels.empty() ? m_filename : m_filename + ".level" + std::to_string(m_levels.size()) + ".tmp";
+            level.width = width;
+            level.height = height;
+            level.tilesX = (width + m_tileWidth - 1) / m_tileWidth;
+            level.tilesY = (height + m_tileHeight - 1) / m_tileHeight;
+            m_levels.push_back(level);
+            if(std::max(width, height) <= 2048 || std::min(width, height) < 2)
+                break;
+            width /= 2;
+            height /= 2;
+        }
+        // Levels are written at the same time, each to its own file, and copied into one file when finished
+        const bool bigTIFF = (int64_t)m_levels[0].width*m_levels[0].height*channels >= ((int64_t)1 << 31);
+        for(int i = 0; i < m_levels.size(); ++i) {
+            auto& level = m_levels[i];
+            level.tiff = TIFFOpen(level.filename.c_str(), bigTIFF ? "w8" : "w");
+            if(level.tiff == nullptr)
+                throw Exception("Unable to create TIFF file " + level.filename);
+            setFields(level.tiff, level, i);
+        }
+        m_tile.resize(m_tileWidth*m_tileHeight*channels);
+    }
+
+    uint8_t* StreamingStitcher::getRow(int level, int row)
+    {
+        auto& rows = m_levels[level].rows;
+        auto it = rows.find(row);
+        if(it == rows.end()) {
+            const int64_t size = (int64_t)m_levels[level].tilesX*m_tileWidth*m_tileHeight*m_channels;
+            it = rows.emplace(row, std::vector<uint8_t>(size, 0)).first;
+            m_memory += size;
+            m_peakMemory = std::max(m_peakMemory, m_memory);
+        }
+        return it->second.data();
+    }
+
+    void StreamingStitcher::add(std::shared_ptr<Image> patch)
+    {
+        if(patch->getDataType() != TYPE_UINT8)
+            throw Exception("Streaming stitcher only supports 8 bit images");
+        if(m_levels.empty()) {
+            float spacingX = 1, spacingY = 1;
+            if(patch->hasFrameData("patch-spacing-x")) {
+                spacingX = std::stof(patch->getFrameData("patch-spacing-x"));
+                spacingY = std::stof(patch->getFrameData("patch-spacing-y"));
+            }
+            open(getFrameInt(patch, "original-width"), getFrameInt(patch, "original-height"), patch->getNrOfChannels(), spacingX, spacingY);
+        }
+        if(patch->getNrOfChannels() != m_channels)
+            throw Exception("All patches must have the same number of channels");
+        auto& level = m_levels[0];
+        const int offsetX = getFrameInt(patch, "patch-offset-x");
+        const int offsetY = getFrameInt(patch, "patch-offset-y");
+        const int patchWidth = getFrameInt(patch, "patch-width");
+        const int patchHeight = getFrameInt(patch, "patch-height");
+        const int overlapX = getFrameInt(patch, "patch-overlap-x");
+        const int overlapY = getFrameInt(patch, "patch-overlap-y");
+
+        // Overlap is cropped, except at the borders of the image
+        const int startX = offsetX > 0 ? offsetX + overlapX : 0;
+        const int startY = offsetY > 0 ? offsetY + overlapY : 0;
+        const int endX = std::min(level.width, offsetX + patchWidth < level.width ? offsetX + patchWidth - overlapX : level.width);
+        const int endY = std::min(level.height, offsetY + patchHeight < level.height ? offsetY + patchHeight - overlapY : level.height);
+
+        // Patches are generated row by row, so all tile rows above this patch are done
+        flush(0, startY / m_tileHeight);
+
+        // The network output may have a different size than the patch, e.g. if the network resizes its input
+        const float scaleX = (float)patch->getWidth() / patchWidth;
+        const float scaleY = (float)patch->getHeight() / patchHeight;
+        auto access = patch->getImageAccess(ACCESS_READ);
+        const auto data = (const uint8_t*)access->get();
+        const int stride = level.tilesX*m_tileWidth*m_channels;
+        for(int y = startY; y < endY; ++y) {
+            const int sourceY = std::min(patch->getHeight() - 1, (int)((y - offsetY)*scaleY));
+            uint8_t* destination = getRow(0, y / m_tileHeight) + (y % m_tileHeight)*stride;
+            for(int x = startX; x < endX; ++x) {
+                const int sourceX = std::min(patch->getWidth() - 1, (int)((x - offsetX)*scaleX));
+                std::memcpy(&destination[x*m_channels], &data[(sourceY*patch->getWidth() + sourceX)*m_channels], m_channels);
+            }
+        }
+    }
+
+    void StreamingStitcher::flush(int level, int untilRow)
+    {
+        untilRow = std::min(untilRow, m_levels[level].tilesY);
+        while(m_levels[level].nextRow < untilRow)
+            writeRow(level, m_levels[level].nextRow++);
+    }
+
+    void StreamingStitcher::writeRow(int level, int row)
+    {
+        TraceSpan span("export", "write tile row");
+        auto& current = m_levels[level];
+        // Rows without any patches, e.g. background which wasn't processed, are written as empty tiles
+        const uint8_t* data = getRow(level, row);
+        const int stride = current.tilesX*m_tileWidth*m_channels;
+        const int tileStride = m_tileWidth*m_channels;
+        for(int tileX = 0; tileX < current.tilesX; ++tileX) {
+            for(int y = 0; y < m_tileHeight; ++y)
+                std::memcpy(&m_tile[y*tileStride], &data[y*stride + tileX*tileStride], tileStride);
+            if(TIFFWriteTile(current.tiff, m_tile.data(), tileX*m_tileWidth, row*m_tileHeight, 0, 0) < 0)
+                throw Exception("Unable to write tile to " + current.filename);
+        }
+
+        if(level + 1 < m_levels.size()) {
+            // Downsample into half a tile row of the next level
+            auto& next = m_levels[level + 1];
+            if(row / 2 < next.tilesY) {
+                const int nextStride = next.tilesX*tileStride;
+                uint8_t* destination = getRow(level + 1, row / 2) + (row % 2)*(m_tileHeight/2)*nextStride;
+                downsample(data, stride, destination, nextStride, next.width, m_tileHeight/2);
+            }
+            auto& rows = current.rows;
+            m_memory -= rows.at(row).size();
+            rows.erase(row);
+            flush(level + 1, row + 1 == current.tilesY ? next.tilesY : (row + 1) / 2);
+        } else {
+            m_memory -= current.rows.at(row).size();
+            current.rows.erase(row);
+        }
+    }
+
+    void StreamingStitcher::downsample(const uint8_t* source, int sourceStride, uint8_t* destination, int destinationStride, int width, int rows) const
+    {
+        const int channels = m_channels;
+        const bool labels = m_downsampling == Downsampling::Mode;
+        auto run = [=](int start, int end) {
+            for(int y = 0; y < rows; ++y) {
+                const uint8_t* top = &source[2*y*sourceStride];
+                const uint8_t* bottom = top + sourceStride;
+                uint8_t* output = &destination[y*destinationStride];
+                for(int x = start; x < end; ++x) {
+                    for(int c = 0; c < channels; ++c) {
+                        const int left = 2*x*channels + c;
+                        const int right = left + channels;
+                        output[x*channels + c] = labels ?
+                                mode(top[left], top[right], bottom[left], bottom[right]) :
+                                (uint8_t)((top[left] + top[right] + bottom[left] + bottom[right] + 2) / 4);
+                    }
+                }
+            }
+        };
+        // Wide tile rows are split between threads, narrow ones aren't worth handing over to other threads
+        auto& pool = DownsamplingPool::get();
+        const int threads = std::max(1, std::min(pool.getThreads(), width / 512));
+        pool.run(threads, [&run, threads, width](int i) {
+            run(i*width / threads, (i + 1)*width / threads);
+        });
+    }
+
+    void StreamingStitcher::finish()
+    {
+        if(m_levels.empty())
+            throw Exception("Streaming stitcher got no patches for " + m_filename);
+        flush(0, m_levels[0].tilesY);
+
+        // Append the lower levels to the first file by copying their compressed tiles
+        TIFF* output = m_levels[0].tiff;
+        if(!TIFFWriteDirectory(output))
+            throw Exception("Unable to write " + m_filename);
+        std::vector<uint8_t> buffer;
+        for(int i = 1; i < m_levels.size(); ++i) {
+            auto& level = m_levels[i];
+            TIFFClose(level.tiff);
+            level.tiff = TIFFOpen(level.filename.c_str(), "r");
+            if(level.tiff == nullptr)
+                throw Exception("Unable to read " + level.filename);
+            setFields(output, level, i);
+            const uint32_t tiles = TIFFNumberOfTiles(level.tiff);
+            for(uint32_t tile = 0; tile < tiles; ++tile) {
+                buffer.resize(TIFFGetStrileByteCount(level.tiff, tile));
+                if(TIFFReadRawTile(level.tiff, tile, buffer.data(), buffer.size()) < 0 ||
+                        TIFFWriteRawTile(output, tile, buffer.data(), buffer.size()) < 0)
+                    throw Exception("Unable to copy level " + std::to_string(i) + " to " + m_filename);
+            }
+            if(!TIFFWriteDirectory(output))
+                throw Exception("Unable to write " + m_filename);
+            TIFFClose(level.tiff);
+            level.tiff = nullptr;
+            std::remove(level.filename.c_str());
+        }
+        TIFFClose(output);
+        m_levels[0].tiff = nullptr;
+        m_finished = true;
+    }
+
+    void StreamingStitcher::addRows(std::function<void(int, int, uint8_t*, int)> read)
+    {
+        const auto& level = m_levels[0];
+        for(int row = 0; row < level.tilesY; ++row) {
+            const int y = row*m_tileHeight;
+            read(y, std::min(m_tileHeight, level.height - y), getRow(0, row), level.tilesX*m_tileWidth*m_channels);
+            flush(0, row + 1);
+        }
+    }
+
+    bool StreamingStitcher::isSegmentation(const PipelineRewriter& pipeline, const std::string& outputName)
+    {
+        const auto outputs = pipeline.getPipelineOutputs();
+        if(outputs.count(outputName) == 0)
+            return false;
+        const auto processObjects = pipeline.getProcessObjects();
+        std::string id = split(outputs.at(outputName), " ")[0];
+        // Stitchers and batch generators pass on the data of the process object before them
+        for(int depth = 0; depth < 16 && std::find(processObjects.begin(), processObjects.end(), id) != processObjects.end(); ++depth) {
+            const std::string type = pipeline.getType(id);
+            if(type.find("Segmentation") != std::string::npos)
+                return true;
+            if(type != "PatchStitcher" && type != "ImageToBatchGenerator")
+                return false;
+            id = split(pipeline.getInput(id, 0), " ")[0];
+        }
+        return false;
+    }
+
+    void StreamingStitcher::write(const std::string& filename, std::shared_ptr<Image> image, Downsampling downsampling)
+    {
+        if(image->getDataType() != TYPE_UINT8)
+            throw Exception("Only 8 bit images can be stored as tiled TIFF");
+        StreamingStitcher stitcher(filename, downsampling);
+        const auto spacing = image->getSpacing();
+        stitcher.open(image->getWidth(), image->getHeight(), image->getNrOfChannels(), spacing.x(), spacing.y());
+        auto access = image->getImageAccess(ACCESS_READ);
+        const auto data = (const uint8_t*)access->get();
+        const int rowSize = image->getWidth()*image->getNrOfChannels();
+        stitcher.addRows([data, rowSize](int y, int rows, uint8_t* destination, int stride) {
+            for(int i = 0; i < rows; ++i)
+                std::memcpy(&destination[i*stride], &data[(int64_t)(y + i)*rowSize], rowSize);
+        });
+        stitcher.finish();
+    }
+
+    void StreamingStitcher::write(const std::string& filename, std::shared_ptr<ImagePyramid> pyramid, Downsampling downsampling)
+    {
+        StreamingStitcher stitcher(filename, downsampling);
+        const auto spacing = pyramid->getSpacing();
+        const int width = pyramid->getFullWidth();
+        const int channels = pyramid->getNrOfChannels();
+        stitcher.open(width, pyramid->getFullHeight(), channels, spacing.x(), spacing.y());
+        auto access = pyramid->getAccess(ACCESS_READ);
+        stitcher.addRows([&access, width, channels](int y, int rows, uint8_t* destination, int stride) {
+            // In blocks, to limit the size of each read
+            const int blockWidth = 4096;
+            for(int x = 0; x < width; x += blockWidth) {
+                const int columns = std::min(blockWidth, width - x);
+                auto block = access->getPatchAsImage(0, x, y, columns, rows, false);
+                if(block->getDataType() != TYPE_UINT8)
+                    throw Exception("Only 8 bit image pyramids can be stored as tiled TIFF");
+                auto blockAccess = block->getImageAccess(ACCESS_READ);
+                const auto data = (const uint8_t*)blockAccess->get();
+                for(int i = 0; i < rows; ++i)
+                    std::memcpy(&destination[i*stride + x*channels], &data[i*columns*channels], columns*channels);
+            }
+        });
+        stitcher.finish();
+    }
+
+    std::map<std::string, std::string> StreamingStitcher::getStreamableOutputs(const PipelineRewriter& pipeline)
+    {
+        std::map<std::string, std::string> outputs;
+        const auto processObjects = pipeline.getProcessObjects();
+        auto isProcessObject = [&processObjects](const std::string& id) {
+            return std::find(processObjects.begin(), processObjects.end(), id) != processObjects.end();
+        };
+        for(const auto& output : pipeline.getPipelineOutputs()) {
+            const std::string stitcher = split(output.second, " ")[0];
+            if(!isProcessObject(stitcher) || pipeline.getType(stitcher) != "PatchStitcher")
+                continue;
+            const std::string network = split(pipeline.getInput(stitcher, 0), " ")[0];
+            if(!isProcessObject(network) || pipeline.getType(network) != "SegmentationNetwork")
+                continue;
+            // Batches would have to be split again, which only the PatchStitcher knows how to do
+            const std::string generator = split(pipeline.getInput(network, 0), " ")[0];
+            if(!isProcessObject(generator) || pipeline.getType(generator) != "PatchGenerator")
+                continue;
+            outputs[output.first] = stitcher;
+        }
+        return outputs;
+    }
+
+    void StreamingStitcher::stream(std::shared_ptr<Pipeline> pipeline, const PipelineRewriter& rewriter, const std::map<std::string, std::string>& filenames)
+    {
+        const auto outputs = getStreamableOutputs(rewriter);
+        auto processObjects = pipeline->getProcessObjects();
+        std::vector<std::shared_ptr<ProcessObject>> networks;
+        std::vector<std::unique_ptr<StreamingStitcher>> stitchers;
+        for(const auto& file : filenames) {
+            if(outputs.count(file.first) == 0)
+                throw Exception("Output " + file.first + " of pipeline " + pipeline->getName() + " can't be stitched to disk");
+            const std::string network = split(rewriter.getInput(outputs.at(file.first), 0), " ")[0];
+            networks.push_back(processObjects.at(network));
+            stitchers.push_back(std::make_unique<StreamingStitcher>(file.second));
+        }
+
+        // Pulling the patches of the networks runs the pipeline without its stitchers
+        DataStream stream(networks);
+        while(!stream.isDone()) {
+            for(int i = 0; i < networks.size(); ++i) {
+                std::shared_ptr<Image> patch;
+                {
+                    TraceSpan span("inference", "wait for network");
+                    patch = stream.getNextFrame<Image>(networks[i]);
+                }
+                TraceSpan span("stitching", "add patch");
+                stitchers[i]->add(patch);
+            }
+        }
+        int i = 0;
+        for(const auto& file : filenames) {
+            {
+                TraceSpan span("export", "finish stitching");
+                stitchers[i]->finish();
+            }
+            Logger::info("StreamingStitcher") << "Stitched " << file.first << " to " << file.second << " with at most "
+                      << stitchers[i]->getPeakMemory() / (1024*1024) << " MB in memory";
+            ++i;
+        }
+    }
+} // End of namespace fast
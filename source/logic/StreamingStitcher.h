@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+typedef struct tiff TIFF;
+
+namespace fast{
+    class Image;
+    class ImagePyramid;
+    class Pipeline;
+    class PipelineRewriter;
+
+    /**
+     * @brief Stitches segmentation patches directly into a tiled, pyramidal TIFF while the pipeline runs, instead of
+     * stitching the whole segmentation in memory with a PatchStitcher and exporting it afterwards.
+     *
+     * Patches must arrive in the order they are generated, row by row. A tile row is written as soon as the patches
+     * have moved past it, together with the rows of the lower resolution levels it completes. Only the tile rows
+     * overlapped by the current row of patches are kept in memory, so memory use depends on the patch size and
+     * the slide width, not on the slide area. The file can be read with the TIFFImagePyramidImporter.
+     *
+     * Each lower resolution level halves the previous one. Labels are downsampled to the most frequent label of each
+     * 2x2 block, so that classes don't blend or shift when zoomed out, and other images to the mean of the block.
+     * The columns of wide tile rows are downsampled in parallel, by a fixed set of threads shared by all stitchers.
+     */
+    class StreamingStitcher {
+        public:
+            enum class Downsampling {
+                Mode, /* Most frequent value of each block, ties go to the foreground. For segmentations */
+                Mean, /* For intensities and heatmaps */
+            };
+            /**
+             * @param filename TIFF file to write. Lower resolution levels are written to temporary files next to it,
+             *      and appended when the stitcher is finished.
+             */
+            StreamingStitcher(std::string filename, Downsampling downsampling = Downsampling::Mode, int tileWidth = 256, int tileHeight = 256);
+            /**
+             * Removes the incomplete file if the stitcher wasn't finished.
+             */
+            ~StreamingStitcher();
+            /**
+             * @brief add Paste a patch, using the frame data set by the PatchGenerator. The overlap of neighbouring
+             * patches is cropped as by the PatchStitcher.
+             */
+            void add(std::shared_ptr<Image> patch);
+            /**
+             * @brief finish Write the remaining tiles and lower resolution levels, and close the file.
+             */
+            void finish();
+            /**
+             * @brief getPeakMemory Largest number of bytes of tile rows held in memory at the same time.
+             */
+            int64_t getPeakMemory() const { return m_peakMemory; }
+
+            /**
+             * @brief getStreamableOutputs Outputs of a pipeline which can be stitched to disk while it runs: PatchStitchers
+             * of segmentation networks which get their patches straight from a PatchGenerator.
+             * @return Id of the PatchStitcher of each output, indexed by output name.
+             */
+            static std::map<std::string, std::string> getStreamableOutputs(const PipelineRewriter& pipeline);
+            /**
+             * @brief stream Run a parsed pipeline, and stitch outputs to disk instead of getting them with
+             * getAllPipelineOutputData. The PatchStitchers of the outputs are not run.
+             * @param filenames TIFF file of each output to stream, indexed by output name, see getStreamableOutputs.
+             */
+            static void stream(std::shared_ptr<Pipeline> pipeline, const PipelineRewriter& rewriter, const std::map<std::string, std::string>& filenames);
+            /**
+             * @brief write Store an 8 bit image as a tiled TIFF with overview levels.
+             */
+            static void write(const std::string& filename, std::shared_ptr<Image> image, Downsampling downsampling);
+            /**
+             * @brief write Store the full resolution of an 8 bit pyramid as a tiled TIFF, replacing its overview levels.
+             * The pyramid is read one tile row at a time.
+             */
+            static void write(const std::string& filename, std::shared_ptr<ImagePyramid> pyramid, Downsampling downsampling);
+            /**
+             * @brief isSegmentation Whether an output of a pipeline is a segmentation, i.e. made by a process object
+             * whose type names a segmentation, such as SegmentationNetwork or TissueSegmentation, possibly through a
+             * PatchStitcher. Only segmentations are labels, which are downsampled with Downsampling::Mode.
+             */
+            static bool isSegmentation(const PipelineRewriter& pipeline, const std::string& outputName);
+        private:
+            struct Level {
+                TIFF* tiff = nullptr;
+                std::string filename;
+                int width = 0;
+                int height = 0;
+                int tilesX = 0;
+                int tilesY = 0;
+                int nextRow = 0; /* Next tile row to write */
+                std::map<int, std::vector<uint8_t>> rows; /* Tile rows not written yet, padded to whole tiles */
+            };
+            void open(int width, int height, int channels, float spacingX, float spacingY);
+            void setFields(TIFF* tiff, const Level& level, int index) const;
+            uint8_t* getRow(int level, int row);
+            /**
+             * Write all tile rows of a level above a row.
+             */
+            void flush(int level, int untilRow);
+            void writeRow(int level, int row);
+            /**
+             * Halve tile rows of a level into the next level.
+             */
+            void downsample(const uint8_t* source, int sourceStride, uint8_t* destination, int destinationStride, int width, int rows) const;
+            /**
+             * Fill all tile rows of the full resolution, one after the other.
+             * @param read Copies rows of the image, starting at y, to the destination.
+             */
+            void addRows(std::function<void(int y, int rows, uint8_t* destination, int stride)> read);
+            void close();
+
+            std::string m_filename;
+            Downsampling m_downsampling;
+            int m_tileWidth;
+            int m_tileHeight;
+            int m_channels = 0;
+            float m_spacingX = 1;
+            float m_spacingY = 1;
+            std::vector<Level> m_levels;
+            std::vector<uint8_t> m_tile;
+            int64_t m_memory = 0;
+            int64_t m_peakMemory = 0;
+            bool m_finished = false;
+    };
+} // End of namespace fast
@@ -0,0 +1,293 @@
+#include "Tracer.h"
+#include "Logger.h"
+#include <FAST/Pipeline.hpp>
+#include <FAST/ProcessObject.hpp>
+#include <FAST/RuntimeMeasurement.hpp>
+#include <FAST/Utility.hpp>
+#include <QDir>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <fstream>
+
+namespace fast{
+    namespace {
+        // Events kept per thread, about 2 MB
+        const size_t bufferCapacity = 1 << 16;
+        // Interval between samples of the runtime measurements of process objects
+        const auto samplingInterval = std::chrono::milliseconds(5);
+
+        struct Event {
+            const char* category;
+            const char* name;
+            int64_t start;
+            int64_t end; /* Value of counter events */
+            bool counter;
+        };
+
+        struct Buffer {
+            int id;
+            std::string name;
+            int session = -1; /* Events of other sessions are discarded */
+            std::vector<Event> events;
+            size_t next = 0; /* Oldest event once the buffer is full */
+            std::atomic_bool finished{false}; /* The thread has exited */
+            std::mutex mutex; /* Only contended while the trace is written */
+        };
+
+        struct Watched {
+            std::string id;
+            std::weak_ptr<ProcessObject> processObject; /* Not kept alive by the trace, pruned when it is deleted */
+            std::shared_ptr<Buffer> buffer;
+            unsigned int samples;
+            double sum;
+        };
+
+        const auto epoch = std::chrono::steady_clock::now();
+        std::atomic_bool enabled(false);
+        std::atomic_int session(0); /* Incremented when tracing starts, so that buffers drop older events */
+        std::mutex sessionMutex; /* Serializes starting and stopping traces, and the sampler thread */
+        int sessions = 0; /* Traces which are running */
+        std::mutex registryMutex;
+        std::vector<std::shared_ptr<Buffer>> buffers;
+        int nextBufferId = 1;
+        std::mutex internMutex;
+        std::set<std::string> interned;
+        std::mutex samplerMutex;
+        std::condition_variable samplerCondition;
+        std::vector<Watched> watched;
+        std::thread sampler;
+        bool stopSampler = false;
+
+        std::shared_ptr<Buffer> createBuffer(const std::string& name) {
+            auto buffer = std::make_shared<Buffer>();
+            std::lock_guard<std::mutex> lock(registryMutex);
+            buffer->id = nextBufferId++;
+            buffer->name = name.empty() ? "Thread " + std::to_string(buffer->id) : name;
+            buffers.push_back(buffer);
+            return buffer;
+        }
+
+        // Marks the buffer of a thread as finished when the thread exits, so that it is dropped by the next session
+        struct ThreadBuffer {
+            std::shared_ptr<Buffer> buffer;
+            ~ThreadBuffer() {
+                if(buffer)
+                    buffer->finished = true;
+            }
+        };
+
+        Buffer& getThreadBuffer() {
+            thread_local ThreadBuffer thread;
+            if(!thread.buffer)
+                thread.buffer = createBuffer("");
+            return *thread.buffer;
+        }
+
+        void append(Buffer& buffer, const Event& event) {
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            if(buffer.session != session) {
+                buffer.events.clear();
+                buffer.next = 0;
+                buffer.session = session;
+            }
+            if(buffer.events.size() < bufferCapacity) {
+                buffer.events.push_back(event);
+            } else {
+                buffer.events[buffer.next] = event;
+                buffer.next = (buffer.next + 1) % bufferCapacity;
+            }
+        }
+
+        void sample() {
+            std::unique_lock<std::mutex> lock(samplerMutex);
+            while(!samplerCondition.wait_for(lock, samplingInterval, []() { return stopSampler; })) {
+                const int64_t now = Tracer::now();
+                // Pipelines of finished slides are deleted while the trace runs
+                watched.erase(std::remove_if(watched.begin(), watched.end(), [](const Watched& item) {
+                    return item.processObject.expired();
+                }), watched.end());
+                for(auto& item : watched) {
+                    auto processObject = item.processObject.lock();
+                    if(!processObject)
+                        continue;
+                    auto runtime = processObject->getRuntime();
+                    const unsigned int samples = runtime->getSamples();
+                    if(samples == item.samples)
+                        continue;
+                    // Sums are in milliseconds. All executions since the last sample are merged into one span.
+                    const double sum = runtime->getSum();
+                    const int64_t duration = std::min<int64_t>((sum - item.sum) * 1000, now);
+                    append(*item.buffer, {"process object", Tracer::intern(item.id), now - duration, now, false});
+                    item.samples = samples;
+                    item.sum = sum;
+                }
+            }
+        }
+
+        std::string escape(const std::string& text) {
+            std::string escaped;
+            for(char c : text) {
+                if(c == '"' || c == '\\') {
+                    escaped += '\\';
+                    escaped += c;
+                } else if(static_cast<unsigned char>(c) < 0x20) {
+                    escaped += ' ';
+                } else {
+                    escaped += c;
+                }
+            }
+            return escaped;
+        }
+    }
+
+    int64_t Tracer::now()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    bool Tracer::isEnabled()
+    {
+        return enabled;
+    }
+
+    void Tracer::record(const char* category, const char* name, int64_t start, int64_t end)
+    {
+        if(!enabled)
+            return;
+        append(getThreadBuffer(), {category, name, start, end, false});
+    }
+
+    void Tracer::recordCounter(const char* name, int64_t value)
+    {
+        if(!enabled)
+            return;
+        append(getThreadBuffer(), {"counter", name, now(), value, true});
+    }
+
+    void Tracer::setThreadName(const std::string& name)
+    {
+        auto& buffer = getThreadBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.name = name;
+    }
+
+    const char* Tracer::intern(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(internMutex);
+        return interned.insert(name).first->c_str();
+    }
+
+    std::string Tracer::getTraceFilename(const std::string& name)
+    {
+        // Traces of jobs which finish in the same second would have the same name
+        static std::atomic_int traces(0);
+        const int number = ++traces;
+        return join(QDir::homePath().toStdString(), "fastpathology", "traces", name + "-" + currentDateTime() + (number > 1 ? "-" + std::to_string(number) : "") + ".json");
+    }
+
+    int64_t Tracer::start()
+    {
+        std::lock_guard<std::mutex> sessionLock(sessionMutex);
+        const int64_t begin = now();
+        // Traces which overlap share the buffers and the sampler
+        if(sessions++ > 0)
+            return begin;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](const std::shared_ptr<Buffer>& buffer) {
+                return buffer->finished.load();
+            }), buffers.end());
+        }
+        ++session;
+        stopSampler = false;
+        sampler = std::thread(sample);
+        enabled = true;
+        return begin;
+    }
+
+    void Tracer::watch(std::shared_ptr<Pipeline> pipeline)
+    {
+        if(!enabled)
+            return;
+        std::vector<Watched> items;
+        for(const auto& processObject : pipeline->getProcessObjects()) {
+            processObject.second->enableRuntimeMeasurements();
+            auto runtime = processObject.second->getRuntime();
+            auto buffer = createBuffer(processObject.first + " (" + processObject.second->getNameOfClass() + ")");
+            // Sampled process objects are never exited threads, the flag only drops the track from later sessions
+            buffer->finished = true;
+            items.push_back({processObject.first, processObject.second, buffer, runtime->getSamples(), runtime->getSum()});
+        }
+        std::lock_guard<std::mutex> lock(samplerMutex);
+        watched.insert(watched.end(), items.begin(), items.end());
+    }
+
+    void Tracer::stop(int64_t start, const std::string& filename)
+    {
+        int generation;
+        {
+            std::lock_guard<std::mutex> sessionLock(sessionMutex);
+            if(sessions == 0)
+                return;
+            generation = session;
+            if(--sessions == 0) {
+                enabled = false;
+                {
+                    std::lock_guard<std::mutex> lock(samplerMutex);
+                    stopSampler = true;
+                }
+                samplerCondition.notify_all();
+                sampler.join();
+                watched.clear();
+            }
+        }
+        if(filename.empty())
+            return;
+
+        std::vector<std::shared_ptr<Buffer>> tracks;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            tracks = buffers;
+        }
+        createDirectories(getDirName(filename));
+        std::ofstream file(filename);
+        if(!file.is_open())
+            throw Exception("Unable to write trace to " + filename);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        int events = 0;
+        for(const auto& track : tracks) {
+            std::lock_guard<std::mutex> lock(track->mutex);
+            if(track->session != generation)
+                continue;
+            file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << track->id
+                 << ", \"args\": {\"name\": \"" << escape(track->name) << "\"}}";
+            first = false;
+            for(size_t i = 0; i < track->events.size(); ++i) {
+                // Oldest first
+                const auto& event = track->events[(track->next + i) % track->events.size()];
+                // Events from before the trace started belong to other traces which overlapped with it
+                if((event.counter ? event.start : event.end) < start)
+                    continue;
+                if(event.counter) {
+                    file << ",\n{\"name\": \"" << escape(event.name) << "\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << event.start
+                         << ", \"args\": {\"value\": " << event.end << "}}";
+                    ++events;
+                    continue;
+                }
+                file << ",\n{\"name\": \"" << escape(event.name) << "\", \"cat\": \"" << escape(event.category)
+                     << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << track->id << ", \"ts\": " << event.start
+                     << ", \"dur\": " << event.end - event.start << "}";
+                ++events;
+            }
+        }
+        file << "\n]}\n";
+        Logger::info("Tracer") << "Wrote " << events << " trace events to " << filename;
+    }
+} // End of namespace fast
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <memory>
+
+namespace fast{
+    class Pipeline;
+
+    /**
+     * @brief Records a timeline of a pipeline run, which is written as a Chrome trace that can be opened in
+     * chrome://tracing or ui.perfetto.dev to find stalls and idle threads.
+     *
+     * Spans are recorded with TraceSpan in ring buffers owned by each thread, so that threads don't contend when
+     * recording, and only the most recent events of a thread are kept. When tracing is off, a span costs a single
+     * atomic load. Several runs can be traced at the same time, such as the jobs of the job server. Their traces
+     * share the recording, so the trace of a run also has the events of the runs that overlapped with it.
+     *
+     * Process objects of FAST pipelines execute inside FAST, where spans can't be recorded. Instead, the runtime
+     * measurements of the process objects of watched pipelines are sampled every few milliseconds, and each new
+     * execution becomes a span on a track of its own, ending when it was sampled. These spans are therefore
+     * accurate to the sampling interval.
+     */
+    class Tracer {
+        public:
+            /**
+             * @brief start Start a trace. Recording starts with the first trace, discarding previous events.
+             * @return Start of the trace, for stop.
+             */
+            static int64_t start();
+            /**
+             * @brief stop Stop a trace, and write the events recorded since it started as Chrome trace JSON.
+             * Recording stops with the last trace.
+             * @param start Start of the trace, as returned by start.
+             * @param filename Nothing is written if empty.
+             */
+            static void stop(int64_t start, const std::string& filename);
+            static bool isEnabled();
+            /**
+             * @brief watch Record the executions of the process objects of a pipeline until tracing stops, or until
+             * the process objects are deleted. The trace doesn't keep them alive.
+             */
+            static void watch(std::shared_ptr<Pipeline> pipeline);
+            /**
+             * @brief setThreadName Name of the calling thread in the timeline.
+             */
+            static void setThreadName(const std::string& name);
+            /**
+             * @brief intern Get a name which lives as long as the program, for spans with names that aren't literals.
+             */
+            static const char* intern(const std::string& name);
+            /**
+             * @brief getTraceFilename File for the trace of a run in the traces folder, named by the run and the time,
+             * and numbered if several traces of this process are written.
+             */
+            static std::string getTraceFilename(const std::string& name);
+            /**
+             * @brief now Microseconds on the clock of the events.
+             */
+            static int64_t now();
+            /**
+             * @brief record Add a span to the buffer of the calling thread.
+             */
+            static void record(const char* category, const char* name, int64_t start, int64_t end);
+            /**
+             * @brief recordCounter Add a value of a counter, such as the memory of the process, which is shown as a
+             * graph over time.
+             * @param name Name of the counter. Must be a literal, or from Tracer::intern.
+             */
+            static void recordCounter(const char* name, int64_t value);
+    };
+
+    /**
+     * @brief Records a span from its creation until it goes out of scope, if tracing is on.
+     * @param category Category of the span, such as "io" or "inference". Must be a literal, or from Tracer::intern.
+     * @param name Name of the span. Must be a literal, or from Tracer::intern.
+     */
+    class TraceSpan {
+        public:
+            TraceSpan(const char* category, const char* name) : m_category(category), m_name(name), m_start(Tracer::isEnabled() ? Tracer::now() : -1) {};
+            ~TraceSpan() {
+                if(m_start >= 0)
+                    Tracer::record(m_category, m_name, m_start, Tracer::now());
+            };
+            TraceSpan(const TraceSpan&) = delete;
+            TraceSpan& operator=(const TraceSpan&) = delete;
+        private:
+            const char* m_category;
+            const char* m_name;
+            int64_t m_start;
+    };
+} // End of namespace fast
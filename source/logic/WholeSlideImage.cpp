@@ -1,8 +1,12 @@
 #include "WholeSlideImage.h"
+#include "MemoryMonitor.h"
 #include <FAST/Importers/WholeSlideImageImporter.hpp>
 #include <FAST/Visualization/ImagePyramidRenderer/ImagePyramidRenderer.hpp>
 #include <FAST/Data/ImagePyramid.hpp>
 #include <FAST/Data/Image.hpp>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
 
 namespace fast{
     WholeSlideImage::WholeSlideImage(const std::string filename): _filename(filename)
@@ -12,11 +16,10 @@ namespace fast{
 
     WholeSlideImage::WholeSlideImage(const std::string filename, const QImage thumbnail):_filename(filename), _thumbnail(thumbnail)
     {
-        auto importer = WholeSlideImageImporter::New();
-        importer->setFilename(this->_filename);
-        auto currImage = importer->updateAndGetOutputData<ImagePyramid>();
-        this->_image = currImage;
-        this->_metadata = this->_image->getMetadata(); // Can be dropped?
+    }
+
+    WholeSlideImage::WholeSlideImage(const std::string filename, const std::string thumbnailFilename):_filename(filename), _thumbnail_filename(thumbnailFilename)
+    {
     }
 
     WholeSlideImage::~WholeSlideImage()
@@ -25,12 +28,83 @@ namespace fast{
 
     void WholeSlideImage::init()
     {
+        std::lock_guard<std::mutex> lock(_mutex);
+        this->open();
+        this->create_thumbnail();
+    }
+
+    void WholeSlideImage::open()
+    {
+        if(this->_image)
+            return;
         auto importer = WholeSlideImageImporter::New();
         importer->setFilename(this->_filename);
         auto currImage = importer->updateAndGetOutputData<ImagePyramid>();
         this->_image = currImage;
         this->_metadata = this->_image->getMetadata(); // Can be dropped?
-        this->create_thumbnail();
+    }
+
+    std::shared_ptr<ImagePyramid> WholeSlideImage::get_image_pyramid()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        this->open();
+        _last_used = std::chrono::steady_clock::now();
+        return _image;
+    }
+
+    bool WholeSlideImage::is_open()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return (bool)_image;
+    }
+
+    bool WholeSlideImage::close_if_idle()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(!_image || _image.use_count() > 1)
+            return false;
+        _image.reset();
+        return true;
+    }
+
+    int64_t WholeSlideImage::get_memory_usage()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return MemoryMonitor::getMemoryUsage(_image) + _thumbnail.sizeInBytes();
+    }
+
+    std::chrono::steady_clock::time_point WholeSlideImage::get_last_used()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _last_used;
+    }
+
+    QImage WholeSlideImage::get_thumbnail()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(!this->_thumbnail.isNull())
+            return _thumbnail;
+        QImage thumbnail;
+        const QString cacheFilename = QString::fromStdString(_thumbnail_filename);
+        if(!_thumbnail_filename.empty() && QFile(cacheFilename).exists())
+            thumbnail = QImage(cacheFilename);
+        if(thumbnail.isNull()) {
+            const bool wasOpen = (bool)this->_image;
+            this->open();
+            this->create_thumbnail();
+            thumbnail = this->_thumbnail;
+            if(!_thumbnail_filename.empty()) {
+                QDir().mkpath(QFileInfo(cacheFilename).absolutePath());
+                thumbnail.save(cacheFilename);
+                // Cached on disk, so there is no need to keep it in memory for every slide in the project
+                this->_thumbnail = QImage();
+            }
+            // A pyramid opened only to create the thumbnail is closed again, otherwise every slide shown in the
+            // project list would stay open
+            if(!wasOpen && _image.use_count() == 1)
+                _image.reset();
+        }
+        return thumbnail;
     }
 
     void WholeSlideImage::create_thumbnail()
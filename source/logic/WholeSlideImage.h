@@ -4,8 +4,11 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <map>
+#include <chrono>
+#include <cstdint>
 #include <QImage>
 
 namespace fast{
@@ -15,15 +18,47 @@ namespace fast{
         public:
             WholeSlideImage(const std::string filename);
             WholeSlideImage(const std::string filename, const QImage thumbnail);
+            /**
+             * Creates a WSI without touching the slide file. The image pyramid is opened the first time it is
+             * requested, and the thumbnail is read from the cache file, or created and cached if it doesn't exist.
+             * @param filename Disk location of the whole slide image.
+             * @param thumbnailFilename Disk location of the cached thumbnail.
+             */
+            WholeSlideImage(const std::string filename, const std::string thumbnailFilename);
             ~WholeSlideImage();
 
             std::string get_filename(){return _filename;}
-            QImage get_thumbnail() {return _thumbnail;}
-            std::shared_ptr<ImagePyramid> get_image_pyramid(){return _image;}
+            /**
+             * Get the thumbnail, which may require opening the slide. Safe to call from any thread.
+             */
+            QImage get_thumbnail();
+            /**
+             * Get the image pyramid, which is opened on first use. Safe to call from any thread.
+             */
+            std::shared_ptr<ImagePyramid> get_image_pyramid();
+            bool is_open();
+            /**
+             * Close the image pyramid if nothing but this WSI uses it, e.g. no pipeline or renderer. It is opened
+             * again when it is requested.
+             * @return Whether the pyramid was closed.
+             */
+            bool close_if_idle();
+            /**
+             * Estimated memory of the open image pyramid and the thumbnail, see MemoryMonitor::getMemoryUsage.
+             */
+            int64_t get_memory_usage();
+            /**
+             * Time the image pyramid was last requested.
+             */
+            std::chrono::steady_clock::time_point get_last_used();
 
             void init();
 
         private:
+            /**
+             * Opens the image pyramid if it hasn't been opened already. Must be called with _mutex locked.
+             */
+            void open();
             /**
              * Gets the thumbnail image and stores it as a QImage.
              * @return
@@ -32,8 +67,11 @@ namespace fast{
 
         private:
             const std::string _filename; /* Disk location for the whole slide image*/
+            std::string _thumbnail_filename; /* Disk location of the cached thumbnail, empty if not cached */
             std::map<std::string, std::string> _metadata; /* */
             std::shared_ptr<ImagePyramid> _image; /* Loaded WSI */
             QImage _thumbnail; /* Thumbnail for the WSI */
+            std::chrono::steady_clock::time_point _last_used; /* Time the pyramid was last requested */
+            std::mutex _mutex; /* Guards lazy loading of the pyramid and thumbnail */
     };
-}
\ No newline at end of file
+}
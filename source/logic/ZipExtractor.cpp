@@ -0,0 +1,294 @@
+#include "ZipExtractor.h"
+#include <FAST/Utility.hpp>
+#include <QCryptographicHash>
+#include <QFile>
+#include <zlib.h>
+#include <sstream>
+#include <algorithm>
+
+namespace fast{
+    namespace {
+        const uint32_t localHeaderSignature = 0x04034b50;
+        const uint32_t centralHeaderSignature = 0x02014b50;
+        const uint32_t endSignature = 0x06054b50;
+        const uint32_t descriptorSignature = 0x08074b50;
+        const size_t localHeaderSize = 30;
+        const size_t chunkSize = 64*1024;
+
+        uint16_t read16(const std::string& buffer, size_t offset) {
+            return (uint8_t)buffer[offset] | ((uint8_t)buffer[offset + 1] << 8);
+        }
+
+        uint32_t read32(const std::string& buffer, size_t offset) {
+            return read16(buffer, offset) | ((uint32_t)read16(buffer, offset + 2) << 16);
+        }
+
+        uint64_t read64(const std::string& buffer, size_t offset) {
+            return read32(buffer, offset) | ((uint64_t)read32(buffer, offset + 4) << 32);
+        }
+
+        // Paths which would be extracted outside of the destination folder are refused
+        bool isSafePath(const std::string& name) {
+            if(name.empty() || name[0] == '/' || name[0] == '\\' || name.find(':') != std::string::npos)
+                return false;
+            std::stringstream stream(name);
+            std::string part;
+            while(std::getline(stream, part, '/')) {
+                if(part == "..")
+                    return false;
+            }
+            return name.find('\\') == std::string::npos;
+        }
+    }
+
+    struct ZipExtractor::Inflater {
+        z_stream stream;
+        Inflater() {
+            stream = {};
+            // Raw deflate data, without zlib header
+            if(inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+                throw Exception("Unable to initialize zlib");
+        }
+        ~Inflater() {
+            inflateEnd(&stream);
+        }
+    };
+
+    ZipExtractor::ZipExtractor(std::string destination, std::map<std::string, std::string> manifest)
+    {
+        m_destination = destination;
+        m_manifest = manifest;
+        createDirectories(m_destination);
+    }
+
+    ZipExtractor::~ZipExtractor()
+    {
+        if(m_output.is_open()) {
+            m_output.close();
+            QFile::remove(QString::fromStdString(m_partFilename));
+        }
+    }
+
+    std::map<std::string, std::string> ZipExtractor::getFiles() const
+    {
+        return m_files;
+    }
+
+    int ZipExtractor::getSkippedFiles() const
+    {
+        return m_skipped;
+    }
+
+    std::string ZipExtractor::getSHA256(const std::string& filename)
+    {
+        QFile file(QString::fromStdString(filename));
+        if(!file.open(QIODevice::ReadOnly))
+            return "";
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        if(!hash.addData(&file))
+            return "";
+        return hash.result().toHex().toStdString();
+    }
+
+    bool ZipExtractor::fill(size_t size, const char*& data, int64_t& available)
+    {
+        if(m_header.size() < size) {
+            const int64_t count = std::min<int64_t>(size - m_header.size(), available);
+            m_header.append(data, count);
+            data += count;
+            available -= count;
+        }
+        return m_header.size() >= size;
+    }
+
+    void ZipExtractor::write(const char* data, int64_t size)
+    {
+        while(m_state != State::Done && (size > 0 || (m_state == State::Data && m_remaining == 0))) {
+            if(m_state == State::Header) {
+                if(!fill(4, data, size))
+                    return;
+                const uint32_t signature = read32(m_header, 0);
+                if(signature == centralHeaderSignature || signature == endSignature) {
+                    // All files are extracted, the central directory only repeats their headers
+                    m_state = State::Done;
+                    return;
+                }
+                if(signature != localHeaderSignature)
+                    throw Exception("Corrupt zip archive, expected a file header");
+                if(!fill(localHeaderSize, data, size))
+                    return;
+                if(!fill(localHeaderSize + read16(m_header, 26) + read16(m_header, 28), data, size))
+                    return;
+                startEntry();
+            } else if(m_state == State::Data) {
+                if(readData(data, size)) {
+                    if(m_flags & 0x08) {
+                        m_state = State::Descriptor;
+                    } else {
+                        finishEntry();
+                    }
+                }
+            } else if(m_state == State::Descriptor) {
+                if(!fill(4, data, size))
+                    return;
+                // The signature of the data descriptor is optional
+                const size_t offset = read32(m_header, 0) == descriptorSignature ? 4 : 0;
+                if(!fill(offset + (m_zip64 ? 20 : 12), data, size))
+                    return;
+                m_crc = read32(m_header, offset);
+                finishEntry();
+            }
+        }
+    }
+
+    void ZipExtractor::startEntry()
+    {
+        const size_t nameLength = read16(m_header, 26);
+        const size_t extraLength = read16(m_header, 28);
+        m_flags = read16(m_header, 6);
+        m_method = read16(m_header, 8);
+        m_crc = read32(m_header, 14);
+        int64_t compressedSize = read32(m_header, 18);
+        m_name = m_header.substr(localHeaderSize, nameLength);
+        m_zip64 = false;
+        // Zip64 sizes are in an extra field, for the sizes which don't fit in the header
+        for(size_t offset = localHeaderSize + nameLength; offset + 4 <= localHeaderSize + nameLength + extraLength;) {
+            const uint16_t id = read16(m_header, offset);
+            const uint16_t length = read16(m_header, offset + 2);
+            if(id == 0x0001) {
+                m_zip64 = true;
+                size_t field = offset + 4;
+                if(read32(m_header, 22) == 0xFFFFFFFF)
+                    field += 8;
+                if(compressedSize == 0xFFFFFFFF && field + 8 <= offset + 4 + length)
+                    compressedSize = read64(m_header, field);
+            }
+            offset += 4 + length;
+        }
+        m_header.clear();
+
+        if(m_flags & 0x01)
+            throw Exception("Encrypted zip archives are not supported: " + m_name);
+        if(m_method != 0 && m_method != 8)
+            throw Exception("Unsupported compression method " + std::to_string(m_method) + " of " + m_name);
+        if(!isSafePath(m_name))
+            throw Exception("Refusing to extract " + m_name + " outside of " + m_destination);
+        // With a data descriptor, the end of deflated data is found by inflating it
+        m_remaining = (m_flags & 0x08) ? -1 : compressedSize;
+        if(m_remaining < 0 && m_method == 0)
+            throw Exception("Stored zip entries with data descriptors can't be extracted while reading: " + m_name);
+        m_computedCrc = crc32(0L, Z_NULL, 0);
+        m_state = State::Data;
+
+        const std::string filename = join(m_destination, m_name);
+        if(m_name.back() == '/') {
+            createDirectories(filename);
+            m_skip = true;
+        } else {
+            auto expected = m_manifest.find(m_name);
+            m_skip = expected != m_manifest.end() && fileExists(filename) && getSHA256(filename) == expected->second;
+            if(!m_skip) {
+                createDirectories(getDirName(filename));
+                m_partFilename = filename + ".part";
+                m_output.open(m_partFilename, std::ios::binary | std::ios::trunc);
+                if(!m_output.is_open())
+                    throw Exception("Unable to write " + m_partFilename);
+                m_hash = std::make_unique<QCryptographicHash>(QCryptographicHash::Sha256);
+            }
+        }
+        if(m_method == 8 && (!m_skip || m_remaining < 0))
+            m_inflater = std::make_unique<Inflater>();
+    }
+
+    void ZipExtractor::writeOutput(const char* data, size_t size)
+    {
+        if(m_skip)
+            return;
+        m_computedCrc = crc32(m_computedCrc, (const Bytef*)data, size);
+        m_output.write(data, size);
+        m_hash->addData(data, size);
+    }
+
+    bool ZipExtractor::readData(const char*& data, int64_t& available)
+    {
+        if(!m_inflater) {
+            // Stored, or skipped with a known size
+            const int64_t count = std::min(m_remaining, available);
+            writeOutput(data, count);
+            data += count;
+            available -= count;
+            m_remaining -= count;
+            return m_remaining == 0;
+        }
+        auto& stream = m_inflater->stream;
+        const int64_t input = m_remaining < 0 ? available : std::min(m_remaining, available);
+        stream.next_in = (Bytef*)data;
+        stream.avail_in = input;
+        char output[chunkSize];
+        int result = Z_OK;
+        while(result != Z_STREAM_END && (stream.avail_in > 0 || stream.avail_out == 0)) {
+            stream.next_out = (Bytef*)output;
+            stream.avail_out = chunkSize;
+            result = inflate(&stream, Z_NO_FLUSH);
+            if(result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                throw Exception("Corrupt zip archive, unable to inflate " + m_name);
+            writeOutput(output, chunkSize - stream.avail_out);
+            if(result == Z_BUF_ERROR)
+                break;
+        }
+        const int64_t consumed = input - stream.avail_in;
+        data += consumed;
+        available -= consumed;
+        if(m_remaining >= 0)
+            m_remaining -= consumed;
+        if(result != Z_STREAM_END) {
+            if(m_remaining == 0)
+                throw Exception("Corrupt zip archive, deflated data of " + m_name + " is truncated");
+            return false;
+        }
+        m_inflater.reset();
+        return true;
+    }
+
+    void ZipExtractor::finishEntry()
+    {
+        m_header.clear();
+        m_state = State::Header;
+        const std::string filename = join(m_destination, m_name);
+        if(m_skip) {
+            if(m_name.back() != '/') {
+                m_files[m_name] = m_manifest[m_name];
+                ++m_skipped;
+            }
+            return;
+        }
+        m_output.close();
+        const std::string sha256 = m_hash->result().toHex().toStdString();
+        m_hash.reset();
+        std::string error;
+        if(m_computedCrc != m_crc) {
+            error = "CRC-32 of " + m_name + " doesn't match the archive";
+        } else if(m_manifest.count(m_name) > 0 && m_manifest[m_name] != sha256) {
+            error = "SHA-256 of " + m_name + " doesn't match the manifest";
+        }
+        if(!error.empty()) {
+            QFile::remove(QString::fromStdString(m_partFilename));
+            throw Exception(error);
+        }
+        QFile::remove(QString::fromStdString(filename));
+        if(!QFile::rename(QString::fromStdString(m_partFilename), QString::fromStdString(filename)))
+            throw Exception("Unable to move " + m_partFilename + " to " + filename);
+        m_files[m_name] = sha256;
+    }
+
+    bool ZipExtractor::isFinished() const
+    {
+        return m_state == State::Done;
+    }
+
+    void ZipExtractor::finish()
+    {
+        if(m_state != State::Done)
+            throw Exception("The zip archive ended before all files were extracted");
+    }
+} // End of namespace fast
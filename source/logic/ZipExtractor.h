@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+
+class QCryptographicHash;
+
+namespace fast{
+    /**
+     * @brief Extracts a zip archive while it is read, e.g. while it is downloaded, so that the archive doesn't have
+     * to be stored before it is extracted.
+     *
+     * Each file is written next to its destination, and moved into place when its CRC-32 and, if it is in the
+     * manifest, its SHA-256 are verified, so that an interrupted extraction never leaves partial files. Files which
+     * already exist with the SHA-256 of the manifest are skipped. Stored and deflated entries are supported, also
+     * with data descriptors and zip64 sizes.
+     */
+    class ZipExtractor {
+        public:
+            /**
+             * @param destination Folder to extract to.
+             * @param manifest SHA-256 of the files, as lower case hex, by path in the archive. Files which are not
+             *      in the manifest are only verified by their CRC-32.
+             */
+            ZipExtractor(std::string destination, std::map<std::string, std::string> manifest = {});
+            ~ZipExtractor();
+            /**
+             * @brief write Extract the next bytes of the archive. Throws an exception if the archive is corrupt, or
+             * a file doesn't match its checksums.
+             */
+            void write(const char* data, int64_t size);
+            /**
+             * @brief finish Throws an exception if the archive ended before all files were extracted.
+             */
+            void finish();
+            /**
+             * @brief isFinished Whether all files of the archive have been extracted.
+             */
+            bool isFinished() const;
+            /**
+             * @brief getFiles SHA-256 of each extracted or skipped file, by path in the archive.
+             */
+            std::map<std::string, std::string> getFiles() const;
+            /**
+             * @brief getSkippedFiles Number of files skipped because they already existed.
+             */
+            int getSkippedFiles() const;
+
+            /**
+             * @brief getSHA256 SHA-256 of a file as lower case hex, or an empty string if it can't be read.
+             */
+            static std::string getSHA256(const std::string& filename);
+        private:
+            enum class State {
+                Header,
+                Data,
+                Descriptor,
+                Done,
+            };
+
+            /**
+             * Buffer input until the header buffer has size bytes.
+             * @return Whether the buffer is complete.
+             */
+            bool fill(size_t size, const char*& data, int64_t& available);
+            void startEntry();
+            /**
+             * Consume file data of the current entry.
+             * @return Whether the end of the file data was reached.
+             */
+            bool readData(const char*& data, int64_t& available);
+            void writeOutput(const char* data, size_t size);
+            void finishEntry();
+
+            std::string m_destination;
+            std::map<std::string, std::string> m_manifest;
+            std::map<std::string, std::string> m_files;
+            int m_skipped = 0;
+            State m_state = State::Header;
+            std::string m_header; /* Buffered header bytes */
+
+            // Current entry
+            std::string m_name;
+            uint16_t m_flags = 0;
+            uint16_t m_method = 0;
+            uint32_t m_crc = 0;
+            uint32_t m_computedCrc = 0;
+            int64_t m_remaining = 0; /* Compressed bytes left, -1 if the size is only in the data descriptor */
+            bool m_zip64 = false;
+            bool m_skip = false;
+            std::string m_partFilename;
+            std::ofstream m_output;
+            std::unique_ptr<QCryptographicHash> m_hash;
+            struct Inflater;
+            std::unique_ptr<Inflater> m_inflater;
+    };
+} // End of namespace fast
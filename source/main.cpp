@@ -1,14 +1,182 @@
 #include <FAST/Tools/CommandLineParser.hpp>
 #include "source/gui/MainWindow.hpp"
+#include "source/logic/Project.h"
+#include "source/logic/HeadlessRunner.h"
+#include "source/logic/JobServer.h"
+#include "source/logic/DistributedRunner.h"
+#include "source/logic/Logger.h"
+#include "source/logic/ModelQuantizer.h"
+#include "source/logic/HeatmapFile.h"
+#include <QCoreApplication>
+#include <QFileInfo>
 
 using namespace fast;
 
 int main(int argc, char** argv) {
     CommandLineParser parser("FastPathology", "An open-source platform for deep learning-based research and decision support in digital pathology");
+    parser.addVariable("pipeline", false, "Run this pipeline file on all images of a project, without the GUI. Requires --project");
+    parser.addVariable("project", false, "Name of the project to process when running without the GUI");
+    parser.addVariable("execution-policy", false, "Execution policy file with thread counts, core pinning and NUMA binding. Default is ~/fastpathology/execution_policy.txt");
+    parser.addVariable("concurrent-slides", false, "Number of slides to process at the same time, overrides the execution policy");
+    parser.addOption("stream-results", "Stitch segmentations to disk while the pipeline runs, instead of in memory. Overrides the execution policy");
+    parser.addOption("trace", "Write a timeline of the run to ~/fastpathology/traces, which can be opened in chrome://tracing or ui.perfetto.dev. Overrides the execution policy");
+    parser.addOption("cascade", "Run a patch classification pipeline as a cascade: classify at a lower magnification first, and only refine uncertain and positive regions at full magnification");
+    parser.addVariable("cascade-magnification", false, "Magnification of the first cascade pass, default is half of the pipeline's");
+    parser.addVariable("cascade-model", false, "Cheaper model for the first cascade pass, default is the pipeline's model");
+    parser.addVariable("cascade-uncertainty", "0.3", "Refine regions where 1 - the highest class probability of the first pass is above this");
+    parser.addVariable("cascade-positivity", "0.5", "Refine regions where 1 - the probability of the first (normal) class is above this");
+    parser.addOption("cascade-validate", "Also run the full pipeline, and report the speed-up and agreement of the cascade");
+    parser.addOption("distributed", "Process the slides of the project together with other workers running the same pipeline on the project, e.g. on other nodes with the project on shared storage");
+    parser.addVariable("lease-timeout", "300", "Seconds without a heartbeat after which the slide of a distributed worker is given to another worker");
+    parser.addOption("job-server", "Run a job server, which runs pipelines submitted by all users of this computer on the cores of the execution policy");
+    parser.addOption("queue", "Submit the pipeline to the running job server instead of running it. Requires --pipeline and --project");
+    parser.addVariable("priority", "0", "Priority of a job submitted with --queue, higher runs first");
+    parser.addVariable("threads", "0", "Cores of a job submitted with --queue, default is the job server's");
+    parser.addVariable("model-precision", false, "Run the fp16 or int8 variants of the models, or fp32 for the original models. Overrides the execution policy and the pipeline");
+    parser.addVariable("quantize-model", false, "Create fp16 and int8 variants of an ONNX model, calibrated on patches of the slides of a project, and report their speed-up and agreement with the model. Requires --project");
+    parser.addVariable("model-precisions", "fp16,int8", "Variants to create with --quantize-model");
+    parser.addVariable("calibration-patches", "200", "Patches to calibrate the int8 variant with");
+    parser.addVariable("evaluation-patches", "100", "Patches to compare the outputs of the variants and the model on");
+    parser.addOption("heatmap-statistics", "Print the class statistics of the heatmap results of all slides of a project as CSV, without loading the heatmaps into memory. Requires --project");
+    parser.addVariable("log-level", false, "Lowest level which is logged: debug, info, warning, error or off. Overrides ~/fastpathology/logging.txt");
     parser.parse(argc, argv);
 
+    if(parser.gotValue("log-level"))
+        Logger::setLevel(Logger::getLevel(parser.get("log-level")));
+
+    // The thread counts of the inference engines are read from the environment, which is shared by the whole
+    // process, so they are set before any thread is started
+    auto policy = parser.gotValue("execution-policy") ? ExecutionPolicy::load(parser.get("execution-policy")) : ExecutionPolicy::load();
+    policy.applyEnvironment();
+
+    if(parser.getOption("job-server")) {
+        QCoreApplication application(argc, argv);
+        if(parser.getOption("stream-results"))
+            policy.streamResults = true;
+        if(parser.getOption("trace"))
+            policy.trace = true;
+        JobServer server(JobServer::getDefaultName(), policy);
+        if(!server.listen())
+            return 1;
+        return application.exec();
+    }
+
+    if(parser.gotValue("quantize-model")) {
+        if(!parser.gotValue("project")) {
+            std::cout << "A project must be given with --project to calibrate the model variants" << std::endl;
+            return 1;
+        }
+        // Finds quantize_model.py next to the executable
+        QCoreApplication application(argc, argv);
+        auto project = std::make_shared<Project>(parser.get("project"), true);
+        ModelQuantizer quantizer(QFileInfo(QString::fromStdString(parser.get("quantize-model"))).absoluteFilePath().toStdString(), project);
+        quantizer.setPatches(std::stoi(parser.get("calibration-patches")), std::stoi(parser.get("evaluation-patches")));
+        try {
+            int failed = 0;
+            for(const auto& result : quantizer.run(split(parser.get("model-precisions"), ","))) {
+                std::cout << result.toString() << std::endl;
+                failed += result.error.empty() ? 0 : 1;
+            }
+            return failed == 0 ? 0 : 1;
+        } catch(std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if(parser.getOption("heatmap-statistics")) {
+        if(!parser.gotValue("project")) {
+            std::cout << "A project must be given with --project to compute heatmap statistics" << std::endl;
+            return 1;
+        }
+        auto project = std::make_shared<Project>(parser.get("project"), true);
+        std::cout << "slide,pipeline,result,cells,class,mean probability,fraction" << std::endl;
+        int failed = 0;
+        for(const auto& uid : project->getAllWsiUids()) {
+            for(const auto& result : project->getResultIndex(uid)) {
+                if(QFileInfo(QString::fromStdString(result.filename)).suffix() != "hdf5")
+                    continue;
+                try {
+                    const auto statistics = HeatmapFile(result.filename).computeStatistics();
+                    for(size_t i = 0; i < statistics.meanProbability.size(); ++i) {
+                        const std::string className = i < result.classNames.size() ? result.classNames[i] : std::to_string(i);
+                        std::cout << uid << "," << result.pipelineName << "," << result.name << "," << statistics.cells << ","
+                                  << className << "," << statistics.meanProbability[i] << "," << statistics.fraction[i] << std::endl;
+                    }
+                } catch(std::exception& e) {
+                    Logger::error("HeatmapStatistics") << "Unable to read " << result.filename << ": " << e.what();
+                    ++failed;
+                }
+            }
+        }
+        return failed == 0 ? 0 : 1;
+    }
+
+    if(parser.gotValue("pipeline") && parser.getOption("queue")) {
+        if(!parser.gotValue("project")) {
+            std::cout << "A project must be given with --project to submit a pipeline" << std::endl;
+            return 1;
+        }
+        QCoreApplication application(argc, argv);
+        Job job;
+        job.project = parser.get("project");
+        // The job server may run from another folder
+        job.pipeline = QFileInfo(QString::fromStdString(parser.get("pipeline"))).absoluteFilePath().toStdString();
+        job.priority = std::stoi(parser.get("priority"));
+        job.threads = std::max(0, std::stoi(parser.get("threads")));
+        try {
+            std::cout << "Submitted job " << JobClient().submit(job) << std::endl;
+        } catch(std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if(parser.gotValue("pipeline")) {
+        if(!parser.gotValue("project")) {
+            std::cout << "A project must be given with --project to run a pipeline without the GUI" << std::endl;
+            return 1;
+        }
+        if(parser.gotValue("concurrent-slides"))
+            policy.concurrentSlides = std::max(1, std::stoi(parser.get("concurrent-slides")));
+        if(parser.getOption("stream-results"))
+            policy.streamResults = true;
+        if(parser.getOption("trace"))
+            policy.trace = true;
+        if(parser.gotValue("model-precision"))
+            policy.modelPrecision = parser.get("model-precision");
+        auto project = std::make_shared<Project>(parser.get("project"), true);
+        // Configures a HeadlessRunner or DistributedRunner, and runs it
+        auto run = [&](auto& runner) {
+            if(parser.getOption("cascade")) {
+                CascadeSettings cascade;
+                if(parser.gotValue("cascade-magnification"))
+                    cascade.magnification = std::stof(parser.get("cascade-magnification"));
+                if(parser.gotValue("cascade-model"))
+                    cascade.model = parser.get("cascade-model");
+                cascade.uncertainty = std::stof(parser.get("cascade-uncertainty"));
+                cascade.positivity = std::stof(parser.get("cascade-positivity"));
+                cascade.validate = parser.getOption("cascade-validate");
+                try {
+                    runner.setCascade(cascade);
+                } catch(std::exception& e) {
+                    std::cout << e.what() << std::endl;
+                    return 1;
+                }
+            }
+            return runner.run() == 0 ? 0 : 1;
+        };
+        if(parser.getOption("distributed")) {
+            DistributedRunner runner(project, parser.get("pipeline"), policy);
+            runner.setLeaseTimeout(std::stoi(parser.get("lease-timeout")));
+            return run(runner);
+        }
+        HeadlessRunner runner(project, parser.get("pipeline"), policy);
+        return run(runner);
+    }
+
     // Setup window
     auto window = MainWindow::New();
     window->start();
 }
-
@@ -5,12 +5,13 @@
 #include <string>
 #include <time.h>
 #include <QElapsedTimer>
-#include <QStandardPaths>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
 #include <FAST/Utility.hpp>
 #include <QProgressDialog>
-#include <QEventLoop>
+#include <QMessageBox>
+#include <QCoreApplication>
+#include <cmath>
+#include "source/logic/Downloader.h"
+#include "source/logic/Logger.h"
 
 
 namespace fast {
@@ -46,62 +47,47 @@ namespace fast {
 
 
 
-    static void downloadZipFile(std::string URL, std::string destination, std::string title) {
-        createDirectories(destination);
-        std::cout << "Progress: " << std::endl;
-        QNetworkAccessManager manager;
-        QUrl url(QString::fromStdString(URL));
-        QNetworkRequest request(url);
-        auto timer = new QElapsedTimer;
-        timer->start();
-        auto reply = manager.get(request);
-        int step = 5;
-        int progress = step;
-        auto progressDialog = new QProgressDialog("Downloading " + QString::fromStdString(title) +", please wait..", "Stop", 0, 101);
-        progressDialog->setModal(Qt::ApplicationModal);
-        QObject::connect(progressDialog, &QProgressDialog::canceled, reply, &QNetworkReply::abort);
-        progressDialog->setWindowTitle("Downloading " + QString::fromStdString(title));
-        progressDialog->setAutoClose(true);
-        progressDialog->show();
-        QObject::connect(reply, &QNetworkReply::downloadProgress, [&](quint64 current, quint64 max) {
-            int percent = ((float)current / max) * 100;
-            float speed = ((float)timer->elapsed() / 1000.0f)/percent;
-            uint64_t remaining = speed * (100 - percent);
-            if(percent >= progress) {
-                std::cout << percent << "% - ETA ~" << (int)std::ceil((float)remaining / 60) << " minutes. " << std::endl;;
-                progress += step;
+    /**
+     * Download a zip archive and extract it, showing the progress in a dialog. Files already present are skipped,
+     * and a canceled or failed download is resumed the next time, see Downloader.
+     * @return Whether all files were downloaded. The reason of a failure is shown to the user.
+     */
+    static bool downloadZipFile(std::string URL, std::string destination, std::string title) {
+        QProgressDialog progressDialog("Downloading " + QString::fromStdString(title) + ", please wait..", "Stop", 0, 100);
+        progressDialog.setWindowModality(Qt::ApplicationModal);
+        progressDialog.setWindowTitle("Downloading " + QString::fromStdString(title));
+        progressDialog.setAutoClose(true);
+        progressDialog.show();
+        QElapsedTimer timer;
+        timer.start();
+        int64_t first = -1; // Bytes received when the progress was first reported, which were resumed
+        Downloader downloader(URL, destination);
+        downloader.setProgressCallback([&](int64_t received, int64_t total) {
+            if(first < 0)
+                first = received;
+            if(total > 0 && received > first) {
+                // Time of the bytes downloaded so far, scaled to the bytes remaining
+                const float seconds = timer.elapsed() / 1000.0f * (total - received) / (received - first);
+                progressDialog.setLabelText("Downloading " + QString::fromStdString(title) + ", about " +
+                                            QString::number((int)std::ceil(seconds / 60)) + " minutes left..");
+                progressDialog.setValue(100 * received / total);
             }
-            progressDialog->setValue(percent);
+            QCoreApplication::processEvents();
+            return !progressDialog.wasCanceled();
         });
-        auto tempLocation = QStandardPaths::writableLocation(QStandardPaths::TempLocation) + "/data.zip";
-        QFile file(tempLocation);
-        if(!file.open(QIODevice::WriteOnly)) {
-            throw Exception("Could not write to " + tempLocation.toStdString());
-        }
-        QObject::connect(reply, &QNetworkReply::readyRead, [&reply, &file]() {
-            file.write(reply->read(reply->bytesAvailable()));
-        });
-        QObject::connect(&manager, &QNetworkAccessManager::finished, [&]() {
-            std::cout << "Finished downloading file. Processing.." << std::endl;
-            file.close();
-            std::cout << "Unzipping the data file to: " << destination << std::endl;
-            try {
-                extractZipFile(file.fileName().toStdString(), destination);
-            } catch(Exception & e) {
-                std::cout << "ERROR: Zip extraction failed." << std::endl;
+        try {
+            downloader.run();
+        } catch(Exception& e) {
+            const bool canceled = progressDialog.wasCanceled();
+            progressDialog.close();
+            Logger::error("Downloader") << e.what();
+            if(!canceled) {
+                QMessageBox::warning(nullptr, "Download failed", "The " + QString::fromStdString(title) + " could not be downloaded: " +
+                                     QString::fromStdString(e.what()) + "\nThe download is resumed the next time it is started.");
             }
-
-            file.remove();
-            std::cout << "Done." << std::endl;
-            progressDialog->setValue(101);
-        });
-
-        auto eventLoop = new QEventLoop(&manager);
-
-        // Make sure to quit the event loop when download is finished
-        QObject::connect(&manager, &QNetworkAccessManager::finished, eventLoop, &QEventLoop::quit);
-
-        // Wait for it to finish
-        eventLoop->exec();
+            return false;
+        }
+        progressDialog.setValue(100);
+        return true;
     }
 }
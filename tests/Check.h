@@ -0,0 +1,30 @@
+#pragma once
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+
+/**
+ * Checks of the test executables. A failed check prints its location and fails the test.
+ */
+#define CHECK(condition) \
+    do { \
+        if(!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #condition << std::endl; \
+            std::exit(1); \
+        } \
+    } while(false)
+
+#define CHECK_THROWS(statement) \
+    do { \
+        bool thrown = false; \
+        try { \
+            statement; \
+        } catch(std::exception& e) { \
+            thrown = true; \
+        } \
+        if(!thrown) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": expected an exception from: " << #statement << std::endl; \
+            std::exit(1); \
+        } \
+    } while(false)
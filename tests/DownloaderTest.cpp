@@ -0,0 +1,229 @@
+#include "source/logic/Downloader.h"
+#include "source/logic/ZipExtractor.h"
+#include "tests/Check.h"
+#include "tests/TestZip.h"
+#include <FAST/Utility.hpp>
+#include <QCoreApplication>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <fstream>
+#include <sstream>
+#include <memory>
+
+using namespace fast;
+
+namespace {
+    std::string readFile(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    /**
+     * Local stand-in for the download server, which serves files from memory with range requests and an ETag.
+     */
+    class TestServer {
+        public:
+            struct Request {
+                std::string path;
+                std::string range;
+            };
+
+            TestServer() {
+                m_server.listen(QHostAddress::LocalHost);
+                QObject::connect(&m_server, &QTcpServer::newConnection, [this]() {
+                    while(auto socket = m_server.nextPendingConnection())
+                        accept(socket);
+                });
+            }
+            void setFile(const std::string& name, const std::string& content) {
+                m_files["/" + name] = content;
+            }
+            /**
+             * Send only this many bytes of the next file, and the rest a second later.
+             */
+            void stallNextReply(int64_t bytes) {
+                m_stallAfter = bytes;
+            }
+            std::string getUrl(const std::string& name) const {
+                return "http://127.0.0.1:" + std::to_string(m_server.serverPort()) + "/" + name;
+            }
+            std::vector<Request> getRequests(const std::string& name) const {
+                std::vector<Request> requests;
+                for(const auto& request : m_requests) {
+                    if(request.path == "/" + name)
+                        requests.push_back(request);
+                }
+                return requests;
+            }
+        private:
+            void accept(QTcpSocket* socket) {
+                auto received = std::make_shared<std::string>();
+                QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+                QObject::connect(socket, &QTcpSocket::readyRead, [this, socket, received]() {
+                    *received += socket->readAll().toStdString();
+                    if(received->find("\r\n\r\n") != std::string::npos) {
+                        reply(socket, *received);
+                        received->clear();
+                    }
+                });
+            }
+            void reply(QTcpSocket* socket, const std::string& request) {
+                std::stringstream stream(request);
+                std::string method, line;
+                Request parsed;
+                stream >> method >> parsed.path;
+                std::string ifRange;
+                while(std::getline(stream, line)) {
+                    trim(line);
+                    if(line.find("Range: bytes=") == 0)
+                        parsed.range = line.substr(std::string("Range: bytes=").size());
+                    if(line.find("If-Range: ") == 0)
+                        ifRange = line.substr(std::string("If-Range: ").size());
+                }
+                m_requests.push_back(parsed);
+                auto file = m_files.find(parsed.path);
+                if(file == m_files.end()) {
+                    socket->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+                    socket->disconnectFromHost();
+                    return;
+                }
+                const std::string etag = "\"" + std::to_string(file->second.size()) + "\"";
+                int64_t offset = 0;
+                if(!parsed.range.empty() && (ifRange.empty() || ifRange == etag))
+                    offset = std::stoll(parsed.range.substr(0, parsed.range.find('-')));
+                const std::string body = file->second.substr(offset);
+                std::string header = offset > 0 ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+                if(offset > 0)
+                    header += "Content-Range: bytes " + std::to_string(offset) + "-" + std::to_string(file->second.size() - 1) + "/" + std::to_string(file->second.size()) + "\r\n";
+                header += "ETag: " + etag + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+                if(m_stallAfter > 0 && m_stallAfter < (int64_t)body.size()) {
+                    socket->write(QByteArray::fromStdString(header + body.substr(0, m_stallAfter)));
+                    const std::string rest = body.substr(m_stallAfter);
+                    m_stallAfter = 0;
+                    QTimer::singleShot(1000, socket, [socket, rest]() {
+                        socket->write(QByteArray::fromStdString(rest));
+                        socket->disconnectFromHost();
+                    });
+                    return;
+                }
+                socket->write(QByteArray::fromStdString(header + body));
+                socket->disconnectFromHost();
+            }
+
+            QTcpServer m_server;
+            std::map<std::string, std::string> m_files;
+            std::vector<Request> m_requests;
+            int64_t m_stallAfter = 0;
+    };
+
+    std::string createManifest(const std::vector<std::pair<std::string, std::string>>& files, const std::string& folder) {
+        std::stringstream manifest;
+        for(const auto& file : files)
+            manifest << ZipExtractor::getSHA256(join(folder, file.first)) << "  " << file.first << "\n";
+        return manifest.str();
+    }
+
+    // Files of an archive, and their manifest, which is created by extracting them once
+    std::string createArchive(TestServer& server, const std::string& name, const std::vector<std::pair<std::string, std::string>>& files) {
+        QTemporaryDir folder;
+        ZipExtractor extractor(folder.path().toStdString());
+        const std::string archive = test::createZip(files, false);
+        extractor.write(archive.data(), archive.size());
+        server.setFile(name, archive);
+        return createManifest(files, folder.path().toStdString());
+    }
+
+    void testParseManifest() {
+        const std::string hash(64, 'a');
+        const auto manifest = Downloader::parseManifest(
+                std::string(64, 'A') + "  models/model.onnx\n"
+                "\n"
+                "   " + hash + " *pipelines/name with spaces.fpl  \r\n"
+                "invalid\n");
+        CHECK(manifest.size() == 2);
+        CHECK(manifest.at("models/model.onnx") == hash);
+        CHECK(manifest.at("pipelines/name with spaces.fpl") == hash);
+    }
+
+    void testDownload(TestServer& server) {
+        QTemporaryDir folder;
+        const std::string destination = folder.path().toStdString();
+        const std::vector<std::pair<std::string, std::string>> files = {{"model.onnx", std::string(100000, 'm')}, {"pipelines/a.fpl", "PipelineName \"A\"\n"}};
+        server.setFile("complete.zip.sha256", createArchive(server, "complete.zip", files));
+        Downloader(server.getUrl("complete.zip"), destination).run();
+        for(const auto& file : files)
+            CHECK(readFile(join(destination, file.first)) == file.second);
+        CHECK(fileExists(join(Downloader::getDownloadFolder(), "complete.zip.sha256")));
+        CHECK(!fileExists(join(Downloader::getDownloadFolder(), "complete.zip.partial")));
+        // All files are present, so the archive isn't downloaded again
+        Downloader(server.getUrl("complete.zip"), destination).run();
+        CHECK(server.getRequests("complete.zip").size() == 1);
+    }
+
+    void testIncompleteArchive(TestServer& server) {
+        QTemporaryDir folder;
+        const std::string manifest = createArchive(server, "incomplete.zip", {{"model.onnx", "model"}});
+        server.setFile("incomplete.zip.sha256", manifest + std::string(64, '0') + "  missing.onnx\n");
+        CHECK_THROWS(Downloader(server.getUrl("incomplete.zip"), folder.path().toStdString()).run());
+        // The extracted files match the manifest, only the missing file fails the download
+        CHECK(readFile(join(folder.path().toStdString(), "model.onnx")) == "model");
+    }
+
+    void testMissingArchive(TestServer& server) {
+        QTemporaryDir folder;
+        CHECK_THROWS(Downloader(server.getUrl("missing.zip"), folder.path().toStdString()).run());
+    }
+
+    void testResume(TestServer& server) {
+        QTemporaryDir folder;
+        const std::string destination = folder.path().toStdString();
+        std::string large;
+        for(int i = 0; i < 1000000; ++i)
+            large += std::to_string(i * 7919 % 10007);
+        const std::vector<std::pair<std::string, std::string>> files = {{"large.onnx", large}, {"small.txt", "small"}};
+        server.setFile("resumed.zip.sha256", createArchive(server, "resumed.zip", files));
+        server.stallNextReply(1024*1024);
+        Downloader canceled(server.getUrl("resumed.zip"), destination);
+        canceled.setProgressCallback([](int64_t received, int64_t total) {
+            return false;
+        });
+        CHECK_THROWS(canceled.run());
+        const std::string partial = join(Downloader::getDownloadFolder(), "resumed.zip.partial");
+        CHECK(fileExists(partial));
+        const int64_t kept = readFile(partial).size();
+        CHECK(kept > 0);
+
+        int64_t first = -1;
+        Downloader resumed(server.getUrl("resumed.zip"), destination);
+        resumed.setProgressCallback([&first](int64_t received, int64_t total) {
+            if(first < 0)
+                first = received;
+            return true;
+        });
+        resumed.run();
+        for(const auto& file : files)
+            CHECK(readFile(join(destination, file.first)) == file.second);
+        const auto requests = server.getRequests("resumed.zip");
+        CHECK(requests.size() == 2);
+        CHECK(requests.back().range == std::to_string(kept) + "-");
+        // Progress includes the resumed part
+        CHECK(first > kept);
+        CHECK(!fileExists(partial));
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication application(argc, argv);
+    testParseManifest();
+    TestServer server;
+    testDownload(server);
+    testIncompleteArchive(server);
+    testMissingArchive(server);
+    testResume(server);
+    std::cout << "Downloader tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "source/logic/Logger.h"
+#include "tests/Check.h"
+#include <FAST/Utility.hpp>
+#include <QTemporaryDir>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <random>
+
+using namespace fast;
+
+namespace {
+    std::string writeSettings(const QTemporaryDir& folder, const std::string& settings) {
+        const std::string filename = join(folder.path().toStdString(), "logging.txt");
+        std::ofstream file(filename);
+        file << settings;
+        return filename;
+    }
+
+    // Lines of the log file with a text, which other tests may write to as well
+    std::vector<std::string> readLog(const std::string& text) {
+        Logger::flush();
+        std::ifstream file(join(Logger::getLogFolder(), "fastpathology.log"));
+        std::vector<std::string> lines;
+        std::string line;
+        while(std::getline(file, line)) {
+            if(line.find(text) != std::string::npos)
+                lines.push_back(line);
+        }
+        return lines;
+    }
+
+    std::string getToken() {
+        return std::to_string(std::random_device()());
+    }
+
+    void testConfigure() {
+        QTemporaryDir folder;
+        Logger::configure(writeSettings(folder,
+            "# Quiet, except for the projects\n"
+            "level warning\n"
+            "console error\n"
+            "\n"
+            "module Project debug\n"
+            "  module Downloader off  \n"));
+        CHECK(!Logger::isEnabled(LogLevel::Info, "Tracer"));
+        CHECK(Logger::isEnabled(LogLevel::Warning, "Tracer"));
+        CHECK(Logger::isEnabled(LogLevel::Debug, "Project"));
+        CHECK(!Logger::isEnabled(LogLevel::Error, "Downloader"));
+        CHECK(!Logger::isEnabled(LogLevel::Off, "Project"));
+
+        // Settings replace the previous ones, also the module levels
+        Logger::configure(writeSettings(folder, "level debug\n"));
+        CHECK(Logger::isEnabled(LogLevel::Debug, "Tracer"));
+        CHECK(Logger::isEnabled(LogLevel::Debug, "Downloader"));
+
+        // Without a settings file, info and above are logged
+        Logger::configure(join(folder.path().toStdString(), "missing.txt"));
+        CHECK(!Logger::isEnabled(LogLevel::Debug, "Project"));
+        CHECK(Logger::isEnabled(LogLevel::Info, "Project"));
+    }
+
+    void testInvalidSettings() {
+        QTemporaryDir folder;
+        const std::string token = getToken();
+        Logger::configure(writeSettings(folder,
+            "level verbose" + token + "\n"
+            "colour" + token + " red\n"
+            "module Project" + token + "\n"
+            "console off\n"));
+        // The valid settings are used, and the others reported
+        CHECK(Logger::isEnabled(LogLevel::Info, "Project"));
+        CHECK(!Logger::isEnabled(LogLevel::Debug, "Project"));
+        const auto lines = readLog(token);
+        CHECK(lines.size() == 3);
+        CHECK(lines[0].find("Logger: Invalid logging setting: level verbose" + token) != std::string::npos);
+        CHECK(lines[1].find("Logger: Unknown logging setting colour" + token) != std::string::npos);
+        CHECK(lines[2].find("Logger: Invalid logging setting: module Project" + token) != std::string::npos);
+    }
+
+    void testSetLevel() {
+        QTemporaryDir folder;
+        Logger::configure(writeSettings(folder, "level info\nconsole off\n"));
+        Logger::setLevel(LogLevel::Error);
+        Logger::setLevel(LogLevel::Debug, "Project");
+        CHECK(!Logger::isEnabled(LogLevel::Warning, "Tracer"));
+        CHECK(Logger::isEnabled(LogLevel::Error, "Tracer"));
+        CHECK(Logger::isEnabled(LogLevel::Debug, "Project"));
+        // The module level stays when the level changes
+        Logger::setLevel(LogLevel::Info);
+        CHECK(Logger::isEnabled(LogLevel::Info, "Tracer"));
+        CHECK(Logger::isEnabled(LogLevel::Debug, "Project"));
+    }
+
+    void testMessages() {
+        QTemporaryDir folder;
+        Logger::configure(writeSettings(folder, "level info\nconsole off\nmodule Verbose debug\n"));
+        const std::string token = getToken();
+        Logger::debug("Quiet") << "hidden " << token;
+        Logger::debug("Verbose") << "debug " << token;
+        Logger::warning("Quiet") << "warning " << token << " " << 1.5;
+        auto lines = readLog(token);
+        CHECK(lines.size() == 2);
+        CHECK(lines[0].find(" debug   Verbose: debug " + token) != std::string::npos);
+        CHECK(lines[1].find(" warning Quiet: warning " + token + " 1.5") != std::string::npos);
+
+        // Messages of each thread are written in order
+        const int threadCount = 4;
+        const int messageCount = 200;
+        std::vector<std::thread> threads;
+        for(int t = 0; t < threadCount; ++t) {
+            threads.emplace_back([t, &token]() {
+                for(int i = 0; i < messageCount; ++i)
+                    Logger::info("LoggerTest") << "thread " << t << " message " << i << " " << token;
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+        lines = readLog(token);
+        CHECK(lines.size() == 2 + threadCount*messageCount);
+        std::vector<int> next(threadCount, 0);
+        for(int i = 2; i < lines.size(); ++i) {
+            std::stringstream stream(lines[i].substr(lines[i].find("thread ")));
+            std::string word;
+            int thread, message;
+            stream >> word >> thread >> word >> message;
+            CHECK(message == next[thread]);
+            ++next[thread];
+        }
+    }
+
+    void testLevelNames() {
+        for(auto level : {LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error, LogLevel::Off})
+            CHECK(Logger::getLevel(Logger::getLevelName(level)) == level);
+        CHECK_THROWS(Logger::getLevel("verbose"));
+        CHECK_THROWS(Logger::getLevel("Info"));
+    }
+}
+
+int main(int argc, char** argv) {
+    testConfigure();
+    testInvalidSettings();
+    testSetLevel();
+    testMessages();
+    testLevelNames();
+    std::cout << "Logger tests passed" << std::endl;
+    return 0;
+}
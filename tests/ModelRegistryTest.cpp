@@ -0,0 +1,152 @@
+#include "source/logic/ModelRegistry.h"
+#include "tests/Check.h"
+#include <FAST/Utility.hpp>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <fstream>
+#include <cmath>
+
+using namespace fast;
+
+namespace {
+    std::string getRegistryFilename() {
+        const std::string folder = QDir::home().path().toStdString() + "/fastpathology";
+        QDir().mkpath(QString::fromStdString(folder));
+        return folder + "/model_registry.txt";
+    }
+
+    void writeFile(const std::string& filename, const std::string& content) {
+        std::ofstream file(filename, std::ios::binary);
+        file << content;
+    }
+
+    // A model file, and the start of its registry line: filename, size and modification time
+    std::string createModel(const QTemporaryDir& folder, const std::string& name, const std::string& content) {
+        const std::string filename = join(folder.path().toStdString(), name);
+        writeFile(filename, content);
+        const std::string canonical = ModelRegistry::getCanonicalFilename(filename);
+        QFileInfo file(QString::fromStdString(canonical));
+        return canonical + "\t" + std::to_string(file.size()) + "\t" + std::to_string(file.lastModified().toMSecsSinceEpoch());
+    }
+
+    std::string getFilename(const std::string& line) {
+        return line.substr(0, line.find('\t'));
+    }
+
+    void testLoad() {
+        QTemporaryDir folder;
+        const std::string current = createModel(folder, "current.onnx", "current model");
+        const std::string old = createModel(folder, "old.xml", "model of an older version");
+        const std::string changed = createModel(folder, "changed.onnx", "changed model");
+        const std::string invalid = createModel(folder, "invalid.onnx", "invalid line");
+        writeFile(getRegistryFilename(),
+            current + "\thash1\tONNX\tOpenVINO\tinput_1:-1x256x256x3\tconv:-1x256x256x2;dense:-1x3\t20\t512x512\t0.00392\n" +
+            old + "\thash2\tOpenVINO\tOpenVINO\tinput:1x3x224x224\toutput:1x2\t0\t0x0\n" +
+            // The registry has another size than the file
+            getFilename(changed) + "\t1\t0\thash3\tONNX\tOpenVINO\tinput:1x64x64x1\toutput:1x2\t0\t0x0\t1\n" +
+            invalid + "\thash4\tONNX\tOpenVINO\tinput:1xAx64x1\toutput:1x2\t0\t0x0\t1\n" +
+            "too\tfew\tfields\n");
+
+        ModelRegistry registry;
+        ModelInfo info;
+        CHECK(registry.findModel(getFilename(current), info));
+        CHECK(info.sha256 == "hash1");
+        CHECK(info.format == "ONNX");
+        CHECK(info.engine == "OpenVINO");
+        CHECK(info.inputs.size() == 1);
+        CHECK(info.inputs[0].name == "input_1");
+        CHECK((info.inputs[0].shape == std::vector<int>{-1, 256, 256, 3}));
+        CHECK(info.outputs.size() == 2);
+        CHECK(info.outputs[1].name == "dense");
+        CHECK((info.outputs[1].shape == std::vector<int>{-1, 3}));
+        CHECK(info.magnification == 20);
+        CHECK(info.patchWidth == 512 && info.patchHeight == 512);
+        CHECK(std::abs(info.scaleFactor - 0.00392f) < 1e-6f);
+
+        // Registries of older versions have no scale factor
+        CHECK(registry.findModel(getFilename(old), info));
+        CHECK(info.scaleFactor == 1);
+        CHECK(info.patchWidth == 0);
+        CHECK((info.inputs[0].shape == std::vector<int>{1, 3, 224, 224}));
+
+        CHECK(!registry.findModel(getFilename(changed), info));
+        CHECK(!registry.findModel(getFilename(invalid), info));
+        CHECK(!registry.findModel(join(folder.path().toStdString(), "missing.onnx"), info));
+
+        CHECK(registry.findModelByHash("hash2") == getFilename(old));
+        CHECK(registry.findModelByHash("hash5").empty());
+    }
+
+    void testIndexPipelines() {
+        QTemporaryDir folder;
+        createDirectories(join(folder.path().toStdString(), "models"));
+        createDirectories(join(folder.path().toStdString(), "pipelines"));
+        const std::string model = createModel(folder, "models/model.onnx", "model");
+        const std::string removed = createModel(folder, "models/removed.onnx", "removed model");
+        writeFile(getRegistryFilename(),
+            model + "\thash1\tONNX\tOpenVINO\tinput:-1x256x256x3\toutput:-1x2\t0\t0x0\t1\n" +
+            removed + "\thash2\tONNX\tOpenVINO\tinput:-1x256x256x3\toutput:-1x2\t0\t0x0\t1\n");
+        QFile::remove(QString::fromStdString(getFilename(removed)));
+        writeFile(join(folder.path().toStdString(), "pipelines/classification.fpl"),
+            "PipelineInputData WSI \"Whole-slide image\"\n\n"
+            "ProcessObject patch PatchGenerator\n"
+            "Attribute patch-size 224 224\n"
+            "Attribute patch-magnification 10\n"
+            "Input 0 WSI\n\n"
+            "ProcessObject network NeuralNetwork\n"
+            "Attribute scale-factor 0.5\n"
+            "Attribute model \"$CURRENT_PATH$/../models/model.onnx\"\n"
+            "Input 0 patch 0\n");
+        writeFile(join(folder.path().toStdString(), "pipelines/notes.txt"), "Not a pipeline\n");
+
+        ModelRegistry().indexPipelines(join(folder.path().toStdString(), "pipelines"));
+        ModelRegistry registry;
+        ModelInfo info;
+        CHECK(registry.findModel(join(folder.path().toStdString(), "pipelines/../models/model.onnx"), info));
+        CHECK(info.magnification == 10);
+        CHECK(info.patchWidth == 224 && info.patchHeight == 224);
+        CHECK(info.scaleFactor == 0.5f);
+        CHECK(info.sha256 == "hash1");
+        CHECK(registry.findModelByHash("hash2").empty());
+
+        CHECK((ModelRegistry::getModelFilenames(join(folder.path().toStdString(), "models")) == std::vector<std::string>{getFilename(model)}));
+    }
+
+    void testModelInfo() {
+        ModelInfo info;
+        info.format = "ONNX";
+        int width, height, channels;
+        CHECK(!info.getInputSize(width, height, channels));
+        info.inputs = {{"input", {-1, 256, 128, 3}}};
+        CHECK(info.getInputSize(width, height, channels));
+        CHECK(width == 128 && height == 256 && channels == 3);
+        info.inputs = {{"input", {1, 1, 64, 32}}};
+        CHECK(info.getInputSize(width, height, channels));
+        CHECK(width == 32 && height == 64 && channels == 1);
+        // The pipelines' patch size is used for models with a dynamic input size
+        info.inputs = {{"input", {-1, -1, -1, 3}}};
+        CHECK(!info.getInputSize(width, height, channels));
+        info.patchWidth = 512;
+        info.patchHeight = 512;
+        info.magnification = 20;
+        info.engine = "OpenVINO";
+        CHECK(info.getInputSize(width, height, channels));
+        CHECK(info.toString() == "ONNX, input 512x512x3 at 20x, OpenVINO");
+
+        CHECK(ModelRegistry::getFormat("model.ONNX") == "ONNX");
+        CHECK(ModelRegistry::getFormat("model.xml") == "OpenVINO");
+        CHECK(ModelRegistry::getFormat("model.pb") == "TensorFlow");
+        CHECK(ModelRegistry::getFormat("model.bin").empty());
+    }
+}
+
+int main(int argc, char** argv) {
+    testLoad();
+    testIndexPipelines();
+    testModelInfo();
+    std::cout << "ModelRegistry tests passed" << std::endl;
+    return 0;
+}
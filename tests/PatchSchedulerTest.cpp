@@ -0,0 +1,122 @@
+#include "source/logic/PatchScheduler.h"
+#include "source/logic/PatchGrid.h"
+#include "source/logic/PipelineRewriter.h"
+#include "tests/Check.h"
+#include <FAST/Data/ImagePyramid.hpp>
+#include <FAST/Data/Image.hpp>
+#include <FAST/Utility.hpp>
+#include <QTemporaryDir>
+#include <fstream>
+#include <numeric>
+
+using namespace fast;
+
+namespace {
+    const int tileSize = 256;
+    const int tiles = 4;
+
+    // A slide of 4x4 tiles with a row of background, a row of tissue, a row of half tissue and a row with a thin
+    // line of tissue
+    std::shared_ptr<ImagePyramid> createSlide() {
+        auto pyramid = ImagePyramid::create(tileSize*tiles, tileSize*tiles, 3, tileSize, tileSize, ImageCompression::LZW);
+        auto access = pyramid->getAccess(ACCESS_READ_WRITE);
+        const int tissueRows[] = {0, tileSize, tileSize/2, 5};
+        for(int ty = 0; ty < tiles; ++ty) {
+            std::vector<uchar> pixels(tileSize*tileSize*3, 255);
+            std::fill(pixels.begin(), pixels.begin() + tissueRows[ty]*tileSize*3, 0);
+            for(int tx = 0; tx < tiles; ++tx)
+                access->setPatch(0, tx*tileSize, ty*tileSize, Image::create(tileSize, tileSize, TYPE_UINT8, 3, pixels.data()));
+        }
+        return pyramid;
+    }
+
+    std::vector<int> range(int first, int last) {
+        std::vector<int> indices(last - first);
+        std::iota(indices.begin(), indices.end(), first);
+        return indices;
+    }
+
+    std::string writePipeline(const QTemporaryDir& folder, const std::string& mask) {
+        const std::string filename = join(folder.path().toStdString(), "pipeline.fpl");
+        std::ofstream file(filename);
+        file << "PipelineName \"Tissue\"\n"
+                "PipelineInputData WSI \"Whole-slide image\"\n\n"
+                "ProcessObject tissueSeg TissueSegmentation\n"
+                "Attribute threshold 70\n"
+                "Input 0 WSI\n\n"
+                "ProcessObject patch PatchGenerator\n"
+                "Attribute patch-size 256 256\n"
+                "Attribute mask-threshold 0.1\n"
+                "Input 0 WSI\n"
+                "Input 1 " << mask << "\n";
+        return filename;
+    }
+
+    void testGrid(const std::shared_ptr<ImagePyramid>& slide) {
+        const auto grid = PatchGrid::create(slide, tileSize, tileSize);
+        CHECK(grid.level == 0);
+        CHECK(grid.getPatchCount() == tiles*tiles);
+        int x, y, width, height;
+        grid.getRegion(6, x, y, width, height);
+        CHECK(x == 2*tileSize && y == tileSize && width == tileSize && height == tileSize);
+
+        // Overlapping patches start before the border, and the last ones are clamped to the level
+        const auto overlapping = PatchGrid::create(slide, tileSize, tileSize, 0, 0.125f);
+        CHECK(overlapping.overlapX == 32);
+        CHECK(overlapping.patchesX == 6);
+        overlapping.getRegion(0, x, y, width, height);
+        CHECK(x == 0 && y == 0 && width == tileSize);
+        overlapping.getRegion(5, x, y, width, height);
+        CHECK(x == 5*192 - 32 && x + width == tileSize*tiles);
+    }
+
+    void testSchedule(const std::shared_ptr<ImagePyramid>& slide) {
+        const auto grid = PatchGrid::create(slide, tileSize, tileSize);
+        CHECK(PatchScheduler(0).schedule(slide, grid) == range(0, 16));
+        CHECK(PatchScheduler(0.01f).schedule(slide, grid) == range(4, 16));
+        CHECK(PatchScheduler(0.1f).schedule(slide, grid) == range(4, 12));
+        CHECK(PatchScheduler(0.6f).schedule(slide, grid) == range(4, 8));
+        // Not even black is tissue with a tissue threshold above its distance from white
+        CHECK(PatchScheduler(0.1f, 442).schedule(slide, grid).empty());
+    }
+
+    void testCache(const std::shared_ptr<ImagePyramid>& slide) {
+        QTemporaryDir folder;
+        const std::string cacheFolder = join(folder.path().toStdString(), "cache");
+        const auto grid = PatchGrid::create(slide, tileSize, tileSize);
+        PatchScheduler scheduler(0.1f);
+        CHECK(scheduler.schedule(slide, grid, cacheFolder) == range(4, 12));
+        const auto files = getDirectoryList(cacheFolder, true, false);
+        CHECK(files.size() == 1);
+
+        // The stored schedule is used instead of the slide
+        std::ofstream(join(cacheFolder, files[0])) << "3\n5\n";
+        CHECK((scheduler.schedule(slide, grid, cacheFolder) == std::vector<int>{3, 5}));
+        // Other thresholds have a schedule of their own
+        CHECK(PatchScheduler(0.6f).schedule(slide, grid, cacheFolder) == range(4, 8));
+    }
+
+    void testPipeline(const std::shared_ptr<ImagePyramid>& slide) {
+        QTemporaryDir folder;
+        PatchScheduler scheduler;
+        PipelineRewriter pipeline(writePipeline(folder, "tissueSeg 0"));
+        CHECK(PatchScheduler::fromPipeline(pipeline, "patch", scheduler));
+        CHECK(scheduler.schedule(slide, PatchGrid::fromPipeline(pipeline, "patch", slide)) == range(4, 12));
+        CHECK(PatchScheduler::countPatches(join(folder.path().toStdString(), "pipeline.fpl"), slide) == 8);
+
+        // A mask which isn't a tissue segmentation of the slide can't be scheduled, all patches are counted
+        PipelineRewriter other(writePipeline(folder, "WSI"));
+        CHECK(!PatchScheduler::fromPipeline(other, "patch", scheduler));
+        CHECK(PatchScheduler::countPatches(join(folder.path().toStdString(), "pipeline.fpl"), slide) == 16);
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto slide = createSlide();
+    testGrid(slide);
+    testSchedule(slide);
+    testCache(slide);
+    testPipeline(slide);
+    std::cout << "PatchScheduler tests passed" << std::endl;
+    return 0;
+}
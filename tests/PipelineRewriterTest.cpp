@@ -0,0 +1,142 @@
+#include "source/logic/PipelineRewriter.h"
+#include "tests/Check.h"
+#include <FAST/Utility.hpp>
+#include <QTemporaryDir>
+#include <fstream>
+#include <sstream>
+
+using namespace fast;
+
+namespace {
+    const std::string pipeline =
+        "PipelineName \"Segmentation\"\n"
+        "Attribute classes \"Background;Tumor\"\n"
+        "PipelineInputData WSI \"Whole-slide image\"\n"
+        "\n"
+        "ProcessObject tissueSeg TissueSegmentation\n"
+        "Attribute threshold 70\n"
+        "Input 0 WSI\n"
+        "\n"
+        "ProcessObject patch PatchGenerator\n"
+        "Attribute patch-size 256 256\n"
+        "Attribute patch-magnification 10\n"
+        "Attribute mask-threshold 0.05\n"
+        "Input 0 WSI\n"
+        "Input 1 tissueSeg 0\n"
+        "\n"
+        "# The network\n"
+        "ProcessObject network SegmentationNetwork\n"
+        "Attribute scale-factor 0.003921568627451\n"
+        "Attribute model \"$CURRENT_PATH$/../models/model.onnx\"\n"
+        "Input 0 patch 0\n"
+        "\r\n"
+        "ProcessObject stitcher PatchStitcher\n"
+        "Input 0 network 0\n"
+        "\n"
+        "Renderer segRenderer SegmentationRenderer\n"
+        "Input 0 stitcher 0\n"
+        "\n"
+        "PipelineOutputData segmentation stitcher 0\n";
+
+    std::string writePipeline(const QTemporaryDir& folder, const std::string& content) {
+        const std::string filename = join(folder.path().toStdString(), "pipeline.fpl");
+        std::ofstream file(filename);
+        file << content;
+        return filename;
+    }
+
+    std::string readFile(const std::string& filename) {
+        std::ifstream file(filename);
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    void testRead() {
+        QTemporaryDir folder;
+        PipelineRewriter rewriter(writePipeline(folder, pipeline));
+        CHECK((rewriter.getProcessObjects() == std::vector<std::string>{"tissueSeg", "patch", "network", "stitcher"}));
+        CHECK((rewriter.getProcessObjects("PatchGenerator") == std::vector<std::string>{"patch"}));
+        CHECK(rewriter.getProcessObjects("ImageToBatchGenerator").empty());
+        CHECK(rewriter.getType("network") == "SegmentationNetwork");
+        CHECK(rewriter.getAttribute("patch", "patch-size") == "256 256");
+        CHECK(rewriter.getAttribute("patch", "patch-overlap").empty());
+        CHECK(rewriter.getAttribute("network", "model") == folder.path().toStdString() + "/../models/model.onnx");
+        CHECK(rewriter.getPipelineAttribute("classes") == "Background;Tumor");
+        CHECK(rewriter.getPipelineAttribute("threshold").empty());
+        CHECK(rewriter.getInput("patch", 0) == "WSI");
+        CHECK(rewriter.getInput("patch", 1) == "tissueSeg 0");
+        CHECK(rewriter.getInput("tissueSeg", 1).empty());
+        CHECK((rewriter.getConsumers("network") == std::vector<std::string>{"stitcher"}));
+        CHECK((rewriter.getConsumers("stitcher") == std::vector<std::string>{"segRenderer"}));
+        CHECK((rewriter.getPipelineOutputs() == std::map<std::string, std::string>{{"segmentation", "stitcher 0"}}));
+        CHECK_THROWS(rewriter.getAttribute("missing", "model"));
+        CHECK_THROWS(PipelineRewriter(join(folder.path().toStdString(), "missing.fpl")));
+    }
+
+    void testEdit() {
+        QTemporaryDir folder;
+        PipelineRewriter rewriter(writePipeline(folder, pipeline));
+        rewriter.setAttribute("patch", "patch-size", "512 512");
+        rewriter.setAttribute("patch", "patch-overlap", "0.1");
+        rewriter.setInput("network", 1, "tissueSeg 0");
+        CHECK(rewriter.getAttribute("patch", "patch-size") == "512 512");
+        CHECK(rewriter.getAttribute("patch", "patch-overlap") == "0.1");
+        CHECK(rewriter.getInput("network", 1) == "tissueSeg 0");
+        CHECK(rewriter.getInput("network", 0) == "patch 0");
+        // Edits stay inside their block
+        CHECK(rewriter.getAttribute("tissueSeg", "patch-overlap").empty());
+        CHECK(rewriter.getInput("stitcher", 1).empty());
+        rewriter.removeAttribute("network", "model");
+        rewriter.removeAttribute("network", "model");
+        CHECK(rewriter.getAttribute("network", "model").empty());
+        CHECK(rewriter.getAttribute("network", "scale-factor") == "0.003921568627451");
+    }
+
+    void testBatching() {
+        QTemporaryDir folder;
+        PipelineRewriter rewriter(writePipeline(folder, pipeline));
+        CHECK(rewriter.canBatch("network"));
+        CHECK(!rewriter.canBatch("stitcher"));
+        rewriter.enableBatching("network", 8);
+        CHECK((rewriter.getProcessObjects() == std::vector<std::string>{"tissueSeg", "patch", "networkBatch", "network", "stitcher"}));
+        CHECK(rewriter.getType("networkBatch") == "ImageToBatchGenerator");
+        CHECK(rewriter.getAttribute("networkBatch", "max-batch-size") == "8");
+        CHECK(rewriter.getInput("networkBatch", 0) == "patch 0");
+        CHECK(rewriter.getInput("network", 0) == "networkBatch 0");
+        CHECK(rewriter.getAttribute("network", "scale-factor") == "0.003921568627451");
+
+        // A network whose output is rendered directly can't be batched
+        std::string rendered = pipeline;
+        rendered.replace(rendered.find("Input 0 stitcher 0"), 18, "Input 0 network 0");
+        PipelineRewriter unbatchable(writePipeline(folder, rendered));
+        CHECK(!unbatchable.canBatch("network"));
+    }
+
+    void testSave() {
+        QTemporaryDir folder;
+        PipelineRewriter rewriter(writePipeline(folder, pipeline));
+        rewriter.addInputData("mask", "Tissue mask");
+        rewriter.enableBatching("network", 4);
+        const std::string filename = join(folder.path().toStdString(), "saved/rewritten.fpl");
+        createDirectories(getDirName(filename));
+        rewriter.save(filename);
+        const std::string saved = readFile(filename);
+        CHECK(saved.find("$CURRENT_PATH$") == std::string::npos);
+        CHECK(saved.find("PipelineInputData WSI \"Whole-slide image\"\nPipelineInputData mask \"Tissue mask\"\n") != std::string::npos);
+        // Paths are resolved against the original pipeline, not the saved one
+        PipelineRewriter reloaded(filename);
+        CHECK(reloaded.getAttribute("network", "model") == rewriter.getAttribute("network", "model"));
+        CHECK(reloaded.getInput("network", 0) == "networkBatch 0");
+        CHECK(reloaded.getProcessObjects() == rewriter.getProcessObjects());
+    }
+}
+
+int main(int argc, char** argv) {
+    testRead();
+    testEdit();
+    testBatching();
+    testSave();
+    std::cout << "PipelineRewriter tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <zlib.h>
+
+namespace fast{
+    namespace test{
+        inline void append16(std::string& buffer, uint16_t value) {
+            buffer += (char)(value & 0xFF);
+            buffer += (char)(value >> 8);
+        }
+
+        inline void append32(std::string& buffer, uint32_t value) {
+            append16(buffer, value & 0xFFFF);
+            append16(buffer, value >> 16);
+        }
+
+        inline std::string deflateRaw(const std::string& data) {
+            z_stream stream = {};
+            deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+            std::string output(deflateBound(&stream, data.size()), '\0');
+            stream.next_in = (Bytef*)data.data();
+            stream.avail_in = data.size();
+            stream.next_out = (Bytef*)&output[0];
+            stream.avail_out = output.size();
+            deflate(&stream, Z_FINISH);
+            output.resize(stream.total_out);
+            deflateEnd(&stream);
+            return output;
+        }
+
+        /**
+         * Create a zip archive with a central directory, e.g. to test ZipExtractor.
+         * @param files Name and content of each file.
+         * @param compress Deflate the files instead of storing them.
+         */
+        inline std::string createZip(const std::vector<std::pair<std::string, std::string>>& files, bool compress) {
+            std::string archive;
+            std::string directory;
+            for(const auto& file : files) {
+                const uint32_t crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef*)file.second.data(), file.second.size());
+                const std::string data = compress ? deflateRaw(file.second) : file.second;
+                const uint32_t offset = archive.size();
+                append32(archive, 0x04034b50);
+                append16(archive, 20);
+                append16(archive, 0); // Flags
+                append16(archive, compress ? 8 : 0);
+                append32(archive, 0); // Time and date
+                append32(archive, crc);
+                append32(archive, data.size());
+                append32(archive, file.second.size());
+                append16(archive, file.first.size());
+                append16(archive, 0); // Extra field
+                archive += file.first + data;
+
+                append32(directory, 0x02014b50);
+                append16(directory, 20);
+                append16(directory, 20);
+                append16(directory, 0);
+                append16(directory, compress ? 8 : 0);
+                append32(directory, 0);
+                append32(directory, crc);
+                append32(directory, data.size());
+                append32(directory, file.second.size());
+                append16(directory, file.first.size());
+                append16(directory, 0); // Extra field
+                append16(directory, 0); // Comment
+                append16(directory, 0); // Disk
+                append16(directory, 0); // Internal attributes
+                append32(directory, 0); // External attributes
+                append32(directory, offset);
+                directory += file.first;
+            }
+            const uint32_t directoryOffset = archive.size();
+            archive += directory;
+            append32(archive, 0x06054b50);
+            append16(archive, 0);
+            append16(archive, 0);
+            append16(archive, files.size());
+            append16(archive, files.size());
+            append32(archive, directory.size());
+            append32(archive, directoryOffset);
+            append16(archive, 0);
+            return archive;
+        }
+    }
+} // End of namespace fast
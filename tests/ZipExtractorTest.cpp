@@ -0,0 +1,115 @@
+#include "source/logic/ZipExtractor.h"
+#include "tests/Check.h"
+#include "tests/TestZip.h"
+#include <FAST/Utility.hpp>
+#include <QTemporaryDir>
+#include <QFile>
+#include <fstream>
+#include <sstream>
+
+using namespace fast;
+
+namespace {
+    std::string readFile(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    std::vector<std::pair<std::string, std::string>> getFiles() {
+        std::string large;
+        for(int i = 0; i < 200000; ++i)
+            large += std::to_string(i % 97);
+        return {{"model.onnx", large}, {"pipelines/classification.fpl", "PipelineName \"Classification\"\n"}, {"empty.txt", ""}};
+    }
+
+    // Extract an archive in chunks of a given size, as when it is downloaded
+    void extract(ZipExtractor& extractor, const std::string& archive, size_t chunk) {
+        for(size_t offset = 0; offset < archive.size(); offset += chunk)
+            extractor.write(archive.data() + offset, std::min(chunk, archive.size() - offset));
+    }
+
+    void testExtract(bool compress, size_t chunk) {
+        QTemporaryDir folder;
+        const std::string destination = folder.path().toStdString();
+        const auto files = getFiles();
+        ZipExtractor extractor(destination);
+        extract(extractor, test::createZip(files, compress), chunk);
+        CHECK(extractor.isFinished());
+        extractor.finish();
+        CHECK(extractor.getFiles().size() == files.size());
+        CHECK(extractor.getSkippedFiles() == 0);
+        for(const auto& file : files) {
+            const std::string filename = join(destination, file.first);
+            CHECK(readFile(filename) == file.second);
+            CHECK(extractor.getFiles()[file.first] == ZipExtractor::getSHA256(filename));
+            CHECK(!fileExists(filename + ".part"));
+        }
+    }
+
+    void testSkipPresentFiles() {
+        QTemporaryDir folder;
+        const std::string destination = folder.path().toStdString();
+        const std::string archive = test::createZip(getFiles(), true);
+        ZipExtractor first(destination);
+        extract(first, archive, 4096);
+        first.finish();
+        ZipExtractor second(destination, first.getFiles());
+        extract(second, archive, 4096);
+        second.finish();
+        CHECK(second.getSkippedFiles() == (int)getFiles().size());
+        CHECK(second.getFiles() == first.getFiles());
+    }
+
+    void testCorruptData() {
+        QTemporaryDir folder;
+        const std::string destination = folder.path().toStdString();
+        std::string archive = test::createZip({{"file.txt", "Content which is corrupted"}}, false);
+        // First byte of the file data, after the local header and the name
+        archive[30 + 8] ^= 0xFF;
+        ZipExtractor extractor(destination);
+        CHECK_THROWS(extract(extractor, archive, 7));
+        CHECK(!fileExists(join(destination, "file.txt")));
+        CHECK(!fileExists(join(destination, "file.txt.part")));
+    }
+
+    void testManifestMismatch() {
+        QTemporaryDir folder;
+        const std::string destination = folder.path().toStdString();
+        const std::string hash(64, '0');
+        ZipExtractor extractor(destination, {{"file.txt", hash}});
+        CHECK_THROWS(extract(extractor, test::createZip({{"file.txt", "Content"}}, true), 1024));
+        CHECK(!fileExists(join(destination, "file.txt")));
+    }
+
+    void testUnsafePath() {
+        QTemporaryDir folder;
+        ZipExtractor extractor(join(folder.path().toStdString(), "destination"));
+        CHECK_THROWS(extract(extractor, test::createZip({{"../outside.txt", "Content"}}, false), 1024));
+        CHECK(!fileExists(join(folder.path().toStdString(), "outside.txt")));
+    }
+
+    void testTruncatedArchive() {
+        QTemporaryDir folder;
+        const std::string archive = test::createZip(getFiles(), true);
+        ZipExtractor extractor(folder.path().toStdString());
+        extract(extractor, archive.substr(0, archive.size() / 2), 4096);
+        CHECK(!extractor.isFinished());
+        CHECK_THROWS(extractor.finish());
+    }
+}
+
+int main(int argc, char** argv) {
+    testExtract(false, 1);
+    testExtract(false, 65536);
+    testExtract(true, 1);
+    testExtract(true, 1000);
+    testSkipPresentFiles();
+    testCorruptData();
+    testManifestMismatch();
+    testUnsafePath();
+    testTruncatedArchive();
+    std::cout << "ZipExtractor tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,72 @@
+#!/usr/bin/env bash
+# Runs several distributed workers on a copy of a project, kills one of them while it processes a slide, and checks
+# that the remaining workers process every slide exactly once, see DistributedRunner.
+# Usage: distributed_workers.sh <fastpathology executable> <project folder> <pipeline file> [workers]
+set -u
+
+executable=$1
+project=$2
+pipeline=$3
+workers=${4:-3}
+leaseTimeout=8
+
+folder=$(mktemp -d)
+trap 'rm -rf "$folder"' EXIT
+# Results and leases of earlier runs are left out, the slides themselves are referenced by project.txt
+mkdir -p "$folder/project"
+for file in project.txt metadata.txt thumbnails; do
+    if [ -e "$project/$file" ]; then
+        cp -r "$project/$file" "$folder/project/"
+    fi
+done
+mkdir -p "$folder/project/results"
+
+fail() {
+    echo "FAILED: $*"
+    exit 1
+}
+
+pids=()
+for ((i = 0; i < workers; i++)); do
+    "$executable" --pipeline "$pipeline" --project "$folder/project" --distributed --lease-timeout $leaseTimeout \
+        > "$folder/worker$i.log" 2>&1 &
+    pids+=($!)
+done
+
+# Kill the first worker once it holds a lease, so that its slide has to be reclaimed
+for ((second = 0; second < 120; second++)); do
+    if grep -qs -- "-${pids[0]}$" "$folder"/project/leases/*/*.lease; then
+        kill -9 "${pids[0]}"
+        echo "Killed worker ${pids[0]} while it held a lease"
+        break
+    fi
+    if ! kill -0 "${pids[0]}" 2> /dev/null; then
+        echo "Worker ${pids[0]} finished before it could be killed, no lease is reclaimed"
+        break
+    fi
+    sleep 1
+done
+
+for ((i = 1; i < workers; i++)); do
+    wait "${pids[$i]}" || echo "Worker ${pids[$i]} reported failed slides"
+done
+
+slides=$(awk 'NR % 2 == 1' "$folder/project/project.txt")
+[ -n "$slides" ] || fail "The project has no slides"
+leases=$(ls -d "$folder"/project/leases/*/ | head -n 1)
+[ -d "$leases" ] || fail "No lease folder was created"
+for slide in $slides; do
+    markers=0
+    [ -e "$leases/$slide.done" ] && markers=$((markers + 1))
+    [ -e "$leases/$slide.failed" ] && markers=$((markers + 1))
+    [ $markers -eq 1 ] || fail "Slide $slide has $markers done or failed markers instead of one"
+    [ ! -e "$leases/$slide.lease" ] || fail "The lease of slide $slide was not released"
+    if [ -e "$leases/$slide.done" ]; then
+        [ -n "$(ls -A "$folder/project/results/$slide" 2> /dev/null)" ] || fail "Slide $slide is done but has no results"
+    fi
+done
+# Only the killed worker may leave staged results
+staged=$(find "$folder/project/results" -mindepth 2 -maxdepth 2 -name ".*" -not -name "*-${pids[0]}.partial")
+[ -z "$staged" ] || fail "Staged results were left behind: $staged"
+
+echo "All slides were processed exactly once by $workers workers"